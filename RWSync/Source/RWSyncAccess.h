@@ -0,0 +1,88 @@
+#ifndef RW_SYNC_ACCESS_H_INCLUDED
+#define RW_SYNC_ACCESS_H_INCLUDED
+
+/*
+ *  Copyright (C) 2019 Ethan Blackwood
+ *  This is free software released under the MIT license.
+ *  See attached LICENSE file for more details, or https://opensource.org/licenses/MIT.
+ */
+
+#include "RWSyncDetail.h"
+
+/*
+ * Scoped access to the instance behind a read or write pointer, for hot loops. Dereferencing a
+ * pointer checks it (see RWSYNC_ACCESS_CHECKS) and looks up its instance every time; a ScopedAccess
+ * does that once when it's made and after each update made through it, and in between is just a
+ * raw pointer.
+ *
+ * Example:
+ *
+ *     RWSync::ReadPtr<Buffer> rp(container);
+ *     if (rp.canRead())
+ *     {
+ *         RWSync::ScopedAccess<RWSync::ReadPtr<Buffer>> buffer(rp);
+ *         while (running)
+ *         {
+ *             buffer.pullUpdate();
+ *             for (int i = 0; i < n; ++i) { out[i] = buffer->samples[i]; }
+ *         }
+ *     }
+ *
+ * Ptr can be any of the read or write pointer types. While the ScopedAccess exists, updates must
+ * go through it rather than the pointer, so that it doesn't keep pointing at the old instance.
+ * Making one (or updating through it) when the pointer couldn't be dereferenced is handled like
+ * dereferencing it.
+ */
+
+namespace RWSync
+{
+    template<typename Ptr>
+    class ScopedAccess
+    {
+    public:
+        typedef typename Ptr::element_type element_type;
+
+        explicit ScopedAccess(Ptr& p)
+            : ptr       (p)
+            , instance  (static_cast<element_type*>(p))
+        {}
+
+        element_type* get() const
+        {
+            return instance;
+        }
+
+        element_type& operator*() const
+        {
+            return *instance;
+        }
+
+        element_type* operator->() const
+        {
+            return instance;
+        }
+
+        // For read pointers: pull through the pointer and switch to the instance we get.
+        void pullUpdate()
+        {
+            ptr.pullUpdate();
+            instance = static_cast<element_type*>(ptr);
+        }
+
+        // For write pointers: push through the pointer and switch to the next instance to write.
+        void pushUpdate()
+        {
+            ptr.pushUpdate();
+            instance = static_cast<element_type*>(ptr);
+        }
+
+    private:
+        Ptr& ptr;
+        element_type* instance;
+
+        ScopedAccess(const ScopedAccess&);
+        ScopedAccess& operator=(const ScopedAccess&);
+    };
+}
+
+#endif // RW_SYNC_ACCESS_H_INCLUDED
@@ -0,0 +1,120 @@
+#ifndef RW_SYNC_AWAIT_H_INCLUDED
+#define RW_SYNC_AWAIT_H_INCLUDED
+
+/*
+ *  Copyright (C) 2019 Ethan Blackwood
+ *  This is free software released under the MIT license.
+ *  See attached LICENSE file for more details, or https://opensource.org/licenses/MIT.
+ */
+
+#include "RWSyncDetail.h"
+
+/*
+ * Waiting for updates from a coroutine (C++20), so that many consumer tasks can wait on many
+ * containers without a thread each. `co_await rp.nextUpdate(schedule)` suspends until the writer
+ * pushes, then pulls the update; it evaluates to false (without suspending) if the read pointer
+ * is invalid, and otherwise to true once it has pulled.
+ *
+ * The suspended coroutine is parked with the same readers that sleep in waitForUpdate(), so the
+ * writer only does extra work while some reader is actually waiting. On the push that wakes it, the
+ * writer's thread calls schedule(handle), which should hand the std::coroutine_handle<> to your
+ * executor to resume (and must not throw):
+ *
+ *     auto onPool = [&pool](std::coroutine_handle<> h) { pool.post([h]() { h.resume(); }); };
+ *     RWSync::ReadPtr<Block> rp(blocks);
+ *     while (co_await rp.nextUpdate(onPool))
+ *     {
+ *         stream(*rp);
+ *     }
+ *
+ * Keep schedule cheap, since it runs in the writer's pushUpdate() (and is copied each time it's
+ * called, since the coroutine may be gone by the time the call returns). If there's already an update,
+ * the coroutine doesn't suspend and pulls right away. A coroutine suspended here may be destroyed
+ * (which takes it off the list), but not while a push might be waking it.
+ *
+ * Enabled when the compiler supports coroutines (__cpp_impl_coroutine); define RWSYNC_COROUTINES
+ * as 0 to leave it out anyway.
+ */
+
+#ifndef RWSYNC_COROUTINES
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+#define RWSYNC_COROUTINES 1
+#else
+#define RWSYNC_COROUTINES 0
+#endif
+#endif
+
+#if RWSYNC_COROUTINES
+
+#include <coroutine>
+#include <utility>
+
+namespace RWSync
+{
+    // Returned by nextUpdate() on a read pointer. Index is the manager's ReadIndex (or a read
+    // pointer with the same interface).
+    template<typename Index, typename Schedule>
+    class UpdateAwaiter : private detail::AsyncWaiter
+    {
+    public:
+        UpdateAwaiter(Index& i, Schedule s)
+            : ind       (i)
+            , schedule  (std::move(s))
+        {}
+
+        ~UpdateAwaiter()
+        {
+            ind.unpark(*this);
+        }
+
+        bool await_ready() const
+        {
+            return !ind.isValid() || ind.hasUpdate();
+        }
+
+        // stays suspended unless an update arrived in the meantime
+        bool await_suspend(std::coroutine_handle<> h)
+        {
+            handle = h;
+            return ind.parkUntilUpdate(*this);
+        }
+
+        bool await_resume()
+        {
+            if (!ind.isValid())
+            {
+                return false;
+            }
+
+            ind.pullUpdate();
+            return true;
+        }
+
+    private:
+        void wake() override
+        {
+            // We can be woken by a push we had already pulled (if the writer was just about to notify
+            // when we parked), so check again. The reader is suspended, so its state is safe to read here.
+            // Once we're parked again, or once schedule has the handle, the coroutine can be resumed or
+            // destroyed (and this awaiter with it) on another thread, so don't touch *this after parking.
+            Index& i = ind;
+            Schedule s(schedule);
+            std::coroutine_handle<> h = handle;
+            if (!i.parkUntilUpdate(*this))
+            {
+                s(h);
+            }
+        }
+
+        Index& ind;
+        Schedule schedule;
+        std::coroutine_handle<> handle;
+
+        UpdateAwaiter(const UpdateAwaiter&);
+        UpdateAwaiter& operator=(const UpdateAwaiter&);
+    };
+}
+
+#endif // RWSYNC_COROUTINES
+
+#endif // RW_SYNC_AWAIT_H_INCLUDED
@@ -0,0 +1,236 @@
+#ifndef RW_SYNC_CARRY_FORWARD_H_INCLUDED
+#define RW_SYNC_CARRY_FORWARD_H_INCLUDED
+
+/*
+ *  Copyright (C) 2019 Ethan Blackwood
+ *  This is free software released under the MIT license.
+ *  See attached LICENSE file for more details, or https://opensource.org/licenses/MIT.
+ */
+
+/*
+ * Support for carry-forward writing (Container<T>::CarryForwardWritePtr). After each push, the
+ * instance the writer gets next is brought up to date with the one it just pushed by copying only
+ * the ranges that were marked dirty in the pushes it missed, rather than all of T.
+ */
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+// Maximum number of dirty ranges remembered. An instance that missed more than this many ranges
+// (e.g. because a reader held it for a long time) gets a full copy instead.
+#ifndef RWSYNC_CARRY_FORWARD_LOG_SIZE
+#define RWSYNC_CARRY_FORWARD_LOG_SIZE 1024
+#endif
+
+namespace RWSync
+{
+    // How to copy dirty ranges from one instance to another. By default, ranges are byte offsets
+    // into T, which must be trivially copyable. Specialize this for other types, defining what a
+    // range means for them (as is done for std::vector below).
+    template<typename T>
+    struct CarryForwardTraits
+    {
+        // copy [begin, end) of source into dest
+        static void copyRange(T& dest, const T& source, std::size_t begin, std::size_t end)
+        {
+            static_assert(std::is_trivially_copyable<T>::value,
+                "Specialize CarryForwardTraits to use carry-forward writing with this type");
+
+            end = std::min(end, sizeof(T));
+            if (begin < end)
+            {
+                std::memcpy(reinterpret_cast<unsigned char*>(&dest) + begin,
+                    reinterpret_cast<const unsigned char*>(&source) + begin, end - begin);
+            }
+        }
+
+        static void copyAll(T& dest, const T& source)
+        {
+            dest = source;
+        }
+    };
+
+    // For vectors, ranges are element indices. The size is carried forward as well.
+    template<typename U, typename Alloc>
+    struct CarryForwardTraits<std::vector<U, Alloc>>
+    {
+        static void copyRange(std::vector<U, Alloc>& dest, const std::vector<U, Alloc>& source,
+            std::size_t begin, std::size_t end)
+        {
+            if (dest.size() != source.size())
+            {
+                dest.resize(source.size());
+            }
+
+            end = std::min(end, source.size());
+            if (begin < end)
+            {
+                std::copy(source.begin() + begin, source.begin() + end, dest.begin() + begin);
+            }
+        }
+
+        static void copyAll(std::vector<U, Alloc>& dest, const std::vector<U, Alloc>& source)
+        {
+            dest = source; // reuses dest's storage if it's big enough
+        }
+    };
+
+    namespace detail
+    {
+        // Writer-side record of the dirty ranges of recent pushes and of which push each instance
+        // was last brought up to date with. Only accessed by the current writer (or under a Lockout).
+        // Nothing is allocated until a range is first marked, so a container that's never written
+        // with a CarryForwardWritePtr doesn't allocate for it.
+        class CarryForwardLog
+        {
+        public:
+            CarryForwardLog()
+                : nextEntry     (0)
+                , nEntries      (0)
+                , nPushes       (0)
+                , knownSince    (0)
+                , allDirty      (false)
+            {}
+
+            // mark a range that is being changed in the upcoming push
+            void markDirty(std::size_t begin, std::size_t end)
+            {
+                if (begin >= end || allDirty)
+                {
+                    return;
+                }
+
+                if (log.empty())
+                {
+                    log.resize(RWSYNC_CARRY_FORWARD_LOG_SIZE);
+                }
+
+                Entry& entry = log[nextEntry];
+                if (nEntries == log.size())
+                {
+                    // forget the oldest range; instances that missed its push can't be caught up
+                    knownSince = std::max(knownSince, entry.push);
+                }
+                else
+                {
+                    ++nEntries;
+                }
+
+                entry.push = nPushes + 1;
+                entry.begin = begin;
+                entry.end = end;
+                nextEntry = (nextEntry + 1) % log.size();
+            }
+
+            void markAllDirty()
+            {
+                allDirty = true;
+            }
+
+            // Finish the upcoming push, which was written to instance i.
+            void push(int i)
+            {
+                ++nPushes;
+                if (allDirty)
+                {
+                    knownSince = nPushes;
+                    allDirty = false;
+                }
+                setVersion(i, nPushes);
+            }
+
+            // Bring instance i up to date with the last push by calling copyRange(begin, end) for each
+            // range it missed, or copyAll() if they aren't all known. Ranges may overlap and aren't in order.
+            template<typename CopyRange, typename CopyAll>
+            void catchUp(int i, CopyRange copyRange, CopyAll copyAll)
+            {
+                std::uint64_t version = getVersion(i);
+                if (version == nPushes)
+                {
+                    return;
+                }
+
+                if (version < knownSince)
+                {
+                    copyAll();
+                }
+                else
+                {
+                    // newest first, until reaching ranges the instance already has
+                    std::size_t n = log.size();
+                    std::size_t e = nextEntry;
+                    for (std::size_t k = 0; k < nEntries; ++k)
+                    {
+                        e = (e + n - 1) % n;
+                        if (log[e].push <= version)
+                        {
+                            break;
+                        }
+                        copyRange(log[e].begin, log[e].end);
+                    }
+                }
+
+                setVersion(i, nPushes);
+            }
+
+            // After the instances have been changed some other way (reset or map), forget what's known
+            // about them, so that each one gets a full copy the next time it's caught up.
+            void invalidate()
+            {
+                ++nPushes;
+                knownSince = nPushes;
+                allDirty = false;
+                nEntries = 0;
+            }
+
+            // Instance i was replaced by a copy of the initial value.
+            void forget(int i)
+            {
+                if (static_cast<std::size_t>(i) < versions.size())
+                {
+                    versions[i] = 0;
+                }
+            }
+
+        private:
+            struct Entry
+            {
+                std::uint64_t push;
+                std::size_t begin;
+                std::size_t end;
+            };
+
+            // Instances that have never been written are all still equal to the initial value,
+            // i.e. up to date with push 0.
+            std::uint64_t getVersion(int i) const
+            {
+                return static_cast<std::size_t>(i) < versions.size() ? versions[i] : 0;
+            }
+
+            void setVersion(int i, std::uint64_t version)
+            {
+                if (static_cast<std::size_t>(i) >= versions.size())
+                {
+                    versions.resize(i + 1, 0);
+                }
+                versions[i] = version;
+            }
+
+            std::vector<Entry> log; // circular, RWSYNC_CARRY_FORWARD_LOG_SIZE entries once used
+            std::size_t nextEntry;
+            std::size_t nEntries;
+
+            std::uint64_t nPushes;
+            std::uint64_t knownSince; // the log has every range of pushes after this one
+            bool allDirty;            // markAllDirty() was called for the upcoming push
+
+            std::vector<std::uint64_t> versions; // by instance: last push it's up to date with
+        };
+    }
+}
+
+#endif // RW_SYNC_CARRY_FORWARD_H_INCLUDED
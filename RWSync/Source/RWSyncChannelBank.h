@@ -0,0 +1,210 @@
+#ifndef RW_SYNC_CHANNEL_BANK_H_INCLUDED
+#define RW_SYNC_CHANNEL_BANK_H_INCLUDED
+
+/*
+ *  Copyright (C) 2019 Ethan Blackwood
+ *  This is free software released under the MIT license.
+ *  See attached LICENSE file for more details, or https://opensource.org/licenses/MIT.
+ */
+
+#include "RWSyncContainer.h"
+
+#include <chrono>
+#include <cstdint>
+
+/*
+ * A fixed number of independent per-channel states (e.g. one small struct per electrode) kept in
+ * sync with one manager for the whole bank, instead of a FixedContainer per channel. The writer
+ * changes any subset of channels and publishes them all with one pushUpdate(), and a reader's
+ * pullUpdate() gets all channels as of the same push, so a push or pull costs the same few atomic
+ * operations no matter how many channels there are.
+ *
+ * Each of the Readers + 2 instances of the bank holds all the channels contiguously (instance-major,
+ * so reading every channel is one sweep through memory), and alongside it, in a separate array, the
+ * version of the push that last changed each channel. When the writer starts on a channel, or pushes
+ * without having touched one, any channel whose copy in the writer's instance is older than the last
+ * push gets copied from there, so only channels changed since the writer last had that instance are
+ * copied (T must be copy-assignable).
+ *
+ * Example:
+ *
+ *     RWSync::ChannelBank<ChannelState, 256, 2> bank;
+ *     ...
+ *     RWSync::ChannelBank<ChannelState, 256, 2>::WritePtr wp(bank);
+ *     wp[17].threshold = -40;
+ *     wp[18].threshold = -45;
+ *     wp.pushUpdate(); // both changes, and all the other channels, in one push
+ *     ...
+ *     RWSync::ChannelBank<ChannelState, 256, 2>::ReadPtr rp(bank);
+ *     rp.pullUpdate();
+ *     for (int c = 0; c < 256; ++c)
+ *     {
+ *         if (rp.changedSinceLastPull(c)) { apply(c, rp[c]); }
+ *     }
+ */
+
+namespace RWSync
+{
+    template<typename T, int Channels, int Readers = 1>
+    class ChannelBank
+    {
+        static_assert(Channels >= 1, "ChannelBank must have at least 1 channel");
+
+        typedef typename detail::FixedManagerFor<Readers>::type ManagerType;
+
+        static const int nInstances = Readers + 2;
+
+    public:
+        static const int numChannels = Channels;
+
+        // Initializes every channel of every instance with the given arguments.
+        template<typename... Args>
+        explicit ChannelBank(Args&&... args);
+
+        int numAllocatedReaders() const;
+
+        // Same as Container<T>::getStats (one push and pull per batch, however many channels)
+        Stats getStats() const;
+
+        // Same as Container<T>::reset
+        bool reset();
+
+        // Same as Container<T>::map and parallelMap (f is called on every channel of every instance)
+        template<typename UnaryOperator>
+        bool map(UnaryOperator f);
+
+        template<typename UnaryOperator>
+        bool parallelMap(UnaryOperator f, int nThreads = 0);
+
+        // Same as Container<T>::resetFor and mapFor
+        bool resetFor(std::chrono::nanoseconds timeout);
+
+        template<typename UnaryOperator>
+        bool mapFor(UnaryOperator f, std::chrono::nanoseconds timeout);
+
+        class WritePtr
+        {
+        public:
+            typedef T element_type;
+
+            explicit WritePtr(ChannelBank& o);
+
+            // see BasicWritePtr
+            WritePtr(WritePtr&& other);
+
+            bool tryToMakeValid();
+            bool isValid() const;
+
+            // Channel c of the writer's instance (up to date with the last push), marked as changed by
+            // this batch. Checked as RWSYNC_ACCESS_CHECKS says.
+            T& operator[](int c);
+
+            // all the channels at once (e.g. to sweep through them), all marked as changed
+            T* allChannels();
+
+            // number of channels changed since the last push
+            int numChanged() const;
+
+            // Publishes the changed channels (and the rest, as of the last push) as one push.
+            void pushUpdate();
+
+            // see Manager::WriteIndex::latestWasPulled
+            bool latestWasPulled() const;
+
+        private:
+            // brings channel c of the current instance up to date with the last push
+            void carryForward(int c);
+
+            ChannelBank& owner;
+            typename ManagerType::WriteIndex ind;
+
+            WritePtr(const WritePtr&);
+            WritePtr& operator=(const WritePtr&);
+        };
+
+        class ReadPtr
+        {
+        public:
+            typedef T element_type;
+
+            explicit ReadPtr(ChannelBank& o);
+
+            // see BasicWritePtr
+            ReadPtr(ReadPtr&& other);
+
+            bool tryToMakeValid();
+            bool isValid() const;
+            bool canRead() const;
+            bool hasUpdate() const;
+
+            // gets all the channels as of the latest push
+            void pullUpdate();
+
+            // see Manager::ReadIndex::waitForUpdate(For)
+            bool waitForUpdate();
+            bool waitForUpdateFor(std::chrono::nanoseconds timeout);
+
+            // Channel c as of the push we're reading, if canRead() (checked as RWSYNC_ACCESS_CHECKS says).
+            const T& operator[](int c) const;
+
+            // all the channels at once, contiguous, if canRead()
+            const T* allChannels() const;
+
+            // see Manager::ReadIndex::version and missedSinceLastPull (a version covers all channels)
+            std::uint64_t version() const;
+            std::uint64_t missedSinceLastPull() const;
+
+            // version of the push that last changed channel c (0 if none since the last reset), and
+            // whether that was after the version we were on before the last pullUpdate (with any
+            // pushes it skipped over counted too; on the first pullUpdate, every channel that any push
+            // has changed counts, while one still as constructed doesn't)
+            std::uint64_t channelVersion(int c) const;
+            bool changedSinceLastPull(int c) const;
+
+        private:
+            ChannelBank& owner;
+            typename ManagerType::ReadIndex ind;
+            std::uint64_t previousVersion; // version() before the last pull
+            bool hasPulled;
+
+            ReadPtr(const ReadPtr&);
+            ReadPtr& operator=(const ReadPtr&);
+        };
+
+    private:
+        T& channel(int instance, int c);
+
+        template<typename UnaryOperator>
+        bool map(UnaryOperator f, const typename ManagerType::Lockout& lock, int nThreads = 1);
+
+        bool reset(const typename ManagerType::Lockout& lock);
+
+        // Only accessed by the writer (or a Lockout); persists between WritePtrs.
+        struct WriterState
+        {
+            int lastPushed; // instance, or -1 if there hasn't been a push since the reset
+            std::uint64_t nPushes;
+            int nChanged;
+            bool changed[Channels];
+        };
+
+        ManagerType manager;
+
+        // instance-major: channel c of instance i is at i * Channels + c
+        detail::InlineStorage<T, nInstances * Channels> data;
+
+        // Version of the push that last changed each channel, as held by each instance. Written by
+        // the writer while the instance is its own, and read by readers registered on it.
+        std::uint64_t versions[nInstances][Channels];
+
+        detail::Padded<WriterState> writer;
+
+#ifdef OPEN_EPHYS
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ChannelBank);
+#endif
+    };
+}
+
+#include "RWSyncChannelBank.ipp"
+
+#endif // RW_SYNC_CHANNEL_BANK_H_INCLUDED
@@ -0,0 +1,348 @@
+#include "RWSyncChannelBank.h"
+
+/*
+*  Copyright (C) 2019 Ethan Blackwood
+*  This is free software released under the MIT license.
+*  See attached LICENSE file for more details, or https://opensource.org/licenses/MIT.
+*/
+
+namespace RWSync
+{
+    template<typename T, int Channels, int Readers>
+    template<typename... Args>
+    ChannelBank<T, Channels, Readers>::ChannelBank(Args&&... args)
+        : data(std::forward<Args>(args)...)
+    {
+        static_assert(Readers >= 1, "Maximum readers of ChannelBank must be at least 1");
+
+        typename ManagerType::Lockout lock(manager);
+        reset(lock);
+    }
+
+    template<typename T, int Channels, int Readers>
+    int ChannelBank<T, Channels, Readers>::numAllocatedReaders() const
+    {
+        return manager.getMaxReaders();
+    }
+
+    template<typename T, int Channels, int Readers>
+    Stats ChannelBank<T, Channels, Readers>::getStats() const
+    {
+        return manager.getStats();
+    }
+
+    template<typename T, int Channels, int Readers>
+    bool ChannelBank<T, Channels, Readers>::reset()
+    {
+        typename ManagerType::Lockout lock(manager);
+        return reset(lock);
+    }
+
+    template<typename T, int Channels, int Readers>
+    template<typename UnaryOperator>
+    bool ChannelBank<T, Channels, Readers>::map(UnaryOperator f)
+    {
+        typename ManagerType::Lockout lock(manager);
+        return map(f, lock);
+    }
+
+    template<typename T, int Channels, int Readers>
+    template<typename UnaryOperator>
+    bool ChannelBank<T, Channels, Readers>::parallelMap(UnaryOperator f, int nThreads)
+    {
+        typename ManagerType::Lockout lock(manager);
+        return map(f, lock, nThreads);
+    }
+
+    template<typename T, int Channels, int Readers>
+    bool ChannelBank<T, Channels, Readers>::resetFor(std::chrono::nanoseconds timeout)
+    {
+        typename ManagerType::Lockout lock(manager, timeout);
+        return reset(lock);
+    }
+
+    template<typename T, int Channels, int Readers>
+    template<typename UnaryOperator>
+    bool ChannelBank<T, Channels, Readers>::mapFor(UnaryOperator f, std::chrono::nanoseconds timeout)
+    {
+        typename ManagerType::Lockout lock(manager, timeout);
+        return map(f, lock);
+    }
+
+    template<typename T, int Channels, int Readers>
+    template<typename UnaryOperator>
+    bool ChannelBank<T, Channels, Readers>::map(UnaryOperator f, const typename ManagerType::Lockout& lock, int nThreads)
+    {
+        if (!reset(lock))
+        {
+            return false;
+        }
+
+        detail::parallelFor(nInstances * Channels, nThreads, [&](int i) { f(data[i]); });
+        return true;
+    }
+
+    template<typename T, int Channels, int Readers>
+    bool ChannelBank<T, Channels, Readers>::reset(const typename ManagerType::Lockout& lock)
+    {
+        if (!manager.reset(lock))
+        {
+            return false;
+        }
+
+        // every instance starts at "version 0" of every channel, so nothing is carried forward until a push
+        for (int i = 0; i < nInstances; ++i)
+        {
+            for (int c = 0; c < Channels; ++c)
+            {
+                versions[i][c] = 0;
+            }
+        }
+
+        writer.lastPushed = -1;
+        writer.nPushes = 0;
+        writer.nChanged = 0;
+        for (int c = 0; c < Channels; ++c)
+        {
+            writer.changed[c] = false;
+        }
+
+        return true;
+    }
+
+    template<typename T, int Channels, int Readers>
+    T& ChannelBank<T, Channels, Readers>::channel(int instance, int c)
+    {
+        return data[instance * Channels + c];
+    }
+
+    // WritePtr
+
+    template<typename T, int Channels, int Readers>
+    ChannelBank<T, Channels, Readers>::WritePtr::WritePtr(ChannelBank& o)
+        : owner (o)
+        , ind   (o.manager)
+    {}
+
+    template<typename T, int Channels, int Readers>
+    ChannelBank<T, Channels, Readers>::WritePtr::WritePtr(WritePtr&& other)
+        : owner (other.owner)
+        , ind   (std::move(other.ind))
+    {}
+
+    template<typename T, int Channels, int Readers>
+    bool ChannelBank<T, Channels, Readers>::WritePtr::tryToMakeValid()
+    {
+        return ind.tryToMakeValid();
+    }
+
+    template<typename T, int Channels, int Readers>
+    bool ChannelBank<T, Channels, Readers>::WritePtr::isValid() const
+    {
+        return ind.isValid();
+    }
+
+    template<typename T, int Channels, int Readers>
+    T& ChannelBank<T, Channels, Readers>::WritePtr::operator[](int c)
+    {
+        RWSYNC_CHECK_ACCESS(ind.isValid(), "Attempt to access an invalid write pointer");
+        RWSYNC_CHECK_ACCESS(c >= 0 && c < Channels, "Channel index out of range");
+
+        WriterState& w = owner.writer;
+        if (!w.changed[c])
+        {
+            carryForward(c);
+            w.changed[c] = true;
+            ++w.nChanged;
+        }
+
+        return owner.channel(ind, c);
+    }
+
+    template<typename T, int Channels, int Readers>
+    T* ChannelBank<T, Channels, Readers>::WritePtr::allChannels()
+    {
+        RWSYNC_CHECK_ACCESS(ind.isValid(), "Attempt to access an invalid write pointer");
+
+        WriterState& w = owner.writer;
+        if (w.nChanged < Channels)
+        {
+            for (int c = 0; c < Channels; ++c)
+            {
+                if (!w.changed[c])
+                {
+                    carryForward(c);
+                    w.changed[c] = true;
+                }
+            }
+            w.nChanged = Channels;
+        }
+
+        return &owner.channel(ind, 0);
+    }
+
+    template<typename T, int Channels, int Readers>
+    int ChannelBank<T, Channels, Readers>::WritePtr::numChanged() const
+    {
+        return ind.isValid() ? owner.writer.nChanged : 0;
+    }
+
+    template<typename T, int Channels, int Readers>
+    void ChannelBank<T, Channels, Readers>::WritePtr::pushUpdate()
+    {
+        if (!ind.isValid())
+        {
+            return;
+        }
+
+        WriterState& w = owner.writer;
+        int i = ind;
+        std::uint64_t v = w.nPushes + 1;
+
+        for (int c = 0; c < Channels; ++c)
+        {
+            if (w.changed[c])
+            {
+                owner.versions[i][c] = v;
+                w.changed[c] = false;
+            }
+            else
+            {
+                carryForward(c);
+            }
+        }
+
+        w.nChanged = 0;
+        w.lastPushed = i;
+        w.nPushes = v;
+
+        // one push for the whole batch; the manager publishes versions along with the data
+        ind.pushUpdate();
+    }
+
+    template<typename T, int Channels, int Readers>
+    bool ChannelBank<T, Channels, Readers>::WritePtr::latestWasPulled() const
+    {
+        return ind.latestWasPulled();
+    }
+
+    template<typename T, int Channels, int Readers>
+    void ChannelBank<T, Channels, Readers>::WritePtr::carryForward(int c)
+    {
+        int from = owner.writer.lastPushed;
+        int i = ind;
+
+        // The last pushed instance isn't ours, but readers only read it, so it's safe to copy from.
+        if (from != -1 && from != i && owner.versions[i][c] != owner.versions[from][c])
+        {
+            owner.channel(i, c) = owner.channel(from, c);
+            owner.versions[i][c] = owner.versions[from][c];
+        }
+    }
+
+    // ReadPtr
+
+    template<typename T, int Channels, int Readers>
+    ChannelBank<T, Channels, Readers>::ReadPtr::ReadPtr(ChannelBank& o)
+        : owner             (o)
+        , ind               (o.manager)
+        , previousVersion   (0)
+        , hasPulled         (false)
+    {}
+
+    template<typename T, int Channels, int Readers>
+    ChannelBank<T, Channels, Readers>::ReadPtr::ReadPtr(ReadPtr&& other)
+        : owner             (other.owner)
+        , ind               (std::move(other.ind))
+        , previousVersion   (other.previousVersion)
+        , hasPulled         (other.hasPulled)
+    {}
+
+    template<typename T, int Channels, int Readers>
+    bool ChannelBank<T, Channels, Readers>::ReadPtr::tryToMakeValid()
+    {
+        return ind.tryToMakeValid();
+    }
+
+    template<typename T, int Channels, int Readers>
+    bool ChannelBank<T, Channels, Readers>::ReadPtr::isValid() const
+    {
+        return ind.isValid();
+    }
+
+    template<typename T, int Channels, int Readers>
+    bool ChannelBank<T, Channels, Readers>::ReadPtr::canRead() const
+    {
+        return ind.canRead();
+    }
+
+    template<typename T, int Channels, int Readers>
+    bool ChannelBank<T, Channels, Readers>::ReadPtr::hasUpdate() const
+    {
+        return ind.hasUpdate();
+    }
+
+    template<typename T, int Channels, int Readers>
+    void ChannelBank<T, Channels, Readers>::ReadPtr::pullUpdate()
+    {
+        // A new reader may already be on a push it hasn't looked at, so everything counts as changed at first.
+        previousVersion = hasPulled ? ind.version() : 0;
+        hasPulled = ind.isValid();
+        ind.pullUpdate();
+    }
+
+    template<typename T, int Channels, int Readers>
+    bool ChannelBank<T, Channels, Readers>::ReadPtr::waitForUpdate()
+    {
+        return ind.waitForUpdate();
+    }
+
+    template<typename T, int Channels, int Readers>
+    bool ChannelBank<T, Channels, Readers>::ReadPtr::waitForUpdateFor(std::chrono::nanoseconds timeout)
+    {
+        return ind.waitForUpdateFor(timeout);
+    }
+
+    template<typename T, int Channels, int Readers>
+    const T& ChannelBank<T, Channels, Readers>::ReadPtr::operator[](int c) const
+    {
+        RWSYNC_CHECK_ACCESS(ind.canRead(), "Attempt to access an invalid read pointer");
+        RWSYNC_CHECK_ACCESS(c >= 0 && c < Channels, "Channel index out of range");
+
+        return owner.channel(ind, c);
+    }
+
+    template<typename T, int Channels, int Readers>
+    const T* ChannelBank<T, Channels, Readers>::ReadPtr::allChannels() const
+    {
+        RWSYNC_CHECK_ACCESS(ind.canRead(), "Attempt to access an invalid read pointer");
+
+        return &owner.channel(ind, 0);
+    }
+
+    template<typename T, int Channels, int Readers>
+    std::uint64_t ChannelBank<T, Channels, Readers>::ReadPtr::version() const
+    {
+        return ind.version();
+    }
+
+    template<typename T, int Channels, int Readers>
+    std::uint64_t ChannelBank<T, Channels, Readers>::ReadPtr::missedSinceLastPull() const
+    {
+        return ind.missedSinceLastPull();
+    }
+
+    template<typename T, int Channels, int Readers>
+    std::uint64_t ChannelBank<T, Channels, Readers>::ReadPtr::channelVersion(int c) const
+    {
+        RWSYNC_CHECK_ACCESS(c >= 0 && c < Channels, "Channel index out of range");
+
+        return ind.canRead() ? owner.versions[ind][c] : 0;
+    }
+
+    template<typename T, int Channels, int Readers>
+    bool ChannelBank<T, Channels, Readers>::ReadPtr::changedSinceLastPull(int c) const
+    {
+        return channelVersion(c) > previousVersion;
+    }
+}
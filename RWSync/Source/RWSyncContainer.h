@@ -7,8 +7,17 @@
  *  See attached LICENSE file for more details, or https://opensource.org/licenses/MIT.
  */
 
+#include "RWSyncAccess.h"
+#include "RWSyncAwait.h"
+#include "RWSyncCarryForward.h"
 #include "RWSyncManager.h"
+#include "RWSyncFixedManager.h"
+#include "RWSyncReconfiguration.h"
+#include "RWSyncTripleBufferManager.h"
 
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <functional>
 #include <type_traits>
 #include <memory>
@@ -21,14 +30,300 @@
 
 namespace RWSync
 {
+    namespace detail
+    {
+        // used by AnyWritePtr and AnyReadPtr (see below)
+        template<typename T, typename Ptr>
+        class WritePtrModel;
+
+        template<typename T, typename Ptr>
+        class ReadPtrModel;
+    }
+
+    // Pointer types used by each kind of container. Use the WritePtr and ReadPtr members
+    // of the container class (or the convenience aliases at the bottom) rather than these directly.
+    //
+    // Owner is the container class; it must declare these as friends and provide a manager
+    // member of type Owner::ManagerType, a getInstance(int) method that returns a pointer to
+    // the data instance with the given index, a prepareInstance(int) method that the writer calls
+    // each time it takes an instance to write to (before getInstance), and a reconfigurations
+    // member (a detail::ReconfigurationQueue<T>, or detail::NoReconfigurations<T>).
+    template<typename T, typename Owner>
+    class BasicWritePtr
+    {
+    public:
+        typedef T element_type;
+
+        explicit BasicWritePtr(Owner& o);
+
+        // Takes over other's index (if valid), leaving other invalid. Pointers can be moved
+        // (e.g. kept in a std::vector or returned from a function), but not copied or assigned.
+        BasicWritePtr(BasicWritePtr&& other);
+
+        bool tryToMakeValid();
+
+        // verify that we actually have a place to write
+        bool isValid() const;
+
+        // Provide access to data. An invalid pointer is handled as RWSYNC_ACCESS_CHECKS says
+        // (by default, it throws). See also ScopedAccess.
+        operator T*();
+        T& operator*();
+        T* operator->();
+
+        // report that a write is complete an obtain new place to write
+        void pushUpdate();
+
+        // whether a reader has pulled the last push yet (see Manager::WriteIndex::latestWasPulled)
+        bool latestWasPulled() const;
+
+    protected:
+        // for pointers of containers whose index has more to report (e.g. RingContainer::WritePtr)
+        const typename Owner::ManagerType::WriteIndex& getIndex() const;
+
+    private:
+        // prepare the current instance and bring it up to date with Owner::reconfigure
+        void applyReconfigurations();
+
+        template<typename, typename> friend class detail::WritePtrModel;
+
+        Owner& owner;
+        typename Owner::ManagerType::WriteIndex ind;
+
+        BasicWritePtr(const BasicWritePtr&);
+        BasicWritePtr& operator=(const BasicWritePtr&);
+    };
+
+    // Write pointer for containers that support carry-forward writing (currently Container). After
+    // each push, it brings the next instance up to date with the push by copying only the ranges that
+    // have been marked dirty since that instance was last written (see CarryForwardTraits), so the
+    // writer can keep modifying the data incrementally. Every range that is changed must be marked
+    // before pushUpdate(), and all pushes to the container must go through this kind of pointer.
+    template<typename T, typename Owner>
+    class BasicCarryForwardWritePtr
+    {
+    public:
+        typedef T element_type;
+
+        explicit BasicCarryForwardWritePtr(Owner& o);
+
+        // see BasicWritePtr
+        BasicCarryForwardWritePtr(BasicCarryForwardWritePtr&& other);
+
+        bool tryToMakeValid();
+
+        bool isValid() const;
+
+        operator T*();
+        T& operator*();
+        T* operator->();
+
+        // mark [begin, end) as changed in this write, in the units of CarryForwardTraits<T>
+        // (by default, byte offsets into T)
+        void markDirty(std::size_t begin, std::size_t end);
+
+        // mark nBytes starting at first, which must point into the current instance
+        // (only for the default CarryForwardTraits)
+        void markBytesDirty(const void* first, std::size_t nBytes);
+
+        // the next instance will be copied in full
+        void markAllDirty();
+
+        // push the write, then bring the new write instance up to date
+        void pushUpdate();
+
+        bool latestWasPulled() const;
+
+    private:
+        Owner& owner;
+        typename Owner::ManagerType::WriteIndex ind;
+
+        BasicCarryForwardWritePtr(const BasicCarryForwardWritePtr&);
+        BasicCarryForwardWritePtr& operator=(const BasicCarryForwardWritePtr&);
+    };
+
+    template<typename T, typename Owner>
+    class BasicReadPtr
+    {
+    public:
+        typedef T element_type;
+
+        explicit BasicReadPtr(Owner& o);
+
+        // see BasicWritePtr
+        BasicReadPtr(BasicReadPtr&& other);
+
+        bool tryToMakeValid();
+
+        // check whether this read pointer is registered as a
+        // legitimate reader, i.e. it hasn't been locked out
+        bool isValid() const;
+
+        // verify that we actually have something to read
+        bool canRead() const;
+
+        // check if there's an update available
+        bool hasUpdate() const;
+
+        // get latest data from the writer
+        void pullUpdate();
+
+        // block until there's an update available (see Manager::ReadIndex::waitForUpdate)
+        bool waitForUpdate();
+
+        // same, but give up after the timeout; returns hasUpdate()
+        bool waitForUpdateFor(std::chrono::nanoseconds timeout);
+
+#if RWSYNC_COROUTINES
+        // for coroutines: `co_await nextUpdate(schedule)` suspends until there's an update and then
+        // pulls it (see RWSyncAwait.h)
+        template<typename Schedule>
+        UpdateAwaiter<typename Owner::ManagerType::ReadIndex, Schedule> nextUpdate(Schedule schedule);
+#endif
+
+        // version number of the push we're reading (1 for the first push) and number of pushes
+        // skipped by the last pullUpdate (see Manager::ReadIndex::version)
+        std::uint64_t version() const;
+        std::uint64_t missedSinceLastPull() const;
+
+        // when the push we're reading was made and how long ago, and a snapshot of this pointer's
+        // push-to-pull latencies (see Manager::ReadIndex::pushTime; needs RWSYNC_TIMESTAMPS)
+        std::chrono::steady_clock::time_point pushTime() const;
+        std::chrono::nanoseconds age() const;
+        LatencyHistogram getLatencyHistogram() const;
+
+        // Provide access to data, if canRead() (see BasicWritePtr).
+        operator T*();
+        T& operator*();
+        T* operator->();
+
+        // For containers with a history (see HistoryDepth): the ith push before the current one
+        // (history(0) is the current one), for i in [0, historySize()], or nullptr if not available,
+        // and its version number. See Manager::ReadIndex::history.
+        int historySize() const;
+        T* history(int i);
+        std::uint64_t historyVersion(int i) const;
+
+    protected:
+        // see BasicWritePtr::getIndex
+        const typename Owner::ManagerType::ReadIndex& getIndex() const;
+
+    private:
+        template<typename, typename> friend class detail::ReadPtrModel;
+
+        Owner& owner;
+        typename Owner::ManagerType::ReadIndex ind;
+
+        BasicReadPtr(const BasicReadPtr&);
+        BasicReadPtr& operator=(const BasicReadPtr&);
+    };
+
+
+    // Options for an ExpandableContainer, passed as its first constructor arguments (in any order)
+    // before the arguments for T.
+
+    // Lets each reader also read the given number of pushes before the latest one it has pulled
+    // (see BasicReadPtr::history).
+    struct HistoryDepth
+    {
+        explicit HistoryDepth(int d) : depth(d) {}
+
+        int depth;
+    };
+
+    // Constructs only one copy of T up front, and each data instance from it when the writer first
+    // takes that instance to write to. Useful when T owns a lot of memory and there are many readers,
+    // since the writer may only ever use a few of the instances. The first write to each instance
+    // costs a copy of T (under a mutex that reconfigure() and expanding also take), and instances the
+    // writer has stopped using can be freed with trim().
+    struct LazyInstances {};
+
+    // Allocates the data instances and the manager's reader counts from the given resource (see
+    // RWSyncMemoryResource.h), which must outlive the container. (What T itself allocates is up to T.)
+    struct InMemory
+    {
+        explicit InMemory(MemoryResource& m) : memory(m) {}
+
+        MemoryResource& memory;
+    };
+
+    namespace detail
+    {
+        // the options above, as collected by the Container constructor
+        struct ContainerOptions
+        {
+            ContainerOptions()
+                : maxReaders    (0)
+                , historyDepth  (0)
+                , lazy          (false)
+                , memory        (&MemoryResource::getDefault())
+                , firstBlock    (nullptr)
+                , firstBlockSize(0)
+            {}
+
+            ContainerOptions withHistoryDepth(int depth) const
+            {
+                ContainerOptions result(*this);
+                result.historyDepth = depth;
+                return result;
+            }
+
+            ContainerOptions withLazyInstances() const
+            {
+                ContainerOptions result(*this);
+                result.lazy = true;
+                return result;
+            }
+
+            ContainerOptions withMemory(MemoryResource& m) const
+            {
+                ContainerOptions result(*this);
+                result.memory = &m;
+                return result;
+            }
+
+            ContainerOptions withMaxReaders(int n) const
+            {
+                ContainerOptions result(*this);
+                result.maxReaders = n;
+                return result;
+            }
+
+            // Space for the first nInstances instances, to use instead of allocating from memory
+            // if that's enough for all of the initial instances (see InlineInstanceBlock).
+            ContainerOptions withFirstBlock(void* block, int nInstances) const
+            {
+                ContainerOptions result(*this);
+                result.firstBlock = block;
+                result.firstBlockSize = nInstances;
+                return result;
+            }
+
+            int maxReaders; // 0 for expandable
+            int historyDepth;
+            bool lazy;
+            MemoryResource* memory;
+            void* firstBlock;
+            int firstBlockSize;
+        };
+    }
+
+
     // Abstract base class that isn't a template over maxReaders
     // and thus has an ugly constructor signature
-    template<typename T>
+    //
+    // Each data instance is aligned to `alignment` bytes (or alignof(T), if larger). The initial
+    // instances are allocated contiguously; expanding adds more in new blocks, so existing
+    // instances never move.
+    template<typename T, std::size_t alignment = RWSYNC_INSTANCE_ALIGNMENT>
     class Container
     {
     public:
         int numAllocatedReaders() const;
 
+        // Snapshot of the manager's hot-path counters (see RWSyncStats.h)
+        Stats getStats() const;
+
         // Reset to state where no writes have been made.
         // Requires that no readers or writers exist. Returns false if
         // this condition is unmet, true otherwise.
@@ -46,75 +341,108 @@ namespace RWSync
         template<typename UnaryOperator>
         bool map(UnaryOperator f);
 
-        class WritePtr
-        {
-        public:
-            explicit WritePtr(Container<T>& o);
-
-            bool tryToMakeValid();
-
-            // verify that we actually have a place to write
-            bool isValid() const;
-
-            // provide access to data
-            operator T*();
-            T& operator*();
-            T* operator->();
+        // Same as map(), but f is called on several instances at once, from up to nThreads threads
+        // (including this one; 0 for one per hardware thread), so the lockout lasts about as long as
+        // the slowest call rather than all of them. f must be safe to call concurrently on different
+        // instances. The threads are started for each call, so this is only worth it when f is slow
+        // (e.g. it reallocates large buffers). If f throws, it's still called on the other instances,
+        // and then the first exception is rethrown.
+        template<typename UnaryOperator>
+        bool parallelMap(UnaryOperator f, int nThreads = 0);
 
-            // report that a write is complete an obtain new place to write
-            void pushUpdate();
+        // Versions of reset() and map() that, rather than failing if any readers or writers
+        // exist, make new ones fail to be made valid and wait for the existing ones to be
+        // released (see Manager::Lockout). Return false if that takes longer than timeout.
+        bool resetFor(std::chrono::nanoseconds timeout);
 
-        private:
-            Container<T>& owner;
-            WriteIndex ind;
-        };
-
-        class ReadPtr
-        {
-        public:
-            explicit ReadPtr(Container<T>& o);
+        template<typename UnaryOperator>
+        bool mapFor(UnaryOperator f, std::chrono::nanoseconds timeout);
+
+        // Changes each data instance by calling f on it, without locking out readers or the writer
+        // (unlike map()) and without a reset. f is queued, and each instance gets it on the writer's
+        // thread when the writer next takes that instance to write to, before the writer sees it, so
+        // the pushes after the one in progress have it. The writer takes instances that still need
+        // it when it can, but ones that readers are holding have to wait until they are released.
+        // Changes are applied in order. Returns the version of this change (numbered from 1).
+        //
+        // UnaryOperator should be convertible to std::function<void(T&)> (it's stored as one).
+        template<typename UnaryOperator>
+        std::uint64_t reconfigure(UnaryOperator f);
 
-            bool tryToMakeValid();
+        // Whether every instance has received the change with the given version. (A writer must
+        // keep pushing, and readers pulling, for this to become true.)
+        bool isReconfigured(std::uint64_t version) const;
 
-            // check whether this read pointer is registered as a
-            // legitimate reader, i.e. it hasn't been locked out
-            bool isValid() const;
+        // Block until isReconfigured(version). The second form gives up after the timeout and
+        // returns isReconfigured(version).
+        void waitForReconfiguration(std::uint64_t version);
+        bool waitForReconfigurationFor(std::uint64_t version, std::chrono::nanoseconds timeout);
 
-            // verify that we actually have something to read
-            bool canRead() const;
+        // For containers made with LazyInstances (otherwise does nothing): destroys each instance that the writer hasn't
+        // taken in its last maxIdleTakes takes (and that doesn't hold the latest push or one in the
+        // history), freeing what it owns. It's constructed again if it's taken again. Requires that
+        // no readers or writers exist, like reset(), and returns false if that's unmet. Doesn't reset.
+        bool trim(std::uint64_t maxIdleTakes);
 
-            // check if there's an update available
-            bool hasUpdate() const;
+        typedef BasicWritePtr<T, Container> WritePtr;
+        typedef BasicReadPtr<T, Container> ReadPtr;
+        typedef BasicCarryForwardWritePtr<T, Container> CarryForwardWritePtr;
 
-            // get latest data from the writer
-            void pullUpdate();
+    protected:
+        // Takes any options (HistoryDepth etc.) from the start of args, and constructs
+        // the instances with the rest.
+        template<typename... Args>
+        Container(detail::ContainerOptions options, Args&&... args);
 
-            // provide access to data
-            operator T*();
-            T& operator*();
-            T* operator->();
+        template<typename... Args>
+        Container(detail::ContainerOptions options, HistoryDepth history, Args&&... args);
 
-        private:
-            Container<T>& owner;
-            ReadIndex ind;
-        };
+        template<typename... Args>
+        Container(detail::ContainerOptions options, LazyInstances, Args&&... args);
 
-    protected:
         template<typename... Args>
-        Container(int maxReaders, Args&&... args);
+        Container(detail::ContainerOptions options, InMemory memory, Args&&... args);
 
         // Requires that T is copy-constructible.
         void increaseMaxReadersTo(int nReaders);
 
     private:
+        template<typename, typename> friend class BasicWritePtr;
+        template<typename, typename> friend class BasicReadPtr;
+        template<typename, typename> friend class BasicCarryForwardWritePtr;
+
+        typedef Manager ManagerType;
+
+        T* getInstance(int i);
+
+        // For the writer: construct instance i if it isn't, and note that it was taken.
+        void prepareInstance(int i);
+
+        // reset() and map() with the given Lockout
+        bool reset(const Manager::Lockout& lock);
+
+        template<typename UnaryOperator>
+        bool map(UnaryOperator f, const Manager::Lockout& lock, int nThreads = 1);
+
         const bool expandable;
+        const bool lazy;
 
         Manager manager;
 
-        std::deque<T> data;
-        std::unique_ptr<T> original; // as in "original copy"
+        detail::AlignedSegmentedStorage<T, alignment> data;
+        std::unique_ptr<T, detail::ResourceDeleter<T>> original; // as in "original copy"
+
+        std::mutex dataSizeMutex; // also held while constructing lazy instances from original
+
+        // Only used with lazy instances, by the writer (or under a Lockout): number of instances
+        // the writer has taken, and by instance, the value it had when that instance was last taken.
+        std::uint64_t nTakes;
+        detail::SegmentedArray<std::uint64_t, 8> lastTaken;
 
-        std::mutex dataSizeMutex;
+        // only used by CarryForwardWritePtr
+        detail::CarryForwardLog carryForward;
+
+        detail::ReconfigurationQueue<T> reconfigurations;
 
 #ifdef OPEN_EPHYS
         JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(Container);
@@ -122,45 +450,430 @@ namespace RWSync
     };
 
 
-    // Container with fixed size
+    // Base class for containers with a fixed number of readers, which store all data instances
+    // inline and are synchronized by a manager with a compile-time size (such as FixedManager).
+    // Not a subclass of Container<T>, but has the same interface (aside from expansion).
+    template<typename T, typename ManagerT, int nInstances>
+    class InlineContainer
+    {
+    public:
+        int numAllocatedReaders() const;
+
+        // Same as Container<T>::getStats
+        Stats getStats() const;
+
+        // Same as Container<T>::reset
+        bool reset();
+
+        // Same as Container<T>::map and parallelMap
+        template<typename UnaryOperator>
+        bool map(UnaryOperator f);
+
+        template<typename UnaryOperator>
+        bool parallelMap(UnaryOperator f, int nThreads = 0);
+
+        // Same as Container<T>::resetFor and mapFor
+        bool resetFor(std::chrono::nanoseconds timeout);
+
+        template<typename UnaryOperator>
+        bool mapFor(UnaryOperator f, std::chrono::nanoseconds timeout);
+
+        // Same as Container<T>::reconfigure, isReconfigured and waitForReconfiguration(For)
+        template<typename UnaryOperator>
+        std::uint64_t reconfigure(UnaryOperator f);
+        bool isReconfigured(std::uint64_t version) const;
+        void waitForReconfiguration(std::uint64_t version);
+        bool waitForReconfigurationFor(std::uint64_t version, std::chrono::nanoseconds timeout);
+
+        typedef BasicWritePtr<T, InlineContainer> WritePtr;
+        typedef BasicReadPtr<T, InlineContainer> ReadPtr;
+
+    protected:
+        template<typename... Args>
+        explicit InlineContainer(Args&&... args);
+
+    private:
+        template<typename, typename> friend class BasicWritePtr;
+        template<typename, typename> friend class BasicReadPtr;
+
+        typedef ManagerT ManagerType;
+
+        T* getInstance(int i);
+
+        // instances are always constructed
+        void prepareInstance(int) {}
+
+        template<typename UnaryOperator>
+        bool map(UnaryOperator f, const typename ManagerT::Lockout& lock, int nThreads = 1);
+
+        ManagerT manager;
+
+        detail::InlineStorage<T, nInstances> data;
+
+        detail::ReconfigurationQueue<T> reconfigurations;
+
+#ifdef OPEN_EPHYS
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(InlineContainer);
+#endif
+    };
+
+
+    namespace detail
+    {
+        // Manager used by StaticContainer<T, maxReaders>
+        template<int maxReaders>
+        struct FixedManagerFor
+        {
+            typedef FixedManager<maxReaders> type;
+        };
+
+        // with just one reader, a triple buffer is all we need
+        template<>
+        struct FixedManagerFor<1>
+        {
+            typedef TripleBufferManager type;
+        };
+    }
+
+
+    // Container with a fixed maximum number of readers. Is a Container<T>, so use
+    // FixedContainer<T, maxReaders>::WritePtr and ::ReadPtr, RWSync::WritePtr<T> and ReadPtr<T>, or
+    // Container<T>::WritePtr and ::ReadPtr to access, and it can be passed as a Container<T>&.
+    // Its data instances are stored inline (unless a HistoryDepth needs more of them), but the
+    // Manager's bookkeeping is still allocated, from the default MemoryResource or the given one.
     template<typename T, int maxReaders = 1>
-    class FixedContainer : public Container<T>
+    class FixedContainer
+        : private detail::InlineInstanceBlock<T, maxReaders + 2, RWSYNC_INSTANCE_ALIGNMENT>
+        , public Container<T>
+    {
+    public:
+        // Creates a container that allows maxReaders readers, initializing each
+        // data instance with the given arguments. args can start with options
+        // (HistoryDepth or InMemory); the rest are for constructing T.
+        template<typename... Args>
+        FixedContainer(Args&&... args);
+    };
+
+
+    // Container with a fixed maximum number of readers whose data instances and synchronization
+    // state are all inline: it doesn't allocate any memory on the heap (aside from what T does),
+    // and is synchronized by a FixedManager (or, for one reader, a TripleBufferManager), which
+    // is cheaper than Container's Manager. Not a Container<T>, so use
+    // StaticContainer<T, maxReaders>::WritePtr and ::ReadPtr (or AnyWritePtr and AnyReadPtr) to access.
+    template<typename T, int maxReaders = 1>
+    class StaticContainer : public InlineContainer<T,
+        typename detail::FixedManagerFor<maxReaders>::type, maxReaders + 2>
     {
     public:
         // Creates a container that allows maxReaders readers, initializing each
         // data instance with the given arguments.
         template<typename... Args>
-        FixedContainer(Args&&... args);        
+        StaticContainer(Args&&... args);
     };
 
-    template<typename T>
-    class ExpandableContainer : public Container<T>
+
+    template<typename T, std::size_t alignment = RWSYNC_INSTANCE_ALIGNMENT>
+    class ExpandableContainer : public Container<T, alignment>
     {
     public:
         // Creates a container that allows one reader but can be expanded.
         // Use increaseMaxReadersTo() to pre-allocate the number of readers that
         // will be needed, or use a GuaranteedReadPtr to do so automatically when needed.
+        // args can start with options (HistoryDepth, LazyInstances or InMemory); the rest
+        // are for constructing T.
         template<typename... Args>
         ExpandableContainer(Args&&... args);
 
         void increaseMaxReadersTo(int nReaders);
 
         // Only for copy-constructible T
-        class GuaranteedReadPtr : public Container<T>::ReadPtr
+        class GuaranteedReadPtr : public Container<T, alignment>::ReadPtr
         {
         public:
 
             // Makes sure there is space for
             // this read pointer by increasing the max # of readers
-            // if necessary. Note that the pointer could still be
+            // if necessary (doubling it each time, so that space is
+            // added in bulk). Note that the pointer could still be
             // not ready for reading if nothing has been written yet,
             // so checking isValid is still necessary.
-            explicit GuaranteedReadPtr(ExpandableContainer<T>& o);
+            explicit GuaranteedReadPtr(ExpandableContainer& o);
+
+            GuaranteedReadPtr(GuaranteedReadPtr&& other);
+        };
+    };
+
+
+    namespace detail
+    {
+        // What AnyWritePtr and AnyReadPtr call on the pointer they hold
+        template<typename T>
+        class WritePtrInterface
+        {
+        public:
+            virtual ~WritePtrInterface() {}
+
+            // move-construct a model holding the same pointer at dest, and return it
+            virtual WritePtrInterface* moveTo(void* dest) = 0;
+
+            virtual bool tryToMakeValid() = 0;
+            virtual bool isValid() const = 0;
+            virtual T* get() = 0;
+            virtual void pushUpdate() = 0;
+            virtual bool latestWasPulled() const = 0;
+        };
+
+        template<typename T>
+        class ReadPtrInterface
+        {
+        public:
+            virtual ~ReadPtrInterface() {}
+
+            virtual ReadPtrInterface* moveTo(void* dest) = 0;
+
+            virtual bool tryToMakeValid() = 0;
+            virtual bool isValid() const = 0;
+            virtual bool canRead() const = 0;
+            virtual bool hasUpdate() const = 0;
+            virtual void pullUpdate() = 0;
+            virtual bool waitForUpdate() = 0;
+            virtual bool waitForUpdateFor(std::chrono::nanoseconds timeout) = 0;
+            virtual bool parkUntilUpdate(AsyncWaiter& w) = 0;
+            virtual void unpark(AsyncWaiter& w) = 0;
+            virtual std::uint64_t version() const = 0;
+            virtual std::uint64_t missedSinceLastPull() const = 0;
+            virtual std::chrono::steady_clock::time_point pushTime() const = 0;
+            virtual std::chrono::nanoseconds age() const = 0;
+            virtual LatencyHistogram getLatencyHistogram() const = 0;
+            virtual T* get() = 0;
+            virtual int historySize() const = 0;
+            virtual T* history(int i) = 0;
+            virtual std::uint64_t historyVersion(int i) const = 0;
         };
+
+        // Ptr is a container's WritePtr
+        template<typename T, typename Ptr>
+        class WritePtrModel : public WritePtrInterface<T>
+        {
+        public:
+            template<typename ContainerType>
+            explicit WritePtrModel(ContainerType& container) : ptr(container) {}
+
+            explicit WritePtrModel(Ptr&& other) : ptr(std::move(other)) {}
+
+            WritePtrInterface<T>* moveTo(void* dest) override;
+
+            bool tryToMakeValid() override;
+            bool isValid() const override;
+            T* get() override;
+            void pushUpdate() override;
+            bool latestWasPulled() const override;
+
+        private:
+            Ptr ptr;
+        };
+
+        // Ptr is a container's ReadPtr. The history is empty if its manager doesn't keep one.
+        template<typename T, typename Ptr>
+        class ReadPtrModel : public ReadPtrInterface<T>
+        {
+        public:
+            template<typename ContainerType>
+            explicit ReadPtrModel(ContainerType& container) : ptr(container) {}
+
+            explicit ReadPtrModel(Ptr&& other) : ptr(std::move(other)) {}
+
+            ReadPtrInterface<T>* moveTo(void* dest) override;
+
+            bool tryToMakeValid() override;
+            bool isValid() const override;
+            bool canRead() const override;
+            bool hasUpdate() const override;
+            void pullUpdate() override;
+            bool waitForUpdate() override;
+            bool waitForUpdateFor(std::chrono::nanoseconds timeout) override;
+            bool parkUntilUpdate(AsyncWaiter& w) override;
+            void unpark(AsyncWaiter& w) override;
+            std::uint64_t version() const override;
+            std::uint64_t missedSinceLastPull() const override;
+            std::chrono::steady_clock::time_point pushTime() const override;
+            std::chrono::nanoseconds age() const override;
+            LatencyHistogram getLatencyHistogram() const override;
+            T* get() override;
+            int historySize() const override;
+            T* history(int i) override;
+            std::uint64_t historyVersion(int i) const override;
+
+        private:
+            // whether the index type has history() etc. (Manager::ReadIndex does)
+            template<typename Index>
+            static std::true_type hasHistory(decltype(&Index::historySize));
+
+            template<typename Index>
+            static std::false_type hasHistory(...);
+
+            typedef decltype(hasHistory<decltype(std::declval<Ptr&>().ind)>(nullptr)) HasHistory;
+
+            int historySizeIf(std::true_type) const { return ptr.historySize(); }
+            int historySizeIf(std::false_type) const { return 0; }
+            T* historyIf(int i, std::true_type) { return ptr.history(i); }
+            T* historyIf(int, std::false_type) { return nullptr; }
+            std::uint64_t historyVersionIf(int i, std::true_type) const { return ptr.historyVersion(i); }
+            std::uint64_t historyVersionIf(int, std::false_type) const { return 0; }
+
+            Ptr ptr;
+        };
+
+        // Space reserved inline in AnyWritePtr and AnyReadPtr: enough for the pointers of Container<T>
+        // (and so ExpandableContainer<T> and FixedContainer<T, N>) and of StaticContainer<T, N>, so they
+        // don't allocate.
+        template<typename T, template<typename, typename> class Model, typename P1, typename P2, typename P3>
+        struct AnyPtrStorageFor
+        {
+            static const std::size_t size1 = sizeof(Model<T, P1>);
+            static const std::size_t size2 = sizeof(Model<T, P2>);
+            static const std::size_t size3 = sizeof(Model<T, P3>);
+            static const std::size_t size12 = size1 > size2 ? size1 : size2;
+            static const std::size_t size = size12 > size3 ? size12 : size3;
+
+            static const std::size_t align1 = std::alignment_of<Model<T, P1>>::value;
+            static const std::size_t align2 = std::alignment_of<Model<T, P2>>::value;
+            static const std::size_t align3 = std::alignment_of<Model<T, P3>>::value;
+            static const std::size_t align12 = align1 > align2 ? align1 : align2;
+            static const std::size_t alignment = align12 > align3 ? align12 : align3;
+
+            typedef typename std::aligned_storage<size, alignment>::type type;
+        };
+
+        template<typename T, template<typename, typename> class Model, template<typename> class PtrOf>
+        struct AnyPtrStorage : AnyPtrStorageFor<T, Model, typename PtrOf<Container<T>>::type,
+            typename PtrOf<StaticContainer<T, 1>>::type, typename PtrOf<StaticContainer<T, 2>>::type>
+        {};
+
+        template<typename ContainerType>
+        struct WritePtrOf
+        {
+            typedef typename ContainerType::WritePtr type;
+        };
+
+        template<typename ContainerType>
+        struct ReadPtrOf
+        {
+            typedef typename ContainerType::ReadPtr type;
+        };
+    }
+
+
+    // Opt-in write pointer that works with any kind of container of T (Container, ExpandableContainer
+    // FixedContainer<T, N> or StaticContainer<T, N>), for code that has to take several kinds without
+    // being a template.
+    // Each call goes through a virtual function to the container's own WritePtr, which it holds
+    // inline, so use the container's own type (or RWSync::WritePtr<T>) wherever the kind is known.
+    template<typename T>
+    class AnyWritePtr
+    {
+    public:
+        typedef T element_type;
+
+        template<typename ContainerType>
+        explicit AnyWritePtr(ContainerType& container);
+
+        // see BasicWritePtr
+        AnyWritePtr(AnyWritePtr&& other);
+
+        ~AnyWritePtr();
+
+        // same as BasicWritePtr
+        bool tryToMakeValid();
+        bool isValid() const;
+
+        operator T*();
+        T& operator*();
+        T* operator->();
+
+        void pushUpdate();
+        bool latestWasPulled() const;
+
+    private:
+        typedef detail::AnyPtrStorage<T, detail::WritePtrModel, detail::WritePtrOf> Storage;
+        typename Storage::type storage;
+
+        // the model constructed in storage
+        detail::WritePtrInterface<T>* impl;
+
+        AnyWritePtr(const AnyWritePtr&);
+        AnyWritePtr& operator=(const AnyWritePtr&);
+    };
+
+
+    // Opt-in read pointer that works with any kind of container of T (see AnyWritePtr). For a
+    // StaticContainer, historySize() is 0.
+    template<typename T>
+    class AnyReadPtr
+    {
+    public:
+        typedef T element_type;
+
+        template<typename ContainerType>
+        explicit AnyReadPtr(ContainerType& container);
+
+        // see BasicReadPtr
+        AnyReadPtr(AnyReadPtr&& other);
+
+        ~AnyReadPtr();
+
+        // same as BasicReadPtr
+        bool tryToMakeValid();
+        bool isValid() const;
+        bool canRead() const;
+        bool hasUpdate() const;
+        void pullUpdate();
+        bool waitForUpdate();
+        bool waitForUpdateFor(std::chrono::nanoseconds timeout);
+
+#if RWSYNC_COROUTINES
+        template<typename Schedule>
+        UpdateAwaiter<AnyReadPtr, Schedule> nextUpdate(Schedule schedule);
+#endif
+
+        std::uint64_t version() const;
+        std::uint64_t missedSinceLastPull() const;
+
+        std::chrono::steady_clock::time_point pushTime() const;
+        std::chrono::nanoseconds age() const;
+        LatencyHistogram getLatencyHistogram() const;
+
+        operator T*();
+        T& operator*();
+        T* operator->();
+
+        int historySize() const;
+        T* history(int i);
+        std::uint64_t historyVersion(int i) const;
+
+    private:
+#if RWSYNC_COROUTINES
+        template<typename, typename> friend class UpdateAwaiter;
+#endif
+
+        // for UpdateAwaiter
+        bool parkUntilUpdate(detail::AsyncWaiter& w);
+        void unpark(detail::AsyncWaiter& w);
+
+        typedef detail::AnyPtrStorage<T, detail::ReadPtrModel, detail::ReadPtrOf> Storage;
+        typename Storage::type storage;
+
+        // the model constructed in storage
+        detail::ReadPtrInterface<T>* impl;
+
+        AnyReadPtr(const AnyReadPtr&);
+        AnyReadPtr& operator=(const AnyReadPtr&);
     };
 
 
-    // for convenience:
+    // for convenience (for StaticContainers, use StaticContainer<T, N>::WritePtr/ReadPtr or
+    // AnyWritePtr/AnyReadPtr, and for containers with a non-default alignment, use their own
+    // WritePtr/ReadPtr):
     template<typename T>
     using WritePtr = typename Container<T>::WritePtr;
 
@@ -6,45 +6,114 @@
 
 #include "RWSyncContainer.h"
 
+#include <cassert>
+#include <climits>
+#include <new>
+#include <stdexcept>
 #include <utility>
 
 namespace RWSync
 {
-    template<typename T>
-    int Container<T>::numAllocatedReaders() const
+    template<typename T, std::size_t alignment>
+    int Container<T, alignment>::numAllocatedReaders() const
     {
         return manager.getMaxReaders();
     }
 
 
-    template<typename T>
-    void Container<T>::increaseMaxReadersTo(int nReaders)
+    template<typename T, std::size_t alignment>
+    Stats Container<T, alignment>::getStats() const
+    {
+        return manager.getStats();
+    }
+
+
+    template<typename T, std::size_t alignment>
+    void Container<T, alignment>::increaseMaxReadersTo(int nReaders)
     {
         assert(original != nullptr); // original should be assigned in constructor if expandable
 
+        // no need to wait for another expansion if it has already made enough space
+        if (manager.getMaxReaders() >= nReaders)
+        {
+            return;
+        }
+
         // step 1: ensure space in data
         std::lock_guard<std::mutex> dataSizeLock(dataSizeMutex);
-        int newElementsNeeded = nReaders + 2 - data.size();
+        int newElementsNeeded = manager.getNumInstancesFor(nReaders) - data.size();
         for (int i = 0; i < newElementsNeeded; ++i)
         {
-            data.push_back(*original);
+            if (lazy)
+            {
+                data.addUnconstructed();
+            }
+            else
+            {
+                data.emplaceBack(*original);
+            }
         }
+        lastTaken.grow(data.size());
+        reconfigurations.addInstances(data.size());
 
         // step 2: allow more readers in manager
         manager.ensureSpaceForReaders(nReaders);
     }
 
-    template<typename T>
-    bool Container<T>::reset()
+    template<typename T, std::size_t alignment>
+    bool Container<T, alignment>::reset()
     {
-        return manager.reset();
+        Manager::Lockout lock(manager);
+        return reset(lock);
     }
 
-    template<typename T>
+    template<typename T, std::size_t alignment>
+    template<typename UnaryOperator>
+    bool Container<T, alignment>::map(UnaryOperator f)
+    {
+        Manager::Lockout lock(manager);
+        return map(f, lock);
+    }
+
+    template<typename T, std::size_t alignment>
     template<typename UnaryOperator>
-    bool Container<T>::map(UnaryOperator f)
+    bool Container<T, alignment>::parallelMap(UnaryOperator f, int nThreads)
     {
         Manager::Lockout lock(manager);
+        return map(f, lock, nThreads);
+    }
+
+    template<typename T, std::size_t alignment>
+    bool Container<T, alignment>::resetFor(std::chrono::nanoseconds timeout)
+    {
+        Manager::Lockout lock(manager, timeout);
+        return reset(lock);
+    }
+
+    template<typename T, std::size_t alignment>
+    template<typename UnaryOperator>
+    bool Container<T, alignment>::mapFor(UnaryOperator f, std::chrono::nanoseconds timeout)
+    {
+        Manager::Lockout lock(manager, timeout);
+        return map(f, lock);
+    }
+
+    template<typename T, std::size_t alignment>
+    bool Container<T, alignment>::reset(const Manager::Lockout& lock)
+    {
+        if (!manager.reset(lock))
+        {
+            return false;
+        }
+
+        carryForward.invalidate();
+        return true;
+    }
+
+    template<typename T, std::size_t alignment>
+    template<typename UnaryOperator>
+    bool Container<T, alignment>::map(UnaryOperator f, const Manager::Lockout& lock, int nThreads)
+    {
         if (!manager.reset(lock))
         {
             return false;
@@ -55,196 +124,1100 @@ namespace RWSync
         {
             // make sure we don't start expanding "data" while this is happening
             dataSizeLock.lock();
+        }
 
-            // only need to apply to "original" if can expand, since otherwise
-            // it won't be used.
-            f(*original);
+        // carry-forward state is stale from here on, even if f throws
+        carryForward.invalidate();
+
+        // the last one is "original", which only needs it if we can expand,
+        // since otherwise it won't be used.
+        int nInstances = data.size();
+        detail::parallelFor(expandable ? nInstances + 1 : nInstances, nThreads, [&](int i)
+        {
+            if (i == nInstances)
+            {
+                f(*original);
+            }
+            else if (data.isConstructed(i)) // the rest will be copied from original
+            {
+                f(data[i]);
+            }
+        });
+
+        return true;
+    }
+
+    template<typename T, std::size_t alignment>
+    bool Container<T, alignment>::trim(std::uint64_t maxIdleTakes)
+    {
+        if (!lazy)
+        {
+            return true;
         }
 
-        for (T& instance : data)
+        // (locked before the Lockout, in the same order as increaseMaxReadersTo)
+        std::lock_guard<std::mutex> dataSizeLock(dataSizeMutex);
+        Manager::Lockout lock(manager);
+        if (!lock.isValid())
+        {
+            return false;
+        }
+
+        int nInstances = data.size();
+        for (int i = 0; i < nInstances; ++i)
         {
-            f(instance);
+            if (data.isConstructed(i) && nTakes - lastTaken[i] > maxIdleTakes && !manager.isInUse(i, lock))
+            {
+                data.destroy(i);
+            }
         }
 
+        // they'll be copied from original, like the ones that were never constructed
+        reconfigurations.markCurrentIf([this](int i) { return !data.isConstructed(i); });
         return true;
     }
 
+    template<typename T, std::size_t alignment>
+    template<typename UnaryOperator>
+    std::uint64_t Container<T, alignment>::reconfigure(UnaryOperator f)
+    {
+        // future instances are copied from original, so it needs the change now
+        std::lock_guard<std::mutex> dataSizeLock(dataSizeMutex);
+        if (expandable)
+        {
+            f(*original);
+        }
+        std::uint64_t version = reconfigurations.add(f);
 
-    template<typename T>
-    Container<T>::WritePtr::WritePtr(Container<T>& o)
+        // instances that aren't constructed will be copied from original, so the writer
+        // shouldn't go out of its way to construct them for this
+        if (lazy)
+        {
+            reconfigurations.markCurrentIf([this](int i) { return !data.isConstructed(i); });
+        }
+        return version;
+    }
+
+    template<typename T, std::size_t alignment>
+    bool Container<T, alignment>::isReconfigured(std::uint64_t version) const
+    {
+        return reconfigurations.isApplied(version);
+    }
+
+    template<typename T, std::size_t alignment>
+    void Container<T, alignment>::waitForReconfiguration(std::uint64_t version)
+    {
+        reconfigurations.wait(version, nullptr);
+    }
+
+    template<typename T, std::size_t alignment>
+    bool Container<T, alignment>::waitForReconfigurationFor(std::uint64_t version, std::chrono::nanoseconds timeout)
+    {
+        detail::ParkedReaders::Clock::time_point deadline = detail::ParkedReaders::deadlineAfter(timeout);
+        return reconfigurations.wait(version, &deadline);
+    }
+
+
+    template<typename T, typename Owner>
+    BasicWritePtr<T, Owner>::BasicWritePtr(Owner& o)
         : owner (o)
         , ind   (o.manager)
+    {
+        applyReconfigurations();
+    }
+
+
+    template<typename T, typename Owner>
+    BasicWritePtr<T, Owner>::BasicWritePtr(BasicWritePtr&& other)
+        : owner (other.owner)
+        , ind   (std::move(other.ind))
     {}
 
 
-    template<typename T>
-    bool Container<T>::WritePtr::tryToMakeValid()
+    template<typename T, typename Owner>
+    bool BasicWritePtr<T, Owner>::tryToMakeValid()
     {
-        return ind.tryToMakeValid();
+        if (!ind.isValid() && ind.tryToMakeValid())
+        {
+            applyReconfigurations();
+        }
+        return ind.isValid();
     }
 
 
-    template<typename T>
-    bool Container<T>::WritePtr::isValid() const
+    template<typename T, typename Owner>
+    bool BasicWritePtr<T, Owner>::isValid() const
     {
         return ind.isValid();
     }
 
 
-    template<typename T>
-    Container<T>::WritePtr::operator T*()
+    template<typename T, typename Owner>
+    BasicWritePtr<T, Owner>::operator T*()
     {
-        if (!ind.isValid())
-        {
-            throw new std::out_of_range("Attempt to access an invalid write pointer");
-        }
+        RWSYNC_CHECK_ACCESS(ind.isValid(), "Attempt to access an invalid write pointer");
 
-        return owner.data[ind];
+        return owner.getInstance(ind);
     }
 
-    template<typename T>
-    T& Container<T>::WritePtr::operator*()
+    template<typename T, typename Owner>
+    T& BasicWritePtr<T, Owner>::operator*()
     {
-        return **this;
+        return *static_cast<T*>(*this);
     }
 
     
-    template<typename T>
-    T* Container<T>::WritePtr::operator->()
+    template<typename T, typename Owner>
+    T* BasicWritePtr<T, Owner>::operator->()
     {
         return *this;
     }
 
 
-    template<typename T>
-    void Container<T>::WritePtr::pushUpdate()
+    template<typename T, typename Owner>
+    void BasicWritePtr<T, Owner>::pushUpdate()
     {
-        ind.pushUpdate();
+        if (ind.isValid())
+        {
+            ind.pushUpdate(owner.reconfigurations.preferredNext());
+            applyReconfigurations();
+        }
     }
 
 
-    template<typename T>
-    Container<T>::ReadPtr::ReadPtr(Container<T>& o)
+    template<typename T, typename Owner>
+    void BasicWritePtr<T, Owner>::applyReconfigurations()
+    {
+        if (ind.isValid())
+        {
+            owner.prepareInstance(ind);
+            owner.reconfigurations.apply(ind, *owner.getInstance(ind));
+        }
+    }
+
+
+    template<typename T, typename Owner>
+    bool BasicWritePtr<T, Owner>::latestWasPulled() const
+    {
+        return ind.latestWasPulled();
+    }
+
+
+    template<typename T, typename Owner>
+    const typename Owner::ManagerType::WriteIndex& BasicWritePtr<T, Owner>::getIndex() const
+    {
+        return ind;
+    }
+
+
+    template<typename T, typename Owner>
+    BasicCarryForwardWritePtr<T, Owner>::BasicCarryForwardWritePtr(Owner& o)
         : owner (o)
         , ind   (o.manager)
+    {
+        if (ind.isValid())
+        {
+            owner.prepareInstance(ind);
+            owner.reconfigurations.apply(ind, *owner.getInstance(ind));
+        }
+    }
+
+
+    template<typename T, typename Owner>
+    BasicCarryForwardWritePtr<T, Owner>::BasicCarryForwardWritePtr(BasicCarryForwardWritePtr&& other)
+        : owner (other.owner)
+        , ind   (std::move(other.ind))
     {}
 
 
-    template<typename T>
-    bool Container<T>::ReadPtr::tryToMakeValid()
+    template<typename T, typename Owner>
+    bool BasicCarryForwardWritePtr<T, Owner>::tryToMakeValid()
     {
-        return ind.tryToMakeValid();
+        if (!ind.isValid() && ind.tryToMakeValid())
+        {
+            owner.prepareInstance(ind);
+            owner.reconfigurations.apply(ind, *owner.getInstance(ind));
+        }
+        return ind.isValid();
     }
 
 
-    template<typename T>
-    bool Container<T>::ReadPtr::isValid() const
+    template<typename T, typename Owner>
+    bool BasicCarryForwardWritePtr<T, Owner>::isValid() const
     {
         return ind.isValid();
     }
 
 
-    template<typename T>
-    bool Container<T>::ReadPtr::canRead() const
+    template<typename T, typename Owner>
+    BasicCarryForwardWritePtr<T, Owner>::operator T*()
     {
-        return ind.canRead();
+        RWSYNC_CHECK_ACCESS(ind.isValid(), "Attempt to access an invalid write pointer");
+
+        return owner.getInstance(ind);
     }
 
 
-    template<typename T>
-    bool Container<T>::ReadPtr::hasUpdate() const
+    template<typename T, typename Owner>
+    T& BasicCarryForwardWritePtr<T, Owner>::operator*()
     {
-        return ind.hasUpdate();
+        return *static_cast<T*>(*this);
     }
 
 
-    template<typename T>
-    void Container<T>::ReadPtr::pullUpdate()
+    template<typename T, typename Owner>
+    T* BasicCarryForwardWritePtr<T, Owner>::operator->()
     {
-        ind.pullUpdate();
+        return *this;
     }
 
 
-    template<typename T>
-    Container<T>::ReadPtr::operator T*()
+    template<typename T, typename Owner>
+    void BasicCarryForwardWritePtr<T, Owner>::markDirty(std::size_t begin, std::size_t end)
     {
-        if (!canRead())
+        if (ind.isValid())
         {
-            throw new std::out_of_range("Attempt to access an invalid read pointer");
+            owner.carryForward.markDirty(begin, end);
         }
-
-        return owner.data[ind];
     }
 
-    template<typename T>
-    T& Container<T>::ReadPtr::operator*()
+
+    template<typename T, typename Owner>
+    void BasicCarryForwardWritePtr<T, Owner>::markBytesDirty(const void* first, std::size_t nBytes)
     {
-        return **this;
+        if (ind.isValid())
+        {
+            const unsigned char* base = reinterpret_cast<const unsigned char*>(owner.getInstance(ind));
+            std::size_t begin = static_cast<const unsigned char*>(first) - base;
+            assert(begin + nBytes <= sizeof(T));
+            owner.carryForward.markDirty(begin, begin + nBytes);
+        }
     }
 
 
-    template<typename T>
-    T* Container<T>::ReadPtr::operator->()
+    template<typename T, typename Owner>
+    void BasicCarryForwardWritePtr<T, Owner>::markAllDirty()
     {
-        return *this;
+        if (ind.isValid())
+        {
+            owner.carryForward.markAllDirty();
+        }
     }
 
 
-    template<typename T>
-    template<typename... Args>
-    Container<T>::Container(int maxReaders, Args&&... args)
-        : expandable    (maxReaders == 0)
-        , manager       (expandable ? 1 : maxReaders)
+    template<typename T, typename Owner>
+    void BasicCarryForwardWritePtr<T, Owner>::pushUpdate()
     {
-        assert(maxReaders >= 0);
+        if (!ind.isValid())
+        {
+            return;
+        }
 
-        if (expandable)
+        int pushed = ind;
+        ind.pushUpdate(owner.reconfigurations.preferredNext());
+        owner.carryForward.push(pushed);
+        owner.prepareInstance(ind);
+
+        // Don't patch ranges of a reconfigured instance into one that hasn't been reconfigured yet
+        // (the change would be applied to them twice). Copy it all instead.
+        if (owner.reconfigurations.isAhead(pushed, ind))
         {
-            original.reset(new T(args...));
+            owner.carryForward.invalidate();
         }
 
-        int initialCopies = manager.getMaxReaders() + 2;
+        // Only the writer modifies instances, so it can read the one it just pushed while readers do.
+        T& source = *owner.getInstance(pushed);
+        T& dest = *owner.getInstance(ind);
+        bool copiedAll = false;
+        owner.carryForward.catchUp(ind,
+            [&](std::size_t begin, std::size_t end) { CarryForwardTraits<T>::copyRange(dest, source, begin, end); },
+            [&]() { CarryForwardTraits<T>::copyAll(dest, source); copiedAll = true; });
 
-        for (int i = 0; i < initialCopies - 1; ++i)
+        if (copiedAll)
         {
-            data.emplace_back(args...);
+            owner.reconfigurations.copied(pushed, ind);
         }
+        owner.reconfigurations.apply(ind, dest);
+    }
 
-        // move into last entry if possible
-        data.emplace_back(std::forward<Args>(args)...);
+
+    template<typename T, typename Owner>
+    bool BasicCarryForwardWritePtr<T, Owner>::latestWasPulled() const
+    {
+        return ind.latestWasPulled();
     }
 
-    template<typename T, int maxReaders>
-    template<typename... Args>
-    FixedContainer<T, maxReaders>::FixedContainer(Args&&... args)
-        : Container<T>(maxReaders, std::forward<Args>(args)...)
+    template<typename T, typename Owner>
+    BasicReadPtr<T, Owner>::BasicReadPtr(Owner& o)
+        : owner (o)
+        , ind   (o.manager)
+    {}
+
+
+    template<typename T, typename Owner>
+    BasicReadPtr<T, Owner>::BasicReadPtr(BasicReadPtr&& other)
+        : owner (other.owner)
+        , ind   (std::move(other.ind))
+    {}
+
+
+    template<typename T, typename Owner>
+    bool BasicReadPtr<T, Owner>::tryToMakeValid()
     {
-        static_assert(maxReaders >= 1, "Maximum readers of FixedContainer must be at least 1");
+        return ind.tryToMakeValid();
     }
 
-    template<typename T>
-    template<typename... Args>
-    ExpandableContainer<T>::ExpandableContainer(Args&&... args)
-        : Container<T>(0, std::forward<Args>(args)...)
+
+    template<typename T, typename Owner>
+    bool BasicReadPtr<T, Owner>::isValid() const
     {
-        // is_copy_constructible is broken on VS2013, sadly...
-        static_assert(std::is_copy_constructible<T>::value,
-            "An ExpandableContainer cannot be created of a non-copyable type.");
+        return ind.isValid();
     }
 
-    template<typename T>
-    void ExpandableContainer<T>::increaseMaxReadersTo(int nReaders)
+
+    template<typename T, typename Owner>
+    bool BasicReadPtr<T, Owner>::canRead() const
     {
-        Container<T>::increaseMaxReadersTo(nReaders);
+        return ind.canRead();
     }
 
-    template<typename T>
-    ExpandableContainer<T>::GuaranteedReadPtr::GuaranteedReadPtr(ExpandableContainer<T>& o)
-        : Container<T>::ReadPtr(o)
+
+    template<typename T, typename Owner>
+    bool BasicReadPtr<T, Owner>::hasUpdate() const
     {
-        while (!this->tryToMakeValid())
+        return ind.hasUpdate();
+    }
+
+
+    template<typename T, typename Owner>
+    void BasicReadPtr<T, Owner>::pullUpdate()
+    {
+        ind.pullUpdate();
+    }
+
+
+    template<typename T, typename Owner>
+    bool BasicReadPtr<T, Owner>::waitForUpdate()
+    {
+        return ind.waitForUpdate();
+    }
+
+
+    template<typename T, typename Owner>
+    bool BasicReadPtr<T, Owner>::waitForUpdateFor(std::chrono::nanoseconds timeout)
+    {
+        return ind.waitForUpdateFor(timeout);
+    }
+
+
+#if RWSYNC_COROUTINES
+    template<typename T, typename Owner>
+    template<typename Schedule>
+    UpdateAwaiter<typename Owner::ManagerType::ReadIndex, Schedule> BasicReadPtr<T, Owner>::nextUpdate(Schedule schedule)
+    {
+        return UpdateAwaiter<typename Owner::ManagerType::ReadIndex, Schedule>(ind, std::move(schedule));
+    }
+#endif
+
+
+    template<typename T, typename Owner>
+    std::uint64_t BasicReadPtr<T, Owner>::version() const
+    {
+        return ind.version();
+    }
+
+
+    template<typename T, typename Owner>
+    std::uint64_t BasicReadPtr<T, Owner>::missedSinceLastPull() const
+    {
+        return ind.missedSinceLastPull();
+    }
+
+
+    template<typename T, typename Owner>
+    std::chrono::steady_clock::time_point BasicReadPtr<T, Owner>::pushTime() const
+    {
+        return ind.pushTime();
+    }
+
+
+    template<typename T, typename Owner>
+    std::chrono::nanoseconds BasicReadPtr<T, Owner>::age() const
+    {
+        return ind.age();
+    }
+
+
+    template<typename T, typename Owner>
+    LatencyHistogram BasicReadPtr<T, Owner>::getLatencyHistogram() const
+    {
+        return ind.getLatencyHistogram();
+    }
+
+
+    template<typename T, typename Owner>
+    int BasicReadPtr<T, Owner>::historySize() const
+    {
+        return ind.historySize();
+    }
+
+
+    template<typename T, typename Owner>
+    T* BasicReadPtr<T, Owner>::history(int i)
+    {
+        int instance = ind.history(i);
+        return instance == -1 ? nullptr : owner.getInstance(instance);
+    }
+
+
+    template<typename T, typename Owner>
+    std::uint64_t BasicReadPtr<T, Owner>::historyVersion(int i) const
+    {
+        return ind.historyVersion(i);
+    }
+
+
+    template<typename T, typename Owner>
+    const typename Owner::ManagerType::ReadIndex& BasicReadPtr<T, Owner>::getIndex() const
+    {
+        return ind;
+    }
+
+
+    template<typename T, typename Owner>
+    BasicReadPtr<T, Owner>::operator T*()
+    {
+        RWSYNC_CHECK_ACCESS(canRead(), "Attempt to access an invalid read pointer");
+
+        return owner.getInstance(ind);
+    }
+
+    template<typename T, typename Owner>
+    T& BasicReadPtr<T, Owner>::operator*()
+    {
+        return *static_cast<T*>(*this);
+    }
+
+
+    template<typename T, typename Owner>
+    T* BasicReadPtr<T, Owner>::operator->()
+    {
+        return *this;
+    }
+
+
+    template<typename T, std::size_t alignment>
+    T* Container<T, alignment>::getInstance(int i)
+    {
+        return &data[i];
+    }
+
+
+    template<typename T, std::size_t alignment>
+    void Container<T, alignment>::prepareInstance(int i)
+    {
+        if (!lazy)
+        {
+            return;
+        }
+
+        if (!data.isConstructed(i))
         {
-            o.increaseMaxReadersTo(o.numAllocatedReaders() + 1);
-        }        
+            // original can't be changed by reconfigure() while we copy it
+            std::lock_guard<std::mutex> dataSizeLock(dataSizeMutex);
+            data.construct(i, *original);
+            reconfigurations.markCurrentIf([i](int j) { return j == i; });
+            carryForward.forget(i);
+        }
+
+        lastTaken[i] = ++nTakes;
+    }
+
+
+    template<typename T, std::size_t alignment>
+    template<typename... Args>
+    Container<T, alignment>::Container(detail::ContainerOptions options, Args&&... args)
+        : expandable    (options.maxReaders == 0)
+        , lazy              (options.lazy)
+        , manager           (expandable ? 1 : options.maxReaders, options.historyDepth, *options.memory)
+        , data              (manager.getNumInstances(), *options.memory,
+            manager.getNumInstances() <= options.firstBlockSize ? options.firstBlock : nullptr)
+        , original          (nullptr, detail::ResourceDeleter<T>(*options.memory))
+        , nTakes            (0)
+        , lastTaken         (*options.memory)
+        , reconfigurations  (manager.getNumInstances())
+    {
+        assert(options.maxReaders >= 0);
+        assert(expandable || !lazy); // lazy instances are copied from original
+
+        int initialCopies = manager.getNumInstances();
+        lastTaken.grow(initialCopies);
+
+        if (lazy)
+        {
+            original.reset(detail::newIn<T>(*options.memory, std::forward<Args>(args)...));
+            for (int i = 0; i < initialCopies; ++i)
+            {
+                data.addUnconstructed();
+            }
+            return;
+        }
+
+        if (expandable)
+        {
+            original.reset(detail::newIn<T>(*options.memory, args...));
+        }
+
+        for (int i = 0; i < initialCopies - 1; ++i)
+        {
+            data.emplaceBack(args...);
+        }
+
+        // move into last entry if possible
+        data.emplaceBack(std::forward<Args>(args)...);
+    }
+
+    template<typename T, std::size_t alignment>
+    template<typename... Args>
+    Container<T, alignment>::Container(detail::ContainerOptions options, HistoryDepth history, Args&&... args)
+        : Container(options.withHistoryDepth(history.depth), std::forward<Args>(args)...)
+    {}
+
+    template<typename T, std::size_t alignment>
+    template<typename... Args>
+    Container<T, alignment>::Container(detail::ContainerOptions options, LazyInstances, Args&&... args)
+        : Container(options.withLazyInstances(), std::forward<Args>(args)...)
+    {}
+
+    template<typename T, std::size_t alignment>
+    template<typename... Args>
+    Container<T, alignment>::Container(detail::ContainerOptions options, InMemory memory, Args&&... args)
+        : Container(options.withMemory(memory.memory), std::forward<Args>(args)...)
+    {}
+
+    template<typename T, typename ManagerT, int nInstances>
+    template<typename... Args>
+    InlineContainer<T, ManagerT, nInstances>::InlineContainer(Args&&... args)
+        : data              (std::forward<Args>(args)...)
+        , reconfigurations  (nInstances)
+    {}
+
+    template<typename T, typename ManagerT, int nInstances>
+    int InlineContainer<T, ManagerT, nInstances>::numAllocatedReaders() const
+    {
+        return manager.getMaxReaders();
+    }
+
+    template<typename T, typename ManagerT, int nInstances>
+    Stats InlineContainer<T, ManagerT, nInstances>::getStats() const
+    {
+        return manager.getStats();
+    }
+
+    template<typename T, typename ManagerT, int nInstances>
+    bool InlineContainer<T, ManagerT, nInstances>::reset()
+    {
+        return manager.reset();
+    }
+
+    template<typename T, typename ManagerT, int nInstances>
+    template<typename UnaryOperator>
+    bool InlineContainer<T, ManagerT, nInstances>::map(UnaryOperator f)
+    {
+        typename ManagerT::Lockout lock(manager);
+        return map(f, lock);
+    }
+
+    template<typename T, typename ManagerT, int nInstances>
+    template<typename UnaryOperator>
+    bool InlineContainer<T, ManagerT, nInstances>::parallelMap(UnaryOperator f, int nThreads)
+    {
+        typename ManagerT::Lockout lock(manager);
+        return map(f, lock, nThreads);
+    }
+
+    template<typename T, typename ManagerT, int nInstances>
+    bool InlineContainer<T, ManagerT, nInstances>::resetFor(std::chrono::nanoseconds timeout)
+    {
+        typename ManagerT::Lockout lock(manager, timeout);
+        return manager.reset(lock);
+    }
+
+    template<typename T, typename ManagerT, int nInstances>
+    template<typename UnaryOperator>
+    bool InlineContainer<T, ManagerT, nInstances>::mapFor(UnaryOperator f, std::chrono::nanoseconds timeout)
+    {
+        typename ManagerT::Lockout lock(manager, timeout);
+        return map(f, lock);
+    }
+
+    template<typename T, typename ManagerT, int nInstances>
+    template<typename UnaryOperator>
+    bool InlineContainer<T, ManagerT, nInstances>::map(UnaryOperator f, const typename ManagerT::Lockout& lock, int nThreads)
+    {
+        if (!manager.reset(lock))
+        {
+            return false;
+        }
+
+        detail::parallelFor(nInstances, nThreads, [&](int i) { f(data[i]); });
+        return true;
+    }
+
+    template<typename T, typename ManagerT, int nInstances>
+    template<typename UnaryOperator>
+    std::uint64_t InlineContainer<T, ManagerT, nInstances>::reconfigure(UnaryOperator f)
+    {
+        return reconfigurations.add(f);
+    }
+
+    template<typename T, typename ManagerT, int nInstances>
+    bool InlineContainer<T, ManagerT, nInstances>::isReconfigured(std::uint64_t version) const
+    {
+        return reconfigurations.isApplied(version);
+    }
+
+    template<typename T, typename ManagerT, int nInstances>
+    void InlineContainer<T, ManagerT, nInstances>::waitForReconfiguration(std::uint64_t version)
+    {
+        reconfigurations.wait(version, nullptr);
+    }
+
+    template<typename T, typename ManagerT, int nInstances>
+    bool InlineContainer<T, ManagerT, nInstances>::waitForReconfigurationFor(std::uint64_t version, std::chrono::nanoseconds timeout)
+    {
+        detail::ParkedReaders::Clock::time_point deadline = detail::ParkedReaders::deadlineAfter(timeout);
+        return reconfigurations.wait(version, &deadline);
+    }
+
+    template<typename T, typename ManagerT, int nInstances>
+    T* InlineContainer<T, ManagerT, nInstances>::getInstance(int i)
+    {
+        return &data[i];
+    }
+
+    template<typename T, int maxReaders>
+    template<typename... Args>
+    FixedContainer<T, maxReaders>::FixedContainer(Args&&... args)
+        : Container<T>(detail::ContainerOptions().withMaxReaders(maxReaders)
+            .withFirstBlock(this->instanceBlock(), maxReaders + 2), std::forward<Args>(args)...)
+    {
+        static_assert(maxReaders >= 1, "Maximum readers of FixedContainer must be at least 1");
+    }
+
+    template<typename T, int maxReaders>
+    template<typename... Args>
+    StaticContainer<T, maxReaders>::StaticContainer(Args&&... args)
+        : InlineContainer<T, typename detail::FixedManagerFor<maxReaders>::type, maxReaders + 2>(
+            std::forward<Args>(args)...)
+    {
+        static_assert(maxReaders >= 1, "Maximum readers of StaticContainer must be at least 1");
+    }
+
+    template<typename T, std::size_t alignment>
+    template<typename... Args>
+    ExpandableContainer<T, alignment>::ExpandableContainer(Args&&... args)
+        : Container<T, alignment>(detail::ContainerOptions(), std::forward<Args>(args)...)
+    {
+        // is_copy_constructible is broken on VS2013, sadly...
+        static_assert(std::is_copy_constructible<T>::value,
+            "An ExpandableContainer cannot be created of a non-copyable type.");
+    }
+
+    template<typename T, std::size_t alignment>
+    void ExpandableContainer<T, alignment>::increaseMaxReadersTo(int nReaders)
+    {
+        Container<T, alignment>::increaseMaxReadersTo(nReaders);
+    }
+
+    template<typename T, std::size_t alignment>
+    ExpandableContainer<T, alignment>::GuaranteedReadPtr::GuaranteedReadPtr(ExpandableContainer& o)
+        : Container<T, alignment>::ReadPtr(o)
+    {
+        while (!this->tryToMakeValid())
+        {
+            // Double the capacity, so that a burst of new readers only has to expand (and wait for
+            // the mutexes) a few times. Threads that request the same size at the same time just
+            // retry once the first has expanded.
+            int currMaxReaders = o.numAllocatedReaders();
+            o.increaseMaxReadersTo(currMaxReaders <= (INT_MAX - 2) / 2 ? currMaxReaders * 2 : INT_MAX - 2);
+        }
+    }
+
+
+    template<typename T, std::size_t alignment>
+    ExpandableContainer<T, alignment>::GuaranteedReadPtr::GuaranteedReadPtr(GuaranteedReadPtr&& other)
+        : Container<T, alignment>::ReadPtr(std::move(other))
+    {}
+
+    namespace detail
+    {
+        template<typename T, typename Ptr>
+        WritePtrInterface<T>* WritePtrModel<T, Ptr>::moveTo(void* dest)
+        {
+            return new (dest) WritePtrModel(std::move(ptr));
+        }
+
+        template<typename T, typename Ptr>
+        bool WritePtrModel<T, Ptr>::tryToMakeValid()
+        {
+            return ptr.tryToMakeValid();
+        }
+
+        template<typename T, typename Ptr>
+        bool WritePtrModel<T, Ptr>::isValid() const
+        {
+            return ptr.isValid();
+        }
+
+        template<typename T, typename Ptr>
+        T* WritePtrModel<T, Ptr>::get()
+        {
+            return ptr;
+        }
+
+        template<typename T, typename Ptr>
+        void WritePtrModel<T, Ptr>::pushUpdate()
+        {
+            ptr.pushUpdate();
+        }
+
+        template<typename T, typename Ptr>
+        bool WritePtrModel<T, Ptr>::latestWasPulled() const
+        {
+            return ptr.latestWasPulled();
+        }
+
+
+        template<typename T, typename Ptr>
+        ReadPtrInterface<T>* ReadPtrModel<T, Ptr>::moveTo(void* dest)
+        {
+            return new (dest) ReadPtrModel(std::move(ptr));
+        }
+
+        template<typename T, typename Ptr>
+        bool ReadPtrModel<T, Ptr>::tryToMakeValid()
+        {
+            return ptr.tryToMakeValid();
+        }
+
+        template<typename T, typename Ptr>
+        bool ReadPtrModel<T, Ptr>::isValid() const
+        {
+            return ptr.isValid();
+        }
+
+        template<typename T, typename Ptr>
+        bool ReadPtrModel<T, Ptr>::canRead() const
+        {
+            return ptr.canRead();
+        }
+
+        template<typename T, typename Ptr>
+        bool ReadPtrModel<T, Ptr>::hasUpdate() const
+        {
+            return ptr.hasUpdate();
+        }
+
+        template<typename T, typename Ptr>
+        void ReadPtrModel<T, Ptr>::pullUpdate()
+        {
+            ptr.pullUpdate();
+        }
+
+        template<typename T, typename Ptr>
+        bool ReadPtrModel<T, Ptr>::waitForUpdate()
+        {
+            return ptr.waitForUpdate();
+        }
+
+        template<typename T, typename Ptr>
+        bool ReadPtrModel<T, Ptr>::waitForUpdateFor(std::chrono::nanoseconds timeout)
+        {
+            return ptr.waitForUpdateFor(timeout);
+        }
+
+        template<typename T, typename Ptr>
+        bool ReadPtrModel<T, Ptr>::parkUntilUpdate(AsyncWaiter& w)
+        {
+            return ptr.ind.parkUntilUpdate(w);
+        }
+
+        template<typename T, typename Ptr>
+        void ReadPtrModel<T, Ptr>::unpark(AsyncWaiter& w)
+        {
+            ptr.ind.unpark(w);
+        }
+
+        template<typename T, typename Ptr>
+        std::uint64_t ReadPtrModel<T, Ptr>::version() const
+        {
+            return ptr.version();
+        }
+
+        template<typename T, typename Ptr>
+        std::uint64_t ReadPtrModel<T, Ptr>::missedSinceLastPull() const
+        {
+            return ptr.missedSinceLastPull();
+        }
+
+        template<typename T, typename Ptr>
+        std::chrono::steady_clock::time_point ReadPtrModel<T, Ptr>::pushTime() const
+        {
+            return ptr.pushTime();
+        }
+
+        template<typename T, typename Ptr>
+        std::chrono::nanoseconds ReadPtrModel<T, Ptr>::age() const
+        {
+            return ptr.age();
+        }
+
+        template<typename T, typename Ptr>
+        LatencyHistogram ReadPtrModel<T, Ptr>::getLatencyHistogram() const
+        {
+            return ptr.getLatencyHistogram();
+        }
+
+        template<typename T, typename Ptr>
+        T* ReadPtrModel<T, Ptr>::get()
+        {
+            return ptr;
+        }
+
+        template<typename T, typename Ptr>
+        int ReadPtrModel<T, Ptr>::historySize() const
+        {
+            return historySizeIf(HasHistory());
+        }
+
+        template<typename T, typename Ptr>
+        T* ReadPtrModel<T, Ptr>::history(int i)
+        {
+            return historyIf(i, HasHistory());
+        }
+
+        template<typename T, typename Ptr>
+        std::uint64_t ReadPtrModel<T, Ptr>::historyVersion(int i) const
+        {
+            return historyVersionIf(i, HasHistory());
+        }
+    }
+
+
+    template<typename T>
+    template<typename ContainerType>
+    AnyWritePtr<T>::AnyWritePtr(ContainerType& container)
+    {
+        typedef detail::WritePtrModel<T, typename ContainerType::WritePtr> Model;
+        static_assert(sizeof(Model) <= sizeof(storage) && Storage::alignment % std::alignment_of<Model>::value == 0,
+            "This container's write pointer doesn't fit in an AnyWritePtr; use ContainerType::WritePtr instead.");
+
+        impl = new (&storage) Model(container);
+    }
+
+    template<typename T>
+    AnyWritePtr<T>::AnyWritePtr(AnyWritePtr&& other)
+        : impl(other.impl->moveTo(&storage))
+    {}
+
+    template<typename T>
+    AnyWritePtr<T>::~AnyWritePtr()
+    {
+        impl->~WritePtrInterface();
+    }
+
+    template<typename T>
+    bool AnyWritePtr<T>::tryToMakeValid()
+    {
+        return impl->tryToMakeValid();
+    }
+
+    template<typename T>
+    bool AnyWritePtr<T>::isValid() const
+    {
+        return impl->isValid();
+    }
+
+    template<typename T>
+    AnyWritePtr<T>::operator T*()
+    {
+        return impl->get();
+    }
+
+    template<typename T>
+    T& AnyWritePtr<T>::operator*()
+    {
+        return *impl->get();
+    }
+
+    template<typename T>
+    T* AnyWritePtr<T>::operator->()
+    {
+        return impl->get();
+    }
+
+    template<typename T>
+    void AnyWritePtr<T>::pushUpdate()
+    {
+        impl->pushUpdate();
+    }
+
+    template<typename T>
+    bool AnyWritePtr<T>::latestWasPulled() const
+    {
+        return impl->latestWasPulled();
+    }
+
+
+    template<typename T>
+    template<typename ContainerType>
+    AnyReadPtr<T>::AnyReadPtr(ContainerType& container)
+    {
+        typedef detail::ReadPtrModel<T, typename ContainerType::ReadPtr> Model;
+        static_assert(sizeof(Model) <= sizeof(storage) && Storage::alignment % std::alignment_of<Model>::value == 0,
+            "This container's read pointer doesn't fit in an AnyReadPtr; use ContainerType::ReadPtr instead.");
+
+        impl = new (&storage) Model(container);
+    }
+
+    template<typename T>
+    AnyReadPtr<T>::AnyReadPtr(AnyReadPtr&& other)
+        : impl(other.impl->moveTo(&storage))
+    {}
+
+    template<typename T>
+    AnyReadPtr<T>::~AnyReadPtr()
+    {
+        impl->~ReadPtrInterface();
+    }
+
+    template<typename T>
+    bool AnyReadPtr<T>::tryToMakeValid()
+    {
+        return impl->tryToMakeValid();
+    }
+
+    template<typename T>
+    bool AnyReadPtr<T>::isValid() const
+    {
+        return impl->isValid();
+    }
+
+    template<typename T>
+    bool AnyReadPtr<T>::canRead() const
+    {
+        return impl->canRead();
+    }
+
+    template<typename T>
+    bool AnyReadPtr<T>::hasUpdate() const
+    {
+        return impl->hasUpdate();
+    }
+
+    template<typename T>
+    void AnyReadPtr<T>::pullUpdate()
+    {
+        impl->pullUpdate();
+    }
+
+    template<typename T>
+    bool AnyReadPtr<T>::waitForUpdate()
+    {
+        return impl->waitForUpdate();
+    }
+
+    template<typename T>
+    bool AnyReadPtr<T>::waitForUpdateFor(std::chrono::nanoseconds timeout)
+    {
+        return impl->waitForUpdateFor(timeout);
+    }
+
+#if RWSYNC_COROUTINES
+    template<typename T>
+    template<typename Schedule>
+    UpdateAwaiter<AnyReadPtr<T>, Schedule> AnyReadPtr<T>::nextUpdate(Schedule schedule)
+    {
+        return UpdateAwaiter<AnyReadPtr, Schedule>(*this, std::move(schedule));
+    }
+#endif
+
+    template<typename T>
+    bool AnyReadPtr<T>::parkUntilUpdate(detail::AsyncWaiter& w)
+    {
+        return impl->parkUntilUpdate(w);
+    }
+
+    template<typename T>
+    void AnyReadPtr<T>::unpark(detail::AsyncWaiter& w)
+    {
+        impl->unpark(w);
+    }
+
+    template<typename T>
+    std::uint64_t AnyReadPtr<T>::version() const
+    {
+        return impl->version();
+    }
+
+    template<typename T>
+    std::uint64_t AnyReadPtr<T>::missedSinceLastPull() const
+    {
+        return impl->missedSinceLastPull();
+    }
+
+    template<typename T>
+    std::chrono::steady_clock::time_point AnyReadPtr<T>::pushTime() const
+    {
+        return impl->pushTime();
+    }
+
+    template<typename T>
+    std::chrono::nanoseconds AnyReadPtr<T>::age() const
+    {
+        return impl->age();
+    }
+
+    template<typename T>
+    LatencyHistogram AnyReadPtr<T>::getLatencyHistogram() const
+    {
+        return impl->getLatencyHistogram();
+    }
+
+    template<typename T>
+    AnyReadPtr<T>::operator T*()
+    {
+        return impl->get();
+    }
+
+    template<typename T>
+    T& AnyReadPtr<T>::operator*()
+    {
+        return *impl->get();
+    }
+
+    template<typename T>
+    T* AnyReadPtr<T>::operator->()
+    {
+        return impl->get();
+    }
+
+    template<typename T>
+    int AnyReadPtr<T>::historySize() const
+    {
+        return impl->historySize();
+    }
+
+    template<typename T>
+    T* AnyReadPtr<T>::history(int i)
+    {
+        return impl->history(i);
+    }
+
+    template<typename T>
+    std::uint64_t AnyReadPtr<T>::historyVersion(int i) const
+    {
+        return impl->historyVersion(i);
     }
 }
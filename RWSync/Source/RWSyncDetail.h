@@ -0,0 +1,1223 @@
+#ifndef RW_SYNC_DETAIL_H_INCLUDED
+#define RW_SYNC_DETAIL_H_INCLUDED
+
+/*
+ *  Copyright (C) 2019 Ethan Blackwood
+ *  This is free software released under the MIT license.
+ *  See attached LICENSE file for more details, or https://opensource.org/licenses/MIT.
+ */
+
+/*
+ * Internal building blocks shared by the managers and containers.
+ * Nothing in here is part of the public interface.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "RWSyncMemoryResource.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#elif defined(__i386__) || defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// Assumed size of a cache line, used to keep independently-modified atomics apart.
+#ifndef RWSYNC_CACHE_LINE_SIZE
+#define RWSYNC_CACHE_LINE_SIZE 64
+#endif
+
+// Default alignment (and so minimum spacing) of each data instance of a Container.
+#ifndef RWSYNC_INSTANCE_ALIGNMENT
+#define RWSYNC_INSTANCE_ALIGNMENT RWSYNC_CACHE_LINE_SIZE
+#endif
+
+// If nonzero (the default), each reader count in a Manager is padded to its own cache
+// line, so readers of different instances don't contend with each other. Set to 0
+// to store the counts densely instead (less memory, more false sharing).
+#ifndef RWSYNC_PAD_SLOTS
+#define RWSYNC_PAD_SLOTS 1
+#endif
+
+// Number of times a reader waiting for an update checks for one before going to sleep.
+#ifndef RWSYNC_WAIT_SPIN_COUNT
+#define RWSYNC_WAIT_SPIN_COUNT 1000
+#endif
+
+// How dereferencing a read or write pointer checks that it can be: 2 (the default) throws
+// std::out_of_range if not, 1 only asserts (so release builds don't check), and 0 never checks.
+#ifndef RWSYNC_ACCESS_CHECKS
+#define RWSYNC_ACCESS_CHECKS 2
+#endif
+
+// Used by the pointer classes to check access as RWSYNC_ACCESS_CHECKS says. ok isn't evaluated
+// if nothing is checked.
+#if RWSYNC_ACCESS_CHECKS >= 2
+#define RWSYNC_CHECK_ACCESS(ok, message) do { if (!(ok)) { throw new std::out_of_range(message); } } while (false)
+#elif RWSYNC_ACCESS_CHECKS == 1
+#define RWSYNC_CHECK_ACCESS(ok, message) assert((ok) && message)
+#else
+#define RWSYNC_CHECK_ACCESS(ok, message) ((void)0)
+#endif
+
+// If nonzero, Manager and FixedManager order their loads and stores on each push and pull with
+// acquire/release instead of seq_cst (see detail::HotPathOrders). 0 by default.
+#ifndef RWSYNC_ACQUIRE_RELEASE
+#define RWSYNC_ACQUIRE_RELEASE 0
+#endif
+
+// Number of times a reader of a Manager or FixedManager tries to register on the latest instance by
+// itself before asking the writer to hand it one instead (see detail::PullRequest). At least 1.
+#ifndef RWSYNC_PULL_ATTEMPTS
+#define RWSYNC_PULL_ATTEMPTS 4
+#endif
+
+namespace RWSync
+{
+    namespace detail
+    {
+        // Wraps a T so that it takes up at least a whole cache line. Two Padded objects placed
+        // next to each other (as members or in an array) never share a cache line.
+        template<typename T>
+        struct Padded : public T
+        {
+            Padded() : T() {}
+
+            template<typename Arg>
+            explicit Padded(Arg&& arg) : T(std::forward<Arg>(arg)) {}
+
+        private:
+            char padding[RWSYNC_CACHE_LINE_SIZE - sizeof(T) % RWSYNC_CACHE_LINE_SIZE];
+        };
+
+        // Same interface as Padded, but without the padding.
+        template<typename T>
+        struct Unpadded : public T
+        {
+            Unpadded() : T() {}
+
+            template<typename Arg>
+            explicit Unpadded(Arg&& arg) : T(std::forward<Arg>(arg)) {}
+        };
+
+        typedef std::chrono::steady_clock PushClock;
+
+        // When an instance was last pushed, if RWSYNC_TIMESTAMPS is defined. Otherwise, stamping
+        // compiles to nothing and get() always returns PushClock::time_point() (which also means
+        // "never pushed" when enabled); the empty class fits in SlotState's tail padding.
+#ifdef RWSYNC_TIMESTAMPS
+
+        class PushTime
+        {
+        public:
+            static const bool enabled = true;
+
+            PushTime() : ticks(0) {}
+
+            void stamp()
+            {
+                ticks.store(PushClock::now().time_since_epoch().count(), std::memory_order_relaxed);
+            }
+
+            void clear()
+            {
+                ticks.store(0, std::memory_order_relaxed);
+            }
+
+            PushClock::time_point get() const
+            {
+                return PushClock::time_point(PushClock::duration(ticks.load(std::memory_order_relaxed)));
+            }
+
+        private:
+            std::atomic<PushClock::rep> ticks;
+        };
+
+#else // RWSYNC_TIMESTAMPS
+
+        class PushTime
+        {
+        public:
+            static const bool enabled = false;
+
+            void stamp() {}
+            void clear() {}
+
+            PushClock::time_point get() const
+            {
+                return PushClock::time_point();
+            }
+        };
+
+#endif // RWSYNC_TIMESTAMPS
+
+        // Time since the given push time, or 0 if it's PushClock::time_point().
+        inline std::chrono::nanoseconds ageOf(PushClock::time_point pushed)
+        {
+            if (pushed == PushClock::time_point())
+            {
+                return std::chrono::nanoseconds::zero();
+            }
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(PushClock::now() - pushed);
+        }
+
+        // State of one data instance of a Manager or FixedManager. readers is the number of readers
+        // registered on it, or -1 if it's being written. The rest is written by the writer on each push
+        // before it's published, and readers only look at it while registered (so it can't change).
+        // Keeping it all together means a reader that has just registered can read the version for free.
+        struct SlotState
+        {
+            std::atomic<int> readers;
+            std::atomic<std::uint64_t> version; // of the push it holds; pushes are numbered from 1
+            std::atomic<int> previous;          // index of the push before, or -1 (for histories)
+            PushTime pushTime;
+        };
+
+#if RWSYNC_PAD_SLOTS
+        typedef Padded<SlotState> Slot;
+#else
+        typedef Unpadded<SlotState> Slot;
+#endif
+
+        // For a reader of a Manager or FixedManager that has just registered on instance index, which it
+        // loaded from latest: tell the writer (through pulled, see Manager::pulled) that the push in it
+        // was read. Only the first reader of each push needs to store; the others see it's done.
+        //
+        // A reader that loaded latest just before a push would overwrite a newer reader's store if it
+        // stored unconditionally, and the writer would think its push wasn't read. So pulled only moves
+        // to an index that is still the latest, by CAS: a failed CAS acquires the store it saw (a
+        // release by the reader that made it, after that reader loaded latest), so this reader then
+        // sees a latest at least as new as that reader's and gives up if it's no longer index.
+        inline void storePulled(std::atomic<int>& pulled, const std::atomic<int>& latest, int index)
+        {
+            int current = pulled.load(std::memory_order_relaxed);
+            while (current != index && latest.load(std::memory_order_relaxed) == index)
+            {
+                if (pulled.compare_exchange_weak(current, index, std::memory_order_release, std::memory_order_acquire))
+                {
+                    return;
+                }
+            }
+        }
+
+        // One word of an occupancy bitmap, which summarizes which of 64 consecutive slots are in use.
+        typedef Padded<std::atomic<std::uint64_t>> OccupancyWord;
+        const int occupancyWordBits = 64;
+
+        // Index of the highest set bit of x, which must be nonzero.
+        inline int floorLog2(unsigned int x)
+        {
+            assert(x != 0);
+#if defined(__GNUC__) || defined(__clang__)
+            return int(sizeof(unsigned int) * 8 - 1) - __builtin_clz(x);
+#elif defined(_MSC_VER)
+            unsigned long result;
+            _BitScanReverse(&result, x);
+            return int(result);
+#else
+            int result = 0;
+            while (x >>= 1)
+            {
+                ++result;
+            }
+            return result;
+#endif
+        }
+
+
+        // Index of the lowest set bit of x, which must be nonzero.
+        inline int countTrailingZeros(std::uint64_t x)
+        {
+            assert(x != 0);
+#if defined(__GNUC__) || defined(__clang__)
+            return __builtin_ctzll(x);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+            unsigned long result;
+            _BitScanForward64(&result, x);
+            return int(result);
+#elif defined(_MSC_VER)
+            unsigned long result;
+            if (_BitScanForward(&result, static_cast<unsigned long>(x)))
+            {
+                return int(result);
+            }
+            _BitScanForward(&result, static_cast<unsigned long>(x >> 32));
+            return int(result) + 32;
+#else
+            int result = 0;
+            while ((x & 1) == 0)
+            {
+                x >>= 1;
+                ++result;
+            }
+            return result;
+#endif
+        }
+
+
+        // Hint to the CPU that we're in a spin loop.
+        inline void cpuRelax()
+        {
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+            _mm_pause();
+#elif defined(_MSC_VER) && (defined(_M_ARM) || defined(_M_ARM64))
+            __yield();
+#elif defined(__i386__) || defined(__x86_64__)
+            _mm_pause();
+#elif defined(__GNUC__) && (defined(__arm__) || defined(__aarch64__))
+            __asm__ __volatile__("yield");
+#endif
+        }
+
+
+        /*
+         * Memory orders of the operations that Manager and FixedManager do on each push and pull.
+         *
+         * By default, the writer's store of latest and its claims of free instances, and readers' loads
+         * of latest and releases of instances, are seq_cst. As explained in Manager::ReadIndex::getLatest,
+         * that keeps a reader from being counted on two instances at once while the writer looks for
+         * one to claim, so one pass over the instances always finds one. On weakly-ordered CPUs, though,
+         * each of these costs a full barrier.
+         *
+         * With RWSYNC_ACQUIRE_RELEASE, they are only as strong as needed to pass the data along: pushes
+         * are published with release, readers register with acquire and release with release, and the
+         * writer claims with acquire. A reader that has just released an instance may then still see the
+         * previous latest and register on it again after the writer has passed over its new one, so the
+         * writer may find every instance taken; it then tries them all again until one is free (which
+         * it will be once the reader sees the push). So this gives up the bound on the writer's push:
+         * how many passes it takes depends on how soon such readers get to the new push, which nothing
+         * the writer does can hurry (a fence of its own doesn't make a reader's release visible any
+         * sooner), and a reader that's preempted in between holds the writer up until it runs again.
+         * The occupancy bitmap is only a hint, so it becomes relaxed, and the writer makes up for its
+         * release store with one seq_cst fence before checking for readers asking for help or parked
+         * (see PullRequest and ParkedReaders).
+         */
+        struct HotPathOrders
+        {
+#if RWSYNC_ACQUIRE_RELEASE
+            static const std::memory_order publish = std::memory_order_release;
+            static const std::memory_order claim = std::memory_order_acquire;
+            static const std::memory_order loadLatest = std::memory_order_acquire;
+            static const std::memory_order unregister = std::memory_order_release;
+            static const std::memory_order occupancy = std::memory_order_relaxed;
+            static const bool findsFreeInOnePass = false;
+#else
+            static const std::memory_order publish = std::memory_order_seq_cst;
+            static const std::memory_order claim = std::memory_order_seq_cst;
+            static const std::memory_order loadLatest = std::memory_order_seq_cst;
+            static const std::memory_order unregister = std::memory_order_seq_cst;
+            static const std::memory_order occupancy = std::memory_order_seq_cst;
+            static const bool findsFreeInOnePass = true;
+#endif
+
+            // Called by the writer right after publishing a push, before PullRequest::answer() and
+            // ParkedReaders::notifyIfParked().
+            static void fenceAfterPublish()
+            {
+#if RWSYNC_ACQUIRE_RELEASE
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+#endif
+            }
+        };
+
+
+        /*
+         * A reader's request for the writer to hand it an instance to read, so that each pull takes a
+         * bounded number of steps however fast the writer pushes. Otherwise, a reader trying to register
+         * on the latest instance can keep finding that the writer has already claimed it again (the
+         * reader count is -1), reloading latest and trying again. After RWSYNC_PULL_ATTEMPTS failed
+         * attempts, the reader asks instead, with a fixed number of operations:
+         *
+         *  1. increments nAsking, stores "wanted" in its request and loads latest (all seq_cst);
+         *  2. tries to replace "wanted" with "busy(x)", where x is the instance it loaded;
+         *  3. if that worked, registers on x itself and tries to replace "busy(x)" with "idle"; if the
+         *     writer has handed it x by then (see below), it drops its own registration, since the
+         *     writer made one for it;
+         *  4. otherwise, the writer has handed it an instance, on which it's already registered.
+         *
+         * The writer checks nAsking (seq_cst) right after publishing each push, before claiming an
+         * instance to write next, and answers each request that is wanted or busy by registering the
+         * reader on the latest instance or on x, respectively, and then handing it over. So for every
+         * push, either the reader's load of latest sees it (and the writer can't claim that instance
+         * before its next push), or the writer sees the request and registers the reader on x before
+         * it can claim x. Either way, the reader's registration never finds the instance claimed, and
+         * the instance it gets is at least as new as the push before it asked.
+         *
+         * A reader is registered twice on x if the writer answers "busy(x)" just before it goes idle,
+         * but that's on the same instance, so it doesn't take up another one. Instance indices must be
+         * at most INT_MAX - 3 for busy(x) to be representable.
+         */
+        static_assert(RWSYNC_PULL_ATTEMPTS >= 1, "RWSYNC_PULL_ATTEMPTS must be at least 1");
+
+        class PullRequest
+        {
+        public:
+            PullRequest() : state(unused) {}
+
+            // Claims this request for a reader when it checks out; false if another reader has it.
+            bool tryToClaim()
+            {
+                int expected = unused;
+                return state.compare_exchange_strong(expected, idle, std::memory_order_relaxed);
+            }
+
+            // Called when the reader that claimed this is returned.
+            void release()
+            {
+                state.store(unused, std::memory_order_relaxed);
+            }
+
+            // For the reader that claimed this: gets an instance as described above, once latest has
+            // been published. registerOn(i) and unregisterFrom(i) increment and decrement the reader
+            // count of instance i, respectively; registerOn must synchronize with the publication of i.
+            template<typename Register, typename Unregister>
+            int ask(const std::atomic<int>& latest, std::atomic<int>& nAsking,
+                Register registerOn, Unregister unregisterFrom)
+            {
+                nAsking.fetch_add(1, std::memory_order_seq_cst);
+                state.store(wanted, std::memory_order_seq_cst);
+                int x = latest.load(std::memory_order_seq_cst);
+                assert(x >= 0);
+
+                int result;
+                int expected = wanted;
+                if (state.compare_exchange_strong(expected, busy(x), std::memory_order_seq_cst, std::memory_order_acquire))
+                {
+                    registerOn(x);
+
+                    expected = busy(x);
+                    if (!state.compare_exchange_strong(expected, idle, std::memory_order_seq_cst, std::memory_order_relaxed))
+                    {
+                        // the writer registered us on x too
+                        assert(expected == x);
+                        unregisterFrom(x);
+                        state.store(idle, std::memory_order_relaxed);
+                    }
+                    result = x;
+                }
+                else
+                {
+                    // acquire: the writer made the registration (and published the instance) for us
+                    assert(expected >= 0);
+                    result = expected;
+                    state.store(idle, std::memory_order_relaxed);
+                }
+
+                nAsking.fetch_sub(1, std::memory_order_relaxed);
+                return result;
+            }
+
+            // For the writer, after publishing latest (with a seq_cst fence, if the store wasn't seq_cst)
+            // and before claiming an instance to write next, if nAsking > 0. Makes at most two attempts.
+            // A request goes from wanted to busy to idle, so if the reader has got ahead of both, it's
+            // doing another whole request, which it started after latest was published. Its load of
+            // latest then sees this push, which the writer can't claim before the next one, so that
+            // request is left wanted (or busy) for the reader to finish itself or for the next push.
+            template<typename Register, typename Unregister>
+            void answer(int latest, Register registerOn, Unregister unregisterFrom)
+            {
+                int s = state.load(std::memory_order_seq_cst);
+                for (int attempt = 0; attempt < 2 && (s == wanted || s <= busy(0)); ++attempt)
+                {
+                    int instance = s == wanted ? latest : busyInstance(s);
+                    registerOn(instance);
+                    if (state.compare_exchange_strong(s, instance, std::memory_order_seq_cst))
+                    {
+                        return;
+                    }
+
+                    // the reader moved on; see what it's doing now
+                    unregisterFrom(instance);
+                }
+            }
+
+        private:
+            // instances handed to the reader are >= 0
+            static const int unused = -1;
+            static const int idle = -2;
+            static const int wanted = -3;
+
+            static int busy(int instance)
+            {
+                return -4 - instance;
+            }
+
+            static int busyInstance(int s)
+            {
+                return -4 - s;
+            }
+
+            std::atomic<int> state;
+        };
+
+
+        /*
+         * Lets readers sleep until the writer pushes an update, in such a way that the writer only
+         * pays for notifying when some reader is actually asleep ("parked").
+         *
+         * When it's about to park, a reader increments nParked and, after a seq_cst fence, checks for an
+         * update. The writer publishes each update with a seq_cst operation and then loads nParked
+         * (seq_cst). So either the reader's check sees the update, or the writer sees nParked > 0 and
+         * notifies (after locking the mutex, so that the notification can't fall between the reader's
+         * check and it going to sleep). Checks after waking again are ordered by the mutex.
+         *
+         * Instead of a thread, a reader can also park an AsyncWaiter (e.g. a suspended coroutine; see
+         * RWSyncAwait.h), which counts in nParked the same way. The writer takes all the parked waiters
+         * off the list and wakes each once; to wait for another update, a waiter must park again. As with
+         * threads, a waiter can be woken without a new update (by a notification that was already on
+         * its way when it parked), so it should check again when woken.
+         */
+        class AsyncWaiter
+        {
+        public:
+            AsyncWaiter() : nextParked(nullptr), isParked(false) {}
+
+            // Called by the writer's thread, after this has been taken off the list (so it may be
+            // parked again, or destroyed once it's been handed off). Must not throw.
+            virtual void wake() = 0;
+
+        protected:
+            ~AsyncWaiter() {}
+
+        private:
+            friend class ParkedReaders;
+
+            // guarded by the ParkedReaders' mutex
+            AsyncWaiter* nextParked;
+            bool isParked;
+        };
+
+
+        class ParkedReaders
+        {
+        public:
+            typedef std::chrono::steady_clock Clock;
+
+            ParkedReaders() : nParked(0), asyncWaiters(nullptr) {}
+
+            // Should be called by the writer after publishing an update with a seq_cst operation
+            // (or any operation followed by a seq_cst fence).
+            void notifyIfParked()
+            {
+                if (nParked.load(std::memory_order_seq_cst) > 0)
+                {
+                    AsyncWaiter* toWake;
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        toWake = takeAsyncWaiters();
+                    }
+                    cv.notify_all();
+
+                    // outside the lock, in case a waiter is resumed right here and parks again
+                    while (toWake != nullptr)
+                    {
+                        AsyncWaiter* w = toWake;
+                        toWake = w->nextParked;
+                        w->wake();
+                    }
+                }
+            }
+
+            // Unless hasUpdate() is already true (in which case returns false), adds w to the waiters
+            // to wake after the next update and returns true. Doesn't block (aside from the mutex).
+            template<typename Predicate>
+            bool park(AsyncWaiter& w, Predicate hasUpdate)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                assert(!w.isParked);
+
+                nParked.fetch_add(1, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+
+                if (hasUpdate())
+                {
+                    nParked.fetch_sub(1, std::memory_order_relaxed);
+                    return false;
+                }
+
+                w.nextParked = asyncWaiters;
+                w.isParked = true;
+                asyncWaiters = &w;
+                return true;
+            }
+
+            // Takes w off the list without waking it, if it's still parked.
+            void unpark(AsyncWaiter& w)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!w.isParked)
+                {
+                    return;
+                }
+
+                AsyncWaiter** link = &asyncWaiters;
+                while (*link != &w)
+                {
+                    link = &(*link)->nextParked;
+                }
+                *link = w.nextParked;
+                w.isParked = false;
+                nParked.fetch_sub(1, std::memory_order_relaxed);
+            }
+
+            // Spins and then sleeps until hasUpdate() returns true or the deadline (if not null) passes.
+            // Returns the last result of hasUpdate(). It must read the writer's published state with at
+            // least a relaxed load.
+            template<typename Predicate>
+            bool wait(Predicate hasUpdate, const Clock::time_point* deadline)
+            {
+                for (int i = 0; i < RWSYNC_WAIT_SPIN_COUNT; ++i)
+                {
+                    if (hasUpdate())
+                    {
+                        return true;
+                    }
+                    cpuRelax();
+                }
+
+                nParked.fetch_add(1, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+
+                bool result = true;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    if (deadline != nullptr)
+                    {
+                        result = cv.wait_until(lock, *deadline, hasUpdate);
+                    }
+                    else
+                    {
+                        cv.wait(lock, hasUpdate);
+                    }
+                }
+
+                nParked.fetch_sub(1, std::memory_order_relaxed);
+                return result;
+            }
+
+            // Deadline for waiting the given amount of time from now, saturating instead of overflowing.
+            static Clock::time_point deadlineAfter(std::chrono::nanoseconds timeout)
+            {
+                Clock::time_point now = Clock::now();
+                if (timeout > Clock::time_point::max() - now)
+                {
+                    return Clock::time_point::max();
+                }
+                return now + std::chrono::duration_cast<Clock::duration>(timeout);
+            }
+
+        private:
+            // Empties the list of async waiters and returns it. Must hold the mutex.
+            AsyncWaiter* takeAsyncWaiters()
+            {
+                AsyncWaiter* list = asyncWaiters;
+                int n = 0;
+                for (AsyncWaiter* w = list; w != nullptr; w = w->nextParked)
+                {
+                    w->isParked = false;
+                    ++n;
+                }
+
+                asyncWaiters = nullptr;
+                if (n > 0)
+                {
+                    nParked.fetch_sub(n, std::memory_order_relaxed);
+                }
+                return list;
+            }
+
+            Padded<std::atomic<int>> nParked;
+            std::mutex mutex;
+            std::condition_variable cv;
+            AsyncWaiter* asyncWaiters; // guarded by mutex
+
+            ParkedReaders(const ParkedReaders&);
+            ParkedReaders& operator=(const ParkedReaders&);
+        };
+
+
+        /*
+         * Lets a draining Lockout wait for the indices that are checked out to be returned, while
+         * new checkouts are refused, so that it succeeds even if readers keep coming and going.
+         * A checkout claims its index with a seq_cst operation and then checks isClosed(), backing
+         * out if it's set; the drainer closes the gate and then checks the counts, so at least
+         * one of them sees the other. Returns must also be seq_cst, followed by notifyReturned().
+         */
+        class DrainGate
+        {
+        public:
+            DrainGate() : nDraining(0) {}
+
+            // For checkouts: whether a drain might be in progress, to fail early without claiming.
+            bool mightBeClosed() const
+            {
+                return nDraining.load(std::memory_order_relaxed) > 0;
+            }
+
+            // For checkouts, after claiming: whether the claim must be undone.
+            bool isClosed() const
+            {
+                return nDraining.load(std::memory_order_seq_cst) > 0;
+            }
+
+            void close()
+            {
+                nDraining.fetch_add(1, std::memory_order_seq_cst);
+            }
+
+            void open()
+            {
+                nDraining.fetch_sub(1, std::memory_order_relaxed);
+            }
+
+            void notifyReturned()
+            {
+                drainers.notifyIfParked();
+            }
+
+            // For the drainer, after close(): waits as in ParkedReaders::wait until isDrained().
+            template<typename Predicate>
+            bool wait(Predicate isDrained, const ParkedReaders::Clock::time_point* deadline)
+            {
+                return drainers.wait(isDrained, deadline);
+            }
+
+        private:
+            std::atomic<int> nDraining;
+            ParkedReaders drainers;
+
+            DrainGate(const DrainGate&);
+            DrainGate& operator=(const DrainGate&);
+        };
+
+
+        /*
+         * Array that can grow without ever moving its existing elements, so that other threads
+         * can keep accessing them (without a lock) while it grows. Elements are stored in
+         * segments of geometrically increasing size: segment 0 holds the first baseSize elements,
+         * and each segment k > 0 holds baseSize * 2^(k-1) elements, so the total size at
+         * least doubles with each segment. Within a segment, elements are contiguous.
+         *
+         * Growing requires external synchronization (i.e. only one thread may call grow()
+         * at a time), but element access and size() are safe concurrently with growing.
+         * T must be default-constructible.
+         */
+        template<typename T, int baseSize>
+        class SegmentedArray
+        {
+            static_assert(baseSize > 0 && (baseSize & (baseSize - 1)) == 0,
+                "SegmentedArray base size must be a power of 2");
+
+        public:
+            explicit SegmentedArray(MemoryResource& m = MemoryResource::getDefault())
+                : memory    (m)
+                , currSize  (0)
+            {
+                for (int k = 0; k < maxSegments; ++k)
+                {
+                    segments[k].store(nullptr, std::memory_order_relaxed);
+                }
+            }
+
+            ~SegmentedArray()
+            {
+                for (int k = 0; k < maxSegments; ++k)
+                {
+                    T* segment = segments[k].load(std::memory_order_relaxed);
+                    if (segment != nullptr)
+                    {
+                        for (int j = segmentSize(k) - 1; j >= 0; --j)
+                        {
+                            segment[j].~T();
+                        }
+                        memory.deallocate(segment, segmentSize(k) * sizeof(T), std::alignment_of<T>::value);
+                    }
+                }
+            }
+
+            int size() const
+            {
+                return currSize.load(std::memory_order_acquire);
+            }
+
+            // Make room for at least newSize elements. New elements are value-initialized.
+            // Only one thread may grow the array at a time.
+            void grow(int newSize)
+            {
+                int oldSize = currSize.load(std::memory_order_relaxed);
+                if (newSize <= oldSize)
+                {
+                    return;
+                }
+
+                int lastSegment = segmentOf(newSize - 1);
+                for (int k = 0; k <= lastSegment; ++k)
+                {
+                    if (segments[k].load(std::memory_order_relaxed) == nullptr)
+                    {
+                        segments[k].store(newSegment(segmentSize(k)), std::memory_order_release);
+                    }
+                }
+
+                currSize.store(newSize, std::memory_order_release);
+            }
+
+            T& operator[](int i)
+            {
+                int k = segmentOf(i);
+                return segments[k].load(std::memory_order_acquire)[i - segmentStart(k)];
+            }
+
+            const T& operator[](int i) const
+            {
+                int k = segmentOf(i);
+                return segments[k].load(std::memory_order_acquire)[i - segmentStart(k)];
+            }
+
+        private:
+            // enough to cover all nonnegative ints
+            static const int maxSegments = sizeof(int) * 8;
+
+            static int segmentOf(int i)
+            {
+                assert(i >= 0);
+                unsigned int blocks = unsigned(i) / baseSize;
+                return blocks == 0 ? 0 : floorLog2(blocks) + 1;
+            }
+
+            static int segmentStart(int k)
+            {
+                return k == 0 ? 0 : baseSize << (k - 1);
+            }
+
+            static int segmentSize(int k)
+            {
+                return k == 0 ? baseSize : baseSize << (k - 1);
+            }
+
+            // n value-initialized elements from memory
+            T* newSegment(int n)
+            {
+                T* segment = static_cast<T*>(memory.allocate(n * sizeof(T), std::alignment_of<T>::value));
+                for (int j = 0; j < n; ++j)
+                {
+                    new (segment + j) T();
+                }
+                return segment;
+            }
+
+            MemoryResource& memory;
+            std::atomic<T*> segments[maxSegments];
+            std::atomic<int> currSize;
+
+            SegmentedArray(const SegmentedArray&);
+            SegmentedArray& operator=(const SegmentedArray&);
+        };
+
+
+        /*
+         * Fixed number of T instances stored inline (i.e. no heap allocation), constructed
+         * from a common set of arguments. Unlike std::array, T doesn't need to be default-constructible
+         * or copyable.
+         */
+        template<typename T, int n>
+        class InlineStorage
+        {
+            static_assert(n > 0, "InlineStorage must hold at least 1 instance");
+
+        public:
+            // Constructs each instance with the given arguments (the last one gets them forwarded).
+            template<typename... Args>
+            explicit InlineStorage(Args&&... args)
+            {
+                int nConstructed = 0;
+                try
+                {
+                    for (; nConstructed < n - 1; ++nConstructed)
+                    {
+                        new (address(nConstructed)) T(args...);
+                    }
+
+                    // move into last entry if possible
+                    new (address(nConstructed)) T(std::forward<Args>(args)...);
+                }
+                catch (...)
+                {
+                    destroyFirst(nConstructed);
+                    throw;
+                }
+            }
+
+            ~InlineStorage()
+            {
+                destroyFirst(n);
+            }
+
+            T& operator[](int i)
+            {
+                assert(i >= 0 && i < n);
+                return *address(i);
+            }
+
+            T* begin()
+            {
+                return address(0);
+            }
+
+            T* end()
+            {
+                return address(0) + n;
+            }
+
+        private:
+            T* address(int i)
+            {
+                return reinterpret_cast<T*>(&storage[i]);
+            }
+
+            void destroyFirst(int count)
+            {
+                for (int i = count - 1; i >= 0; --i)
+                {
+                    address(i)->~T();
+                }
+            }
+
+            typename std::aligned_storage<sizeof(T), std::alignment_of<T>::value>::type storage[n];
+
+            InlineStorage(const InlineStorage&);
+            InlineStorage& operator=(const InlineStorage&);
+        };
+
+
+        // Deleter for a single T made with newIn (e.g. for a std::unique_ptr).
+        template<typename T>
+        struct ResourceDeleter
+        {
+            explicit ResourceDeleter(MemoryResource& m) : memory(&m) {}
+
+            void operator()(T* object) const
+            {
+                object->~T();
+                memory->deallocate(object, sizeof(T), std::alignment_of<T>::value);
+            }
+
+            MemoryResource* memory;
+        };
+
+        // Like new T(args...), but allocating from the given resource. Delete with a ResourceDeleter.
+        template<typename T, typename... Args>
+        T* newIn(MemoryResource& memory, Args&&... args)
+        {
+            void* block = memory.allocate(sizeof(T), std::alignment_of<T>::value);
+            try
+            {
+                return new (block) T(std::forward<Args>(args)...);
+            }
+            catch (...)
+            {
+                memory.deallocate(block, sizeof(T), std::alignment_of<T>::value);
+                throw;
+            }
+        }
+
+
+        /*
+         * Storage for the data instances of a Container. Like a SegmentedArray, it grows by adding
+         * segments without moving existing instances, so readers and the writer can keep using theirs
+         * while it grows. The first segment holds the initial instances, and each segment k > 0 holds
+         * firstSize * 2^(k-1). Within a segment, instances are contiguous, each aligned to `alignment`
+         * (or alignof(T), if larger) and `stride` bytes apart, so indexing the first segment
+         * (i.e. any instance of a container that never expands) is just base + i * stride.
+         *
+         * Adding instances requires external synchronization, but access to existing instances
+         * is safe concurrently with adding. An instance can also be added without being constructed,
+         * and constructed or destroyed later, by whoever has exclusive access to it.
+         */
+        template<typename T, std::size_t alignment>
+        class AlignedSegmentedStorage
+        {
+        public:
+            static const std::size_t instanceAlignment =
+                alignment > std::alignment_of<T>::value ? alignment : std::alignment_of<T>::value;
+
+            static_assert((instanceAlignment & (instanceAlignment - 1)) == 0,
+                "Instance alignment must be a power of 2");
+
+            static const std::size_t stride =
+                (sizeof(T) + instanceAlignment - 1) / instanceAlignment * instanceAlignment;
+
+            // Allocates (but doesn't construct) the first segment. Everything is allocated from m,
+            // except that the first segment can instead be given (nFirst * stride bytes, aligned to
+            // instanceAlignment, which must outlive this; see InlineInstanceBlock).
+            AlignedSegmentedStorage(int nFirst, MemoryResource& m, void* firstBlock = nullptr)
+                : memory        (m)
+                , firstSize     (nFirst)
+                , ownsFirst     (firstBlock == nullptr)
+                , first         (ownsFirst
+                    ? static_cast<unsigned char*>(m.allocate(nFirst * stride, instanceAlignment))
+                    : static_cast<unsigned char*>(firstBlock))
+                , currSize      (0)
+                , constructed   (m)
+            {
+                assert(firstSize > 0);
+                for (int k = 0; k < maxSegments; ++k)
+                {
+                    segments[k].store(nullptr, std::memory_order_relaxed);
+                }
+            }
+
+            ~AlignedSegmentedStorage()
+            {
+                for (int i = currSize.load(std::memory_order_relaxed) - 1; i >= 0; --i)
+                {
+                    if (constructed[i])
+                    {
+                        (*this)[i].~T();
+                    }
+                }
+
+                if (ownsFirst)
+                {
+                    memory.deallocate(first, firstSize * stride, instanceAlignment);
+                }
+                for (int k = 1; k < maxSegments; ++k)
+                {
+                    unsigned char* segment = segments[k].load(std::memory_order_relaxed);
+                    if (segment != nullptr)
+                    {
+                        memory.deallocate(segment, segmentSize(k) * stride, instanceAlignment);
+                    }
+                }
+            }
+
+            int size() const
+            {
+                return currSize.load(std::memory_order_acquire);
+            }
+
+            // Constructs a new instance at the end. Only one thread may add instances at a time.
+            template<typename... Args>
+            void emplaceBack(Args&&... args)
+            {
+                int i = currSize.load(std::memory_order_relaxed);
+                constructed.grow(i + 1);
+                construct(i, std::forward<Args>(args)...);
+                currSize.store(i + 1, std::memory_order_release);
+            }
+
+            // Same, but leaves the new instance unconstructed.
+            void addUnconstructed()
+            {
+                int i = currSize.load(std::memory_order_relaxed);
+                constructed.grow(i + 1);
+                address(i); // allocates its segment, if needed
+                currSize.store(i + 1, std::memory_order_release);
+            }
+
+            bool isConstructed(int i) const
+            {
+                return constructed[i];
+            }
+
+            // Constructs instance i, which must not be constructed already.
+            template<typename... Args>
+            void construct(int i, Args&&... args)
+            {
+                assert(!constructed[i]);
+                new (address(i)) T(std::forward<Args>(args)...);
+                constructed[i] = true;
+            }
+
+            void destroy(int i)
+            {
+                assert(constructed[i]);
+                (*this)[i].~T();
+                constructed[i] = false;
+            }
+
+            T& operator[](int i)
+            {
+                assert(i >= 0);
+                if (i < firstSize)
+                {
+                    return *reinterpret_cast<T*>(first + i * stride);
+                }
+
+                int k = segmentOf(i);
+                unsigned char* segment = segments[k].load(std::memory_order_acquire);
+                return *reinterpret_cast<T*>(segment + (i - segmentStart(k)) * stride);
+            }
+
+        private:
+            // enough to cover all nonnegative ints
+            static const int maxSegments = sizeof(int) * 8;
+
+            // Where instance i goes, allocating its segment if it hasn't been. Only for the thread that
+            // adds instances (or for instances that have been added).
+            unsigned char* address(int i)
+            {
+                if (i < firstSize)
+                {
+                    return first + i * stride;
+                }
+
+                int k = segmentOf(i);
+                unsigned char* segment = segments[k].load(std::memory_order_relaxed);
+                if (segment == nullptr)
+                {
+                    segment = static_cast<unsigned char*>(
+                        memory.allocate(segmentSize(k) * stride, instanceAlignment));
+                    segments[k].store(segment, std::memory_order_release);
+                }
+                return segment + (i - segmentStart(k)) * stride;
+            }
+
+            // only for i >= firstSize
+            int segmentOf(int i) const
+            {
+                return floorLog2(unsigned(i) / unsigned(firstSize)) + 1;
+            }
+
+            int segmentStart(int k) const
+            {
+                return firstSize << (k - 1);
+            }
+
+            int segmentSize(int k) const
+            {
+                return firstSize << (k - 1);
+            }
+
+            MemoryResource& memory;
+            const int firstSize;
+            const bool ownsFirst;
+            unsigned char* const first;
+
+            // segments[0] is unused (it's `first`)
+            std::atomic<unsigned char*> segments[maxSegments];
+            std::atomic<int> currSize;
+
+            // by instance; only accessed by whoever constructs and destroys it
+            SegmentedArray<bool, 8> constructed;
+
+            AlignedSegmentedStorage(const AlignedSegmentedStorage&);
+            AlignedSegmentedStorage& operator=(const AlignedSegmentedStorage&);
+        };
+
+
+        // Room for the first nInstances instances of an AlignedSegmentedStorage<T, alignment>, inside
+        // whatever holds it (e.g. FixedContainer, as a base, so that it's there before the container is
+        // constructed). It's aligned by hand, since objects aren't necessarily allocated with more than
+        // the usual alignment.
+        template<typename T, int nInstances, std::size_t alignment>
+        class InlineInstanceBlock
+        {
+            typedef AlignedSegmentedStorage<T, alignment> Storage;
+
+        protected:
+            InlineInstanceBlock() {}
+
+            void* instanceBlock()
+            {
+                std::uintptr_t address = reinterpret_cast<std::uintptr_t>(bytes);
+                std::uintptr_t mask = std::uintptr_t(Storage::instanceAlignment) - 1;
+                return reinterpret_cast<void*>((address + mask) & ~mask);
+            }
+
+        private:
+            unsigned char bytes[nInstances * Storage::stride + Storage::instanceAlignment - 1];
+
+            InlineInstanceBlock(const InlineInstanceBlock&);
+            InlineInstanceBlock& operator=(const InlineInstanceBlock&);
+        };
+
+
+        // Calls f(i) for each i in [0, n), spread across up to nThreads threads including this one
+        // (0 for one per hardware thread), which take the next i in turn. Returns once every call has
+        // returned. If any call throws, the rest still run, and the first exception is rethrown.
+        template<typename Function>
+        void parallelFor(int n, int nThreads, Function f)
+        {
+            if (nThreads <= 0)
+            {
+                nThreads = std::max(1, int(std::thread::hardware_concurrency()));
+            }
+            nThreads = std::min(nThreads, n);
+
+            if (nThreads <= 1)
+            {
+                for (int i = 0; i < n; ++i)
+                {
+                    f(i);
+                }
+                return;
+            }
+
+            std::atomic<int> next(0);
+            std::mutex errorMutex;
+            std::exception_ptr error;
+            auto work = [&]()
+            {
+                for (int i = next.fetch_add(1, std::memory_order_relaxed); i < n;
+                    i = next.fetch_add(1, std::memory_order_relaxed))
+                {
+                    try
+                    {
+                        f(i);
+                    }
+                    catch (...)
+                    {
+                        std::lock_guard<std::mutex> lock(errorMutex);
+                        if (!error)
+                        {
+                            error = std::current_exception();
+                        }
+                    }
+                }
+            };
+
+            std::vector<std::thread> helpers;
+            helpers.reserve(nThreads - 1);
+            try
+            {
+                for (int k = 1; k < nThreads; ++k)
+                {
+                    helpers.emplace_back(work);
+                }
+            }
+            catch (const std::system_error&)
+            {
+                // couldn't start another thread; make do with the ones we have
+            }
+
+            work();
+            for (std::thread& helper : helpers)
+            {
+                helper.join();
+            }
+
+            if (error)
+            {
+                std::rethrow_exception(error);
+            }
+        }
+    }
+}
+
+#endif // RW_SYNC_DETAIL_H_INCLUDED
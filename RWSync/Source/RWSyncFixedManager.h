@@ -0,0 +1,318 @@
+#ifndef RW_SYNC_FIXED_MANAGER_H_INCLUDED
+#define RW_SYNC_FIXED_MANAGER_H_INCLUDED
+
+/*
+ *  Copyright (C) 2019 Ethan Blackwood
+ *  This is free software released under the MIT license.
+ *  See attached LICENSE file for more details, or https://opensource.org/licenses/MIT.
+ */
+
+#include "RWSyncManager.h"
+
+#include <array>
+#include <cstdint>
+
+/*
+ * Replacement for RWSync::Manager when the maximum number of readers is known at compile time
+ * (used by StaticContainer<T, maxReaders> for maxReaders > 1). Has the same interface and uses the
+ * same protocol, but all state is stored inline (no heap allocation and no mutex, since it can't
+ * be resized) and the search for a new write index in pushWrite is unrolled at compile time (for up
+ * to detail::maxUnrolledSlots instances; beyond that, it's a plain loop).
+ */
+
+namespace RWSync
+{
+    template<int maxReaders>
+    class FixedManager
+    {
+        static_assert(maxReaders >= 1, "Maximum readers of FixedManager must be at least 1");
+
+    public:
+        class Lockout;
+
+        FixedManager();
+
+        // Reset to state with no valid object
+        // No readers or writers should be active when this is called!
+        // If it does fail due to existing readers or writers, returns false
+        bool reset();
+
+        // Use this call if you already have a valid Lockout for doing other operations
+        bool reset(const Lockout& existingLock);
+
+        // always maxReaders
+        int getMaxReaders() const;
+
+        // Snapshot of the hot-path counters (all zero unless RWSYNC_STATS is defined; see RWSyncStats.h).
+        // Can be called at any time from any thread.
+        Stats getStats() const;
+
+        class WriteIndex
+        {
+        public:
+            explicit WriteIndex(FixedManager& o);
+
+            // Takes over other's checkout (if it has one), leaving other invalid.
+            WriteIndex(WriteIndex&& other);
+
+            ~WriteIndex();
+
+            // tries to claim writer status if we don't have it
+            // already - returns true if the write index is now valid.
+            bool tryToMakeValid();
+
+            // is there actually a place to write?
+            bool isValid() const;
+
+            // index to access the correct data instance
+            operator int() const;
+
+            // push a finished write to readers
+            void pushUpdate();
+
+            // see Manager::WriteIndex::pushUpdate(int)
+            void pushUpdate(int preferredNext);
+
+            // see Manager::WriteIndex::latestWasPulled
+            bool latestWasPulled() const;
+
+        private:
+            FixedManager& owner;
+            bool valid;
+
+            WriteIndex(const WriteIndex&);
+            WriteIndex& operator=(const WriteIndex&);
+        };
+
+
+        class ReadIndex
+        {
+        public:
+            explicit ReadIndex(FixedManager& o);
+
+            // see WriteIndex
+            ReadIndex(ReadIndex&& other);
+
+            ~ReadIndex();
+
+            // tries to claim reader status if we don't have it
+            // already - returns true if the read index is now valid.
+            bool tryToMakeValid();
+
+            // check whether a reader has been checked out successfully
+            bool isValid() const;
+
+            // check whether a reader has been checked out and there
+            // has been at least one write.
+            bool canRead() const;
+
+            // check whether a new write has been pushed
+            bool hasUpdate() const;
+
+            // update the index, if a new version is available
+            void pullUpdate();
+
+            // Block until hasUpdate() is true (spinning briefly, then sleeping until the writer pushes),
+            // so that the next pullUpdate() gets a new version. Returns false immediately if invalid.
+            bool waitForUpdate();
+
+            // Same as waitForUpdate, but gives up after the timeout. Returns hasUpdate().
+            bool waitForUpdateFor(std::chrono::nanoseconds timeout);
+
+            // see Manager::ReadIndex::parkUntilUpdate and unpark
+            bool parkUntilUpdate(detail::AsyncWaiter& w);
+            void unpark(detail::AsyncWaiter& w);
+
+            // index to access the correct data instance
+            operator int() const;
+
+            // see Manager::ReadIndex::version and missedSinceLastPull
+            std::uint64_t version() const;
+            std::uint64_t missedSinceLastPull() const;
+
+            // see Manager::ReadIndex::pushTime, age and getLatencyHistogram
+            std::chrono::steady_clock::time_point pushTime() const;
+            std::chrono::nanoseconds age() const;
+            LatencyHistogram getLatencyHistogram() const;
+
+        private:
+            // signal that we are not longer reading from the `index`th instance
+            void finishRead();
+
+            // update index to refer to the latest update
+            void getLatest();
+
+            FixedManager& owner;
+            bool valid;
+            int index;
+            int request; // our PullRequest in owner.requests, or -1 if invalid
+            std::uint64_t currVersion;
+            std::uint64_t missed;
+            detail::LatencyCounters latency;
+
+            ReadIndex(const ReadIndex&);
+            ReadIndex& operator=(const ReadIndex&);
+        };
+
+
+        // Registers as a writer and maxReader readers, so no other reader or writer
+        // can exist while it's held. Use to access all the underlying data without
+        // concern for who has access to what, e.g. for updating settings, resizing, etc.
+        class Lockout
+        {
+        public:
+            explicit Lockout(FixedManager& o);
+
+            // Draining version; see Manager::Lockout.
+            Lockout(FixedManager& o, std::chrono::nanoseconds timeout);
+
+            ~Lockout();
+
+            bool isValid() const;
+
+            bool isValidForManager(const FixedManager* expected) const;
+
+        private:
+            FixedManager& owner;
+            bool hasReadLock;
+            bool hasWriteLock;
+            bool valid;
+            const bool draining;
+        };
+
+    private:
+        static const int size = maxReaders + 2;
+
+        // See corresponding methods of Manager.
+        bool checkoutWriter();
+        void returnWriter();
+        bool claimWriter();
+
+        bool checkoutReader();
+        void returnReader();
+
+        // Since the size is fixed, no mutex is needed to register all readers.
+        bool checkoutAllReaders();
+        void returnAllReaders();
+
+        // see Manager::pushWrite
+        void pushWrite(int preferred);
+
+        // see Manager::claimPullRequest and answerPullRequests
+        int claimPullRequest();
+        void answerPullRequests();
+
+        struct WriterState
+        {
+            int index;
+            std::uint64_t nPushes;
+        };
+
+        // See Manager for explanations of all of these.
+        detail::Padded<std::atomic<int>> nWriters;
+        detail::Padded<std::atomic<int>> nReaders;
+
+        detail::DrainGate drainGate;
+
+        detail::Padded<std::atomic<int>> latest;
+        detail::Padded<std::atomic<int>> pulled;
+        detail::Padded<std::atomic<int>> nAsking;
+
+        detail::Padded<WriterState> writer;
+
+        std::array<detail::Slot, size> slots;
+
+        std::array<detail::Padded<detail::PullRequest>, maxReaders> requests;
+
+        detail::StatsCounters stats;
+
+        // readers sleeping in waitForUpdate; the writer wakes them after each push
+        detail::ParkedReaders parked;
+
+#ifdef OPEN_EPHYS
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(FixedManager);
+#endif
+    };
+
+
+    namespace detail
+    {
+        // Tries to claim each of slots[i] for i in [first, end) (aside from i == skip) for writing
+        // until one succeeds, and returns its index (or -1 if none was free). The loop is unrolled
+        // at compile time. If checkFirst is true, skips slots that a relaxed load shows are in use.
+        // nProbed is incremented for each slot that it tries to claim.
+        template<int first, int end>
+        struct ClaimFreeSlot
+        {
+            template<bool checkFirst, typename SlotArray>
+            static int apply(SlotArray& slots, int skip, int& nProbed)
+            {
+                if (first != skip && (!checkFirst || slots[first].readers.load(std::memory_order_relaxed) == 0))
+                {
+                    ++nProbed;
+                    int expected = 0;
+                    // see comment in Manager::ReadIndex::getLatest() for memory order explanation
+                    if (slots[first].readers.compare_exchange_strong(expected, -1, HotPathOrders::claim))
+                    {
+                        return first;
+                    }
+                }
+
+                return ClaimFreeSlot<first + 1, end>::template apply<checkFirst>(slots, skip, nProbed);
+            }
+        };
+
+        template<int end>
+        struct ClaimFreeSlot<end, end>
+        {
+            template<bool checkFirst, typename SlotArray>
+            static int apply(SlotArray&, int, int&)
+            {
+                return -1;
+            }
+        };
+
+        // Largest number of slots for which ClaimFreeSlot is unrolled; each slot is a level of
+        // template recursion, so it would run into the compiler's instantiation depth limit.
+        const int maxUnrolledSlots = 64;
+
+        // ClaimFreeSlot<0, size>, or the same as a plain loop if size > maxUnrolledSlots.
+        template<int size, bool unrolled = (size <= maxUnrolledSlots)>
+        struct ClaimFreeSlotOf
+        {
+            template<bool checkFirst, typename SlotArray>
+            static int apply(SlotArray& slots, int skip, int& nProbed)
+            {
+                return ClaimFreeSlot<0, size>::template apply<checkFirst>(slots, skip, nProbed);
+            }
+        };
+
+        template<int size>
+        struct ClaimFreeSlotOf<size, false>
+        {
+            template<bool checkFirst, typename SlotArray>
+            static int apply(SlotArray& slots, int skip, int& nProbed)
+            {
+                for (int i = 0; i < size; ++i)
+                {
+                    if (i != skip && (!checkFirst || slots[i].readers.load(std::memory_order_relaxed) == 0))
+                    {
+                        ++nProbed;
+                        int expected = 0;
+                        // see comment in Manager::ReadIndex::getLatest() for memory order explanation
+                        if (slots[i].readers.compare_exchange_strong(expected, -1, HotPathOrders::claim))
+                        {
+                            return i;
+                        }
+                    }
+                }
+
+                return -1;
+            }
+        };
+    }
+}
+
+#include "RWSyncFixedManager.ipp"
+
+#endif // RW_SYNC_FIXED_MANAGER_H_INCLUDED
@@ -0,0 +1,694 @@
+/*
+*  Copyright (C) 2019 Ethan Blackwood
+*  This is free software released under the MIT license.
+*  See attached LICENSE file for more details, or https://opensource.org/licenses/MIT.
+*/
+
+#include "RWSyncFixedManager.h"
+
+#include <cassert>
+
+namespace RWSync
+{
+    ////// FixedManager ///////
+
+    template<int maxReaders>
+    FixedManager<maxReaders>::FixedManager()
+        : nWriters(0)
+        , nReaders(0)
+        , nAsking(0)
+    {
+        reset();
+    }
+
+
+    template<int maxReaders>
+    bool FixedManager<maxReaders>::reset()
+    {
+        Lockout lock(*this);
+        return reset(lock);
+    }
+
+
+    template<int maxReaders>
+    bool FixedManager<maxReaders>::reset(const Lockout& existingLock)
+    {
+        if (!existingLock.isValidForManager(this))
+        {
+            return false;
+        }
+
+        writer.index = 0;
+        writer.nPushes = 0;
+        latest.store(-1, std::memory_order_relaxed);
+        pulled.store(-1, std::memory_order_relaxed);
+
+        for (int i = 1; i < size; ++i)
+        {
+            slots[i].readers.store(0, std::memory_order_relaxed);
+        }
+        slots[0].readers.store(-1, std::memory_order_release);
+
+        return true;
+    }
+
+
+    template<int maxReaders>
+    int FixedManager<maxReaders>::getMaxReaders() const
+    {
+        return maxReaders;
+    }
+
+
+    template<int maxReaders>
+    Stats FixedManager<maxReaders>::getStats() const
+    {
+        return stats.snapshot();
+    }
+
+
+    template<int maxReaders>
+    bool FixedManager<maxReaders>::checkoutWriter()
+    {
+        if (drainGate.mightBeClosed() || !claimWriter())
+        {
+            return false;
+        }
+
+        if (drainGate.isClosed())
+        {
+            returnWriter();
+            return false;
+        }
+
+        return true;
+    }
+
+
+    template<int maxReaders>
+    bool FixedManager<maxReaders>::claimWriter()
+    {
+        int currWriters = 0;
+        return nWriters.compare_exchange_strong(currWriters, 1, std::memory_order_seq_cst);
+    }
+
+
+    template<int maxReaders>
+    void FixedManager<maxReaders>::returnWriter()
+    {
+        int oldNWriters = nWriters.exchange(0, std::memory_order_seq_cst);
+        assert(oldNWriters == 1);
+        (void)oldNWriters;
+        drainGate.notifyReturned();
+    }
+
+
+    template<int maxReaders>
+    bool FixedManager<maxReaders>::checkoutReader()
+    {
+        if (drainGate.mightBeClosed())
+        {
+            return false;
+        }
+
+        int currReaders = 0;
+        while (!nReaders.compare_exchange_weak(currReaders, currReaders + 1, std::memory_order_seq_cst))
+        {
+            if (currReaders >= maxReaders)
+            {
+                return false;
+            }
+        }
+
+        if (drainGate.isClosed())
+        {
+            returnReader();
+            return false;
+        }
+
+        return true;
+    }
+
+
+    template<int maxReaders>
+    void FixedManager<maxReaders>::returnReader()
+    {
+        nReaders.fetch_sub(1, std::memory_order_seq_cst);
+        drainGate.notifyReturned();
+    }
+
+
+    template<int maxReaders>
+    bool FixedManager<maxReaders>::checkoutAllReaders()
+    {
+        int currReaders = 0;
+        return nReaders.compare_exchange_strong(currReaders, maxReaders, std::memory_order_acquire);
+    }
+
+
+    template<int maxReaders>
+    void FixedManager<maxReaders>::returnAllReaders()
+    {
+        nReaders.store(0, std::memory_order_seq_cst);
+        drainGate.notifyReturned();
+    }
+
+
+    template<int maxReaders>
+    void FixedManager<maxReaders>::pushWrite(int preferred)
+    {
+        // see Manager::pushWrite() for explanation
+        int writerIndex = writer.index;
+        assert(writerIndex != -1);
+
+        int previous = latest.load(std::memory_order_relaxed);
+
+        detail::Slot& slot = slots[writerIndex];
+        slot.version.store(++writer.nPushes, std::memory_order_relaxed);
+        slot.previous.store(previous, std::memory_order_relaxed);
+        slot.pushTime.stamp();
+
+        if (stats.enabled && previous != -1 && pulled.load(std::memory_order_relaxed) != previous)
+        {
+            stats.countConflatedPush();
+        }
+
+        // before the release below, so that any reader registering on this instance comes after it
+        pulled.store(-1, std::memory_order_relaxed);
+        slot.readers.store(0, std::memory_order_release);
+        latest.store(writerIndex, detail::HotPathOrders::publish);
+
+        detail::HotPathOrders::fenceAfterPublish();
+        if (nAsking.load(std::memory_order_seq_cst) > 0)
+        {
+            answerPullRequests();
+        }
+
+        // First skip instances that are in use according to a relaxed load, to avoid taking
+        // exclusive ownership of their cache lines. The load may be stale, though,
+        // so if no instance was claimed, try them all (as Manager::pushWrite does).
+        int nProbed = 0;
+        int newWriterIndex = -1;
+
+        // the caller's choice, if it's free
+        if (preferred >= 0 && preferred < size && preferred != writerIndex)
+        {
+            ++nProbed;
+            int expected = 0;
+            if (slots[preferred].readers.compare_exchange_strong(expected, -1, detail::HotPathOrders::claim))
+            {
+                newWriterIndex = preferred;
+            }
+        }
+
+        if (newWriterIndex == -1)
+        {
+            newWriterIndex = detail::ClaimFreeSlotOf<size>::template apply<true>(slots, writerIndex, nProbed);
+        }
+        while (newWriterIndex == -1)
+        {
+            newWriterIndex = detail::ClaimFreeSlotOf<size>::template apply<false>(slots, writerIndex, nProbed);
+
+            // only possible with RWSYNC_ACQUIRE_RELEASE (see detail::HotPathOrders)
+            assert(newWriterIndex != -1 || !detail::HotPathOrders::findsFreeInOnePass);
+            if (newWriterIndex == -1)
+            {
+                detail::cpuRelax();
+            }
+        }
+
+        writer.index = newWriterIndex;
+        stats.countPush(nProbed);
+
+        parked.notifyIfParked();
+    }
+
+
+    template<int maxReaders>
+    int FixedManager<maxReaders>::claimPullRequest()
+    {
+        // see Manager::claimPullRequest()
+        int i = 0;
+        while (!requests[i].tryToClaim())
+        {
+            ++i;
+            assert(i < maxReaders);
+        }
+        return i;
+    }
+
+
+    template<int maxReaders>
+    void FixedManager<maxReaders>::answerPullRequests()
+    {
+        // see Manager::answerPullRequests()
+        std::array<detail::Slot, size>& s = slots;
+        auto registerOn = [&s](int i) { s[i].readers.fetch_add(1, std::memory_order_acquire); };
+        auto unregisterFrom = [&s](int i) { s[i].readers.fetch_sub(1, detail::HotPathOrders::unregister); };
+
+        for (int r = 0; r < maxReaders; ++r)
+        {
+            requests[r].answer(writer.index, registerOn, unregisterFrom);
+        }
+    }
+
+    /***** WriteIndex *****/
+
+    template<int maxReaders>
+    FixedManager<maxReaders>::WriteIndex::WriteIndex(FixedManager& o)
+        : owner(o)
+        , valid(false)
+    {
+        tryToMakeValid();
+    }
+
+
+    template<int maxReaders>
+    FixedManager<maxReaders>::WriteIndex::WriteIndex(WriteIndex&& other)
+        : owner(other.owner)
+        , valid(other.valid)
+    {
+        other.valid = false;
+    }
+
+
+    template<int maxReaders>
+    FixedManager<maxReaders>::WriteIndex::~WriteIndex()
+    {
+        if (valid)
+        {
+            owner.returnWriter();
+        }
+    }
+
+
+    template<int maxReaders>
+    bool FixedManager<maxReaders>::WriteIndex::tryToMakeValid()
+    {
+        if (!valid)
+        {
+            valid = owner.checkoutWriter();
+            if (!valid)
+            {
+                owner.stats.countFailedWriterCheckout();
+            }
+        }
+
+        return valid;
+    }
+
+
+    template<int maxReaders>
+    bool FixedManager<maxReaders>::WriteIndex::isValid() const
+    {
+        return valid;
+    }
+
+
+    template<int maxReaders>
+    FixedManager<maxReaders>::WriteIndex::operator int() const
+    {
+        if (valid)
+        {
+            return owner.writer.index;
+        }
+        return -1;
+    }
+
+
+    template<int maxReaders>
+    void FixedManager<maxReaders>::WriteIndex::pushUpdate()
+    {
+        if (valid)
+        {
+            owner.pushWrite(-1);
+        }
+    }
+
+
+    template<int maxReaders>
+    void FixedManager<maxReaders>::WriteIndex::pushUpdate(int preferredNext)
+    {
+        if (valid)
+        {
+            owner.pushWrite(preferredNext);
+        }
+    }
+
+
+    template<int maxReaders>
+    bool FixedManager<maxReaders>::WriteIndex::latestWasPulled() const
+    {
+        if (!valid)
+        {
+            return false;
+        }
+
+        int latest = owner.latest.load(std::memory_order_relaxed);
+        return latest != -1 && owner.pulled.load(std::memory_order_relaxed) == latest;
+    }
+
+    /***** ReadIndex *****/
+
+    template<int maxReaders>
+    FixedManager<maxReaders>::ReadIndex::ReadIndex(FixedManager& o)
+        : owner         (o)
+        , valid         (false)
+        , index         (-1)
+        , request       (-1)
+        , currVersion   (0)
+        , missed        (0)
+    {
+        tryToMakeValid();
+    }
+
+
+    template<int maxReaders>
+    FixedManager<maxReaders>::ReadIndex::ReadIndex(ReadIndex&& other)
+        : owner         (other.owner)
+        , valid         (other.valid)
+        , index         (other.index)
+        , request       (other.request)
+        , currVersion   (other.currVersion)
+        , missed        (other.missed)
+        , latency       (other.latency)
+    {
+        other.valid = false;
+        other.index = -1;
+        other.request = -1;
+    }
+
+
+    template<int maxReaders>
+    FixedManager<maxReaders>::ReadIndex::~ReadIndex()
+    {
+        if (valid)
+        {
+            finishRead();
+            owner.requests[request].release();
+            owner.returnReader();
+        }
+    }
+
+
+    template<int maxReaders>
+    bool FixedManager<maxReaders>::ReadIndex::tryToMakeValid()
+    {
+        if (!valid)
+        {
+            valid = owner.checkoutReader();
+            if (valid)
+            {
+                request = owner.claimPullRequest();
+                getLatest();
+            }
+            else
+            {
+                owner.stats.countFailedReaderCheckout();
+            }
+        }
+
+        return valid;
+    }
+
+
+    template<int maxReaders>
+    bool FixedManager<maxReaders>::ReadIndex::isValid() const
+    {
+        return valid;
+    }
+
+
+    template<int maxReaders>
+    bool FixedManager<maxReaders>::ReadIndex::canRead() const
+    {
+        return valid && index != -1;
+    }
+
+
+    template<int maxReaders>
+    bool FixedManager<maxReaders>::ReadIndex::hasUpdate() const
+    {
+        int newLatest = owner.latest.load(std::memory_order_relaxed);
+        return valid && newLatest != -1 && newLatest != index;
+    }
+
+
+    template<int maxReaders>
+    void FixedManager<maxReaders>::ReadIndex::pullUpdate()
+    {
+        if (!valid)
+        {
+            return;
+        }
+
+        if (!hasUpdate())
+        {
+            missed = 0;
+            owner.stats.countPull(this, false);
+            return;
+        }
+
+        std::uint64_t oldVersion = currVersion;
+        finishRead();
+        getLatest();
+        missed = currVersion - oldVersion - 1;
+        owner.stats.countPull(this, true);
+        latency.record(owner.slots[index].pushTime.get());
+    }
+
+
+    template<int maxReaders>
+    bool FixedManager<maxReaders>::ReadIndex::waitForUpdate()
+    {
+        if (!valid)
+        {
+            return false;
+        }
+
+        return owner.parked.wait([this]() { return hasUpdate(); }, nullptr);
+    }
+
+
+    template<int maxReaders>
+    bool FixedManager<maxReaders>::ReadIndex::waitForUpdateFor(std::chrono::nanoseconds timeout)
+    {
+        if (!valid)
+        {
+            return false;
+        }
+
+        detail::ParkedReaders::Clock::time_point deadline = detail::ParkedReaders::deadlineAfter(timeout);
+        return owner.parked.wait([this]() { return hasUpdate(); }, &deadline);
+    }
+
+
+    template<int maxReaders>
+    bool FixedManager<maxReaders>::ReadIndex::parkUntilUpdate(detail::AsyncWaiter& w)
+    {
+        if (!valid)
+        {
+            return false;
+        }
+
+        return owner.parked.park(w, [this]() { return hasUpdate(); });
+    }
+
+
+    template<int maxReaders>
+    void FixedManager<maxReaders>::ReadIndex::unpark(detail::AsyncWaiter& w)
+    {
+        owner.parked.unpark(w);
+    }
+
+
+    template<int maxReaders>
+    FixedManager<maxReaders>::ReadIndex::operator int() const
+    {
+        if (valid)
+        {
+            return index;
+        }
+        return -1;
+    }
+
+
+    template<int maxReaders>
+    std::uint64_t FixedManager<maxReaders>::ReadIndex::version() const
+    {
+        return canRead() ? currVersion : 0;
+    }
+
+
+    template<int maxReaders>
+    std::uint64_t FixedManager<maxReaders>::ReadIndex::missedSinceLastPull() const
+    {
+        return missed;
+    }
+
+
+    template<int maxReaders>
+    detail::PushClock::time_point FixedManager<maxReaders>::ReadIndex::pushTime() const
+    {
+        return canRead() ? owner.slots[index].pushTime.get() : detail::PushClock::time_point();
+    }
+
+
+    template<int maxReaders>
+    std::chrono::nanoseconds FixedManager<maxReaders>::ReadIndex::age() const
+    {
+        return detail::ageOf(pushTime());
+    }
+
+
+    template<int maxReaders>
+    LatencyHistogram FixedManager<maxReaders>::ReadIndex::getLatencyHistogram() const
+    {
+        return latency.snapshot();
+    }
+
+
+    template<int maxReaders>
+    void FixedManager<maxReaders>::ReadIndex::finishRead()
+    {
+        if (index != -1)
+        {
+            // see comment in Manager::ReadIndex::getLatest()
+            owner.slots[index].readers.fetch_sub(1, detail::HotPathOrders::unregister);
+        }
+        index = -1;
+    }
+
+
+    template<int maxReaders>
+    void FixedManager<maxReaders>::ReadIndex::getLatest()
+    {
+        // see comment in Manager::ReadIndex::getLatest()
+        index = owner.latest.load(detail::HotPathOrders::loadLatest);
+        currVersion = 0;
+
+        if (index != -1)
+        {
+            int latestReaders = 0;
+            int nFailed = 0;
+            while (!owner.slots[index].readers.compare_exchange_weak(latestReaders, latestReaders + 1,
+                std::memory_order_acquire, std::memory_order_relaxed))
+            {
+                owner.stats.countLatestRetry(this, latestReaders == -1);
+                if (++nFailed == RWSYNC_PULL_ATTEMPTS)
+                {
+                    // the writer keeps getting there first; ask it instead
+                    std::array<detail::Slot, size>& s = owner.slots;
+                    index = owner.requests[request].ask(owner.latest, owner.nAsking,
+                        [&s](int i) { s[i].readers.fetch_add(1, std::memory_order_acquire); },
+                        [&s](int i) { s[i].readers.fetch_sub(1, detail::HotPathOrders::unregister); });
+                    owner.stats.countAnsweredPull(this);
+                    break;
+                }
+
+                if (latestReaders == -1)
+                {
+                    // can't read this anymore, it's being written to
+                    // another latest must have been designated
+                    index = owner.latest.load(std::memory_order_relaxed);
+                    assert(index != -1); // should never be -1 again if it wasn't before
+                    latestReaders = 0;
+                }
+            }
+
+            currVersion = owner.slots[index].version.load(std::memory_order_relaxed);
+
+            detail::storePulled(owner.pulled, owner.latest, index);
+        }
+    }
+
+    /***** FixedManager::Lockout *****/
+
+    template<int maxReaders>
+    FixedManager<maxReaders>::Lockout::Lockout(FixedManager& o)
+        : owner         (o)
+        , hasReadLock   (o.checkoutAllReaders())
+        , hasWriteLock  (o.checkoutWriter())
+        , valid         (hasReadLock && hasWriteLock)
+        , draining      (false)
+    {
+        if (!valid)
+        {
+            owner.stats.countFailedLockout();
+        }
+    }
+
+
+    template<int maxReaders>
+    FixedManager<maxReaders>::Lockout::Lockout(FixedManager& o, std::chrono::nanoseconds timeout)
+        : owner         (o)
+        , hasReadLock   (false)
+        , hasWriteLock  (false)
+        , valid         (false)
+        , draining      (true)
+    {
+        owner.drainGate.close();
+
+        detail::ParkedReaders::Clock::time_point deadline = detail::ParkedReaders::deadlineAfter(timeout);
+        FixedManager* m = &owner;
+        auto isDrained = [m]()
+        {
+            return m->nReaders.load(std::memory_order_relaxed) == 0
+                && m->nWriters.load(std::memory_order_relaxed) == 0;
+        };
+
+        // see Manager::Lockout
+        while (owner.drainGate.wait(isDrained, &deadline))
+        {
+            hasReadLock = owner.checkoutAllReaders();
+            hasWriteLock = hasReadLock && owner.claimWriter();
+            if (hasWriteLock)
+            {
+                valid = true;
+                return;
+            }
+
+            if (hasReadLock)
+            {
+                owner.returnAllReaders();
+                hasReadLock = false;
+            }
+        }
+
+        owner.stats.countFailedLockout();
+    }
+
+
+    template<int maxReaders>
+    FixedManager<maxReaders>::Lockout::~Lockout()
+    {
+        if (hasReadLock)
+        {
+            owner.returnAllReaders();
+        }
+
+        if (hasWriteLock)
+        {
+            owner.returnWriter();
+        }
+
+        if (draining)
+        {
+            owner.drainGate.open();
+        }
+    }
+
+
+    template<int maxReaders>
+    bool FixedManager<maxReaders>::Lockout::isValid() const
+    {
+        return valid;
+    }
+
+
+    template<int maxReaders>
+    bool FixedManager<maxReaders>::Lockout::isValidForManager(const FixedManager* expected) const
+    {
+        return valid && expected == &owner;
+    }
+}
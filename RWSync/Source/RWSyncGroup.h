@@ -0,0 +1,225 @@
+#ifndef RW_SYNC_GROUP_H_INCLUDED
+#define RW_SYNC_GROUP_H_INCLUDED
+
+/*
+ *  Copyright (C) 2019 Ethan Blackwood
+ *  This is free software released under the MIT license.
+ *  See attached LICENSE file for more details, or https://opensource.org/licenses/MIT.
+ */
+
+#include "RWSyncContainer.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <tuple>
+#include <type_traits>
+
+/*
+ * Consistent updates of several containers. Related state that is kept in separate containers
+ * (so that changing one part doesn't mean rewriting all of it) can be written through a WriteGroup,
+ * which pushes the containers that were changed as one epoch, and read through a ReadGroup, whose
+ * pullUpdate() gets the instances of all of them from the same epoch.
+ *
+ * Each container keeps using its own manager; the Group just adds a sequence counter on top, like
+ * the one in SeqlockContainer. The writer makes it odd while it's pushing the changed containers,
+ * and a reader pulls each container and then checks that the counter didn't change meanwhile.
+ * If it did, the reader waits for that push to finish and pulls again. The writer never waits
+ * for readers, and readers only wait in the (short) window of another group push.
+ *
+ * Example:
+ *
+ *     RWSync::Group group;
+ *     RWSync::ExpandableContainer<Coefficients> coefficients;
+ *     RWSync::ExpandableContainer<ChannelMap> channelMap;
+ *
+ *     RWSync::WriteGroup<RWSync::ExpandableContainer<Coefficients>,
+ *         RWSync::ExpandableContainer<ChannelMap>> writer(group, coefficients, channelMap);
+ *     writer.write<0>()->update(...);
+ *     writer.pushUpdate(); // only coefficients is pushed
+ *
+ *     RWSync::ReadGroup<...same types...> reader(group, coefficients, channelMap);
+ *     reader.pullUpdate();
+ *     use(*reader.read<0>(), *reader.read<1>());
+ *
+ * All pushes to the containers must go through the WriteGroup (a push through some other
+ * WritePtr would not be part of any epoch). A ReadGroup can also be made over a subset of the
+ * containers in the group, and other readers can still read the containers individually. Each
+ * ReadGroup takes up one reader of each of its containers (even the ones whose read pointers are
+ * valid if the group as a whole isn't).
+ */
+
+namespace RWSync
+{
+    namespace detail
+    {
+        // Calls f(std::get<i>(t), i) for each element of the tuple t, in order.
+        template<std::size_t I, std::size_t N>
+        struct ForEachInTuple
+        {
+            template<typename Tuple, typename F>
+            static void run(Tuple& t, F& f)
+            {
+                f(std::get<I>(t), I);
+                ForEachInTuple<I + 1, N>::run(t, f);
+            }
+        };
+
+        template<std::size_t N>
+        struct ForEachInTuple<N, N>
+        {
+            template<typename Tuple, typename F>
+            static void run(Tuple&, F&) {}
+        };
+
+        template<typename Tuple, typename F>
+        void forEachInTuple(Tuple& t, F f)
+        {
+            ForEachInTuple<0, std::tuple_size<typename std::remove_const<Tuple>::type>::value>::run(t, f);
+        }
+
+        struct TryToMakeValid
+        {
+            template<typename Ptr>
+            void operator()(Ptr& ptr, std::size_t) const
+            {
+                ptr.tryToMakeValid();
+            }
+        };
+
+        // ANDs together isValid() of each pointer
+        struct AllValid
+        {
+            bool* result;
+
+            template<typename Ptr>
+            void operator()(const Ptr& ptr, std::size_t) const
+            {
+                *result = *result && ptr.isValid();
+            }
+        };
+
+        // same for canRead()
+        struct AllCanRead
+        {
+            bool* result;
+
+            template<typename Ptr>
+            void operator()(const Ptr& ptr, std::size_t) const
+            {
+                *result = *result && ptr.canRead();
+            }
+        };
+    }
+
+    // State shared by the WriteGroup and ReadGroups of a set of containers.
+    class Group
+    {
+    public:
+        Group() : sequence(0) {}
+
+        // number of group pushes so far
+        std::uint64_t numPushes() const
+        {
+            return sequence.load(std::memory_order_relaxed) / 2;
+        }
+
+    private:
+        template<typename...> friend class WriteGroup;
+        template<typename...> friend class ReadGroup;
+
+        // twice the number of complete group pushes, plus 1 while one is in progress
+        detail::Padded<std::atomic<std::uint64_t>> sequence;
+
+#ifdef OPEN_EPHYS
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(Group);
+#endif
+    };
+
+
+    // Writes to a set of containers (which must be in the same Group), pushing them together.
+    template<typename... Containers>
+    class WriteGroup
+    {
+        static_assert(sizeof...(Containers) > 0, "A WriteGroup needs at least one container");
+
+        typedef std::tuple<typename Containers::WritePtr...> Ptrs;
+
+    public:
+        // Gets a WritePtr for each container.
+        WriteGroup(Group& g, Containers&... containers);
+
+        // Tries to make each of the write pointers valid. Returns isValid().
+        bool tryToMakeValid();
+
+        // whether all of the write pointers are valid
+        bool isValid() const;
+
+        // Write pointer of the Ith container. Marks that container as changed, so that it's
+        // pushed by the next pushUpdate().
+        template<std::size_t I>
+        typename std::tuple_element<I, Ptrs>::type& write();
+
+        // Pushes all changed containers as one update (if valid).
+        void pushUpdate();
+
+    private:
+        struct PushChanged;
+
+        Group& group;
+        Ptrs ptrs;
+        bool changed[sizeof...(Containers)];
+    };
+
+
+    // Reads from a set of containers (which must be in the same Group), always seeing the writes
+    // from the same group push in all of them.
+    template<typename... Containers>
+    class ReadGroup
+    {
+        static_assert(sizeof...(Containers) > 0, "A ReadGroup needs at least one container");
+
+        typedef std::tuple<typename Containers::ReadPtr...> Ptrs;
+
+    public:
+        // Gets a ReadPtr for each container, and pulls the latest group push.
+        ReadGroup(Group& g, Containers&... containers);
+
+        // Tries to make each of the read pointers valid. If that makes the group valid,
+        // pulls the latest group push. Returns isValid().
+        bool tryToMakeValid();
+
+        // whether all of the read pointers are valid
+        bool isValid() const;
+
+        // whether every container has been pushed to at least once (and we're valid)
+        bool canRead() const;
+
+        // whether a group push newer than the one we have has finished
+        bool hasUpdate() const;
+
+        // get the instances of all the containers from the latest finished group push
+        void pullUpdate();
+
+        // number of the group push that we have the instances of (0 = none)
+        std::uint64_t version() const;
+
+        // Read pointer of the Ith container. Don't call pullUpdate() on it directly.
+        template<std::size_t I>
+        typename std::tuple_element<I, Ptrs>::type& read();
+
+    private:
+        struct PullAll;
+
+        // pull each container until we have a set from the same group push
+        void pullConsistent();
+
+        Group& group;
+        Ptrs ptrs;
+        std::uint64_t seen; // sequence number of the group push we have
+    };
+}
+
+#include "RWSyncGroup.ipp"
+
+#endif // RW_SYNC_GROUP_H_INCLUDED
@@ -0,0 +1,216 @@
+/*
+*  Copyright (C) 2019 Ethan Blackwood
+*  This is free software released under the MIT license.
+*  See attached LICENSE file for more details, or https://opensource.org/licenses/MIT.
+*/
+
+#include "RWSyncGroup.h"
+
+namespace RWSync
+{
+    /***** WriteGroup *****/
+
+    template<typename... Containers>
+    struct WriteGroup<Containers...>::PushChanged
+    {
+        bool* changed;
+
+        template<typename Ptr>
+        void operator()(Ptr& ptr, std::size_t i) const
+        {
+            if (changed[i])
+            {
+                ptr.pushUpdate();
+                changed[i] = false;
+            }
+        }
+    };
+
+
+    template<typename... Containers>
+    WriteGroup<Containers...>::WriteGroup(Group& g, Containers&... containers)
+        : group (g)
+        , ptrs  (containers...)
+    {
+        for (std::size_t i = 0; i < sizeof...(Containers); ++i)
+        {
+            changed[i] = false;
+        }
+    }
+
+
+    template<typename... Containers>
+    bool WriteGroup<Containers...>::tryToMakeValid()
+    {
+        detail::forEachInTuple(ptrs, detail::TryToMakeValid());
+        return isValid();
+    }
+
+
+    template<typename... Containers>
+    bool WriteGroup<Containers...>::isValid() const
+    {
+        bool valid = true;
+        detail::AllValid check = { &valid };
+        detail::forEachInTuple(ptrs, check);
+        return valid;
+    }
+
+
+    template<typename... Containers>
+    template<std::size_t I>
+    typename std::tuple_element<I, typename WriteGroup<Containers...>::Ptrs>::type&
+        WriteGroup<Containers...>::write()
+    {
+        changed[I] = true;
+        return std::get<I>(ptrs);
+    }
+
+
+    template<typename... Containers>
+    void WriteGroup<Containers...>::pushUpdate()
+    {
+        if (!isValid())
+        {
+            return;
+        }
+
+        // same protocol as SeqlockContainer::WritePtr::pushUpdate, with the pushes in place of
+        // the word stores (only the writer modifies the sequence number)
+        std::uint64_t sequence = group.sequence.load(std::memory_order_relaxed);
+        group.sequence.store(sequence + 1, std::memory_order_relaxed);
+
+        // release: a reader that gets any of the new pushes also sees the odd sequence number
+        std::atomic_thread_fence(std::memory_order_release);
+        PushChanged push = { changed };
+        detail::forEachInTuple(ptrs, push);
+
+        // release: a reader that sees the new sequence number gets all of the new pushes
+        group.sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    /***** ReadGroup *****/
+
+    template<typename... Containers>
+    struct ReadGroup<Containers...>::PullAll
+    {
+        template<typename Ptr>
+        void operator()(Ptr& ptr, std::size_t) const
+        {
+            ptr.pullUpdate();
+        }
+    };
+
+
+    template<typename... Containers>
+    ReadGroup<Containers...>::ReadGroup(Group& g, Containers&... containers)
+        : group (g)
+        , ptrs  (containers...)
+        , seen  (0)
+    {
+        // the read pointers have each pulled whatever was latest, not necessarily from one group push
+        if (isValid())
+        {
+            pullConsistent();
+        }
+    }
+
+
+    template<typename... Containers>
+    bool ReadGroup<Containers...>::tryToMakeValid()
+    {
+        if (!isValid())
+        {
+            detail::forEachInTuple(ptrs, detail::TryToMakeValid());
+            if (isValid())
+            {
+                pullConsistent();
+            }
+        }
+
+        return isValid();
+    }
+
+
+    template<typename... Containers>
+    bool ReadGroup<Containers...>::isValid() const
+    {
+        bool valid = true;
+        detail::AllValid check = { &valid };
+        detail::forEachInTuple(ptrs, check);
+        return valid;
+    }
+
+
+    template<typename... Containers>
+    bool ReadGroup<Containers...>::canRead() const
+    {
+        bool canRead = true;
+        detail::AllCanRead check = { &canRead };
+        detail::forEachInTuple(ptrs, check);
+        return canRead;
+    }
+
+
+    template<typename... Containers>
+    bool ReadGroup<Containers...>::hasUpdate() const
+    {
+        // while a group push is in progress, the update isn't available yet
+        std::uint64_t sequence = group.sequence.load(std::memory_order_relaxed);
+        return (sequence & 1) == 0 && sequence != seen && isValid();
+    }
+
+
+    template<typename... Containers>
+    void ReadGroup<Containers...>::pullUpdate()
+    {
+        if (hasUpdate())
+        {
+            pullConsistent();
+        }
+    }
+
+
+    template<typename... Containers>
+    std::uint64_t ReadGroup<Containers...>::version() const
+    {
+        return seen / 2;
+    }
+
+
+    template<typename... Containers>
+    template<std::size_t I>
+    typename std::tuple_element<I, typename ReadGroup<Containers...>::Ptrs>::type&
+        ReadGroup<Containers...>::read()
+    {
+        return std::get<I>(ptrs);
+    }
+
+
+    template<typename... Containers>
+    void ReadGroup<Containers...>::pullConsistent()
+    {
+        while (true)
+        {
+            // acquire: make sure we get at least the pushes from this group push
+            std::uint64_t before = group.sequence.load(std::memory_order_acquire);
+            if ((before & 1) == 0)
+            {
+                detail::forEachInTuple(ptrs, PullAll());
+
+                // acquire: if any container got a push from a later group push (registering on its
+                // instance is a load of what the writer pushed), we see its odd sequence number
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (group.sequence.load(std::memory_order_relaxed) == before)
+                {
+                    seen = before;
+                    return;
+                }
+            }
+
+            // Another group push is in progress, and some containers may already be pulled from it.
+            // Unlike a plain pull, we can't go back to the previous set, so wait for it to finish.
+            detail::cpuRelax();
+        }
+    }
+}
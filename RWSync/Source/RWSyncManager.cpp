@@ -4,68 +4,130 @@
  *  See attached LICENSE file for more details, or https://opensource.org/licenses/MIT.
  */
 
+// In header-only mode, this is included at the end of RWSyncManager.h.
+#ifndef RW_SYNC_MANAGER_CPP_INCLUDED
+#define RW_SYNC_MANAGER_CPP_INCLUDED
+
 #include "RWSyncManager.h"
 
+#include <algorithm>
 #include <cstdint>
 #include <climits>
 #include <cassert>
-#include <exception>
+#include <stdexcept>
+#include <utility>
 
 namespace RWSync
 {
     ////// Manager ///////
 
-    Manager::Manager(int maxReaders)
-        : nReaders(0)
-        , nWriters(0)
+    RWSYNC_INLINE Manager::Manager(int maxReaders, int historyDepth, MemoryResource& memory)
+        : nWriters      (0)
+        , nReaders      (0)
+        , nAsking       (0)
+        , historyDepth  (historyDepth)
+        , slots         (memory)
+        , occupied      (memory)
+        , requests      (memory)
     {
-        if (maxReaders < 1 || maxReaders > INT_MAX - 2)
+        if (historyDepth < 0 || historyDepth > INT_MAX / 2 - 2)
+        {
+            throw new std::domain_error("History depth must be in range [0, INT_MAX / 2 - 2]");
+        }
+
+        if (maxReaders < 1 || maxReaders > maxPossibleReaders())
         {
-            throw new std::domain_error("Max readers must be in range [1, INT_MAX - 2]");
+            throw new std::domain_error("Max readers must be at least 1, and the number of instances must fit in an int");
         }
 
-        readersOf.resize(maxReaders + 2);
+        int nInstances = getNumInstancesFor(maxReaders);
+        requests.grow(maxReaders);
+        slots.grow(nInstances);
+        occupied.grow((nInstances + detail::occupancyWordBits - 1) / detail::occupancyWordBits);
+
+        writer.history.resize(historyDepth);
 
         reset();
     }
 
 
-    bool Manager::reset()
+    RWSYNC_INLINE bool Manager::reset()
     {
         Lockout lock(*this);
         return reset(lock);
     }
 
 
-    bool Manager::reset(const Lockout& existingLock)
+    RWSYNC_INLINE bool Manager::reset(const Lockout& existingLock)
     {
         if (!existingLock.isValidForManager(this))
         {
             return false;
         }
 
-        writerIndex = 0;
+        writer.index = 0;
+        writer.nPushes = 0;
+        std::fill(writer.history.begin(), writer.history.end(), -1);
+        writer.historyHead = 0;
         latest.store(-1, std::memory_order_relaxed);
+        pulled.store(-1, std::memory_order_relaxed);
+
+        int currSize = slots.size();
+        for (int i = 0; i < currSize; ++i)
+        {
+            slots[i].version.store(0, std::memory_order_relaxed);
+            slots[i].previous.store(-1, std::memory_order_relaxed);
+            slots[i].pushTime.clear();
+        }
 
-        int currSize = readersOf.size();
         for (int i = 1; i < currSize; ++i)
         {
-            readersOf[i].store(0, std::memory_order_relaxed);
+            slots[i].readers.store(0, std::memory_order_relaxed);
+        }
+        slots[0].readers.store(-1, std::memory_order_release);
+
+        int nWords = occupied.size();
+        for (int w = 0; w < nWords; ++w)
+        {
+            occupied[w].store(0, std::memory_order_relaxed);
         }
-        readersOf[0].store(-1, std::memory_order_release);
 
         return true;
     }
 
 
-    int Manager::getMaxReaders() const
+    RWSYNC_INLINE int Manager::getMaxReaders() const
+    {
+        return (size() - 1) / (historyDepth + 1) - 1;
+    }
+
+
+    RWSYNC_INLINE int Manager::getHistoryDepth() const
+    {
+        return historyDepth;
+    }
+
+
+    RWSYNC_INLINE int Manager::getNumInstances() const
+    {
+        return size();
+    }
+
+
+    RWSYNC_INLINE int Manager::getNumInstancesFor(int maxReaders) const
     {
-        return size() - 2;
+        // the writer's instance, plus the latest and each reader's instance along with their histories
+        return (std::min(maxReaders, maxPossibleReaders()) + 1) * (historyDepth + 1) + 1;
     }
 
 
-    void Manager::ensureSpaceForReaders(int newMaxReaders)
+    RWSYNC_INLINE void Manager::ensureSpaceForReaders(int newMaxReaders)
     {
+        if (getMaxReaders() >= newMaxReaders)
+        {
+            return;
+        }
+
         std::lock_guard<std::mutex> sizeGuard(sizeMutex);
 
         int currMaxReaders = getMaxReaders();
@@ -74,45 +136,81 @@ namespace RWSync
             return;
         }
         
-        int nToAdd = newMaxReaders - currMaxReaders;
-        for (int i = 0; i < nToAdd; ++i)
-        {
-            readersOf.emplace_back(0);
-        }
+        // new counts start at 0, occupancy bits start cleared and requests start unused
+        int newSize = getNumInstancesFor(newMaxReaders);
+        occupied.grow((newSize + detail::occupancyWordBits - 1) / detail::occupancyWordBits);
+        requests.grow(std::min(newMaxReaders, maxPossibleReaders()));
+        slots.grow(newSize);
     }
 
 
-    int Manager::size() const
+    RWSYNC_INLINE Stats Manager::getStats() const
     {
-        return readersOf.size();
+        return stats.snapshot();
     }
 
 
-    bool Manager::checkoutWriter()
+    RWSYNC_INLINE int Manager::size() const
     {
-        // ensure there is not already a writer
-        int currWriters = 0;
-        if (!nWriters.compare_exchange_strong(currWriters, 1, std::memory_order_acquire))
+        return slots.size();
+    }
+
+
+    RWSYNC_INLINE int Manager::maxPossibleReaders() const
+    {
+        // leaves the last few indices free, as detail::PullRequest requires
+        return (INT_MAX - 3) / (historyDepth + 1) - 1;
+    }
+
+
+    RWSYNC_INLINE bool Manager::checkoutWriter()
+    {
+        if (drainGate.mightBeClosed() || !claimWriter())
         {
             return false;
         }
 
+        // see DrainGate: either the drainer sees our checkout and waits for it, or we see it here
+        if (drainGate.isClosed())
+        {
+            returnWriter();
+            return false;
+        }
+
         return true;
     }
 
 
-    void Manager::returnWriter()
+    RWSYNC_INLINE bool Manager::claimWriter()
     {
-        int oldNWriters = nWriters.exchange(0, std::memory_order_release);
+        // ensure there is not already a writer
+        // seq_cst (rather than acquire) is required by DrainGate
+        int currWriters = 0;
+        return nWriters.compare_exchange_strong(currWriters, 1, std::memory_order_seq_cst);
+    }
+
+
+    RWSYNC_INLINE void Manager::returnWriter()
+    {
+        // release; seq_cst as required by DrainGate
+        int oldNWriters = nWriters.exchange(0, std::memory_order_seq_cst);
         assert(oldNWriters == 1);
+        (void)oldNWriters;
+        drainGate.notifyReturned();
     }
 
 
-    bool Manager::checkoutReader()
+    RWSYNC_INLINE bool Manager::checkoutReader()
     {
+        if (drainGate.mightBeClosed())
+        {
+            return false;
+        }
+
         // ensure there are not already maxReaders readers
+        // seq_cst (rather than acquire) is required by DrainGate
         int currReaders = 0;
-        while (!nReaders.compare_exchange_weak(currReaders, currReaders + 1, std::memory_order_acquire))
+        while (!nReaders.compare_exchange_weak(currReaders, currReaders + 1, std::memory_order_seq_cst))
         {
             if (currReaders >= getMaxReaders())
             {
@@ -120,17 +218,25 @@ namespace RWSync
             }
         }
 
+        if (drainGate.isClosed())
+        {
+            returnReader();
+            return false;
+        }
+
         return true;
     }
 
 
-    void Manager::returnReader()
+    RWSYNC_INLINE void Manager::returnReader()
     {
-        nReaders.fetch_sub(1, std::memory_order_release);
+        // release; seq_cst as required by DrainGate
+        nReaders.fetch_sub(1, std::memory_order_seq_cst);
+        drainGate.notifyReturned();
     }
 
 
-    bool Manager::checkoutAllReaders(std::unique_lock<std::mutex>& lockToLock)
+    RWSYNC_INLINE bool Manager::checkoutAllReaders(std::unique_lock<std::mutex>& lockToLock)
     {
         if (lockToLock.mutex() != &sizeMutex)
         {
@@ -151,64 +257,283 @@ namespace RWSync
     }
 
     
-    void Manager::returnAllReaders(std::unique_lock<std::mutex>& lockToUnlock)
+    RWSYNC_INLINE void Manager::returnAllReaders(std::unique_lock<std::mutex>& lockToUnlock)
     {
         if (lockToUnlock.mutex() != &sizeMutex)
         {
             return;
         }
 
-        nReaders.store(0, std::memory_order_release);
+        nReaders.store(0, std::memory_order_seq_cst);
         lockToUnlock.unlock();
+        drainGate.notifyReturned();
     }
 
 
-    void Manager::pushWrite()
+    RWSYNC_INLINE void Manager::pushWrite(int preferred)
     {
-        // It's an invariant that writerIndex != -1
+        // It's an invariant that writer.index != -1
         // except within this method, and this method is not reentrant.
-        assert(writerIndex != -1);
+        assert(writer.index != -1);
+
+        int previous = latest.load(std::memory_order_relaxed);
+
+        Slot& slot = slots[writer.index];
+        slot.version.store(++writer.nPushes, std::memory_order_relaxed);
+        slot.previous.store(previous, std::memory_order_relaxed);
+        slot.pushTime.stamp();
+
+        if (stats.enabled && previous != -1 && pulled.load(std::memory_order_relaxed) != previous)
+        {
+            stats.countConflatedPush();
+        }
 
-        readersOf[writerIndex].store(0, std::memory_order_relaxed);
+        // A reader only stores to pulled after registering on an instance that it loaded from latest,
+        // and it can't still be registered there by the time the writer reclaims the instance and
+        // pushes it again. So a reader's store for an earlier push is either ordered before this
+        // reset (it released the instance first) or is for an instance other than the new latest.
+        // A reader with a stale latest can register on this instance as soon as the release below,
+        // so the reset comes first, and the reader's store for this push is ordered after it.
+        pulled.store(-1, std::memory_order_relaxed);
+
+        // release: readers of the history register on instances long after they were
+        // published, so they synchronize with this (see ReadIndex::pinHistory())
+        slot.readers.store(0, std::memory_order_release);
 
         // see comment in ReadIndex::getLatest() for memory order explanation
-        latest.store(writerIndex, std::memory_order_seq_cst);
+        latest.store(writer.index, detail::HotPathOrders::publish);
+
+        // Readers that keep finding their instance claimed ask for one instead. Answering first means
+        // their registrations are in place before the claims below (see detail::PullRequest).
+        detail::HotPathOrders::fenceAfterPublish();
+        if (nAsking.load(std::memory_order_seq_cst) > 0)
+        {
+            answerPullRequests();
+        }
+
+        if (historyDepth > 0 && previous != -1)
+        {
+            writer.history[writer.historyHead] = previous;
+            writer.historyHead = (writer.historyHead + 1) % historyDepth;
+        }
 
-        // at this point, the sum of readersOf must be in the range [0, maxReaders] and all entries
-        // are positive. since the length of readersOf is size == maxReaders + 2, at least 2 entries
-        // must equal 0. one of these may be writerIndex a.k.a. latest, which we skip. so there must
-        // be at least one instance that can be identified to write to next in the following loop.
+        // at this point, the sum of reader counts must be in the range [0, maxReaders * (historyDepth + 1)]
+        // and all counts are positive. since the number of slots is 1 more than that plus
+        // historyDepth + 1, which is the number of instances we keep (writer.index a.k.a. latest and
+        // the history), there must be at least one instance that can be identified to write to next
+        // in the following loop. (with no history, that's maxReaders + 2 instances, 1 of them kept.)
 
         int newWriterIndex = -1;
         int currSize = size();
-        for (int i = 0; i < currSize; ++i)
+        int nProbed = 0;
+
+        // the caller's choice, if it's free
+        if (preferred >= 0 && preferred < currSize && !isKeptByWriter(preferred))
+        {
+            ++nProbed;
+            if (tryToClaimForWriting(preferred))
+            {
+                newWriterIndex = preferred;
+            }
+        }
+
+        // first, only try instances that the occupancy bitmap says have no readers
+        int nWords = (currSize + detail::occupancyWordBits - 1) / detail::occupancyWordBits;
+        for (int w = 0; w < nWords && newWriterIndex == -1; ++w)
+        {
+            int firstInWord = w * detail::occupancyWordBits;
+            int bitsInWord = currSize - firstInWord;
+
+            // it's only a hint, so no ordering is needed (the claim below decides)
+            std::uint64_t candidates = ~occupied[w].load(std::memory_order_relaxed);
+            if (bitsInWord < detail::occupancyWordBits)
+            {
+                candidates &= (std::uint64_t(1) << bitsInWord) - 1;
+            }
+            // don't overwrite what we just wrote!
+            candidates &= ~keptByWriterInWord(firstInWord);
+
+            while (candidates != 0)
+            {
+                int i = firstInWord + detail::countTrailingZeros(candidates);
+                ++nProbed;
+                if (tryToClaimForWriting(i))
+                {
+                    newWriterIndex = i;
+                    break;
+                }
+                candidates &= candidates - 1; // clear lowest set bit
+            }
+        }
+
+        // The bitmap can briefly show a free instance as occupied (between a reader's 1 -> 0
+        // transition and clearing the bit), so if that didn't work, fall back to trying each instance.
+        // Only with RWSYNC_ACQUIRE_RELEASE might that fail too (see detail::HotPathOrders), in which case
+        // a reader is on its way to the latest, so keep trying (for as long as it takes the reader).
+        while (newWriterIndex == -1)
+        {
+            for (int i = 0; i < currSize && newWriterIndex == -1; ++i)
+            {
+                if (isKeptByWriter(i)) { continue; } // don't overwrite what we just wrote!
+
+                ++nProbed;
+                if (tryToClaimForWriting(i))
+                {
+                    newWriterIndex = i;
+                }
+            }
+
+            assert(newWriterIndex != -1 || !detail::HotPathOrders::findsFreeInOnePass);
+            if (newWriterIndex == -1)
+            {
+                detail::cpuRelax();
+            }
+        }
+
+        writer.index = newWriterIndex;
+        stats.countPush(nProbed);
+
+        // latest was stored seq_cst above (or fenced after), as ParkedReaders requires
+        parked.notifyIfParked();
+    }
+
+
+    RWSYNC_INLINE bool Manager::isInUse(int i, const Lockout& existingLock) const
+    {
+        if (!existingLock.isValidForManager(this))
         {
-            if (i == writerIndex) { continue; } // don't overwrite what we just wrote!
+            return true;
+        }
+
+        // (between pushes, writer.index is the instance being written, not the latest)
+        return isKeptByWriter(i) || i == latest.load(std::memory_order_relaxed);
+    }
+
 
-            int expected = 0;
-            // see comment in ReadIndex::getLatest() for memory order explanation
-            if (readersOf[i].compare_exchange_strong(expected, -1, std::memory_order_seq_cst))
+    RWSYNC_INLINE bool Manager::isKeptByWriter(int i) const
+    {
+        return i == writer.index || std::find(writer.history.begin(), writer.history.end(), i) != writer.history.end();
+    }
+
+
+    RWSYNC_INLINE std::uint64_t Manager::keptByWriterInWord(int firstInWord) const
+    {
+        std::uint64_t mask = 0;
+        unsigned int offset = unsigned(writer.index - firstInWord);
+        if (offset < unsigned(detail::occupancyWordBits))
+        {
+            mask |= std::uint64_t(1) << offset;
+        }
+
+        for (int h : writer.history)
+        {
+            offset = unsigned(h - firstInWord);
+            if (h != -1 && offset < unsigned(detail::occupancyWordBits))
             {
-                newWriterIndex = i;
-                break;
+                mask |= std::uint64_t(1) << offset;
             }
         }
 
-        assert(newWriterIndex != -1);
-        writerIndex = newWriterIndex;
+        return mask;
+    }
+
+
+    RWSYNC_INLINE bool Manager::tryToClaimForWriting(int i)
+    {
+        int expected = 0;
+        // see comment in ReadIndex::getLatest() for memory order explanation
+        return slots[i].readers.compare_exchange_strong(expected, -1, detail::HotPathOrders::claim);
+    }
+
+
+    RWSYNC_INLINE int Manager::claimPullRequest()
+    {
+        // There is one request for each reader that can be checked out, and a reader releases its
+        // request before it's returned, so once checkoutReader() has succeeded, one of them is free.
+        // Every reader takes the first free one, so one pass finds it: any request we find taken belongs
+        // to a reader that is still checked out, and one released behind us can only go to a reader
+        // that checks out after it was released, which takes it (or one before it) rather than one
+        // further on.
+        int i = 0;
+        while (!requests[i].tryToClaim())
+        {
+            ++i;
+            assert(i < int(requests.size()));
+        }
+        return i;
+    }
+
+
+    RWSYNC_INLINE void Manager::answerPullRequests()
+    {
+        // called before writer.index moves on, so it is still the push just published
+        int latestIndex = writer.index;
+        auto registerOn = [this](int i) { addReader(i); };
+        auto unregisterFrom = [this](int i) { removeReader(i); };
+
+        // This checks every request (one for each reader that can be checked out), and so costs the
+        // writer O(max readers) on each push while any reader is asking.
+        int nRequests = requests.size();
+        for (int r = 0; r < nRequests; ++r)
+        {
+            requests[r].answer(latestIndex, registerOn, unregisterFrom);
+        }
+    }
+
+
+    RWSYNC_INLINE void Manager::addReader(int i)
+    {
+        // acquire: see ReadIndex::getLatest()
+        int oldReaders = slots[i].readers.fetch_add(1, std::memory_order_acquire);
+        assert(oldReaders >= 0); // see detail::PullRequest
+        if (oldReaders == 0)
+        {
+            markOccupied(i);
+        }
+    }
+
+
+    RWSYNC_INLINE void Manager::removeReader(int i)
+    {
+        if (slots[i].readers.fetch_sub(1, detail::HotPathOrders::unregister) == 1)
+        {
+            markFree(i);
+        }
+    }
+
+
+    RWSYNC_INLINE void Manager::markOccupied(int i)
+    {
+        std::uint64_t bit = std::uint64_t(1) << (i % detail::occupancyWordBits);
+        occupied[i / detail::occupancyWordBits].fetch_or(bit, detail::HotPathOrders::occupancy);
+    }
+
+
+    RWSYNC_INLINE void Manager::markFree(int i)
+    {
+        std::uint64_t bit = std::uint64_t(1) << (i % detail::occupancyWordBits);
+        occupied[i / detail::occupancyWordBits].fetch_and(~bit, detail::HotPathOrders::occupancy);
     }
 
     /***** WriteIndex *****/
 
-    WriteIndex::WriteIndex(Manager& o)
+    RWSYNC_INLINE WriteIndex::WriteIndex(Manager& o)
         : owner(o)
         , valid(false)
     {
         tryToMakeValid();
     }
 
+
+    RWSYNC_INLINE WriteIndex::WriteIndex(WriteIndex&& other)
+        : owner(other.owner)
+        , valid(other.valid)
+    {
+        other.valid = false;
+    }
+
     
-    WriteIndex::~WriteIndex()
+    RWSYNC_INLINE WriteIndex::~WriteIndex()
     {
         if (valid)
         {
@@ -217,89 +542,144 @@ namespace RWSync
     }
 
 
-    bool WriteIndex::tryToMakeValid()
+    RWSYNC_INLINE bool WriteIndex::tryToMakeValid()
     {
         if (!valid)
         {
             valid = owner.checkoutWriter();
+            if (!valid)
+            {
+                owner.stats.countFailedWriterCheckout();
+            }
         }
 
         return valid;
     }
 
 
-    bool WriteIndex::isValid() const
+    RWSYNC_INLINE bool WriteIndex::isValid() const
     {
         return valid;
     }
 
 
-    WriteIndex::operator int() const
+    RWSYNC_INLINE WriteIndex::operator int() const
     {
         if (valid)
         {
-            return owner.writerIndex;
+            return owner.writer.index;
         }
         return -1;
     }
 
 
-    void WriteIndex::pushUpdate()
+    RWSYNC_INLINE void WriteIndex::pushUpdate()
     {
         if (valid)
         {
-            owner.pushWrite();
+            owner.pushWrite(-1);
         }
     }
 
+
+    RWSYNC_INLINE void WriteIndex::pushUpdate(int preferredNext)
+    {
+        if (valid)
+        {
+            owner.pushWrite(preferredNext);
+        }
+    }
+
+
+    RWSYNC_INLINE bool WriteIndex::latestWasPulled() const
+    {
+        if (!valid)
+        {
+            return false;
+        }
+
+        // only the writer modifies latest, so this is the index of our last push
+        int latest = owner.latest.load(std::memory_order_relaxed);
+        return latest != -1 && owner.pulled.load(std::memory_order_relaxed) == latest;
+    }
+
     /***** ReadIndex *****/
 
-    ReadIndex::ReadIndex(Manager& o)
-        : owner(o)
-        , valid(false)
+    RWSYNC_INLINE ReadIndex::ReadIndex(Manager& o)
+        : owner         (o)
+        , valid         (false)
+        , index         (-1)
+        , request       (-1)
+        , currVersion   (0)
+        , missed        (0)
     {
+        pinned.reserve(owner.historyDepth);
         tryToMakeValid();
     }
 
 
-    ReadIndex::~ReadIndex()
+    RWSYNC_INLINE ReadIndex::ReadIndex(ReadIndex&& other)
+        : owner         (other.owner)
+        , valid         (other.valid)
+        , index         (other.index)
+        , request       (other.request)
+        , currVersion   (other.currVersion)
+        , missed        (other.missed)
+        , pinned        (std::move(other.pinned))
+        , latency       (other.latency)
+    {
+        // the registrations (of index and pinned) and the request are ours now
+        other.valid = false;
+        other.index = -1;
+        other.request = -1;
+        other.pinned.clear();
+    }
+
+
+    RWSYNC_INLINE ReadIndex::~ReadIndex()
     {
         if (valid)
         {
             finishRead();
+            owner.requests[request].release();
             owner.returnReader();
         }
     }
 
 
-    bool ReadIndex::tryToMakeValid()
+    RWSYNC_INLINE bool ReadIndex::tryToMakeValid()
     {
         if (!valid)
         {
             valid = owner.checkoutReader();
             if (valid)
             {
+                request = owner.claimPullRequest();
                 getLatest();
             }
+            else
+            {
+                owner.stats.countFailedReaderCheckout();
+            }
         }
 
         return valid;
     }
 
 
-    bool ReadIndex::isValid() const
+    RWSYNC_INLINE bool ReadIndex::isValid() const
     {
         return valid;
     }
 
 
-    bool ReadIndex::canRead() const
+    RWSYNC_INLINE bool ReadIndex::canRead() const
     {
         return valid && index != -1;
     }
 
 
-    bool ReadIndex::hasUpdate() const
+    RWSYNC_INLINE bool ReadIndex::hasUpdate() const
     {
         int newLatest = owner.latest.load(std::memory_order_relaxed);
         return valid && newLatest != -1 && newLatest != index;
@@ -308,19 +688,130 @@ namespace RWSync
     }
 
 
-    void ReadIndex::pullUpdate()
+    RWSYNC_INLINE void ReadIndex::pullUpdate()
     {
-        if (!valid || !hasUpdate())
+        if (!valid)
         {
             return;
         }
 
+        if (!hasUpdate())
+        {
+            missed = 0;
+            owner.stats.countPull(this, false);
+            return;
+        }
+
+        std::uint64_t oldVersion = currVersion;
         finishRead();
         getLatest();
+        missed = currVersion - oldVersion - 1;
+        owner.stats.countPull(this, true);
+        latency.record(owner.slots[index].pushTime.get());
     }
 
 
-    ReadIndex::operator int() const
+    RWSYNC_INLINE bool ReadIndex::waitForUpdate()
+    {
+        if (!valid)
+        {
+            return false;
+        }
+
+        return owner.parked.wait([this]() { return hasUpdate(); }, nullptr);
+    }
+
+
+    RWSYNC_INLINE bool ReadIndex::waitForUpdateFor(std::chrono::nanoseconds timeout)
+    {
+        if (!valid)
+        {
+            return false;
+        }
+
+        detail::ParkedReaders::Clock::time_point deadline = detail::ParkedReaders::deadlineAfter(timeout);
+        return owner.parked.wait([this]() { return hasUpdate(); }, &deadline);
+    }
+
+
+    RWSYNC_INLINE bool ReadIndex::parkUntilUpdate(detail::AsyncWaiter& w)
+    {
+        if (!valid)
+        {
+            return false;
+        }
+
+        return owner.parked.park(w, [this]() { return hasUpdate(); });
+    }
+
+
+    RWSYNC_INLINE void ReadIndex::unpark(detail::AsyncWaiter& w)
+    {
+        owner.parked.unpark(w);
+    }
+
+
+    RWSYNC_INLINE std::uint64_t ReadIndex::version() const
+    {
+        return canRead() ? currVersion : 0;
+    }
+
+
+    RWSYNC_INLINE std::uint64_t ReadIndex::missedSinceLastPull() const
+    {
+        return missed;
+    }
+
+
+    RWSYNC_INLINE detail::PushClock::time_point ReadIndex::pushTime() const
+    {
+        return canRead() ? owner.slots[index].pushTime.get() : detail::PushClock::time_point();
+    }
+
+
+    RWSYNC_INLINE std::chrono::nanoseconds ReadIndex::age() const
+    {
+        return detail::ageOf(pushTime());
+    }
+
+
+    RWSYNC_INLINE LatencyHistogram ReadIndex::getLatencyHistogram() const
+    {
+        return latency.snapshot();
+    }
+
+
+    RWSYNC_INLINE int ReadIndex::historySize() const
+    {
+        return canRead() ? int(pinned.size()) : 0;
+    }
+
+
+    RWSYNC_INLINE int ReadIndex::history(int i) const
+    {
+        if (i < 0 || i > historySize() || !canRead())
+        {
+            return -1;
+        }
+
+        return i == 0 ? index : pinned[i - 1];
+    }
+
+
+    RWSYNC_INLINE std::uint64_t ReadIndex::historyVersion(int i) const
+    {
+        int instance = history(i);
+        if (instance == -1)
+        {
+            return 0;
+        }
+
+        // the history is consecutive pushes
+        return currVersion - i;
+    }
+
+
+    RWSYNC_INLINE ReadIndex::operator int() const
     {
         if (valid)
         {
@@ -330,24 +821,36 @@ namespace RWSync
     }
 
 
-    void ReadIndex::finishRead()
+    RWSYNC_INLINE void ReadIndex::finishRead()
     {
+        for (int instance : pinned)
+        {
+            if (owner.slots[instance].readers.fetch_sub(1, detail::HotPathOrders::unregister) == 1)
+            {
+                owner.markFree(instance);
+            }
+        }
+        pinned.clear();
+
         if (index != -1)
         {
             // decrement reader count for current instance
             // see comment in getLatest()
-            owner.readersOf[index].fetch_sub(1, std::memory_order_seq_cst);
+            if (owner.slots[index].readers.fetch_sub(1, detail::HotPathOrders::unregister) == 1)
+            {
+                owner.markFree(index);
+            }
         }
         index = -1;
     }
 
 
-    void ReadIndex::getLatest()
+    RWSYNC_INLINE void ReadIndex::getLatest()
     {
         /*
-        We want to prevent any reader from "occupying 2 places" in readersOf by decrementing one entry
+        We want to prevent any reader from "occupying 2 places" in slots by decrementing one entry
         and incrementing another that is not that actual latest while the writer is searching for the
-        next write index. To accomplish this we make some of the loads and stores of readersOf and latest seq_cst.
+        next write index. To accomplish this we make some of the loads and stores of reader counts and latest seq_cst.
 
         If the single total modification order places a write to "latest" after the decrement that
         may occur in finishRead, this call may not get that updated value of "latest," but it's OK
@@ -356,15 +859,33 @@ namespace RWSync
         to "latest" is ordered before the decrement, this load is guaranteed to see that updated
         value and increment the actual latest index (in the context of the current call to pushWrite())
         below, rather than some other index that might otherwise have been the next write index.
+
+        With RWSYNC_ACQUIRE_RELEASE, neither is guaranteed, and the writer tries again instead if it
+        counts a reader twice, until the reader gets here, so its push isn't bounded any more (see
+        detail::HotPathOrders).
+
+        Registering fails whenever the writer has claimed the instance again in the meantime, so if
+        it keeps pushing faster than we can register, this reader could retry forever. After
+        RWSYNC_PULL_ATTEMPTS failures, we ask the writer for an instance instead, which takes a
+        bounded number of steps (see detail::PullRequest).
         */
-        index = owner.latest.load(std::memory_order_seq_cst);
+        index = owner.latest.load(detail::HotPathOrders::loadLatest);
+        currVersion = 0;
 
         if (index != -1)
         {
+            // acquire: if latest was reloaded below, this is what makes the push visible
             int latestReaders = 0;
-            while (!owner.readersOf[index].compare_exchange_weak(latestReaders, latestReaders + 1,
-                std::memory_order_relaxed))
+            int nFailed = 0;
+            while (!owner.slots[index].readers.compare_exchange_weak(latestReaders, latestReaders + 1,
+                std::memory_order_acquire, std::memory_order_relaxed))
             {
+                owner.stats.countLatestRetry(this, latestReaders == -1);
+                if (++nFailed == RWSYNC_PULL_ATTEMPTS)
+                {
+                    break;
+                }
+
                 if (latestReaders == -1)
                 {
                     // can't read this anymore, it's being written to
@@ -374,21 +895,141 @@ namespace RWSync
                     latestReaders = 0;
                 }
             }
+
+            if (nFailed == RWSYNC_PULL_ATTEMPTS)
+            {
+                Manager* m = &owner;
+                index = owner.requests[request].ask(owner.latest, owner.nAsking,
+                    [m](int i) { m->addReader(i); }, [m](int i) { m->removeReader(i); });
+                owner.stats.countAnsweredPull(this);
+            }
+            else if (latestReaders == 0)
+            {
+                owner.markOccupied(index);
+            }
+
+            // same cache line as the count we just incremented
+            currVersion = owner.slots[index].version.load(std::memory_order_relaxed);
+
+            // tell the writer that this push has been read (unless it has pushed again since)
+            detail::storePulled(owner.pulled, owner.latest, index);
+
+            if (owner.historyDepth > 0)
+            {
+                pinHistory();
+            }
+        }
+    }
+
+
+    RWSYNC_INLINE void ReadIndex::pinHistory()
+    {
+        /*
+        The writer keeps the historyDepth pushes before the latest, so usually all of them are still
+        there. But the writer may have pushed again since we loaded latest, so the oldest may already
+        have been reclaimed and rewritten. So for each one, register as a reader first (after which the
+        writer can't claim it), then check that it still holds the push we expect; stop at the first that
+        doesn't. Acquire: synchronize with the release store in pushWrite() for that push, whenever it was.
+        */
+        int curr = index;
+        while (int(pinned.size()) < owner.historyDepth)
+        {
+            const Slot& slot = owner.slots[curr];
+            int previous = slot.previous.load(std::memory_order_relaxed);
+            std::uint64_t previousVersion = slot.version.load(std::memory_order_relaxed) - 1;
+            if (previous == -1)
+            {
+                return;
+            }
+
+            int readers = owner.slots[previous].readers.load(std::memory_order_relaxed);
+            do
+            {
+                if (readers == -1)
+                {
+                    return; // being rewritten
+                }
+            } while (!owner.slots[previous].readers.compare_exchange_weak(readers, readers + 1,
+                std::memory_order_acquire, std::memory_order_relaxed));
+
+            if (readers == 0)
+            {
+                owner.markOccupied(previous);
+            }
+
+            if (owner.slots[previous].version.load(std::memory_order_relaxed) != previousVersion)
+            {
+                // rewritten since
+                if (owner.slots[previous].readers.fetch_sub(1, detail::HotPathOrders::unregister) == 1)
+                {
+                    owner.markFree(previous);
+                }
+                return;
+            }
+
+            pinned.push_back(previous);
+            curr = previous;
         }
     }
 
     /***** Manager::Lockout *****/
 
-    Manager::Lockout::Lockout(Manager& o)
+    RWSYNC_INLINE Manager::Lockout::Lockout(Manager& o)
         : owner         (o)
         , sizeLock      (o.sizeMutex, std::defer_lock)
         , hasReadLock   (o.checkoutAllReaders(sizeLock))
         , hasWriteLock  (o.checkoutWriter())
         , valid         (hasReadLock && hasWriteLock)
-    {}
+        , draining      (false)
+    {
+        if (!valid)
+        {
+            owner.stats.countFailedLockout();
+        }
+    }
+
+
+    RWSYNC_INLINE Manager::Lockout::Lockout(Manager& o, std::chrono::nanoseconds timeout)
+        : owner         (o)
+        , sizeLock      (o.sizeMutex, std::defer_lock)
+        , hasReadLock   (false)
+        , hasWriteLock  (false)
+        , valid         (false)
+        , draining      (true)
+    {
+        owner.drainGate.close();
+
+        detail::ParkedReaders::Clock::time_point deadline = detail::ParkedReaders::deadlineAfter(timeout);
+        Manager* m = &owner;
+        auto isDrained = [m]()
+        {
+            return m->nReaders.load(std::memory_order_relaxed) == 0
+                && m->nWriters.load(std::memory_order_relaxed) == 0;
+        };
+
+        while (owner.drainGate.wait(isDrained, &deadline))
+        {
+            // only fails if another Lockout got in first; then wait for it too
+            hasReadLock = owner.checkoutAllReaders(sizeLock);
+            hasWriteLock = hasReadLock && owner.claimWriter();
+            if (hasWriteLock)
+            {
+                valid = true;
+                return;
+            }
+
+            if (hasReadLock)
+            {
+                owner.returnAllReaders(sizeLock);
+                hasReadLock = false;
+            }
+        }
+
+        owner.stats.countFailedLockout();
+    }
 
     
-    Manager::Lockout::~Lockout()
+    RWSYNC_INLINE Manager::Lockout::~Lockout()
     {
         if (hasReadLock)
         {
@@ -399,17 +1040,24 @@ namespace RWSync
         {
             owner.returnWriter();
         }
+
+        if (draining)
+        {
+            owner.drainGate.open();
+        }
     }
 
 
-    bool Manager::Lockout::isValid() const
+    RWSYNC_INLINE bool Manager::Lockout::isValid() const
     {
         return valid;
     }
 
 
-    bool Manager::Lockout::isValidForManager(const Manager* expected) const
+    RWSYNC_INLINE bool Manager::Lockout::isValidForManager(const Manager* expected) const
     {
         return valid && expected == &owner;
     }
 }
+
+#endif // RW_SYNC_MANAGER_CPP_INCLUDED
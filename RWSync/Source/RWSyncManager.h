@@ -7,9 +7,13 @@
  *  See attached LICENSE file for more details, or https://opensource.org/licenses/MIT.
  */
 
+#include "RWSyncDetail.h"
+#include "RWSyncStats.h"
+
 #include <atomic>
+#include <cstdint>
 #include <mutex>
-#include <deque>
+#include <vector>
 
 #ifdef OEPLUGIN
 #define OPEN_EPHYS
@@ -21,15 +25,33 @@
 #define COMMON_LIB
 #endif
 
+// Define RWSYNC_HEADER_ONLY to use the library without building any implementation (.cpp) files
+// separately. In this mode, they are included by the corresponding headers and all functions are
+// defined inline, so that the hot paths (pushUpdate, pullUpdate, hasUpdate, etc.) can be inlined into
+// the caller rather than calling across a shared library boundary.
+#ifdef RWSYNC_HEADER_ONLY
+#define RWSYNC_API
+#define RWSYNC_INLINE inline
+#else
+#define RWSYNC_API COMMON_LIB
+#define RWSYNC_INLINE
+#endif
+
 
 namespace RWSync
 {
-    class COMMON_LIB Manager
+    class RWSYNC_API Manager
     {
     public:
         class Lockout;
 
-        explicit Manager(int maxReaders = 1);
+        // With a history depth K > 0, each reader can also read the K pushes before the latest one
+        // it has pulled (see ReadIndex::history). This takes (maxReaders + 1) * (K + 1) + 1 instances
+        // rather than maxReaders + 2, since each reader (and the writer) may keep its own K + 1 pinned.
+        // The reader counts are allocated from memory (see RWSyncMemoryResource.h), which must outlive
+        // the manager.
+        explicit Manager(int maxReaders = 1, int historyDepth = 0,
+            MemoryResource& memory = MemoryResource::getDefault());
 
         // Reset to state with no valid object
         // No readers or writers should be active when this is called!
@@ -41,16 +63,34 @@ namespace RWSync
 
         int getMaxReaders() const;
 
+        int getHistoryDepth() const;
+
+        // Number of data instances needed (i.e. valid indices) for the current max readers,
+        // or for the given number of readers.
+        int getNumInstances() const;
+        int getNumInstancesFor(int maxReaders) const;
+
         // Expands maximum simultaneous readers (this involves allocating memory).
         // If the current max readers is already equal to or greater than the
         // input, does nothing.
         void ensureSpaceForReaders(int newMaxReaders);
 
-        class COMMON_LIB WriteIndex
+        // Whether instance i must be kept as it is: it's the writer's, or it holds the latest push or
+        // one in the history. Only meaningful under a Lockout (returns true if existingLock isn't valid).
+        bool isInUse(int i, const Lockout& existingLock) const;
+
+        // Snapshot of the hot-path counters (all zero unless RWSYNC_STATS is defined; see RWSyncStats.h).
+        // Can be called at any time from any thread.
+        Stats getStats() const;
+
+        class RWSYNC_API WriteIndex
         {
         public:
             explicit WriteIndex(Manager& o);
 
+            // Takes over other's checkout (if it has one), leaving other invalid.
+            WriteIndex(WriteIndex&& other);
+
             ~WriteIndex();
 
             // tries to claim writer status if we don't have it
@@ -66,16 +106,32 @@ namespace RWSync
             // push a finished write to readers
             void pushUpdate();
 
+            // Same, but first tries to take instance preferredNext (if it's free and isn't kept for
+            // readers) to write to next. Containers use this to reach instances that the writer
+            // wouldn't otherwise get to, e.g. to reconfigure them.
+            void pushUpdate(int preferredNext);
+
+            // Whether any reader has pulled the most recent push (or started reading it when checking
+            // out) since it was pushed, e.g. to skip producing updates that nobody is consuming. False
+            // if invalid or nothing has been pushed. This is a snapshot: a reader may pull it just after.
+            bool latestWasPulled() const;
+
         private:
             Manager& owner;
             bool valid;
+
+            WriteIndex(const WriteIndex&);
+            WriteIndex& operator=(const WriteIndex&);
         };
 
 
-        class COMMON_LIB ReadIndex
+        class RWSYNC_API ReadIndex
         {
         public:
-            explicit ReadIndex(Manager& o);                
+            explicit ReadIndex(Manager& o);
+
+            // see WriteIndex
+            ReadIndex(ReadIndex&& other);
 
             ~ReadIndex();
 
@@ -96,29 +152,94 @@ namespace RWSync
             // update the index, if a new version is available
             void pullUpdate();
 
+            // Block until hasUpdate() is true (spinning briefly, then sleeping until the writer pushes),
+            // so that the next pullUpdate() gets a new version. Returns false immediately if invalid.
+            bool waitForUpdate();
+
+            // Same as waitForUpdate, but gives up after the timeout. Returns hasUpdate().
+            bool waitForUpdateFor(std::chrono::nanoseconds timeout);
+
+            // For waiting without a thread (see RWSyncAwait.h): unless there's already an update (or this
+            // is invalid), registers w to be woken by the writer's next push and returns true.
+            bool parkUntilUpdate(detail::AsyncWaiter& w);
+
+            // Takes w back if it's still registered (i.e. hasn't been woken).
+            void unpark(detail::AsyncWaiter& w);
+
             // index to access the correct data instance
             operator int() const;
 
+            // Version of the push this reader is on: pushes are numbered consecutively from 1 since the
+            // last reset, so two reads with the same version see the same update. 0 if it can't read yet.
+            std::uint64_t version() const;
+
+            // Number of pushes that the last pullUpdate() skipped over (made after the version the reader
+            // was on and before the one it got), or 0 if it had no update. The sum over all pulls is the
+            // number of pushes this reader never saw.
+            std::uint64_t missedSinceLastPull() const;
+
+            // When the push this reader is on was made (by the writer's steady_clock), and how long
+            // ago that was. Only recorded if RWSYNC_TIMESTAMPS is defined; otherwise (or if it can't
+            // read yet), a default time_point and 0.
+            std::chrono::steady_clock::time_point pushTime() const;
+            std::chrono::nanoseconds age() const;
+
+            // Snapshot of how long after being pushed the updates this reader got were when it
+            // pulled them (all zeros unless RWSYNC_TIMESTAMPS is defined). Like Stats::pulls, this
+            // counts the pullUpdate() calls that got an update.
+            LatencyHistogram getLatencyHistogram() const;
+
+            // Number of earlier pushes available along with the current one, up to the history depth.
+            // Can be less if the reader has pulled fewer than that many, or if the writer was far enough
+            // ahead that some had already been rewritten when it pulled.
+            int historySize() const;
+
+            // Index of the ith push before the current one, for i in [0, historySize()]
+            // (history(0) is the current index), or -1 if it isn't available.
+            int history(int i) const;
+
+            // Version of history(i): pushes are numbered consecutively from 1 since the last reset.
+            // 0 if not available.
+            std::uint64_t historyVersion(int i) const;
+
         private:
             // signal that we are not longer reading from the `index`th instance
+            // (or any of the history)
             void finishRead();
 
             // update index to refer to the latest update
             void getLatest();
 
+            // register as a reader of as many of the pushes before index as possible
+            void pinHistory();
+
             Manager& owner;
             bool valid;
             int index;
+            int request; // our PullRequest in owner.requests, or -1 if invalid
+            std::uint64_t currVersion;
+            std::uint64_t missed;
+            std::vector<int> pinned; // history(1), history(2), ... that are registered
+            detail::LatencyCounters latency;
+
+            ReadIndex(const ReadIndex&);
+            ReadIndex& operator=(const ReadIndex&);
         };
 
 
         // Registers as a writer and maxReader readers, so no other reader or writer
         // can exist while it's held. Use to access all the underlying data without
         // conern for who has access to what, e.g. for updating settings, resizing, etc.
-        class COMMON_LIB Lockout
+        class RWSYNC_API Lockout
         {
         public:
             explicit Lockout(Manager& o);
+
+            // Draining version: instead of failing right away if any index is checked out, refuses
+            // new checkouts (which fail as if the manager were full) and waits, spinning and then
+            // sleeping, for the existing ones to be returned. Invalid if that takes over timeout.
+            Lockout(Manager& o, std::chrono::nanoseconds timeout);
+
             ~Lockout();
 
             bool isValid() const;
@@ -128,20 +249,28 @@ namespace RWSync
         private:
             Manager& owner;
             std::unique_lock<std::mutex> sizeLock;
-            const bool hasReadLock;
-            const bool hasWriteLock;
-            const bool valid;
+            bool hasReadLock;
+            bool hasWriteLock;
+            bool valid;
+            const bool draining;
         };
 
     private:
 
         int size() const;
 
+        // largest maxReaders for which the number of instances fits in an int
+        int maxPossibleReaders() const;
+
         // Registers a writer. If a writer already exists,
         // returns false, else returns true. returnWriter should be called to release.
+        // Also fails while a draining Lockout is waiting or held.
         bool checkoutWriter();
         void returnWriter();
 
+        // checkoutWriter, ignoring draining Lockouts (for use by one)
+        bool claimWriter();
+
         // Registers a reader and updates the reader index. If maxReaders readers already exist,
         // returns false, else returns true. returnReader should be called to release.
         bool checkoutReader();
@@ -152,23 +281,96 @@ namespace RWSync
         bool checkoutAllReaders(std::unique_lock<std::mutex>& lockToLock);
         void returnAllReaders(std::unique_lock<std::mutex>& lockToUnlock);
 
-        // Makes newly written data available and finds a new place to write. Should
-        // only ever be called by the writer.
-        void pushWrite();
+        // Makes newly written data available and finds a new place to write, trying preferred
+        // first if it isn't -1. Should only ever be called by the writer.
+        void pushWrite(int preferred);
+
+        // Try to claim instance i for writing. Only for use in pushWrite.
+        bool tryToClaimForWriting(int i);
+
+        // Claims a free PullRequest for a reader that has just checked out, and returns its index.
+        // Takes the first free one, in one pass, without waiting.
+        int claimPullRequest();
+
+        // Hands the latest instance to each reader that is asking for one (see detail::PullRequest).
+        // Only for use in pushWrite, between publishing and claiming. Goes through every request, so
+        // while any reader is asking, the writer's push costs O(max readers) more.
+        void answerPullRequests();
+
+        // Increment and decrement the reader count of instance i, keeping the occupancy bitmap up to date.
+        void addReader(int i);
+        void removeReader(int i);
+
+        // Update the occupancy bitmap when slots[i].readers goes from 0 to 1 or 1 to 0,
+        // respectively. Only to be called by readers (or by the writer registering one, see addReader).
+        void markOccupied(int i);
+        void markFree(int i);
+
+        struct WriterState
+        {
+            int index;
+            std::uint64_t nPushes;
+
+            // If there's a history, the pushes before the latest one (circular, most recent at
+            // historyHead - 1). They keep their instances, along with the latest.
+            std::vector<int> history;
+            int historyHead;
+        };
+
+        typedef detail::Slot Slot;
+
+        // Whether instance i is the latest or in the writer's history (so the writer must not claim it),
+        // and the same for each instance in [firstInWord, firstInWord + 64) as a bitmask.
+        bool isKeptByWriter(int i) const;
+        std::uint64_t keptByWriterInWord(int firstInWord) const;
+
+        // Each of these is on its own cache line, since they are modified by different
+        // threads: nWriters and nReaders only when checking out and returning indices,
+        // latest on every push (and it is polled by readers), pulled by the first reader
+        // of each push, and writer is private to the writer.
+        detail::Padded<std::atomic<int>> nWriters;
+        detail::Padded<std::atomic<int>> nReaders;
+
+        // closed by draining Lockouts; nWriters and nReaders are changed with seq_cst operations for it
+        detail::DrainGate drainGate;
+
+        detail::Padded<std::atomic<int>> latest;
+
+        // Index of the latest instance that a reader has pulled, or -1 if none has been since the last
+        // push. Reset by the writer just before publishing each push. Readers only move it to an index
+        // that's still the latest (see detail::storePulled), so a reader pulling an older push doesn't
+        // overwrite a newer one's store; one that stores an earlier push's index anyway (having seen it
+        // as the latest just before the push) can't match the new latest (see pushWrite).
+        detail::Padded<std::atomic<int>> pulled;
 
-        std::atomic<int> nWriters;
-        std::atomic<int> nReaders;
+        // number of readers asking the writer for an instance (see detail::PullRequest)
+        detail::Padded<std::atomic<int>> nAsking;
 
-        int writerIndex;
+        detail::Padded<WriterState> writer;
 
-        std::atomic<int> latest;
+        const int historyDepth;
 
-        std::mutex sizeMutex; // protects the length of readersOf
+        std::mutex sizeMutex; // protects growth of slots
 
-        // deque is one of the few data structures that can contain atomics
-        std::deque<std::atomic<int>> readersOf;
-        // If readersOf[i] == -1, this indicates that it's being written to.
-        // In other words, readersOf[writerIndex] == -1 (but readers should not access writerIndex directly).
+        // Segmented, so that existing reader counts never move when expanding, and (by default)
+        // padded, so that each count is on its own cache line. See RWSyncDetail.h.
+        // slots[writer.index].readers == -1 (but readers should not access writer directly).
+        detail::SegmentedArray<Slot, 8> slots;
+
+        // Bit i % 64 of occupied[i / 64] is set when slots[i].readers > 0; readers maintain this on their
+        // 0 -> 1 and 1 -> 0 transitions, so that the writer can find an unused instance without trying
+        // to claim every one in turn. It is only a hint (a reader sets or clears its bit just after its
+        // transition), so the writer still has to claim the slot itself.
+        detail::SegmentedArray<detail::OccupancyWord, 1> occupied;
+
+        // One for each of maxReaders readers, claimed when checking out. Grown before slots, so that a
+        // reader that sees the new max readers also sees enough requests.
+        detail::SegmentedArray<detail::Padded<detail::PullRequest>, 8> requests;
+
+        detail::StatsCounters stats;
+
+        // readers sleeping in waitForUpdate; the writer wakes them after each push
+        detail::ParkedReaders parked;
 
 #ifdef OPEN_EPHYS
         JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(Manager);
@@ -179,4 +381,8 @@ namespace RWSync
     using ReadIndex = Manager::ReadIndex;
 }
 
+#ifdef RWSYNC_HEADER_ONLY
+#include "RWSyncManager.cpp"
+#endif
+
 #endif // RW_SYNC_MANAGER_H_INCLUDED
@@ -0,0 +1,155 @@
+#ifndef RW_SYNC_MEMORY_RESOURCE_H_INCLUDED
+#define RW_SYNC_MEMORY_RESOURCE_H_INCLUDED
+
+/*
+ *  Copyright (C) 2019 Ethan Blackwood
+ *  This is free software released under the MIT license.
+ *  See attached LICENSE file for more details, or https://opensource.org/licenses/MIT.
+ */
+
+/*
+ * Where a Container's data instances and a Manager's reader counts are allocated. Like
+ * std::pmr::memory_resource (which needs C++17), a MemoryResource is passed by reference and must
+ * outlive everything that allocates from it. By default, memory comes from operator new.
+ *
+ * Allocation only happens when a container or manager is made and when it expands, never for
+ * pushes or pulls, so a container made in a BufferResource (or PageArena, see RWSyncPageArena.h)
+ * that was big enough and is never expanded doesn't touch the heap at all, unless it's used with the
+ * features whose bookkeeping is still on the heap: a HistoryDepth, changes queued by reconfigure(),
+ * and the log kept by a CarryForwardWritePtr (which is only allocated once it's first used).
+ */
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+namespace RWSync
+{
+    namespace detail
+    {
+        // Allocates size bytes aligned to the given power of 2, which may be larger than the
+        // alignment that operator new guarantees. Free with alignedFree.
+        inline void* alignedAlloc(std::size_t size, std::size_t alignment)
+        {
+            if (alignment < sizeof(void*))
+            {
+                alignment = sizeof(void*);
+            }
+
+            // leave room to align the block and to store the original pointer just before it
+            void* raw = ::operator new(size + alignment + sizeof(void*));
+            std::uintptr_t start = reinterpret_cast<std::uintptr_t>(raw) + sizeof(void*);
+            std::uintptr_t aligned = (start + alignment - 1) & ~(std::uintptr_t(alignment) - 1);
+            reinterpret_cast<void**>(aligned)[-1] = raw;
+            return reinterpret_cast<void*>(aligned);
+        }
+
+        inline void alignedFree(void* block)
+        {
+            if (block != nullptr)
+            {
+                ::operator delete(static_cast<void**>(block)[-1]);
+            }
+        }
+    }
+
+
+    class MemoryResource
+    {
+    public:
+        virtual ~MemoryResource() {}
+
+        // Returns a block of at least the given number of bytes, aligned to the given power of 2.
+        // Throws std::bad_alloc if there isn't enough memory. Must be safe to call from any thread.
+        virtual void* allocate(std::size_t bytes, std::size_t alignment) = 0;
+
+        // Frees a block returned by allocate() with the same size and alignment.
+        virtual void deallocate(void* block, std::size_t bytes, std::size_t alignment) = 0;
+
+        // The resource that containers and managers use if they aren't given one (operator new).
+        static MemoryResource& getDefault();
+    };
+
+
+    // A fixed buffer that's handed out in order; deallocating does nothing, so memory is only
+    // reused once the buffer is. The caller owns the buffer, which must outlive this and everything
+    // allocated from it. Put it wherever it's needed (e.g. memory that has been locked, or bound to a
+    // NUMA node), and make it big enough for every instance the container will ever have.
+    class BufferResource : public MemoryResource
+    {
+    public:
+        BufferResource(void* buffer, std::size_t s)
+            : base  (static_cast<unsigned char*>(buffer))
+            , size  (s)
+            , used  (0)
+        {}
+
+        void* allocate(std::size_t bytes, std::size_t alignment) override
+        {
+            std::size_t offset = used.load(std::memory_order_relaxed);
+            std::size_t next;
+            do
+            {
+                std::uintptr_t address = reinterpret_cast<std::uintptr_t>(base) + offset;
+                std::uintptr_t aligned = (address + alignment - 1) & ~(std::uintptr_t(alignment) - 1);
+                std::size_t start = offset + std::size_t(aligned - address);
+                if (start > size || bytes > size - start)
+                {
+                    throw std::bad_alloc();
+                }
+                next = start + bytes;
+            } while (!used.compare_exchange_weak(offset, next, std::memory_order_relaxed));
+
+            return base + (next - bytes);
+        }
+
+        void deallocate(void*, std::size_t, std::size_t) override {}
+
+        // bytes handed out so far (including alignment padding), and the size of the buffer
+        std::size_t getUsed() const
+        {
+            return used.load(std::memory_order_relaxed);
+        }
+
+        std::size_t getSize() const
+        {
+            return size;
+        }
+
+    private:
+        unsigned char* const base;
+        const std::size_t size;
+        std::atomic<std::size_t> used;
+
+        BufferResource(const BufferResource&);
+        BufferResource& operator=(const BufferResource&);
+    };
+
+
+    namespace detail
+    {
+        class HeapResource : public MemoryResource
+        {
+        public:
+            void* allocate(std::size_t bytes, std::size_t alignment) override
+            {
+                return alignedAlloc(bytes, alignment);
+            }
+
+            void deallocate(void* block, std::size_t, std::size_t) override
+            {
+                alignedFree(block);
+            }
+        };
+    }
+
+
+    inline MemoryResource& MemoryResource::getDefault()
+    {
+        static detail::HeapResource heap;
+        return heap;
+    }
+}
+
+#endif // RW_SYNC_MEMORY_RESOURCE_H_INCLUDED
@@ -0,0 +1,192 @@
+/*
+ *  Copyright (C) 2019 Ethan Blackwood
+ *  This is free software released under the MIT license.
+ *  See attached LICENSE file for more details, or https://opensource.org/licenses/MIT.
+ */
+
+// In header-only mode, this is included at the end of RWSyncPageArena.h.
+#ifndef RW_SYNC_PAGE_ARENA_CPP_INCLUDED
+#define RW_SYNC_PAGE_ARENA_CPP_INCLUDED
+
+#include "RWSyncPageArena.h"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace RWSync
+{
+    RWSYNC_INLINE PageArena::PageArena(std::size_t size, int options)
+        : mapping   (map(size, options))
+        , buffer    (mapping.address, mapping.size)
+    {}
+
+
+    RWSYNC_INLINE PageArena::~PageArena()
+    {
+        unmap(mapping);
+    }
+
+
+    RWSYNC_INLINE void* PageArena::allocate(std::size_t bytes, std::size_t alignment)
+    {
+        return buffer.allocate(bytes, alignment);
+    }
+
+
+    RWSYNC_INLINE void PageArena::deallocate(void* block, std::size_t bytes, std::size_t alignment)
+    {
+        buffer.deallocate(block, bytes, alignment);
+    }
+
+
+    RWSYNC_INLINE bool PageArena::usesHugePages() const
+    {
+        return mapping.hugePages;
+    }
+
+
+    RWSYNC_INLINE bool PageArena::isLocked() const
+    {
+        return mapping.locked;
+    }
+
+
+    RWSYNC_INLINE std::size_t PageArena::getUsed() const
+    {
+        return buffer.getUsed();
+    }
+
+
+    RWSYNC_INLINE std::size_t PageArena::getSize() const
+    {
+        return buffer.getSize();
+    }
+
+
+    namespace detail
+    {
+        RWSYNC_INLINE std::size_t roundUpToMultiple(std::size_t size, std::size_t unit)
+        {
+            return (size + unit - 1) / unit * unit;
+        }
+    }
+
+#ifdef _WIN32
+
+    RWSYNC_INLINE PageArena::Mapping PageArena::map(std::size_t size, int options)
+    {
+        Mapping mapping = { nullptr, 0, false, false };
+
+        std::size_t largePageSize = GetLargePageMinimum();
+        if ((options & hugePages) != 0 && largePageSize > 0)
+        {
+            mapping.size = detail::roundUpToMultiple(size, largePageSize);
+            mapping.address = VirtualAlloc(nullptr, mapping.size,
+                MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+            mapping.hugePages = mapping.locked = mapping.address != nullptr;
+        }
+
+        if (mapping.address == nullptr)
+        {
+            SYSTEM_INFO info;
+            GetSystemInfo(&info);
+            mapping.size = detail::roundUpToMultiple(size, info.dwPageSize);
+            mapping.address = VirtualAlloc(nullptr, mapping.size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+            if (mapping.address == nullptr)
+            {
+                throw new std::runtime_error("Failed to map memory for PageArena");
+            }
+        }
+
+        if ((options & lockPages) != 0 && !mapping.locked)
+        {
+            if (!VirtualLock(mapping.address, mapping.size))
+            {
+                unmap(mapping);
+                throw new std::runtime_error("Failed to lock memory for PageArena (is the working set big enough?)");
+            }
+            mapping.locked = true;
+        }
+
+        return mapping;
+    }
+
+
+    RWSYNC_INLINE void PageArena::unmap(const Mapping& mapping)
+    {
+        VirtualFree(mapping.address, 0, MEM_RELEASE);
+    }
+
+#else // _WIN32
+
+    RWSYNC_INLINE PageArena::Mapping PageArena::map(std::size_t size, int options)
+    {
+        Mapping mapping = { nullptr, 0, false, false };
+
+#ifdef MAP_HUGETLB
+        if ((options & hugePages) != 0)
+        {
+            mapping.size = detail::roundUpToMultiple(size, RWSYNC_HUGE_PAGE_SIZE);
+            void* mapped = mmap(nullptr, mapping.size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (mapped != MAP_FAILED)
+            {
+                mapping.address = mapped;
+                mapping.hugePages = true;
+            }
+        }
+#endif
+
+        if (mapping.address == nullptr)
+        {
+            mapping.size = detail::roundUpToMultiple(size, std::size_t(sysconf(_SC_PAGESIZE)));
+            void* mapped = mmap(nullptr, mapping.size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (mapped == MAP_FAILED)
+            {
+                throw new std::runtime_error("Failed to map memory for PageArena");
+            }
+            mapping.address = mapped;
+
+#ifdef MADV_HUGEPAGE
+            if ((options & hugePages) != 0)
+            {
+                madvise(mapped, mapping.size, MADV_HUGEPAGE); // just a hint
+            }
+#endif
+        }
+
+        if ((options & lockPages) != 0)
+        {
+            if (mlock(mapping.address, mapping.size) != 0)
+            {
+                unmap(mapping);
+                throw new std::runtime_error("Failed to lock memory for PageArena (is RLIMIT_MEMLOCK big enough?)");
+            }
+            mapping.locked = true;
+        }
+
+        return mapping;
+    }
+
+
+    RWSYNC_INLINE void PageArena::unmap(const Mapping& mapping)
+    {
+        munmap(mapping.address, mapping.size);
+    }
+
+#endif // _WIN32
+}
+
+#endif // RW_SYNC_PAGE_ARENA_CPP_INCLUDED
@@ -0,0 +1,98 @@
+#ifndef RW_SYNC_PAGE_ARENA_H_INCLUDED
+#define RW_SYNC_PAGE_ARENA_H_INCLUDED
+
+/*
+ *  Copyright (C) 2019 Ethan Blackwood
+ *  This is free software released under the MIT license.
+ *  See attached LICENSE file for more details, or https://opensource.org/licenses/MIT.
+ */
+
+#include "RWSyncManager.h" // for RWSYNC_API and RWSYNC_INLINE
+#include "RWSyncMemoryResource.h"
+
+#include <cstddef>
+
+/*
+ * A MemoryResource (see RWSyncMemoryResource.h) over its own mapping of whole pages (mmap, or
+ * VirtualAlloc on Windows), handed out like a BufferResource. It can use huge pages, so that a
+ * container's instances take fewer TLB entries, and lock its pages into RAM, so that readers and the
+ * writer never page-fault on them.
+ *
+ * Example (instances and reader counts for up to 64 readers, locked in memory):
+ *
+ *     RWSync::PageArena arena(64 << 20, RWSync::PageArena::lockPages);
+ *     RWSync::ExpandableContainer<Frame> frames(RWSync::InMemory(arena), args...);
+ *     frames.increaseMaxReadersTo(64);
+ *
+ * NUMA placement: operating systems put each page on the node of the thread that first touches it.
+ * Locking touches every page when the arena is made, so make a locked arena on a thread that's running
+ * on the node it should be on (e.g. the writer's). Otherwise, pages are placed as they are first
+ * written; with LazyInstances, each instance is constructed (and so first touched) by the writer.
+ * To bind memory to a node explicitly, map it yourself (e.g. with libnuma) and use a BufferResource.
+ */
+
+// Size of the huge pages that PageArena asks for on Linux (where the size must be given in advance).
+#ifndef RWSYNC_HUGE_PAGE_SIZE
+#define RWSYNC_HUGE_PAGE_SIZE (std::size_t(2) << 20)
+#endif
+
+namespace RWSync
+{
+    class RWSYNC_API PageArena : public MemoryResource
+    {
+    public:
+        enum Options
+        {
+            // Use huge pages (MAP_HUGETLB, or MEM_LARGE_PAGES on Windows, which needs the "Lock pages
+            // in memory" privilege) if they're available, or else normal pages (see usesHugePages()).
+            // On Linux, normal pages are then marked for transparent huge pages.
+            hugePages = 1,
+
+            // Lock the pages into RAM (mlock or VirtualLock), which touches them all now. Huge pages
+            // on Windows are always locked.
+            lockPages = 2
+        };
+
+        // Maps at least size bytes, with any combination of Options. Throws a new std::runtime_error
+        // if the memory can't be mapped or locked (e.g. because of RLIMIT_MEMLOCK, or on Windows, the
+        // process's minimum working set size).
+        explicit PageArena(std::size_t size, int options = 0);
+
+        ~PageArena();
+
+        // Throws std::bad_alloc once the arena is used up. Deallocating does nothing.
+        void* allocate(std::size_t bytes, std::size_t alignment) override;
+        void deallocate(void* block, std::size_t bytes, std::size_t alignment) override;
+
+        bool usesHugePages() const;
+        bool isLocked() const;
+
+        // see BufferResource
+        std::size_t getUsed() const;
+        std::size_t getSize() const;
+
+    private:
+        struct Mapping
+        {
+            void* address;
+            std::size_t size; // whole pages
+            bool hugePages;
+            bool locked;
+        };
+
+        static Mapping map(std::size_t size, int options);
+        static void unmap(const Mapping& mapping);
+
+        const Mapping mapping;
+        BufferResource buffer;
+
+        PageArena(const PageArena&);
+        PageArena& operator=(const PageArena&);
+    };
+}
+
+#ifdef RWSYNC_HEADER_ONLY
+#include "RWSyncPageArena.cpp"
+#endif
+
+#endif // RW_SYNC_PAGE_ARENA_H_INCLUDED
@@ -0,0 +1,119 @@
+#ifndef RW_SYNC_READER_POOL_H_INCLUDED
+#define RW_SYNC_READER_POOL_H_INCLUDED
+
+/*
+ *  Copyright (C) 2019 Ethan Blackwood
+ *  This is free software released under the MIT license.
+ *  See attached LICENSE file for more details, or https://opensource.org/licenses/MIT.
+ */
+
+#include "RWSyncDetail.h"
+
+#include <atomic>
+#include <memory>
+
+/*
+ * Read pointers that are kept checked out for short-lived readers (e.g. one per callback), so that
+ * getting one is a pullUpdate() rather than a checkout and a return, which contend with the other
+ * readers for the container's reader count. acquire() returns a Handle to one of the pool's read
+ * pointers, and destroying the Handle puts it back, still checked out.
+ *
+ * acquire() starts probing for a free pointer at a slot picked by hashing the thread's id, and
+ * goes on through the others from there. Nothing is cached per thread, but a thread that acquires
+ * and releases repeatedly usually gets the same pointer, and threads with different starting slots
+ * don't contend, unless two threads' ids hash to the same slot or more threads than slots are
+ * acquiring at once. A pointer's reader is checked out the first time it's acquired.
+ *
+ * Example:
+ *
+ *     RWSync::ReaderPool<RWSync::ExpandableContainer<Settings>> pool(settings, 4);
+ *     ...
+ *     void timerCallback()
+ *     {
+ *         RWSync::ReaderPool<RWSync::ExpandableContainer<Settings>>::Handle reader = pool.acquire();
+ *         if (reader.isValid() && reader->canRead())
+ *         {
+ *             use((*reader)->threshold);
+ *         }
+ *     }
+ *
+ * The pool's readers count against the container's maximum, and since they stay checked out, a
+ * Lockout (reset(), map() etc.) fails while they exist. releaseIdle() returns the ones that aren't
+ * acquired. The pool must outlive its Handles, and the container must outlive the pool.
+ */
+
+namespace RWSync
+{
+    template<typename Container, typename Ptr = typename Container::ReadPtr>
+    class ReaderPool
+    {
+    public:
+        // Pool of up to size read pointers (none are checked out until they're first acquired).
+        ReaderPool(Container& c, int size);
+
+        class Handle
+        {
+        public:
+            // Takes over other's pointer (if any), leaving other invalid.
+            Handle(Handle&& other);
+
+            // puts the pointer back in the pool
+            ~Handle();
+
+            // Whether this has a pointer from the pool and its reader is checked out. A Handle from
+            // a pool whose pointers were all in use has no pointer, and a pointer's reader can fail to
+            // be checked out if the container already has its maximum number of readers.
+            bool isValid() const;
+
+            // The read pointer (only if isValid()). It has pulled the latest update.
+            Ptr& operator*() const;
+            Ptr* operator->() const;
+
+        private:
+            friend class ReaderPool;
+
+            Handle(ReaderPool* p, int i);
+
+            ReaderPool* pool;
+            int slot; // -1 if none
+
+            Handle(const Handle&);
+            Handle& operator=(const Handle&);
+        };
+
+        // Takes a free pointer, trying the slot this thread's id hashes to first, and pulls the latest update
+        // (checking out the pointer's reader first if it doesn't have one).
+        Handle acquire();
+
+        // Destroys the pointers that aren't acquired, returning their readers to the container.
+        // They're made again when next acquired.
+        void releaseIdle();
+
+    private:
+        struct Slot
+        {
+            Slot() : inUse(false) {}
+
+            std::atomic<bool> inUse;
+            std::unique_ptr<Ptr> ptr; // only accessed by whoever holds inUse
+        };
+
+        // Claims slot i if it's free.
+        bool tryToClaim(int i);
+        void release(int i);
+
+        Container& container;
+        const int size;
+
+        // each on its own cache line, so that threads using different slots don't contend
+        std::unique_ptr<detail::Padded<Slot>[]> slots;
+
+#ifdef OPEN_EPHYS
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ReaderPool);
+#endif
+    };
+}
+
+#include "RWSyncReaderPool.ipp"
+
+#endif // RW_SYNC_READER_POOL_H_INCLUDED
@@ -0,0 +1,145 @@
+/*
+*  Copyright (C) 2019 Ethan Blackwood
+*  This is free software released under the MIT license.
+*  See attached LICENSE file for more details, or https://opensource.org/licenses/MIT.
+*/
+
+#include "RWSyncReaderPool.h"
+
+#include <cstddef>
+#include <functional>
+#include <stdexcept>
+#include <thread>
+
+namespace RWSync
+{
+    /***** ReaderPool *****/
+
+    template<typename Container, typename Ptr>
+    ReaderPool<Container, Ptr>::ReaderPool(Container& c, int size)
+        : container (c)
+        , size      (size)
+    {
+        if (size < 1)
+        {
+            throw new std::domain_error("Reader pool size must be at least 1");
+        }
+
+        slots.reset(new detail::Padded<Slot>[size]);
+    }
+
+
+    template<typename Container, typename Ptr>
+    typename ReaderPool<Container, Ptr>::Handle ReaderPool<Container, Ptr>::acquire()
+    {
+        // the probe starts at a slot picked by the thread's id (see the comment in the header)
+        int first = int(std::hash<std::thread::id>()(std::this_thread::get_id()) % std::size_t(size));
+        for (int k = 0; k < size; ++k)
+        {
+            int i = (first + k) % size;
+            if (!tryToClaim(i))
+            {
+                continue;
+            }
+
+            std::unique_ptr<Ptr>& ptr = slots[i].ptr;
+            if (!ptr)
+            {
+                // the constructor pulls (if it gets a reader)
+                ptr.reset(new Ptr(container));
+            }
+            else if (ptr->isValid())
+            {
+                ptr->pullUpdate();
+            }
+            else
+            {
+                ptr->tryToMakeValid();
+            }
+
+            return Handle(this, i);
+        }
+
+        return Handle(this, -1);
+    }
+
+
+    template<typename Container, typename Ptr>
+    void ReaderPool<Container, Ptr>::releaseIdle()
+    {
+        for (int i = 0; i < size; ++i)
+        {
+            if (tryToClaim(i))
+            {
+                slots[i].ptr.reset();
+                release(i);
+            }
+        }
+    }
+
+
+    template<typename Container, typename Ptr>
+    bool ReaderPool<Container, Ptr>::tryToClaim(int i)
+    {
+        // acquire: see what the last holder did with the pointer
+        std::atomic<bool>& inUse = slots[i].inUse;
+        return !inUse.load(std::memory_order_relaxed) && !inUse.exchange(true, std::memory_order_acquire);
+    }
+
+
+    template<typename Container, typename Ptr>
+    void ReaderPool<Container, Ptr>::release(int i)
+    {
+        slots[i].inUse.store(false, std::memory_order_release);
+    }
+
+    /***** ReaderPool::Handle *****/
+
+    template<typename Container, typename Ptr>
+    ReaderPool<Container, Ptr>::Handle::Handle(ReaderPool* p, int i)
+        : pool  (p)
+        , slot  (i)
+    {}
+
+
+    template<typename Container, typename Ptr>
+    ReaderPool<Container, Ptr>::Handle::Handle(Handle&& other)
+        : pool  (other.pool)
+        , slot  (other.slot)
+    {
+        other.slot = -1;
+    }
+
+
+    template<typename Container, typename Ptr>
+    ReaderPool<Container, Ptr>::Handle::~Handle()
+    {
+        if (slot != -1)
+        {
+            pool->release(slot);
+        }
+    }
+
+
+    template<typename Container, typename Ptr>
+    bool ReaderPool<Container, Ptr>::Handle::isValid() const
+    {
+        return slot != -1 && pool->slots[slot].ptr->isValid();
+    }
+
+
+    template<typename Container, typename Ptr>
+    Ptr& ReaderPool<Container, Ptr>::Handle::operator*() const
+    {
+        RWSYNC_CHECK_ACCESS(slot != -1, "Attempt to access an empty reader pool handle");
+
+        return *pool->slots[slot].ptr;
+    }
+
+
+    template<typename Container, typename Ptr>
+    Ptr* ReaderPool<Container, Ptr>::Handle::operator->() const
+    {
+        return &**this;
+    }
+}
@@ -0,0 +1,248 @@
+#ifndef RW_SYNC_RECONFIGURATION_H_INCLUDED
+#define RW_SYNC_RECONFIGURATION_H_INCLUDED
+
+/*
+ *  Copyright (C) 2019 Ethan Blackwood
+ *  This is free software released under the MIT license.
+ *  See attached LICENSE file for more details, or https://opensource.org/licenses/MIT.
+ */
+
+/*
+ * Support for incremental reconfiguration (Container<T>::reconfigure). Instead of locking everyone
+ * out to change each data instance at once (as map() does), each change is queued and applied to an
+ * instance when the writer takes it to write to. Readers never touch the queue, and the writer only
+ * locks its mutex while some instance hasn't received every change yet.
+ */
+
+#include "RWSyncDetail.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace RWSync
+{
+    namespace detail
+    {
+        template<typename T>
+        class ReconfigurationQueue
+        {
+        public:
+            // Nothing is allocated until the first change is added.
+            explicit ReconfigurationQueue(int nInstances)
+                : latest        (0)
+                , converged     (true)
+                , nInstances    (nInstances)
+                , nextPreferred (0)
+            {}
+
+            // Queues a change and returns its version (numbered from 1). The caller applies it
+            // to anything that future instances are copied from (under the lock used for
+            // addInstances()).
+            std::uint64_t add(std::function<void(T&)> f)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (versions.empty())
+                {
+                    versions.assign(nInstances, latest);
+                }
+
+                Entry entry = { ++latest, std::move(f) };
+                pending.push_back(std::move(entry));
+                converged.store(false, std::memory_order_relaxed);
+                return latest;
+            }
+
+            // Records that the instances from the current number up to newNumInstances were copied
+            // from something that already has every change.
+            void addInstances(int newNumInstances)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (newNumInstances > nInstances)
+                {
+                    nInstances = newNumInstances;
+                    if (!versions.empty())
+                    {
+                        versions.resize(newNumInstances, latest);
+                    }
+                }
+            }
+
+            // For the writer: apply every change that instance i hasn't received yet.
+            void apply(int i, T& instance)
+            {
+                // if this is out of date, the change will just be applied the next time
+                if (converged.load(std::memory_order_relaxed))
+                {
+                    return;
+                }
+
+                std::lock_guard<std::mutex> lock(mutex);
+                std::uint64_t& version = versions[i];
+                for (typename std::vector<Entry>::iterator it = pending.begin(); it != pending.end(); ++it)
+                {
+                    if (it->version > version)
+                    {
+                        it->f(instance);
+                    }
+                }
+                version = latest;
+                update();
+            }
+
+            // For the writer: whether source has received a change that dest hasn't (in which case
+            // dest shouldn't be patched with parts of source, and should get a full copy instead).
+            bool isAhead(int source, int dest) const
+            {
+                if (converged.load(std::memory_order_relaxed))
+                {
+                    return false;
+                }
+
+                std::lock_guard<std::mutex> lock(mutex);
+                return versions[source] > versions[dest];
+            }
+
+            // For the writer: dest is now a full copy of source.
+            void copied(int source, int dest)
+            {
+                if (converged.load(std::memory_order_relaxed))
+                {
+                    return;
+                }
+
+                std::lock_guard<std::mutex> lock(mutex);
+                versions[dest] = versions[source];
+                update();
+            }
+
+            // Records that each instance i for which pred(i) is true has every change (e.g. because
+            // it's not constructed yet, and will be copied from something that does). Under the lock
+            // used for add().
+            template<typename Predicate>
+            void markCurrentIf(Predicate pred)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                for (int i = 0; i < int(versions.size()); ++i)
+                {
+                    if (pred(i))
+                    {
+                        versions[i] = latest;
+                    }
+                }
+                update();
+            }
+
+            // For the writer: an instance that still needs a change, to take next if it's free
+            // (checking each such instance in turn), or -1 if all are up to date.
+            int preferredNext()
+            {
+                if (converged.load(std::memory_order_relaxed))
+                {
+                    return -1;
+                }
+
+                std::lock_guard<std::mutex> lock(mutex);
+                int n = int(versions.size());
+                for (int k = 0; k < n; ++k)
+                {
+                    int i = (nextPreferred + k) % n;
+                    if (versions[i] < latest)
+                    {
+                        nextPreferred = (i + 1) % n;
+                        return i;
+                    }
+                }
+                return -1;
+            }
+
+            // whether every instance has received the given change
+            bool isApplied(std::uint64_t version) const
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                return isAppliedLocked(version);
+            }
+
+            // Blocks until isApplied(version) or the deadline (if not null) passes.
+            bool wait(std::uint64_t version, const ParkedReaders::Clock::time_point* deadline)
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                if (deadline == nullptr)
+                {
+                    cv.wait(lock, [&]() { return isAppliedLocked(version); });
+                    return true;
+                }
+                return cv.wait_until(lock, *deadline, [&]() { return isAppliedLocked(version); });
+            }
+
+        private:
+            struct Entry
+            {
+                std::uint64_t version;
+                std::function<void(T&)> f;
+            };
+
+            bool isAppliedLocked(std::uint64_t version) const
+            {
+                return std::find_if(versions.begin(), versions.end(),
+                    [version](std::uint64_t v) { return v < version; }) == versions.end();
+            }
+
+            // after changing versions: forget changes that every instance has, and wake waiters
+            void update()
+            {
+                if (versions.empty())
+                {
+                    return; // no change was ever added
+                }
+
+                std::uint64_t oldest = *std::min_element(versions.begin(), versions.end());
+                typename std::vector<Entry>::iterator firstNeeded = pending.begin();
+                while (firstNeeded != pending.end() && firstNeeded->version <= oldest)
+                {
+                    ++firstNeeded;
+                }
+                pending.erase(pending.begin(), firstNeeded);
+
+                if (pending.empty())
+                {
+                    converged.store(true, std::memory_order_relaxed);
+                }
+                cv.notify_all();
+            }
+
+            mutable std::mutex mutex;
+            std::condition_variable cv;
+
+            std::uint64_t latest;               // version of the last change added
+            std::atomic<bool> converged;        // every instance has received every change (a hint,
+                                                // except while holding the mutex)
+
+            std::vector<Entry> pending;         // changes that some instance hasn't received, oldest first
+            int nInstances;
+            std::vector<std::uint64_t> versions; // by instance: last change it has received (empty
+                                                 // until the first change, while all have all 0 of them)
+            int nextPreferred;
+        };
+
+        // Same interface, for containers that don't support reconfiguration.
+        template<typename T>
+        class NoReconfigurations
+        {
+        public:
+            void apply(int, T&) {}
+
+            int preferredNext()
+            {
+                return -1;
+            }
+        };
+    }
+}
+
+#endif // RW_SYNC_RECONFIGURATION_H_INCLUDED
@@ -0,0 +1,124 @@
+#ifndef RW_SYNC_RING_CONTAINER_H_INCLUDED
+#define RW_SYNC_RING_CONTAINER_H_INCLUDED
+
+/*
+ *  Copyright (C) 2019 Ethan Blackwood
+ *  This is free software released under the MIT license.
+ *  See attached LICENSE file for more details, or https://opensource.org/licenses/MIT.
+ */
+
+#include "RWSyncContainer.h"
+#include "RWSyncRingManager.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Container that delivers every push to every reader, in order, instead of just the latest one
+ * (a single-producer, multi-consumer queue). The last `capacity` pushes are kept, and what happens
+ * when a reader falls that far behind is set by a Backpressure (see RingManager).
+ *
+ * Use RingContainer<T>::WritePtr and ::ReadPtr as with other containers: write in place and
+ * pushUpdate(), and on the reader's side, each pullUpdate() moves to the next push, so
+ *
+ *     while (rp.hasUpdate())
+ *     {
+ *         rp.pullUpdate();
+ *         process(*rp);
+ *     }
+ *
+ * consumes everything that has been pushed. With Backpressure::reportOverrun, check the write
+ * pointer's lastPushOverran() after pushing; the instance keeps what was written, so pushing it
+ * again later retries. Instances are reused, so the writer must overwrite (or clear) whatever it
+ * doesn't want the next reader of an instance to see. There's no history or reconfigure(); a
+ * reader's history is the pushes it hasn't pulled yet.
+ */
+
+namespace RWSync
+{
+    template<typename T, std::size_t alignment = RWSYNC_INSTANCE_ALIGNMENT>
+    class RingContainer
+    {
+    public:
+        // Keeps up to capacity pushes for up to maxReaders readers, initializing each of the
+        // capacity + maxReaders + 1 data instances with the given arguments.
+        template<typename... Args>
+        RingContainer(int capacity, int maxReaders, Backpressure policy, Args&&... args);
+
+        int numAllocatedReaders() const;
+        int getCapacity() const;
+
+        // Same as Container<T>::getStats
+        Stats getStats() const;
+
+        // Same as Container<T>::reset (also drops all pushes readers haven't pulled)
+        bool reset();
+
+        // Same as Container<T>::map and parallelMap (resets first)
+        template<typename UnaryOperator>
+        bool map(UnaryOperator f);
+
+        template<typename UnaryOperator>
+        bool parallelMap(UnaryOperator f, int nThreads = 0);
+
+        // Same as Container<T>::resetFor and mapFor
+        bool resetFor(std::chrono::nanoseconds timeout);
+
+        template<typename UnaryOperator>
+        bool mapFor(UnaryOperator f, std::chrono::nanoseconds timeout);
+
+        class WritePtr : public BasicWritePtr<T, RingContainer>
+        {
+        public:
+            explicit WritePtr(RingContainer& o);
+
+            WritePtr(WritePtr&& other);
+
+            // whether the last push was refused, and how many have been
+            // (see RingManager::WriteIndex::lastPushOverran)
+            bool lastPushOverran() const;
+            std::uint64_t numOverruns() const;
+        };
+
+        class ReadPtr : public BasicReadPtr<T, RingContainer>
+        {
+        public:
+            explicit ReadPtr(RingContainer& o);
+
+            ReadPtr(ReadPtr&& other);
+
+            // number of pushes this pointer hasn't pulled (see RingManager::ReadIndex::backlog)
+            std::uint64_t backlog() const;
+        };
+
+    private:
+        template<typename, typename> friend class BasicWritePtr;
+        template<typename, typename> friend class BasicReadPtr;
+
+        typedef RingManager ManagerType;
+
+        T* getInstance(int i);
+
+        // instances are always constructed
+        void prepareInstance(int) {}
+
+        template<typename UnaryOperator>
+        bool map(UnaryOperator f, const RingManager::Lockout& lock, int nThreads = 1);
+
+        RingManager manager;
+
+        detail::AlignedSegmentedStorage<T, alignment> data;
+
+        // readers go through every push, so there's no "latest" for a reconfiguration to apply to
+        detail::NoReconfigurations<T> reconfigurations;
+
+#ifdef OPEN_EPHYS
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(RingContainer);
+#endif
+    };
+}
+
+#include "RWSyncRingContainer.ipp"
+
+#endif // RW_SYNC_RING_CONTAINER_H_INCLUDED
@@ -0,0 +1,153 @@
+/*
+*  Copyright (C) 2019 Ethan Blackwood
+*  This is free software released under the MIT license.
+*  See attached LICENSE file for more details, or https://opensource.org/licenses/MIT.
+*/
+
+#include "RWSyncRingContainer.h"
+
+#include <utility>
+
+namespace RWSync
+{
+    template<typename T, std::size_t alignment>
+    template<typename... Args>
+    RingContainer<T, alignment>::RingContainer(int capacity, int maxReaders, Backpressure policy, Args&&... args)
+        : manager   (capacity, maxReaders, policy)
+        , data      (manager.getNumInstances(), MemoryResource::getDefault())
+    {
+        for (int i = 0; i < manager.getNumInstances(); ++i)
+        {
+            data.emplaceBack(args...);
+        }
+    }
+
+
+    template<typename T, std::size_t alignment>
+    int RingContainer<T, alignment>::numAllocatedReaders() const
+    {
+        return manager.getMaxReaders();
+    }
+
+
+    template<typename T, std::size_t alignment>
+    int RingContainer<T, alignment>::getCapacity() const
+    {
+        return manager.getCapacity();
+    }
+
+
+    template<typename T, std::size_t alignment>
+    Stats RingContainer<T, alignment>::getStats() const
+    {
+        return manager.getStats();
+    }
+
+
+    template<typename T, std::size_t alignment>
+    bool RingContainer<T, alignment>::reset()
+    {
+        return manager.reset();
+    }
+
+
+    template<typename T, std::size_t alignment>
+    template<typename UnaryOperator>
+    bool RingContainer<T, alignment>::map(UnaryOperator f)
+    {
+        RingManager::Lockout lock(manager);
+        return map(f, lock);
+    }
+
+
+    template<typename T, std::size_t alignment>
+    template<typename UnaryOperator>
+    bool RingContainer<T, alignment>::parallelMap(UnaryOperator f, int nThreads)
+    {
+        RingManager::Lockout lock(manager);
+        return map(f, lock, nThreads);
+    }
+
+
+    template<typename T, std::size_t alignment>
+    bool RingContainer<T, alignment>::resetFor(std::chrono::nanoseconds timeout)
+    {
+        RingManager::Lockout lock(manager, timeout);
+        return manager.reset(lock);
+    }
+
+
+    template<typename T, std::size_t alignment>
+    template<typename UnaryOperator>
+    bool RingContainer<T, alignment>::mapFor(UnaryOperator f, std::chrono::nanoseconds timeout)
+    {
+        RingManager::Lockout lock(manager, timeout);
+        return map(f, lock);
+    }
+
+
+    template<typename T, std::size_t alignment>
+    template<typename UnaryOperator>
+    bool RingContainer<T, alignment>::map(UnaryOperator f, const RingManager::Lockout& lock, int nThreads)
+    {
+        if (!manager.reset(lock))
+        {
+            return false;
+        }
+
+        detail::parallelFor(manager.getNumInstances(), nThreads, [&](int i) { f(data[i]); });
+        return true;
+    }
+
+
+    template<typename T, std::size_t alignment>
+    T* RingContainer<T, alignment>::getInstance(int i)
+    {
+        return &data[i];
+    }
+
+
+    template<typename T, std::size_t alignment>
+    RingContainer<T, alignment>::WritePtr::WritePtr(RingContainer& o)
+        : BasicWritePtr<T, RingContainer>(o)
+    {}
+
+
+    template<typename T, std::size_t alignment>
+    RingContainer<T, alignment>::WritePtr::WritePtr(WritePtr&& other)
+        : BasicWritePtr<T, RingContainer>(std::move(other))
+    {}
+
+
+    template<typename T, std::size_t alignment>
+    bool RingContainer<T, alignment>::WritePtr::lastPushOverran() const
+    {
+        return this->getIndex().lastPushOverran();
+    }
+
+
+    template<typename T, std::size_t alignment>
+    std::uint64_t RingContainer<T, alignment>::WritePtr::numOverruns() const
+    {
+        return this->getIndex().numOverruns();
+    }
+
+
+    template<typename T, std::size_t alignment>
+    RingContainer<T, alignment>::ReadPtr::ReadPtr(RingContainer& o)
+        : BasicReadPtr<T, RingContainer>(o)
+    {}
+
+
+    template<typename T, std::size_t alignment>
+    RingContainer<T, alignment>::ReadPtr::ReadPtr(ReadPtr&& other)
+        : BasicReadPtr<T, RingContainer>(std::move(other))
+    {}
+
+
+    template<typename T, std::size_t alignment>
+    std::uint64_t RingContainer<T, alignment>::ReadPtr::backlog() const
+    {
+        return this->getIndex().backlog();
+    }
+}
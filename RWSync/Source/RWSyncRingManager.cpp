@@ -0,0 +1,801 @@
+/*
+ *  Copyright (C) 2019 Ethan Blackwood
+ *  This is free software released under the MIT license.
+ *  See attached LICENSE file for more details, or https://opensource.org/licenses/MIT.
+ */
+
+// In header-only mode, this is included at the end of RWSyncRingManager.h.
+#ifndef RW_SYNC_RING_MANAGER_CPP_INCLUDED
+#define RW_SYNC_RING_MANAGER_CPP_INCLUDED
+
+#include "RWSyncRingManager.h"
+
+#include <cassert>
+#include <climits>
+#include <stdexcept>
+
+namespace RWSync
+{
+    ////// RingManager ///////
+
+    RWSYNC_INLINE RingManager::RingManager(int cap, int maxR, Backpressure p)
+        : capacity      (cap)
+        , maxReaders    (maxR)
+        , nInstances    (cap + maxR + 1)
+        , policy        (p)
+        , nWriters      (0)
+        , nReaders      (0)
+        , head          (0)
+        , generation    (0)
+    {
+        if (cap < 1 || maxR < 1 || cap > INT_MAX - maxR - 1)
+        {
+            throw new std::domain_error("Ring capacity and max readers must be at least 1, and the number of instances must fit in an int");
+        }
+
+        ring.reset(new std::atomic<int>[capacity]);
+        pins.reset(new detail::Padded<std::atomic<int>>[nInstances]);
+        info.reset(new InstanceInfo[nInstances]);
+        readers.reset(new detail::Padded<ReaderCursor>[maxReaders]);
+        writer.inRing.resize(nInstances);
+
+        reset();
+    }
+
+
+    RWSYNC_INLINE bool RingManager::reset()
+    {
+        Lockout lock(*this);
+        return reset(lock);
+    }
+
+
+    RWSYNC_INLINE bool RingManager::reset(const Lockout& existingLock)
+    {
+        if (!existingLock.isValidForManager(this))
+        {
+            return false;
+        }
+
+        head.store(0, std::memory_order_relaxed);
+        for (int s = 0; s < capacity; ++s)
+        {
+            ring[s].store(-1, std::memory_order_relaxed);
+        }
+
+        for (int i = 0; i < nInstances; ++i)
+        {
+            pins[i].store(0, std::memory_order_relaxed);
+            info[i].seq = 0;
+            info[i].pushTime.clear();
+            writer.inRing[i] = false;
+        }
+
+        for (int r = 0; r < maxReaders; ++r)
+        {
+            readers[r].next.store(0, std::memory_order_relaxed);
+        }
+
+        writer.index = 0;
+        pins[0].store(-1, std::memory_order_relaxed);
+        writer.nPushes = 0;
+        writer.minNext = 0;
+        writer.checkedGeneration = generation.load(std::memory_order_relaxed) - 1; // check on the first push
+        writer.overran = false;
+        writer.nOverruns = 0;
+        writer.nextFree = 1;
+
+        return true;
+    }
+
+
+    RWSYNC_INLINE int RingManager::getMaxReaders() const
+    {
+        return maxReaders;
+    }
+
+
+    RWSYNC_INLINE int RingManager::getCapacity() const
+    {
+        return capacity;
+    }
+
+
+    RWSYNC_INLINE Backpressure RingManager::getBackpressure() const
+    {
+        return policy;
+    }
+
+
+    RWSYNC_INLINE int RingManager::getNumInstances() const
+    {
+        return nInstances;
+    }
+
+
+    RWSYNC_INLINE Stats RingManager::getStats() const
+    {
+        return stats.snapshot();
+    }
+
+
+    RWSYNC_INLINE bool RingManager::checkoutWriter()
+    {
+        if (drainGate.mightBeClosed() || !claimWriter())
+        {
+            return false;
+        }
+
+        // see Manager::checkoutWriter
+        if (drainGate.isClosed())
+        {
+            returnWriter();
+            return false;
+        }
+
+        return true;
+    }
+
+
+    RWSYNC_INLINE bool RingManager::claimWriter()
+    {
+        int currWriters = 0;
+        return nWriters.compare_exchange_strong(currWriters, 1, std::memory_order_seq_cst);
+    }
+
+
+    RWSYNC_INLINE void RingManager::returnWriter()
+    {
+        int oldNWriters = nWriters.exchange(0, std::memory_order_seq_cst);
+        assert(oldNWriters == 1);
+        (void)oldNWriters;
+        drainGate.notifyReturned();
+    }
+
+
+    RWSYNC_INLINE int RingManager::checkoutReader()
+    {
+        if (drainGate.mightBeClosed())
+        {
+            return -1;
+        }
+
+        int currReaders = nReaders.load(std::memory_order_relaxed);
+        do
+        {
+            if (currReaders >= maxReaders)
+            {
+                return -1;
+            }
+        } while (!nReaders.compare_exchange_weak(currReaders, currReaders + 1, std::memory_order_seq_cst));
+
+        if (drainGate.isClosed())
+        {
+            nReaders.fetch_sub(1, std::memory_order_seq_cst);
+            drainGate.notifyReturned();
+            return -1;
+        }
+
+        // Each registered reader has a cursor and frees it before unregistering,
+        // so there's always one left for us.
+        for (int r = 0;; r = (r + 1) % maxReaders)
+        {
+            ReaderCursor& cursor = readers[r];
+            bool wasActive = false;
+            if (cursor.active.load(std::memory_order_relaxed)
+                || !cursor.active.compare_exchange_strong(wasActive, true, std::memory_order_seq_cst))
+            {
+                continue;
+            }
+
+            // Until we store our start below, the writer may see the last reader's next, which
+            // only makes it wait more. Once it sees the new generation (which it checks on every
+            // push), it rereads the cursors; if it read generation before we increment it, its
+            // last push is before our load of head, so it can't evict anything we want.
+            generation.fetch_add(1, std::memory_order_seq_cst);
+            cursor.next.store(head.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+            if (policy == Backpressure::block)
+            {
+                blockedWriter.notifyIfParked();
+            }
+            return r;
+        }
+    }
+
+
+    RWSYNC_INLINE void RingManager::returnReader(int slot)
+    {
+        readers[slot].active.store(false, std::memory_order_seq_cst);
+        if (policy == Backpressure::block)
+        {
+            blockedWriter.notifyIfParked();
+        }
+
+        int oldNReaders = nReaders.fetch_sub(1, std::memory_order_seq_cst);
+        assert(oldNReaders > 0);
+        (void)oldNReaders;
+        drainGate.notifyReturned();
+    }
+
+
+    RWSYNC_INLINE bool RingManager::claimAllReaders()
+    {
+        int currReaders = 0;
+        return nReaders.compare_exchange_strong(currReaders, maxReaders, std::memory_order_seq_cst);
+    }
+
+
+    RWSYNC_INLINE void RingManager::returnAllReaders()
+    {
+        int oldNReaders = nReaders.exchange(0, std::memory_order_seq_cst);
+        assert(oldNReaders == maxReaders);
+        (void)oldNReaders;
+        drainGate.notifyReturned();
+    }
+
+
+    RWSYNC_INLINE bool RingManager::hasRoomFor(std::uint64_t s)
+    {
+        if (s < std::uint64_t(capacity))
+        {
+            return true;
+        }
+
+        std::uint64_t evicted = s - capacity;
+        std::uint64_t gen = generation.load(std::memory_order_seq_cst);
+        if (gen == writer.checkedGeneration && evicted < writer.minNext)
+        {
+            return true;
+        }
+
+        // Readers only move forward, so the minimum stays a lower bound until a new one arrives.
+        writer.checkedGeneration = gen;
+        std::uint64_t minNext = ~std::uint64_t(0);
+        for (int r = 0; r < maxReaders; ++r)
+        {
+            const ReaderCursor& cursor = readers[r];
+            if (cursor.active.load(std::memory_order_seq_cst))
+            {
+                std::uint64_t next = cursor.next.load(std::memory_order_seq_cst);
+                if (next < minNext)
+                {
+                    minNext = next;
+                }
+            }
+        }
+
+        writer.minNext = minNext;
+        return evicted < minNext;
+    }
+
+
+    RWSYNC_INLINE bool RingManager::pushWrite()
+    {
+        std::uint64_t s = writer.nPushes;
+        if (policy == Backpressure::reportOverrun)
+        {
+            if (!hasRoomFor(s))
+            {
+                writer.overran = true;
+                ++writer.nOverruns;
+                return false;
+            }
+        }
+        else if (policy == Backpressure::block)
+        {
+            if (!hasRoomFor(s))
+            {
+                // readers notify after each pull and when they're returned
+                RingManager* m = this;
+                blockedWriter.wait([m, s]() { return m->hasRoomFor(s); }, nullptr);
+            }
+        }
+        else if (detail::StatsCounters::enabled && !hasRoomFor(s))
+        {
+            stats.countConflatedPush();
+        }
+
+        int slot = int(s % std::uint64_t(capacity));
+        int evicted = -1;
+        if (s >= std::uint64_t(capacity))
+        {
+            evicted = ring[slot].load(std::memory_order_relaxed);
+            writer.inRing[evicted] = false;
+        }
+
+        // A reader that finds our instance in the ring while looking for an older push
+        // can register on it (once we release it below), but then sees that the seq doesn't match.
+        int pushed = writer.index;
+        info[pushed].seq = s;
+        info[pushed].pushTime.stamp();
+        pins[pushed].store(0, std::memory_order_release);
+        ring[slot].store(pushed, std::memory_order_release);
+        writer.inRing[pushed] = true;
+
+        // seq_cst is required by ParkedReaders
+        head.store(s + 1, std::memory_order_seq_cst);
+        writer.nPushes = s + 1;
+        writer.overran = false;
+
+        claimFreeInstance(evicted);
+        parked.notifyIfParked();
+        return true;
+    }
+
+
+    RWSYNC_INLINE void RingManager::claimFreeInstance(int first)
+    {
+        // acquire: readers that were registered on the instance are done reading it
+        int expected = 0;
+        if (first != -1 && pins[first].compare_exchange_strong(expected, -1, std::memory_order_acquire))
+        {
+            writer.index = first;
+            stats.countPush(1);
+            return;
+        }
+
+        // Only capacity instances are in the ring and each reader is registered on at most one
+        // other, so one is always free (though readers may briefly register on one as they retry).
+        int nProbed = first != -1 ? 1 : 0;
+        for (int i = writer.nextFree;; i = (i + 1) % nInstances)
+        {
+            if (++nProbed % nInstances == 0)
+            {
+                detail::cpuRelax();
+            }
+
+            expected = 0;
+            if (!writer.inRing[i] && pins[i].compare_exchange_strong(expected, -1, std::memory_order_acquire))
+            {
+                writer.index = i;
+                writer.nextFree = (i + 1) % nInstances;
+                stats.countPush(nProbed);
+                return;
+            }
+        }
+    }
+
+
+    RWSYNC_INLINE bool RingManager::tryToPin(int index)
+    {
+        // acquire: see the writer's push of the instance
+        int currPins = pins[index].load(std::memory_order_relaxed);
+        while (currPins >= 0)
+        {
+            if (pins[index].compare_exchange_weak(currPins, currPins + 1, std::memory_order_acquire))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /***** WriteIndex *****/
+
+    RWSYNC_INLINE RingManager::WriteIndex::WriteIndex(RingManager& o)
+        : owner(o)
+        , valid(false)
+    {
+        tryToMakeValid();
+    }
+
+
+    RWSYNC_INLINE RingManager::WriteIndex::WriteIndex(WriteIndex&& other)
+        : owner(other.owner)
+        , valid(other.valid)
+    {
+        other.valid = false;
+    }
+
+
+    RWSYNC_INLINE RingManager::WriteIndex::~WriteIndex()
+    {
+        if (valid)
+        {
+            owner.returnWriter();
+        }
+    }
+
+
+    RWSYNC_INLINE bool RingManager::WriteIndex::tryToMakeValid()
+    {
+        if (!valid)
+        {
+            valid = owner.checkoutWriter();
+            if (!valid)
+            {
+                owner.stats.countFailedWriterCheckout();
+            }
+        }
+
+        return valid;
+    }
+
+
+    RWSYNC_INLINE bool RingManager::WriteIndex::isValid() const
+    {
+        return valid;
+    }
+
+
+    RWSYNC_INLINE RingManager::WriteIndex::operator int() const
+    {
+        if (valid)
+        {
+            return owner.writer.index;
+        }
+        return -1;
+    }
+
+
+    RWSYNC_INLINE void RingManager::WriteIndex::pushUpdate()
+    {
+        if (valid)
+        {
+            owner.pushWrite();
+        }
+    }
+
+
+    RWSYNC_INLINE void RingManager::WriteIndex::pushUpdate(int)
+    {
+        pushUpdate();
+    }
+
+
+    RWSYNC_INLINE bool RingManager::WriteIndex::latestWasPulled() const
+    {
+        if (!valid || owner.writer.nPushes == 0)
+        {
+            return false;
+        }
+
+        bool anyReaders = false;
+        for (int r = 0; r < owner.maxReaders; ++r)
+        {
+            const ReaderCursor& cursor = owner.readers[r];
+            if (cursor.active.load(std::memory_order_acquire))
+            {
+                if (cursor.next.load(std::memory_order_acquire) < owner.writer.nPushes)
+                {
+                    return false;
+                }
+                anyReaders = true;
+            }
+        }
+        return anyReaders;
+    }
+
+
+    RWSYNC_INLINE bool RingManager::WriteIndex::lastPushOverran() const
+    {
+        return valid && owner.writer.overran;
+    }
+
+
+    RWSYNC_INLINE std::uint64_t RingManager::WriteIndex::numOverruns() const
+    {
+        return valid ? owner.writer.nOverruns : 0;
+    }
+
+    /***** ReadIndex *****/
+
+    RWSYNC_INLINE RingManager::ReadIndex::ReadIndex(RingManager& o)
+        : owner     (o)
+        , slot      (-1)
+        , index     (-1)
+        , seq       (0)
+        , missed    (0)
+    {
+        tryToMakeValid();
+    }
+
+
+    RWSYNC_INLINE RingManager::ReadIndex::ReadIndex(ReadIndex&& other)
+        : owner     (other.owner)
+        , slot      (other.slot)
+        , index     (other.index)
+        , seq       (other.seq)
+        , missed    (other.missed)
+        , latency   (other.latency)
+    {
+        other.slot = -1;
+        other.index = -1;
+    }
+
+
+    RWSYNC_INLINE RingManager::ReadIndex::~ReadIndex()
+    {
+        if (slot != -1)
+        {
+            unpin();
+            owner.returnReader(slot);
+        }
+    }
+
+
+    RWSYNC_INLINE bool RingManager::ReadIndex::tryToMakeValid()
+    {
+        if (slot == -1)
+        {
+            // nothing to pull yet; we start at the next push
+            slot = owner.checkoutReader();
+            if (slot == -1)
+            {
+                owner.stats.countFailedReaderCheckout();
+            }
+        }
+
+        return slot != -1;
+    }
+
+
+    RWSYNC_INLINE bool RingManager::ReadIndex::isValid() const
+    {
+        return slot != -1;
+    }
+
+
+    RWSYNC_INLINE bool RingManager::ReadIndex::canRead() const
+    {
+        return index != -1;
+    }
+
+
+    RWSYNC_INLINE bool RingManager::ReadIndex::hasUpdate() const
+    {
+        return slot != -1 && owner.readers[slot].next.load(std::memory_order_relaxed)
+            < owner.head.load(std::memory_order_relaxed);
+    }
+
+
+    RWSYNC_INLINE void RingManager::ReadIndex::pullUpdate()
+    {
+        if (slot != -1)
+        {
+            bool gotUpdate = pullFrom(owner.readers[slot].next.load(std::memory_order_relaxed));
+            owner.stats.countPull(this, gotUpdate);
+            if (gotUpdate)
+            {
+                latency.record(owner.info[index].pushTime.get());
+            }
+            else
+            {
+                missed = 0;
+            }
+        }
+    }
+
+
+    RWSYNC_INLINE bool RingManager::ReadIndex::pullFrom(std::uint64_t want)
+    {
+        const std::uint64_t capacity = std::uint64_t(owner.capacity);
+        while (true)
+        {
+            // acquire: see the ring entries (and instances) of everything up to head
+            std::uint64_t h = owner.head.load(std::memory_order_acquire);
+            if (want >= h)
+            {
+                return false;
+            }
+
+            // we'll get something, so we're done with what we had
+            unpin();
+
+            std::uint64_t n = h - want > capacity ? h - capacity : want;
+            int i = owner.ring[n % capacity].load(std::memory_order_acquire);
+            if (!owner.tryToPin(i))
+            {
+                // just being rewritten, so n has been evicted
+                continue;
+            }
+
+            // If the writer has reused the instance since we read the ring, its seq is newer,
+            // and it can't change now that we're registered on it (the writer needs it to be free).
+            if (owner.info[i].seq != n)
+            {
+                owner.pins[i].fetch_sub(1, std::memory_order_release);
+                continue;
+            }
+
+            index = i;
+            seq = n;
+            missed = n - want;
+
+            // seq_cst is required by ParkedReaders (for the writer, if it's blocked)
+            owner.readers[slot].next.store(n + 1, std::memory_order_seq_cst);
+            if (owner.policy == Backpressure::block)
+            {
+                owner.blockedWriter.notifyIfParked();
+            }
+            return true;
+        }
+    }
+
+
+    RWSYNC_INLINE void RingManager::ReadIndex::unpin()
+    {
+        if (index != -1)
+        {
+            // release: we're done reading it before the writer can take it
+            owner.pins[index].fetch_sub(1, std::memory_order_release);
+            index = -1;
+        }
+    }
+
+
+    RWSYNC_INLINE bool RingManager::ReadIndex::waitForUpdate()
+    {
+        if (slot == -1)
+        {
+            return false;
+        }
+
+        return owner.parked.wait([this]() { return hasUpdate(); }, nullptr);
+    }
+
+
+    RWSYNC_INLINE bool RingManager::ReadIndex::waitForUpdateFor(std::chrono::nanoseconds timeout)
+    {
+        if (slot == -1)
+        {
+            return false;
+        }
+
+        detail::ParkedReaders::Clock::time_point deadline = detail::ParkedReaders::deadlineAfter(timeout);
+        return owner.parked.wait([this]() { return hasUpdate(); }, &deadline);
+    }
+
+
+    RWSYNC_INLINE bool RingManager::ReadIndex::parkUntilUpdate(detail::AsyncWaiter& w)
+    {
+        if (slot == -1)
+        {
+            return false;
+        }
+
+        return owner.parked.park(w, [this]() { return hasUpdate(); });
+    }
+
+
+    RWSYNC_INLINE void RingManager::ReadIndex::unpark(detail::AsyncWaiter& w)
+    {
+        owner.parked.unpark(w);
+    }
+
+
+    RWSYNC_INLINE RingManager::ReadIndex::operator int() const
+    {
+        return index;
+    }
+
+
+    RWSYNC_INLINE std::uint64_t RingManager::ReadIndex::version() const
+    {
+        return canRead() ? seq + 1 : 0;
+    }
+
+
+    RWSYNC_INLINE std::uint64_t RingManager::ReadIndex::missedSinceLastPull() const
+    {
+        return slot != -1 ? missed : 0;
+    }
+
+
+    RWSYNC_INLINE std::uint64_t RingManager::ReadIndex::backlog() const
+    {
+        if (slot == -1)
+        {
+            return 0;
+        }
+
+        std::uint64_t next = owner.readers[slot].next.load(std::memory_order_relaxed);
+        std::uint64_t h = owner.head.load(std::memory_order_relaxed);
+        return h > next ? h - next : 0;
+    }
+
+
+    RWSYNC_INLINE detail::PushClock::time_point RingManager::ReadIndex::pushTime() const
+    {
+        return canRead() ? owner.info[index].pushTime.get() : detail::PushClock::time_point();
+    }
+
+
+    RWSYNC_INLINE std::chrono::nanoseconds RingManager::ReadIndex::age() const
+    {
+        return detail::ageOf(pushTime());
+    }
+
+
+    RWSYNC_INLINE LatencyHistogram RingManager::ReadIndex::getLatencyHistogram() const
+    {
+        return latency.snapshot();
+    }
+
+    /***** RingManager::Lockout *****/
+
+    RWSYNC_INLINE RingManager::Lockout::Lockout(RingManager& o)
+        : owner         (o)
+        , hasReadLock   (o.claimAllReaders())
+        , hasWriteLock  (o.checkoutWriter()) // fails while a draining Lockout is waiting or held
+        , valid         (hasReadLock && hasWriteLock)
+        , draining      (false)
+    {
+        if (!valid)
+        {
+            owner.stats.countFailedLockout();
+        }
+    }
+
+
+    RWSYNC_INLINE RingManager::Lockout::Lockout(RingManager& o, std::chrono::nanoseconds timeout)
+        : owner         (o)
+        , hasReadLock   (false)
+        , hasWriteLock  (false)
+        , valid         (false)
+        , draining      (true)
+    {
+        owner.drainGate.close();
+
+        detail::ParkedReaders::Clock::time_point deadline = detail::ParkedReaders::deadlineAfter(timeout);
+        RingManager* m = &owner;
+        auto isDrained = [m]()
+        {
+            return m->nReaders.load(std::memory_order_relaxed) == 0
+                && m->nWriters.load(std::memory_order_relaxed) == 0;
+        };
+
+        // see Manager::Lockout
+        while (owner.drainGate.wait(isDrained, &deadline))
+        {
+            hasReadLock = owner.claimAllReaders();
+            hasWriteLock = hasReadLock && owner.claimWriter();
+            if (hasWriteLock)
+            {
+                valid = true;
+                return;
+            }
+
+            if (hasReadLock)
+            {
+                owner.returnAllReaders();
+                hasReadLock = false;
+            }
+        }
+
+        owner.stats.countFailedLockout();
+    }
+
+
+    RWSYNC_INLINE RingManager::Lockout::~Lockout()
+    {
+        if (hasReadLock)
+        {
+            owner.returnAllReaders();
+        }
+
+        if (hasWriteLock)
+        {
+            owner.returnWriter();
+        }
+
+        if (draining)
+        {
+            owner.drainGate.open();
+        }
+    }
+
+
+    RWSYNC_INLINE bool RingManager::Lockout::isValid() const
+    {
+        return valid;
+    }
+
+
+    RWSYNC_INLINE bool RingManager::Lockout::isValidForManager(const RingManager* expected) const
+    {
+        return valid && expected == &owner;
+    }
+}
+
+#endif // RW_SYNC_RING_MANAGER_CPP_INCLUDED
@@ -0,0 +1,329 @@
+#ifndef RW_SYNC_RING_MANAGER_H_INCLUDED
+#define RW_SYNC_RING_MANAGER_H_INCLUDED
+
+/*
+ *  Copyright (C) 2019 Ethan Blackwood
+ *  This is free software released under the MIT license.
+ *  See attached LICENSE file for more details, or https://opensource.org/licenses/MIT.
+ */
+
+#include "RWSyncManager.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/*
+ * Replacement for RWSync::Manager (used by RingContainer) for when readers must see every push,
+ * not just the latest one. The last `capacity` pushes are kept in a ring, and each reader has its
+ * own cursor: pullUpdate() takes the oldest push that reader hasn't pulled yet, so pulling until
+ * hasUpdate() is false goes through all of them in order.
+ *
+ * There are capacity + maxReaders + 1 instances: the ones in the ring, the one each reader is
+ * reading (which may already have left the ring) and the writer's. Each instance has a count of
+ * the readers on it, as in Manager, so the writer never takes one that's being read; the ring
+ * itself is only an array of instance indices, written by the writer and published by the count
+ * of pushes ("head").
+ *
+ * A push evicts the push made `capacity` pushes before it. What happens when some reader hasn't
+ * pulled that one yet depends on the Backpressure given to the constructor:
+ *  - block: the writer waits (spinning, then sleeping) until the reader pulls it or is returned.
+ *  - dropOldest: it's evicted anyway; the reader skips ahead to the oldest push still in the ring
+ *    and missedSinceLastPull() says how many it lost.
+ *  - reportOverrun: the push doesn't happen. The write index keeps the same instance (with what
+ *    was written to it), and lastPushOverran() is true until a push succeeds.
+ * In the first and last cases, no reader ever misses a push made after it was checked out.
+ *
+ * A reader starts at the next push after it's checked out; pushes made before then aren't
+ * delivered to it. Its cursor doesn't outlive it, so unlike Manager, a new ReadIndex doesn't
+ * continue where the last one left off.
+ */
+
+namespace RWSync
+{
+    // What a RingManager's writer does when the push it would evict hasn't been pulled by every reader.
+    enum class Backpressure
+    {
+        block,
+        dropOldest,
+        reportOverrun
+    };
+
+
+    class RWSYNC_API RingManager
+    {
+    public:
+        class Lockout;
+
+        // Keeps the last capacity (>= 1) pushes for up to maxReaders (>= 1) readers.
+        // Throws a new std::domain_error if either is out of range.
+        RingManager(int capacity, int maxReaders, Backpressure policy);
+
+        // Reset to state with no pushes
+        // No readers or writers should be active when this is called!
+        // If it does fail due to existing readers or writers, returns false
+        bool reset();
+
+        // Use this call if you already have a valid Lockout for doing other operations
+        bool reset(const Lockout& existingLock);
+
+        int getMaxReaders() const;
+        int getCapacity() const;
+        Backpressure getBackpressure() const;
+
+        // number of data instances (capacity + maxReaders + 1)
+        int getNumInstances() const;
+
+        // Snapshot of the hot-path counters (all zero unless RWSYNC_STATS is defined; see RWSyncStats.h).
+        // conflatedPushes counts pushes evicted before some reader pulled them (only with dropOldest).
+        // Can be called at any time from any thread.
+        Stats getStats() const;
+
+        class RWSYNC_API WriteIndex
+        {
+        public:
+            explicit WriteIndex(RingManager& o);
+
+            // Takes over other's checkout (if it has one), leaving other invalid.
+            WriteIndex(WriteIndex&& other);
+
+            ~WriteIndex();
+
+            // tries to claim writer status if we don't have it
+            // already - returns true if the write index is now valid.
+            bool tryToMakeValid();
+
+            // is there actually a place to write?
+            bool isValid() const;
+
+            // index to access the correct data instance
+            operator int() const;
+
+            // Push a finished write into the ring (see Backpressure) and take a free instance to
+            // write next. With Backpressure::block, may wait for readers to catch up.
+            void pushUpdate();
+
+            // For compatibility with Manager::WriteIndex::pushUpdate(int); the next instance is
+            // always whichever one is free.
+            void pushUpdate(int preferredNext);
+
+            // whether every reader has pulled the last push (false if there are no readers)
+            bool latestWasPulled() const;
+
+            // With Backpressure::reportOverrun: whether the last pushUpdate() was refused because
+            // a reader was a whole ring behind, and how many have been refused since the last reset.
+            // Always false and 0 with the other policies.
+            bool lastPushOverran() const;
+            std::uint64_t numOverruns() const;
+
+        private:
+            RingManager& owner;
+            bool valid;
+
+            WriteIndex(const WriteIndex&);
+            WriteIndex& operator=(const WriteIndex&);
+        };
+
+
+        class RWSYNC_API ReadIndex
+        {
+        public:
+            explicit ReadIndex(RingManager& o);
+
+            // see WriteIndex
+            ReadIndex(ReadIndex&& other);
+
+            ~ReadIndex();
+
+            // tries to claim reader status if we don't have it
+            // already - returns true if the read index is now valid.
+            bool tryToMakeValid();
+
+            // check whether the reader has been checked out successfully
+            bool isValid() const;
+
+            // check whether the reader has pulled a push yet
+            bool canRead() const;
+
+            // check whether there's a push this reader hasn't pulled
+            bool hasUpdate() const;
+
+            // move to the next push this reader hasn't pulled, if there is one
+            void pullUpdate();
+
+            // see Manager::ReadIndex::waitForUpdate(For)
+            bool waitForUpdate();
+            bool waitForUpdateFor(std::chrono::nanoseconds timeout);
+
+            // see Manager::ReadIndex::parkUntilUpdate and unpark
+            bool parkUntilUpdate(detail::AsyncWaiter& w);
+            void unpark(detail::AsyncWaiter& w);
+
+            // index to access the correct data instance
+            operator int() const;
+
+            // Version of the push we're reading (1 for the first push after a reset) and number of
+            // pushes that were evicted before the last pullUpdate could get them (see Backpressure).
+            std::uint64_t version() const;
+            std::uint64_t missedSinceLastPull() const;
+
+            // number of pushes not pulled yet (some may have been evicted, with dropOldest)
+            std::uint64_t backlog() const;
+
+            // see Manager::ReadIndex::pushTime, age and getLatencyHistogram
+            std::chrono::steady_clock::time_point pushTime() const;
+            std::chrono::nanoseconds age() const;
+            LatencyHistogram getLatencyHistogram() const;
+
+        private:
+            // Moves to push seq or, if it has been evicted, the oldest one still in the ring.
+            // Returns false if there are no pushes from seq on.
+            bool pullFrom(std::uint64_t seq);
+
+            void unpin();
+
+            RingManager& owner;
+            int slot;           // our cursor in owner.readers, or -1 if invalid
+            int index;          // instance we're reading, or -1 if none
+            std::uint64_t seq;  // its push number (0-based)
+            std::uint64_t missed;
+            detail::LatencyCounters latency;
+
+            ReadIndex(const ReadIndex&);
+            ReadIndex& operator=(const ReadIndex&);
+        };
+
+
+        // Registers as the writer and all the readers, so no other reader or writer
+        // can exist while it's held. Use to access all the underlying data without
+        // concern for who has access to what, e.g. for updating settings.
+        class RWSYNC_API Lockout
+        {
+        public:
+            explicit Lockout(RingManager& o);
+
+            // Draining version; see Manager::Lockout.
+            Lockout(RingManager& o, std::chrono::nanoseconds timeout);
+
+            ~Lockout();
+
+            bool isValid() const;
+
+            bool isValidForManager(const RingManager* expected) const;
+
+        private:
+            RingManager& owner;
+            bool hasReadLock;
+            bool hasWriteLock;
+            bool valid;
+            const bool draining;
+        };
+
+    private:
+        // Registers the writer. If one already exists, returns false, else
+        // returns true. returnWriter should be called to release.
+        // Also fails while a draining Lockout is waiting or held.
+        bool checkoutWriter();
+        void returnWriter();
+
+        // Registers a reader and gives it a cursor, returning its index in readers,
+        // or -1 if there are already maxReaders (or a draining Lockout).
+        int checkoutReader();
+        void returnReader(int slot);
+
+        // the same for all the readers at once, ignoring draining Lockouts (for use by one)
+        bool claimWriter();
+        bool claimAllReaders();
+        void returnAllReaders();
+
+        // Pushes the writer's instance into the ring and takes a free one, returning false
+        // (and doing nothing) if it would overrun a reader with Backpressure::reportOverrun.
+        // Should only ever be called by the writer.
+        bool pushWrite();
+
+        // Whether the push at seq can be made without evicting a push some reader hasn't pulled.
+        bool hasRoomFor(std::uint64_t seq);
+
+        // Takes any instance that is neither in the ring nor being read, trying the given one first.
+        void claimFreeInstance(int first);
+
+        // whether the instance at index could be registered on and was
+        bool tryToPin(int index);
+
+        struct ReaderCursor
+        {
+            ReaderCursor() : active(false), next(0) {}
+
+            std::atomic<bool> active;
+            // First push this reader hasn't pulled. While a reader is being checked out, it may
+            // still be its predecessor's, which is never later than the new reader's start.
+            std::atomic<std::uint64_t> next;
+        };
+
+        // Only accessed by the writer (or a Lockout).
+        struct WriterState
+        {
+            int index;
+            std::uint64_t nPushes;
+            std::uint64_t minNext;          // lower bound on readers' next, as of the last check
+            std::uint64_t checkedGeneration;
+            bool overran;
+            std::uint64_t nOverruns;
+            int nextFree;                   // where to start looking for a free instance
+            std::vector<bool> inRing;       // by instance
+        };
+
+        // Written by the writer before pushing an instance, and read by readers registered on it.
+        struct InstanceInfo
+        {
+            std::uint64_t seq;
+            detail::PushTime pushTime;
+        };
+
+        const int capacity;
+        const int maxReaders;
+        const int nInstances;
+        const Backpressure policy;
+
+        // as in Manager, everything that is modified by different threads is on its own cache line
+        detail::Padded<std::atomic<int>> nWriters;
+        detail::Padded<std::atomic<int>> nReaders;
+
+        detail::DrainGate drainGate;
+
+        // number of pushes since the last reset; push s is in ring[s % capacity] while s + capacity >= head
+        detail::Padded<std::atomic<std::uint64_t>> head;
+
+        // incremented whenever a reader is checked out, so the writer knows to check readers' cursors
+        detail::Padded<std::atomic<std::uint64_t>> generation;
+
+        std::unique_ptr<std::atomic<int>[]> ring;
+
+        // by instance: number of readers registered, or -1 if it's the writer's
+        std::unique_ptr<detail::Padded<std::atomic<int>>[]> pins;
+        std::unique_ptr<InstanceInfo[]> info;
+
+        std::unique_ptr<detail::Padded<ReaderCursor>[]> readers;
+
+        detail::Padded<WriterState> writer;
+
+        detail::StatsCounters stats;
+
+        // readers sleeping in waitForUpdate; the writer wakes them after each push
+        detail::ParkedReaders parked;
+
+        // the writer, sleeping in pushUpdate for readers to catch up (with Backpressure::block)
+        detail::ParkedReaders blockedWriter;
+
+#ifdef OPEN_EPHYS
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(RingManager);
+#endif
+    };
+}
+
+#ifdef RWSYNC_HEADER_ONLY
+#include "RWSyncRingManager.cpp"
+#endif
+
+#endif // RW_SYNC_RING_MANAGER_H_INCLUDED
@@ -0,0 +1,200 @@
+#ifndef RW_SYNC_SEQLOCK_CONTAINER_H_INCLUDED
+#define RW_SYNC_SEQLOCK_CONTAINER_H_INCLUDED
+
+/*
+ *  Copyright (C) 2019 Ethan Blackwood
+ *  This is free software released under the MIT license.
+ *  See attached LICENSE file for more details, or https://opensource.org/licenses/MIT.
+ */
+
+#include "RWSyncAccess.h"
+#include "RWSyncAwait.h"
+#include "RWSyncDetail.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+// Largest type (in bytes) that a SeqlockContainer may hold. Each pull copies the whole value,
+// so this should stay small.
+#ifndef RWSYNC_SEQLOCK_MAX_SIZE
+#define RWSYNC_SEQLOCK_MAX_SIZE 256
+#endif
+
+/*
+ * Alternative to the manager-based containers for small, trivially copyable types (e.g. a few
+ * numbers that are updated together). Instead of each reader registering as a reader of one
+ * of several instances, there is one shared copy guarded by a sequence counter: the writer makes
+ * the counter odd while it's copying in a new value, and readers copy the value out and retry if
+ * the counter was odd or changed while they were copying. Each reader keeps its own copy, so
+ * (unlike normal containers):
+ *
+ *  - Readers never write to shared memory, so they don't slow down each other or the writer.
+ *  - There is no limit on the number of readers; a ReadPtr is always valid.
+ *  - Pulling costs a copy of the whole value.
+ *  - A reader that pulls while the writer is in the middle of pushing waits for the push
+ *    to finish (the writer never waits for readers).
+ *
+ * Use SeqlockContainer<T>::WritePtr and ::ReadPtr, which have the same interface as
+ * the container WritePtr and ReadPtr.
+ */
+
+namespace RWSync
+{
+    template<typename T>
+    class SeqlockContainer
+    {
+        static_assert(std::is_trivially_copyable<T>::value,
+            "SeqlockContainer can only hold trivially copyable types");
+        static_assert(sizeof(T) <= RWSYNC_SEQLOCK_MAX_SIZE,
+            "Type is too large for SeqlockContainer (see RWSYNC_SEQLOCK_MAX_SIZE)");
+
+    public:
+        // Initializes the writer's copy with the given arguments. Readers can't read
+        // anything until it has been pushed.
+        template<typename... Args>
+        explicit SeqlockContainer(Args&&... args);
+
+        class WritePtr
+        {
+        public:
+            typedef T element_type;
+
+            explicit WritePtr(SeqlockContainer& o);
+
+            // Takes over other's writer status (if valid), leaving other invalid. Can't be copied.
+            WritePtr(WritePtr&& other);
+
+            ~WritePtr();
+
+            // there can only be one writer at a time
+            bool tryToMakeValid();
+
+            // verify that we actually have a place to write
+            bool isValid() const;
+
+            // Provide access to the writer's copy, which keeps its contents between pushes
+            // (and between write pointers).
+            operator T*();
+            T& operator*();
+            T* operator->();
+
+            // copy the writer's copy to readers
+            void pushUpdate();
+
+        private:
+            SeqlockContainer& owner;
+            bool valid;
+
+            WritePtr(const WritePtr&);
+            WritePtr& operator=(const WritePtr&);
+        };
+
+        class ReadPtr
+        {
+        public:
+            typedef T element_type;
+
+            explicit ReadPtr(SeqlockContainer& o);
+
+            // always true; provided for compatibility with other read pointers
+            bool tryToMakeValid();
+            bool isValid() const;
+
+            // verify that we actually have something to read (i.e. there has been a push)
+            bool canRead() const;
+
+            // check if there's an update available
+            bool hasUpdate() const;
+
+            // copy the latest data from the writer into this pointer's copy
+            void pullUpdate();
+
+            // block until there's an update available (see Manager::ReadIndex::waitForUpdate)
+            bool waitForUpdate();
+
+            // same, but give up after the timeout; returns hasUpdate()
+            bool waitForUpdateFor(std::chrono::nanoseconds timeout);
+
+#if RWSYNC_COROUTINES
+            // see BasicReadPtr::nextUpdate
+            template<typename Schedule>
+            UpdateAwaiter<ReadPtr, Schedule> nextUpdate(Schedule schedule);
+#endif
+
+            // see Manager::ReadIndex::parkUntilUpdate and unpark
+            bool parkUntilUpdate(detail::AsyncWaiter& w);
+            void unpark(detail::AsyncWaiter& w);
+
+            // number of pushes before the one we have a copy of (0 = none), and number of pushes
+            // skipped by the last pullUpdate (see Manager::ReadIndex::version)
+            std::uint64_t version() const;
+            std::uint64_t missedSinceLastPull() const;
+
+            // provide access to this pointer's copy
+            operator T*();
+            T& operator*();
+            T* operator->();
+
+        private:
+            SeqlockContainer& owner;
+
+            // sequence number of the push that we have a copy of (0 = none)
+            std::size_t seen;
+            std::uint64_t missed;
+
+            typename std::aligned_storage<sizeof(T), std::alignment_of<T>::value>::type value;
+        };
+
+        // A ReadPtr can always be created, so there's nothing more to guarantee.
+        typedef ReadPtr GuaranteedReadPtr;
+
+    private:
+        typedef std::size_t Word;
+        static const std::size_t nWords = (sizeof(T) + sizeof(Word) - 1) / sizeof(Word);
+
+        bool checkoutWriter();
+        void returnWriter();
+
+        // Copies out the value if there is a completed push newer than `seen`; returns the
+        // new sequence number if so, else `seen`.
+        std::size_t copyLatest(std::size_t seen, void* dest) const;
+
+        // odd while the writer is copying in; otherwise, twice the number of pushes
+        static bool isWriting(std::size_t sequence);
+
+        // The value is stored as atomic words so that readers copying it out while
+        // it's being written is not a data race.
+        struct Shared
+        {
+            std::atomic<std::size_t> sequence;
+            std::atomic<Word> words[nWords];
+        };
+
+        struct WriterState
+        {
+            template<typename... Args>
+            explicit WriterState(Args&&... args) : value(std::forward<Args>(args)...) {}
+
+            T value;
+        };
+
+        detail::Padded<std::atomic<int>> nWriters;
+        detail::Padded<WriterState> writer;
+        detail::Padded<Shared> shared;
+
+        // readers sleeping in waitForUpdate; the writer wakes them after each push
+        detail::ParkedReaders parked;
+
+#ifdef OPEN_EPHYS
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SeqlockContainer);
+#endif
+    };
+}
+
+#include "RWSyncSeqlockContainer.ipp"
+
+#endif // RW_SYNC_SEQLOCK_CONTAINER_H_INCLUDED
@@ -0,0 +1,317 @@
+/*
+*  Copyright (C) 2019 Ethan Blackwood
+*  This is free software released under the MIT license.
+*  See attached LICENSE file for more details, or https://opensource.org/licenses/MIT.
+*/
+
+#include "RWSyncSeqlockContainer.h"
+
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+namespace RWSync
+{
+    template<typename T>
+    template<typename... Args>
+    SeqlockContainer<T>::SeqlockContainer(Args&&... args)
+        : nWriters  (0)
+        , writer    (WriterState(std::forward<Args>(args)...))
+    {
+        shared.sequence.store(0, std::memory_order_relaxed);
+        for (std::size_t i = 0; i < nWords; ++i)
+        {
+            shared.words[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+
+    template<typename T>
+    bool SeqlockContainer<T>::checkoutWriter()
+    {
+        int currWriters = 0;
+        return nWriters.compare_exchange_strong(currWriters, 1, std::memory_order_acquire);
+    }
+
+
+    template<typename T>
+    void SeqlockContainer<T>::returnWriter()
+    {
+        int oldNWriters = nWriters.exchange(0, std::memory_order_release);
+        assert(oldNWriters == 1);
+        (void)oldNWriters;
+    }
+
+
+    template<typename T>
+    bool SeqlockContainer<T>::isWriting(std::size_t sequence)
+    {
+        return (sequence & 1) != 0;
+    }
+
+
+    template<typename T>
+    std::size_t SeqlockContainer<T>::copyLatest(std::size_t seen, void* dest) const
+    {
+        Word buffer[nWords];
+
+        while (true)
+        {
+            // acquire: see the words of the push that completed with this sequence number
+            std::size_t before = shared.sequence.load(std::memory_order_acquire);
+            if ((before & ~std::size_t(1)) == seen)
+            {
+                // nothing new has been completely pushed
+                return seen;
+            }
+
+            if (!isWriting(before))
+            {
+                for (std::size_t i = 0; i < nWords; ++i)
+                {
+                    buffer[i] = shared.words[i].load(std::memory_order_relaxed);
+                }
+
+                // acquire: if any word we loaded is from a later push, we see its odd sequence number
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (shared.sequence.load(std::memory_order_relaxed) == before)
+                {
+                    std::memcpy(dest, buffer, sizeof(T));
+                    return before;
+                }
+            }
+
+            detail::cpuRelax();
+        }
+    }
+
+    /***** WritePtr *****/
+
+    template<typename T>
+    SeqlockContainer<T>::WritePtr::WritePtr(SeqlockContainer& o)
+        : owner (o)
+        , valid (false)
+    {
+        tryToMakeValid();
+    }
+
+
+    template<typename T>
+    SeqlockContainer<T>::WritePtr::WritePtr(WritePtr&& other)
+        : owner (other.owner)
+        , valid (other.valid)
+    {
+        other.valid = false;
+    }
+
+
+    template<typename T>
+    SeqlockContainer<T>::WritePtr::~WritePtr()
+    {
+        if (valid)
+        {
+            owner.returnWriter();
+        }
+    }
+
+
+    template<typename T>
+    bool SeqlockContainer<T>::WritePtr::tryToMakeValid()
+    {
+        if (!valid)
+        {
+            valid = owner.checkoutWriter();
+        }
+
+        return valid;
+    }
+
+
+    template<typename T>
+    bool SeqlockContainer<T>::WritePtr::isValid() const
+    {
+        return valid;
+    }
+
+
+    template<typename T>
+    SeqlockContainer<T>::WritePtr::operator T*()
+    {
+        RWSYNC_CHECK_ACCESS(valid, "Invalid write pointer");
+
+        return &owner.writer.value;
+    }
+
+
+    template<typename T>
+    T& SeqlockContainer<T>::WritePtr::operator*()
+    {
+        return *static_cast<T*>(*this);
+    }
+
+
+    template<typename T>
+    T* SeqlockContainer<T>::WritePtr::operator->()
+    {
+        return static_cast<T*>(*this);
+    }
+
+
+    template<typename T>
+    void SeqlockContainer<T>::WritePtr::pushUpdate()
+    {
+        if (!valid)
+        {
+            return;
+        }
+
+        Word buffer[nWords];
+        buffer[nWords - 1] = 0; // in case T doesn't fill the last word
+        std::memcpy(buffer, &owner.writer.value, sizeof(T));
+
+        Shared& shared = owner.shared;
+        std::size_t sequence = shared.sequence.load(std::memory_order_relaxed);
+        shared.sequence.store(sequence + 1, std::memory_order_relaxed);
+
+        // release: a reader that sees any of the new words also sees the odd sequence number
+        std::atomic_thread_fence(std::memory_order_release);
+        for (std::size_t i = 0; i < nWords; ++i)
+        {
+            shared.words[i].store(buffer[i], std::memory_order_relaxed);
+        }
+
+        // release for readers; seq_cst as required by ParkedReaders
+        shared.sequence.store(sequence + 2, std::memory_order_seq_cst);
+
+        owner.parked.notifyIfParked();
+    }
+
+    /***** ReadPtr *****/
+
+    template<typename T>
+    SeqlockContainer<T>::ReadPtr::ReadPtr(SeqlockContainer& o)
+        : owner (o)
+        , seen  (0)
+        , missed(0)
+    {
+        pullUpdate();
+    }
+
+
+    template<typename T>
+    bool SeqlockContainer<T>::ReadPtr::tryToMakeValid()
+    {
+        return true;
+    }
+
+
+    template<typename T>
+    bool SeqlockContainer<T>::ReadPtr::isValid() const
+    {
+        return true;
+    }
+
+
+    template<typename T>
+    bool SeqlockContainer<T>::ReadPtr::canRead() const
+    {
+        return seen != 0;
+    }
+
+
+    template<typename T>
+    bool SeqlockContainer<T>::ReadPtr::hasUpdate() const
+    {
+        // an odd sequence number means the push after sequence - 1 is in progress
+        std::size_t sequence = owner.shared.sequence.load(std::memory_order_relaxed);
+        return (sequence & ~std::size_t(1)) != seen;
+    }
+
+
+    template<typename T>
+    void SeqlockContainer<T>::ReadPtr::pullUpdate()
+    {
+        std::size_t oldSeen = seen;
+        seen = owner.copyLatest(seen, &value);
+
+        // each push adds 2 to the sequence number
+        missed = seen == oldSeen ? 0 : (seen - oldSeen) / 2 - 1;
+    }
+
+
+    template<typename T>
+    bool SeqlockContainer<T>::ReadPtr::waitForUpdate()
+    {
+        return owner.parked.wait([this]() { return hasUpdate(); }, nullptr);
+    }
+
+
+    template<typename T>
+    bool SeqlockContainer<T>::ReadPtr::waitForUpdateFor(std::chrono::nanoseconds timeout)
+    {
+        detail::ParkedReaders::Clock::time_point deadline = detail::ParkedReaders::deadlineAfter(timeout);
+        return owner.parked.wait([this]() { return hasUpdate(); }, &deadline);
+    }
+
+
+#if RWSYNC_COROUTINES
+    template<typename T>
+    template<typename Schedule>
+    UpdateAwaiter<typename SeqlockContainer<T>::ReadPtr, Schedule> SeqlockContainer<T>::ReadPtr::nextUpdate(Schedule schedule)
+    {
+        return UpdateAwaiter<ReadPtr, Schedule>(*this, std::move(schedule));
+    }
+#endif
+
+
+    template<typename T>
+    bool SeqlockContainer<T>::ReadPtr::parkUntilUpdate(detail::AsyncWaiter& w)
+    {
+        return owner.parked.park(w, [this]() { return hasUpdate(); });
+    }
+
+
+    template<typename T>
+    void SeqlockContainer<T>::ReadPtr::unpark(detail::AsyncWaiter& w)
+    {
+        owner.parked.unpark(w);
+    }
+
+
+    template<typename T>
+    std::uint64_t SeqlockContainer<T>::ReadPtr::version() const
+    {
+        return seen / 2;
+    }
+
+
+    template<typename T>
+    std::uint64_t SeqlockContainer<T>::ReadPtr::missedSinceLastPull() const
+    {
+        return missed;
+    }
+
+
+    template<typename T>
+    SeqlockContainer<T>::ReadPtr::operator T*()
+    {
+        RWSYNC_CHECK_ACCESS(canRead(), "Invalid read pointer");
+
+        return reinterpret_cast<T*>(&value);
+    }
+
+
+    template<typename T>
+    T& SeqlockContainer<T>::ReadPtr::operator*()
+    {
+        return *static_cast<T*>(*this);
+    }
+
+
+    template<typename T>
+    T* SeqlockContainer<T>::ReadPtr::operator->()
+    {
+        return static_cast<T*>(*this);
+    }
+}
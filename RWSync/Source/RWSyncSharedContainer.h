@@ -0,0 +1,120 @@
+#ifndef RW_SYNC_SHARED_CONTAINER_H_INCLUDED
+#define RW_SYNC_SHARED_CONTAINER_H_INCLUDED
+
+/*
+ *  Copyright (C) 2019 Ethan Blackwood
+ *  This is free software released under the MIT license.
+ *  See attached LICENSE file for more details, or https://opensource.org/licenses/MIT.
+ */
+
+#include "RWSyncContainer.h"
+#include "RWSyncSharedManager.h"
+#include "RWSyncSharedMemory.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+
+/*
+ * Container whose data instances and SharedManager live in a named SharedMemory region, so that
+ * other processes can open the same container and read the writer's data in place (without the
+ * data being copied or any messages being sent). T must be trivially copyable and standard-layout,
+ * since it's accessed from processes that didn't construct it, and it must not contain pointers
+ * (into the region or elsewhere), since the region is mapped at a different address in each process.
+ *
+ * One process (usually the writer's) creates the region, and the others open it by name, at which
+ * point the size and alignment of T are checked. Use SharedContainer<T>::WritePtr and ::ReadPtr as
+ * with other containers. If a process exits (or crashes) while it holds a read or write pointer, its
+ * registration is freed when someone else needs it (see SharedManager).
+ */
+
+namespace RWSync
+{
+    namespace detail
+    {
+        // at the start of a SharedContainer's region
+        struct SharedContainerHeader
+        {
+            std::atomic<std::uint32_t> magic; // set once everything else is initialized
+            std::uint32_t instanceSize;
+            std::uint32_t instanceAlignment;
+            std::int32_t maxReaders;
+            std::uint64_t stride;
+            std::uint64_t dataOffset;
+        };
+    }
+
+    template<typename T, std::size_t alignment = RWSYNC_INSTANCE_ALIGNMENT>
+    class SharedContainer
+    {
+        static_assert(std::is_trivially_copyable<T>::value && std::is_standard_layout<T>::value,
+            "SharedContainer can only hold trivially copyable, standard-layout types");
+
+    public:
+        // Creates the named region with space for the given number of readers, initializing each data
+        // instance with the given arguments. Throws a new std::runtime_error if the region can't be
+        // created, including if one with that name already exists (see removeStale).
+        template<typename... Args>
+        SharedContainer(const std::string& name, int maxReaders, Args&&... args);
+
+        // Opens a container that another process (or this one) has created. Throws a new
+        // std::runtime_error if it doesn't exist or was created for a different type.
+        explicit SharedContainer(const std::string& name);
+
+        int numAllocatedReaders() const;
+
+        // See SharedManager::reclaimAbandoned
+        int reclaimAbandoned();
+
+        // See SharedMemory::removeStale: for a container whose creator crashed, before creating it again.
+        static bool removeStale(const std::string& name);
+
+        typedef BasicWritePtr<T, SharedContainer> WritePtr;
+        typedef BasicReadPtr<T, SharedContainer> ReadPtr;
+
+    private:
+        template<typename, typename> friend class BasicWritePtr;
+        template<typename, typename> friend class BasicReadPtr;
+
+        typedef SharedManager ManagerType;
+
+        T* getInstance(int i);
+
+        // instances are always constructed
+        void prepareInstance(int) {}
+
+        static const std::uint32_t initializedMagic = 0x52575343; // "RWSC"
+
+        static const std::size_t instanceAlignment =
+            alignment > std::alignment_of<T>::value ? alignment : std::alignment_of<T>::value;
+
+        static const std::size_t stride = (sizeof(T) + instanceAlignment - 1) / instanceAlignment * instanceAlignment;
+
+        // Layout of the region: header, manager, then the instances.
+        static std::size_t managerOffset();
+        static std::size_t dataOffset(int maxReaders);
+        static std::size_t totalSize(int maxReaders);
+
+        // Throws if the opened region isn't a compatible container; returns its manager's memory.
+        static void* checkedManagerAddress(const SharedMemory& memory);
+
+        detail::SharedContainerHeader& header();
+
+        SharedMemory memory;
+        SharedManager manager;
+        unsigned char* data;
+
+        // a queue of function objects can't be shared between processes
+        detail::NoReconfigurations<T> reconfigurations;
+
+#ifdef OPEN_EPHYS
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SharedContainer);
+#endif
+    };
+}
+
+#include "RWSyncSharedContainer.ipp"
+
+#endif // RW_SYNC_SHARED_CONTAINER_H_INCLUDED
@@ -0,0 +1,126 @@
+/*
+*  Copyright (C) 2019 Ethan Blackwood
+*  This is free software released under the MIT license.
+*  See attached LICENSE file for more details, or https://opensource.org/licenses/MIT.
+*/
+
+#include "RWSyncSharedContainer.h"
+
+#include <new>
+#include <stdexcept>
+#include <utility>
+
+namespace RWSync
+{
+    template<typename T, std::size_t alignment>
+    template<typename... Args>
+    SharedContainer<T, alignment>::SharedContainer(const std::string& name, int maxReaders, Args&&... args)
+        : memory    (name, totalSize(maxReaders))
+        , manager   (static_cast<unsigned char*>(memory.getAddress()) + managerOffset(), maxReaders)
+        , data      (static_cast<unsigned char*>(memory.getAddress()) + dataOffset(maxReaders))
+    {
+        for (int i = 0; i < maxReaders + 2; ++i)
+        {
+            new (getInstance(i)) T(args...);
+        }
+
+        detail::SharedContainerHeader& h = *new (memory.getAddress()) detail::SharedContainerHeader;
+        h.instanceSize = sizeof(T);
+        h.instanceAlignment = instanceAlignment;
+        h.maxReaders = maxReaders;
+        h.stride = stride;
+        h.dataOffset = dataOffset(maxReaders);
+
+        // release: opening containers see everything above
+        h.magic.store(initializedMagic, std::memory_order_release);
+    }
+
+
+    template<typename T, std::size_t alignment>
+    SharedContainer<T, alignment>::SharedContainer(const std::string& name)
+        : memory    (name)
+        , manager   (checkedManagerAddress(memory))
+        , data      (static_cast<unsigned char*>(memory.getAddress()) + header().dataOffset)
+    {}
+
+
+    template<typename T, std::size_t alignment>
+    int SharedContainer<T, alignment>::numAllocatedReaders() const
+    {
+        return manager.getMaxReaders();
+    }
+
+
+    template<typename T, std::size_t alignment>
+    int SharedContainer<T, alignment>::reclaimAbandoned()
+    {
+        return manager.reclaimAbandoned();
+    }
+
+
+    template<typename T, std::size_t alignment>
+    bool SharedContainer<T, alignment>::removeStale(const std::string& name)
+    {
+        return SharedMemory::removeStale(name);
+    }
+
+
+    template<typename T, std::size_t alignment>
+    T* SharedContainer<T, alignment>::getInstance(int i)
+    {
+        return reinterpret_cast<T*>(data + i * stride);
+    }
+
+
+    template<typename T, std::size_t alignment>
+    std::size_t SharedContainer<T, alignment>::managerOffset()
+    {
+        const std::size_t line = RWSYNC_CACHE_LINE_SIZE;
+        return (sizeof(detail::SharedContainerHeader) + line - 1) / line * line;
+    }
+
+
+    template<typename T, std::size_t alignment>
+    std::size_t SharedContainer<T, alignment>::dataOffset(int maxReaders)
+    {
+        std::size_t managerEnd = managerOffset() + SharedManager::requiredSize(maxReaders);
+        return (managerEnd + instanceAlignment - 1) / instanceAlignment * instanceAlignment;
+    }
+
+
+    template<typename T, std::size_t alignment>
+    std::size_t SharedContainer<T, alignment>::totalSize(int maxReaders)
+    {
+        return dataOffset(maxReaders) + (maxReaders + 2) * stride;
+    }
+
+
+    template<typename T, std::size_t alignment>
+    void* SharedContainer<T, alignment>::checkedManagerAddress(const SharedMemory& memory)
+    {
+        const detail::SharedContainerHeader& h =
+            *static_cast<const detail::SharedContainerHeader*>(memory.getAddress());
+
+        if (memory.getSize() < sizeof(detail::SharedContainerHeader)
+            || h.magic.load(std::memory_order_acquire) != initializedMagic)
+        {
+            throw new std::runtime_error("Shared memory does not hold an initialized SharedContainer");
+        }
+
+        if (h.instanceSize != sizeof(T) || h.instanceAlignment != instanceAlignment || h.stride != stride
+            || h.maxReaders <= 0 || h.dataOffset != dataOffset(h.maxReaders)
+            || memory.getSize() < totalSize(h.maxReaders))
+        {
+            throw new std::runtime_error("SharedContainer was created with a different type or alignment");
+        }
+
+        return static_cast<unsigned char*>(memory.getAddress()) + managerOffset();
+    }
+
+
+    template<typename T, std::size_t alignment>
+    detail::SharedContainerHeader& SharedContainer<T, alignment>::header()
+    {
+        return *static_cast<detail::SharedContainerHeader*>(memory.getAddress());
+    }
+}
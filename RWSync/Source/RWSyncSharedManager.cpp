@@ -0,0 +1,420 @@
+/*
+ *  Copyright (C) 2019 Ethan Blackwood
+ *  This is free software released under the MIT license.
+ *  See attached LICENSE file for more details, or https://opensource.org/licenses/MIT.
+ */
+
+// In header-only mode, this is included at the end of RWSyncSharedManager.h.
+#ifndef RW_SYNC_SHARED_MANAGER_CPP_INCLUDED
+#define RW_SYNC_SHARED_MANAGER_CPP_INCLUDED
+
+#include "RWSyncSharedManager.h"
+#include "RWSyncSharedMemory.h"
+
+#include <algorithm>
+#include <cassert>
+#include <new>
+#include <stdexcept>
+
+namespace RWSync
+{
+    ////// SharedManager ///////
+
+    RWSYNC_INLINE std::size_t SharedManager::requiredSize(int maxReaders)
+    {
+        return sizeof(detail::SharedManagerState) + maxReaders * sizeof(detail::Padded<detail::SharedReaderRecord>);
+    }
+
+
+    RWSYNC_INLINE SharedManager::SharedManager(void* memory, int maxReaders)
+        : state         (*new (memory) detail::SharedManagerState)
+        , nInstances    (maxReaders + 2)
+        , processId     (detail::currentProcessId())
+        , held          (maxReaders + 2)
+    {
+        assert(maxReaders > 0);
+        state.maxReaders = maxReaders;
+        state.writerOwner.store(0, std::memory_order_relaxed);
+        state.latest.store(-1, std::memory_order_relaxed);
+        state.pulled.store(-1, std::memory_order_relaxed);
+        state.writer.index = 0;
+
+        for (int i = 0; i < maxReaders; ++i)
+        {
+            detail::SharedReaderRecord* record = new (&getRecord(i)) detail::Padded<detail::SharedReaderRecord>;
+            record->owner.store(0, std::memory_order_relaxed);
+            record->holding.store(-1, std::memory_order_relaxed);
+        }
+
+        // release: attaching managers see everything above
+        state.magic.store(initializedMagic, std::memory_order_release);
+    }
+
+
+    RWSYNC_INLINE SharedManager::SharedManager(void* memory)
+        : state         (*static_cast<detail::SharedManagerState*>(memory))
+        , nInstances    (state.magic.load(std::memory_order_acquire) == initializedMagic ? state.maxReaders + 2 : 0)
+        , processId     (detail::currentProcessId())
+        , held          (nInstances)
+    {
+        if (nInstances == 0)
+        {
+            throw new std::runtime_error("Shared memory does not hold an initialized SharedManager");
+        }
+    }
+
+
+    RWSYNC_INLINE int SharedManager::getMaxReaders() const
+    {
+        return nInstances - 2;
+    }
+
+
+    RWSYNC_INLINE int SharedManager::reclaimAbandoned()
+    {
+        int nFreed = 0;
+
+        for (int i = 0; i < nInstances - 2; ++i)
+        {
+            detail::SharedReaderRecord& record = getRecord(i);
+            int owner = record.owner.load(std::memory_order_relaxed);
+            if (owner > 0 && owner != processId && !detail::isProcessAlive(owner)
+                && record.owner.compare_exchange_strong(owner, -1, std::memory_order_acquire))
+            {
+                record.holding.store(-1, std::memory_order_relaxed);
+                record.owner.store(0, std::memory_order_release);
+                ++nFreed;
+            }
+        }
+
+        int writer = state.writerOwner.load(std::memory_order_relaxed);
+        if (writer > 0 && writer != processId && !detail::isProcessAlive(writer)
+            && state.writerOwner.compare_exchange_strong(writer, 0, std::memory_order_relaxed))
+        {
+            ++nFreed;
+        }
+
+        return nFreed;
+    }
+
+
+    RWSYNC_INLINE bool SharedManager::checkoutWriter()
+    {
+        int currWriter = 0;
+        if (!state.writerOwner.compare_exchange_strong(currWriter, processId, std::memory_order_acquire))
+        {
+            // take over if the writer's process is gone
+            if (currWriter == processId || detail::isProcessAlive(currWriter)
+                || !state.writerOwner.compare_exchange_strong(currWriter, processId, std::memory_order_acquire))
+            {
+                return false;
+            }
+        }
+
+        // A previous writer could have exited between pushing and picking a new instance,
+        // leaving writer.index pointing at the latest, so always start with a free one.
+        state.writer.index = findFreeInstance();
+        return true;
+    }
+
+
+    RWSYNC_INLINE void SharedManager::returnWriter()
+    {
+        int oldWriter = state.writerOwner.exchange(0, std::memory_order_release);
+        assert(oldWriter == processId);
+        (void)oldWriter;
+    }
+
+
+    RWSYNC_INLINE int SharedManager::checkoutReader()
+    {
+        for (int attempt = 0; attempt < 2; ++attempt)
+        {
+            for (int i = 0; i < nInstances - 2; ++i)
+            {
+                int currOwner = 0;
+                if (getRecord(i).owner.compare_exchange_strong(currOwner, processId, std::memory_order_acquire))
+                {
+                    return i;
+                }
+            }
+
+            // all in use - try again if any belonged to processes that have exited
+            if (attempt == 0 && reclaimAbandoned() == 0)
+            {
+                break;
+            }
+        }
+
+        return -1;
+    }
+
+
+    RWSYNC_INLINE void SharedManager::returnReader(int record)
+    {
+        getRecord(record).owner.store(0, std::memory_order_release);
+    }
+
+
+    RWSYNC_INLINE void SharedManager::pushWrite()
+    {
+        // As in Manager::pushWrite, a reader's store to pulled for an instance that we then reuse
+        // happens before this, since findFreeInstance saw it stop holding the instance.
+        state.pulled.store(-1, std::memory_order_relaxed);
+
+        // seq_cst, so that a reader that checks the latest after storing what it holds
+        // either sees this push or has its holding seen by findFreeInstance.
+        state.latest.store(state.writer.index, std::memory_order_seq_cst);
+
+        int newWriterIndex = findFreeInstance();
+        assert(newWriterIndex != -1);
+        state.writer.index = newWriterIndex;
+    }
+
+
+    RWSYNC_INLINE int SharedManager::findFreeInstance()
+    {
+        std::fill(held.begin(), held.end(), static_cast<unsigned char>(0));
+
+        int latest = state.latest.load(std::memory_order_seq_cst);
+        if (latest != -1)
+        {
+            held[latest] = 1;
+        }
+
+        for (int i = 0; i < nInstances - 2; ++i)
+        {
+            // seq_cst: see comment in pushWrite
+            int holding = getRecord(i).holding.load(std::memory_order_seq_cst);
+            if (holding >= 0 && holding < nInstances)
+            {
+                held[holding] = 1;
+            }
+        }
+
+        // at most maxReaders instances are held, plus the latest, so there are always at least 1 left
+        for (int i = 0; i < nInstances; ++i)
+        {
+            if (!held[i])
+            {
+                return i;
+            }
+        }
+
+        return -1;
+    }
+
+
+    RWSYNC_INLINE detail::SharedReaderRecord& SharedManager::getRecord(int i)
+    {
+        assert(i >= 0 && i < state.maxReaders);
+        unsigned char* records = reinterpret_cast<unsigned char*>(&state) + sizeof(detail::SharedManagerState);
+        return *reinterpret_cast<detail::Padded<detail::SharedReaderRecord>*>(
+            records + i * sizeof(detail::Padded<detail::SharedReaderRecord>));
+    }
+
+    /***** WriteIndex *****/
+
+    RWSYNC_INLINE SharedManager::WriteIndex::WriteIndex(SharedManager& o)
+        : owner (o)
+        , valid (false)
+    {
+        tryToMakeValid();
+    }
+
+
+    RWSYNC_INLINE SharedManager::WriteIndex::WriteIndex(WriteIndex&& other)
+        : owner (other.owner)
+        , valid (other.valid)
+    {
+        other.valid = false;
+    }
+
+
+    RWSYNC_INLINE SharedManager::WriteIndex::~WriteIndex()
+    {
+        if (valid)
+        {
+            owner.returnWriter();
+        }
+    }
+
+
+    RWSYNC_INLINE bool SharedManager::WriteIndex::tryToMakeValid()
+    {
+        if (!valid)
+        {
+            valid = owner.checkoutWriter();
+        }
+
+        return valid;
+    }
+
+
+    RWSYNC_INLINE bool SharedManager::WriteIndex::isValid() const
+    {
+        return valid;
+    }
+
+
+    RWSYNC_INLINE SharedManager::WriteIndex::operator int() const
+    {
+        if (valid)
+        {
+            return owner.state.writer.index;
+        }
+        return -1;
+    }
+
+
+    RWSYNC_INLINE void SharedManager::WriteIndex::pushUpdate()
+    {
+        if (valid)
+        {
+            owner.pushWrite();
+        }
+    }
+
+
+    RWSYNC_INLINE void SharedManager::WriteIndex::pushUpdate(int)
+    {
+        pushUpdate();
+    }
+
+
+    RWSYNC_INLINE bool SharedManager::WriteIndex::latestWasPulled() const
+    {
+        if (!valid)
+        {
+            return false;
+        }
+
+        int latest = owner.state.latest.load(std::memory_order_relaxed);
+        return latest != -1 && owner.state.pulled.load(std::memory_order_relaxed) == latest;
+    }
+
+    /***** ReadIndex *****/
+
+    RWSYNC_INLINE SharedManager::ReadIndex::ReadIndex(SharedManager& o)
+        : owner     (o)
+        , record    (-1)
+        , index     (-1)
+    {
+        tryToMakeValid();
+    }
+
+
+    RWSYNC_INLINE SharedManager::ReadIndex::ReadIndex(ReadIndex&& other)
+        : owner     (other.owner)
+        , record    (other.record)
+        , index     (other.index)
+    {
+        other.record = -1;
+        other.index = -1;
+    }
+
+
+    RWSYNC_INLINE SharedManager::ReadIndex::~ReadIndex()
+    {
+        if (record != -1)
+        {
+            finishRead();
+            owner.returnReader(record);
+        }
+    }
+
+
+    RWSYNC_INLINE bool SharedManager::ReadIndex::tryToMakeValid()
+    {
+        if (record == -1)
+        {
+            record = owner.checkoutReader();
+            if (record != -1)
+            {
+                getLatest();
+            }
+        }
+
+        return record != -1;
+    }
+
+
+    RWSYNC_INLINE bool SharedManager::ReadIndex::isValid() const
+    {
+        return record != -1;
+    }
+
+
+    RWSYNC_INLINE bool SharedManager::ReadIndex::canRead() const
+    {
+        return record != -1 && index != -1;
+    }
+
+
+    RWSYNC_INLINE bool SharedManager::ReadIndex::hasUpdate() const
+    {
+        int newLatest = owner.state.latest.load(std::memory_order_relaxed);
+        return record != -1 && newLatest != -1 && newLatest != index;
+    }
+
+
+    RWSYNC_INLINE void SharedManager::ReadIndex::pullUpdate()
+    {
+        if (hasUpdate())
+        {
+            // replacing what we hold also releases the old instance
+            getLatest();
+        }
+    }
+
+
+    RWSYNC_INLINE SharedManager::ReadIndex::operator int() const
+    {
+        if (record != -1)
+        {
+            return index;
+        }
+        return -1;
+    }
+
+
+    RWSYNC_INLINE void SharedManager::ReadIndex::finishRead()
+    {
+        // release: finish reading before the writer can see that the instance is free
+        owner.getRecord(record).holding.store(-1, std::memory_order_release);
+        index = -1;
+    }
+
+
+    RWSYNC_INLINE void SharedManager::ReadIndex::getLatest()
+    {
+        std::atomic<int>& holding = owner.getRecord(record).holding;
+
+        index = owner.state.latest.load(std::memory_order_seq_cst);
+        while (true)
+        {
+            // seq_cst store then load: see comment in SharedManager::pushWrite()
+            holding.store(index, std::memory_order_seq_cst);
+            if (index == -1)
+            {
+                return;
+            }
+
+            // The writer may have picked this instance before seeing that we hold it, but then it's
+            // no longer the latest, so check again. If it's still the latest (or the latest again),
+            // the writer will leave it alone. Acquire (as part of seq_cst): see its contents.
+            int newLatest = owner.state.latest.load(std::memory_order_seq_cst);
+            if (newLatest == index)
+            {
+                if (owner.state.pulled.load(std::memory_order_relaxed) != index)
+                {
+                    owner.state.pulled.store(index, std::memory_order_relaxed);
+                }
+                return;
+            }
+            index = newLatest;
+        }
+    }
+}
+
+#endif // RW_SYNC_SHARED_MANAGER_CPP_INCLUDED
@@ -0,0 +1,208 @@
+#ifndef RW_SYNC_SHARED_MANAGER_H_INCLUDED
+#define RW_SYNC_SHARED_MANAGER_H_INCLUDED
+
+/*
+ *  Copyright (C) 2019 Ethan Blackwood
+ *  This is free software released under the MIT license.
+ *  See attached LICENSE file for more details, or https://opensource.org/licenses/MIT.
+ */
+
+#include "RWSyncManager.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * Replacement for RWSync::Manager whose state lives in memory shared between processes (see
+ * SharedMemory and SharedContainer), so that readers in other processes can read the writer's
+ * data directly. It has the same interface as Manager aside from resetting and expanding, and
+ * there are also maxReaders + 2 instances, but the protocol is changed so that a process that
+ * crashes while reading or writing can't leave instances claimed forever:
+ *
+ *  - Each reader registers in its own record, which holds the ID of its process and the index of
+ *    the instance it's reading. To read the latest instance, a reader stores its index in its record
+ *    and then checks that it's still the latest (retrying if not); the writer, after pushing, picks
+ *    any instance that isn't the latest and isn't in any reader's record. So readers only ever write
+ *    their own record, and there are no shared reader counts that a crashed reader could leave wrong.
+ *
+ *  - Records (and the writer registration) of processes that no longer exist can be freed with
+ *    reclaimAbandoned(), which also happens automatically when registering a reader or writer fails.
+ *
+ * All state is referred to by offset from the start of the memory, which may be mapped at a
+ * different address in each process. std::atomic<int> must be lock-free for this to work.
+ */
+
+namespace RWSync
+{
+    namespace detail
+    {
+        struct SharedReaderRecord
+        {
+            std::atomic<int> owner;   // process ID of the reader, 0 if free, -1 while being reclaimed
+            std::atomic<int> holding; // index of the instance being read, or -1
+        };
+
+        struct SharedWriterState
+        {
+            int index;
+        };
+
+        // At the start of the memory given to a SharedManager; followed by maxReaders
+        // Padded<SharedReaderRecord>s.
+        struct SharedManagerState
+        {
+            std::atomic<std::uint32_t> magic; // set once everything else is initialized
+            std::int32_t maxReaders;
+
+            Padded<std::atomic<int>> writerOwner; // process ID of the writer, or 0
+            Padded<std::atomic<int>> latest;
+            Padded<std::atomic<int>> pulled;      // see Manager::pulled
+            Padded<SharedWriterState> writer;    // only accessed by the registered writer
+        };
+    }
+
+
+    class RWSYNC_API SharedManager
+    {
+        static_assert(ATOMIC_INT_LOCK_FREE == 2, "SharedManager requires lock-free atomic ints");
+
+    public:
+        // Number of bytes needed for a manager with the given maximum number of readers.
+        static std::size_t requiredSize(int maxReaders);
+
+        // Initializes a new manager in the given memory, which must be (at least) requiredSize(maxReaders)
+        // bytes and aligned to RWSYNC_CACHE_LINE_SIZE, and not yet in use by any other SharedManager.
+        SharedManager(void* memory, int maxReaders);
+
+        // Attaches to a manager that was already initialized in the given memory (usually by another
+        // process). Throws a new std::runtime_error if the memory doesn't hold an initialized manager.
+        explicit SharedManager(void* memory);
+
+        int getMaxReaders() const;
+
+        // Frees the registrations of readers and the writer in processes that have exited without
+        // releasing them. Returns the number of registrations freed.
+        int reclaimAbandoned();
+
+        class RWSYNC_API WriteIndex
+        {
+        public:
+            explicit WriteIndex(SharedManager& o);
+
+            // Takes over other's checkout (if it has one), leaving other invalid.
+            WriteIndex(WriteIndex&& other);
+
+            ~WriteIndex();
+
+            // tries to claim writer status if we don't have it
+            // already - returns true if the write index is now valid.
+            bool tryToMakeValid();
+
+            // is there actually a place to write?
+            bool isValid() const;
+
+            // index to access the correct data instance
+            operator int() const;
+
+            // push a finished write to readers
+            void pushUpdate();
+
+            // For compatibility with Manager::WriteIndex::pushUpdate(int); the preference is ignored.
+            void pushUpdate(int preferredNext);
+
+            // see Manager::WriteIndex::latestWasPulled
+            bool latestWasPulled() const;
+
+        private:
+            SharedManager& owner;
+            bool valid;
+
+            WriteIndex(const WriteIndex&);
+            WriteIndex& operator=(const WriteIndex&);
+        };
+
+
+        class RWSYNC_API ReadIndex
+        {
+        public:
+            explicit ReadIndex(SharedManager& o);
+
+            // see WriteIndex
+            ReadIndex(ReadIndex&& other);
+
+            ~ReadIndex();
+
+            // tries to claim a reader record if we don't have one
+            // already - returns true if the read index is now valid.
+            bool tryToMakeValid();
+
+            // check whether a reader has been checked out successfully
+            bool isValid() const;
+
+            // check whether a reader has been checked out and there
+            // has been at least one write.
+            bool canRead() const;
+
+            // check whether a new write has been pushed
+            bool hasUpdate() const;
+
+            // update the index, if a new version is available
+            void pullUpdate();
+
+            // index to access the correct data instance
+            operator int() const;
+
+        private:
+            // signal that we are not longer reading from the `index`th instance
+            void finishRead();
+
+            // update index to refer to the latest update
+            void getLatest();
+
+            SharedManager& owner;
+            int record; // -1 if invalid
+            int index;
+
+            ReadIndex(const ReadIndex&);
+            ReadIndex& operator=(const ReadIndex&);
+        };
+
+    private:
+        // Registers the writer, taking over from a writer whose process has exited if necessary.
+        bool checkoutWriter();
+        void returnWriter();
+
+        // Returns the index of a newly claimed reader record, or -1 if all are in use.
+        int checkoutReader();
+        void returnReader(int record);
+
+        void pushWrite();
+
+        // Returns an instance that is neither the latest nor held by any reader.
+        // Should only be called by the writer.
+        int findFreeInstance();
+
+        detail::SharedReaderRecord& getRecord(int i);
+
+        static const std::uint32_t initializedMagic = 0x5257534D; // "RWSM"
+
+        detail::SharedManagerState& state;
+        const int nInstances;
+        const int processId;
+
+        // writer's scratch space for findFreeInstance (local to this process)
+        std::vector<unsigned char> held;
+
+#ifdef OPEN_EPHYS
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SharedManager);
+#endif
+    };
+}
+
+#ifdef RWSYNC_HEADER_ONLY
+#include "RWSyncSharedManager.cpp"
+#endif
+
+#endif // RW_SYNC_SHARED_MANAGER_H_INCLUDED
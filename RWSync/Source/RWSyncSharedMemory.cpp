@@ -0,0 +1,264 @@
+/*
+ *  Copyright (C) 2019 Ethan Blackwood
+ *  This is free software released under the MIT license.
+ *  See attached LICENSE file for more details, or https://opensource.org/licenses/MIT.
+ */
+
+// In header-only mode, this is included at the end of RWSyncSharedMemory.h.
+#ifndef RW_SYNC_SHARED_MEMORY_CPP_INCLUDED
+#define RW_SYNC_SHARED_MEMORY_CPP_INCLUDED
+
+#include "RWSyncSharedMemory.h"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace RWSync
+{
+#ifdef _WIN32
+
+    RWSYNC_INLINE SharedMemory::SharedMemory(const std::string& n, std::size_t s)
+        : name      (n)
+        , address   (nullptr)
+        , size      (s)
+        , creator   (true)
+        , handle    (nullptr)
+    {
+        unsigned long long size64 = s;
+        handle = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+            DWORD(size64 >> 32), DWORD(size64 & 0xFFFFFFFF), name.c_str());
+        if (handle == nullptr || GetLastError() == ERROR_ALREADY_EXISTS)
+        {
+            close();
+            throw new std::runtime_error("Failed to create shared memory " + name);
+        }
+
+        address = MapViewOfFile(handle, FILE_MAP_ALL_ACCESS, 0, 0, size);
+        if (address == nullptr)
+        {
+            close();
+            throw new std::runtime_error("Failed to map shared memory " + name);
+        }
+    }
+
+
+    RWSYNC_INLINE SharedMemory::SharedMemory(const std::string& n)
+        : name      (n)
+        , address   (nullptr)
+        , size      (0)
+        , creator   (false)
+        , handle    (nullptr)
+    {
+        handle = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, name.c_str());
+        if (handle == nullptr)
+        {
+            throw new std::runtime_error("Failed to open shared memory " + name);
+        }
+
+        address = MapViewOfFile(handle, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+        MEMORY_BASIC_INFORMATION info;
+        if (address == nullptr || VirtualQuery(address, &info, sizeof(info)) == 0)
+        {
+            close();
+            throw new std::runtime_error("Failed to map shared memory " + name);
+        }
+        size = info.RegionSize;
+    }
+
+
+    RWSYNC_INLINE void SharedMemory::close()
+    {
+        if (address != nullptr)
+        {
+            UnmapViewOfFile(address);
+            address = nullptr;
+        }
+
+        if (handle != nullptr)
+        {
+            CloseHandle(handle);
+            handle = nullptr;
+        }
+    }
+
+
+    RWSYNC_INLINE bool SharedMemory::removeStale(const std::string&)
+    {
+        return false;
+    }
+
+
+    RWSYNC_INLINE int detail::currentProcessId()
+    {
+        return int(GetCurrentProcessId());
+    }
+
+
+    RWSYNC_INLINE bool detail::isProcessAlive(int pid)
+    {
+        HANDLE process = OpenProcess(SYNCHRONIZE, FALSE, DWORD(pid));
+        if (process == nullptr)
+        {
+            // can't open it for another reason (e.g. access denied), so assume it exists
+            return GetLastError() != ERROR_INVALID_PARAMETER;
+        }
+
+        bool alive = WaitForSingleObject(process, 0) == WAIT_TIMEOUT;
+        CloseHandle(process);
+        return alive;
+    }
+
+#else // _WIN32
+
+    namespace detail
+    {
+        // POSIX shared memory names must start with one slash
+        RWSYNC_INLINE std::string posixSharedMemoryName(const std::string& name)
+        {
+            return (!name.empty() && name[0] == '/') ? name : "/" + name;
+        }
+    }
+
+
+    RWSYNC_INLINE SharedMemory::SharedMemory(const std::string& n, std::size_t s)
+        : name      (detail::posixSharedMemoryName(n))
+        , address   (nullptr)
+        , size      (s)
+        , creator   (true)
+    {
+        int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd == -1)
+        {
+            if (errno == EEXIST)
+            {
+                throw new std::runtime_error("Shared memory " + name
+                    + " already exists (see SharedMemory::removeStale)");
+            }
+            throw new std::runtime_error("Failed to create shared memory " + name);
+        }
+
+        if (ftruncate(fd, off_t(size)) == 0)
+        {
+            void* mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (mapped != MAP_FAILED)
+            {
+                address = mapped;
+            }
+        }
+        ::close(fd);
+
+        if (address == nullptr)
+        {
+            shm_unlink(name.c_str());
+            throw new std::runtime_error("Failed to map shared memory " + name);
+        }
+    }
+
+
+    RWSYNC_INLINE SharedMemory::SharedMemory(const std::string& n)
+        : name      (detail::posixSharedMemoryName(n))
+        , address   (nullptr)
+        , size      (0)
+        , creator   (false)
+    {
+        int fd = shm_open(name.c_str(), O_RDWR, 0);
+        if (fd == -1)
+        {
+            throw new std::runtime_error("Failed to open shared memory " + name);
+        }
+
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size > 0)
+        {
+            size = std::size_t(info.st_size);
+            void* mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (mapped != MAP_FAILED)
+            {
+                address = mapped;
+            }
+        }
+        ::close(fd);
+
+        if (address == nullptr)
+        {
+            throw new std::runtime_error("Failed to map shared memory " + name);
+        }
+    }
+
+
+    RWSYNC_INLINE void SharedMemory::close()
+    {
+        if (address != nullptr)
+        {
+            munmap(address, size);
+            address = nullptr;
+        }
+
+        if (creator)
+        {
+            shm_unlink(name.c_str());
+        }
+    }
+
+
+    RWSYNC_INLINE bool SharedMemory::removeStale(const std::string& name)
+    {
+        return shm_unlink(detail::posixSharedMemoryName(name).c_str()) == 0;
+    }
+
+
+    RWSYNC_INLINE int detail::currentProcessId()
+    {
+        return int(getpid());
+    }
+
+
+    RWSYNC_INLINE bool detail::isProcessAlive(int pid)
+    {
+        // EPERM means it exists but belongs to another user
+        return kill(pid_t(pid), 0) == 0 || errno == EPERM;
+    }
+
+#endif // _WIN32
+
+    RWSYNC_INLINE SharedMemory::~SharedMemory()
+    {
+        close();
+    }
+
+
+    RWSYNC_INLINE void* SharedMemory::getAddress() const
+    {
+        return address;
+    }
+
+
+    RWSYNC_INLINE std::size_t SharedMemory::getSize() const
+    {
+        return size;
+    }
+
+
+    RWSYNC_INLINE bool SharedMemory::isCreator() const
+    {
+        return creator;
+    }
+}
+
+#endif // RW_SYNC_SHARED_MEMORY_CPP_INCLUDED
@@ -0,0 +1,85 @@
+#ifndef RW_SYNC_SHARED_MEMORY_H_INCLUDED
+#define RW_SYNC_SHARED_MEMORY_H_INCLUDED
+
+/*
+ *  Copyright (C) 2019 Ethan Blackwood
+ *  This is free software released under the MIT license.
+ *  See attached LICENSE file for more details, or https://opensource.org/licenses/MIT.
+ */
+
+#include "RWSyncManager.h" // for RWSYNC_API and RWSYNC_INLINE
+
+#include <cstddef>
+#include <string>
+
+/*
+ * A named region of memory that can be mapped by several processes (POSIX shm_open/mmap, or
+ * CreateFileMapping/MapViewOfFile on Windows), used by SharedManager and SharedContainer.
+ * The region may be mapped at a different address in each process, so anything stored in it
+ * must refer to other parts of it by offset rather than by pointer.
+ */
+
+namespace RWSync
+{
+    class RWSYNC_API SharedMemory
+    {
+    public:
+        // Creates a new region of the given size (zero-filled). Fails if a region with the same name
+        // already exists. On POSIX systems, the name is removed again when this object is destroyed
+        // (processes that already opened the region keep it until they close it), but if the creator
+        // crashes, the name outlives it, so creating it again fails until removeStale() is called.
+        // On Windows, the region exists as long as any process has it open. Throws a new
+        // std::runtime_error on failure (like the pointer classes do with std::out_of_range).
+        SharedMemory(const std::string& name, std::size_t size);
+
+        // Opens an existing region. Throws a new std::runtime_error on failure.
+        explicit SharedMemory(const std::string& name);
+
+        // Removes the name of a region left behind by a creator that didn't destroy its SharedMemory
+        // (e.g. because it crashed), so that it can be created again. Processes that have it open keep
+        // it, but new ones can't open it. Only call this when the region is known not to be in use.
+        // Returns whether there was such a name to remove (always false on Windows, where a region
+        // doesn't outlive the processes that have it open).
+        static bool removeStale(const std::string& name);
+
+        ~SharedMemory();
+
+        void* getAddress() const;
+        std::size_t getSize() const;
+
+        // whether this object created the region (rather than opening it)
+        bool isCreator() const;
+
+    private:
+        void close();
+
+        std::string name;
+        void* address;
+        std::size_t size;
+        bool creator;
+
+#ifdef _WIN32
+        void* handle;
+#endif
+
+        SharedMemory(const SharedMemory&);
+        SharedMemory& operator=(const SharedMemory&);
+    };
+
+
+    namespace detail
+    {
+        // Identifies the current process (never 0).
+        RWSYNC_API int currentProcessId();
+
+        // Whether the process with the given ID is still running. A process that has exited may be
+        // reported as alive if the OS has reused its ID for another process.
+        RWSYNC_API bool isProcessAlive(int pid);
+    }
+}
+
+#ifdef RWSYNC_HEADER_ONLY
+#include "RWSyncSharedMemory.cpp"
+#endif
+
+#endif // RW_SYNC_SHARED_MEMORY_H_INCLUDED
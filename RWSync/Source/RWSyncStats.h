@@ -0,0 +1,323 @@
+#ifndef RW_SYNC_STATS_H_INCLUDED
+#define RW_SYNC_STATS_H_INCLUDED
+
+/*
+ *  Copyright (C) 2019 Ethan Blackwood
+ *  This is free software released under the MIT license.
+ *  See attached LICENSE file for more details, or https://opensource.org/licenses/MIT.
+ */
+
+/*
+ * Optional instrumentation of the hot paths of each manager. Define RWSYNC_STATS to enable;
+ * otherwise, counting compiles to nothing and getStats() always returns zeros.
+ *
+ * All counters are updated with relaxed atomics. Those updated by the writer are only written by
+ * one thread at a time; those updated by readers are split over a few padded stripes (chosen
+ * by the address of the ReadIndex), so that readers don't all contend for one cache line.
+ *
+ * Separately, if RWSYNC_TIMESTAMPS is defined, each push is timestamped and each ReadIndex keeps
+ * a histogram of how long after being pushed the instances it pulled were (getLatencyHistogram()).
+ */
+
+#include "RWSyncDetail.h"
+
+#include <chrono>
+#include <cstdint>
+
+// number of separate sets of reader counters
+#ifndef RWSYNC_STATS_STRIPES
+#define RWSYNC_STATS_STRIPES 8
+#endif
+
+namespace RWSync
+{
+    // Snapshot of the counters of a manager. Each counter is read atomically, but since
+    // readers and the writer keep working while a snapshot is taken, the counters may not
+    // all be from exactly the same moment.
+    struct Stats
+    {
+        std::uint64_t pushes = 0;                   // calls to pushUpdate() on a valid WriteIndex
+        std::uint64_t slotsProbed = 0;              // total instances tried while looking for a new write index
+        std::uint64_t conflatedPushes = 0;          // pushes that were replaced by the next one before any reader pulled them
+        std::uint64_t pulls = 0;                    // calls to pullUpdate() that got a new instance
+        std::uint64_t emptyPulls = 0;               // calls to pullUpdate() on a valid ReadIndex with no update
+        std::uint64_t latestRetries = 0;            // failed attempts to register as a reader of the latest instance
+        std::uint64_t latestOverwrittenRetries = 0; // ...of which the latest instance was already being rewritten
+        std::uint64_t answeredPulls = 0;            // pulls that gave up retrying and asked the writer for an instance
+        std::uint64_t failedWriterCheckouts = 0;    // WriteIndex::tryToMakeValid() calls that failed
+        std::uint64_t failedReaderCheckouts = 0;    // ReadIndex::tryToMakeValid() calls that failed
+        std::uint64_t failedLockouts = 0;           // Lockouts that were constructed invalid
+    };
+
+    // Distribution of the time from push to pull of the updates a reader got, in power-of-two
+    // buckets: counts[b] is the number that took [2^b, 2^(b+1)) ns (counts[0] also includes 0 ns,
+    // and the last bucket also includes anything longer). Taken from a single reader, so unlike
+    // Stats, all the counts are from the same moment if the snapshot is taken on the reader's thread.
+    struct LatencyHistogram
+    {
+        static const int numBuckets = 32;
+
+        std::uint64_t counts[numBuckets];
+
+        LatencyHistogram() : counts() {}
+
+        // smallest latency counted in bucket b
+        static std::chrono::nanoseconds bucketMin(int b)
+        {
+            return std::chrono::nanoseconds(b == 0 ? 0 : std::int64_t(1) << b);
+        }
+
+        std::uint64_t total() const
+        {
+            std::uint64_t sum = 0;
+            for (int b = 0; b < numBuckets; ++b)
+            {
+                sum += counts[b];
+            }
+            return sum;
+        }
+
+        // Upper bound of the bucket containing the given quantile (e.g. 0.99) of the latencies,
+        // i.e. at least that fraction of them were shorter. nanoseconds::max() if it's in the last
+        // bucket, and 0 if nothing has been recorded.
+        std::chrono::nanoseconds quantileUpperBound(double quantile) const
+        {
+            std::uint64_t n = total();
+            std::uint64_t sum = 0;
+            for (int b = 0; b < numBuckets - 1 && n > 0; ++b)
+            {
+                sum += counts[b];
+                if (sum >= quantile * n)
+                {
+                    return bucketMin(b + 1);
+                }
+            }
+            return n > 0 ? std::chrono::nanoseconds::max() : std::chrono::nanoseconds::zero();
+        }
+    };
+
+    namespace detail
+    {
+#ifdef RWSYNC_STATS
+
+        class StatsCounters
+        {
+        public:
+            // lets callers skip work that is only needed to compute a count
+            static const bool enabled = true;
+
+            // writer side; only one writer can exist at a time, so these don't need to be RMWs
+            void countPush(int nSlotsProbed)
+            {
+                increment(writer.pushes, 1);
+                increment(writer.slotsProbed, nSlotsProbed);
+            }
+
+            void countConflatedPush()
+            {
+                increment(writer.conflatedPushes, 1);
+            }
+
+            // reader side
+            void countPull(const void* reader, bool gotUpdate)
+            {
+                ReaderCounters& counters = stripeFor(reader);
+                (gotUpdate ? counters.pulls : counters.emptyPulls).fetch_add(1, std::memory_order_relaxed);
+            }
+
+            void countLatestRetry(const void* reader, bool overwritten)
+            {
+                ReaderCounters& counters = stripeFor(reader);
+                counters.latestRetries.fetch_add(1, std::memory_order_relaxed);
+                if (overwritten)
+                {
+                    counters.latestOverwrittenRetries.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+
+            void countAnsweredPull(const void* reader)
+            {
+                stripeFor(reader).answeredPulls.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            // rare events, from any thread
+            void countFailedWriterCheckout()
+            {
+                rare.failedWriterCheckouts.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            void countFailedReaderCheckout()
+            {
+                rare.failedReaderCheckouts.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            void countFailedLockout()
+            {
+                rare.failedLockouts.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            Stats snapshot() const
+            {
+                Stats stats;
+                stats.pushes = writer.pushes.load(std::memory_order_relaxed);
+                stats.slotsProbed = writer.slotsProbed.load(std::memory_order_relaxed);
+                stats.conflatedPushes = writer.conflatedPushes.load(std::memory_order_relaxed);
+
+                for (int i = 0; i < RWSYNC_STATS_STRIPES; ++i)
+                {
+                    const ReaderCounters& counters = readers[i];
+                    stats.pulls += counters.pulls.load(std::memory_order_relaxed);
+                    stats.emptyPulls += counters.emptyPulls.load(std::memory_order_relaxed);
+                    stats.latestRetries += counters.latestRetries.load(std::memory_order_relaxed);
+                    stats.latestOverwrittenRetries += counters.latestOverwrittenRetries.load(std::memory_order_relaxed);
+                    stats.answeredPulls += counters.answeredPulls.load(std::memory_order_relaxed);
+                }
+
+                stats.failedWriterCheckouts = rare.failedWriterCheckouts.load(std::memory_order_relaxed);
+                stats.failedReaderCheckouts = rare.failedReaderCheckouts.load(std::memory_order_relaxed);
+                stats.failedLockouts = rare.failedLockouts.load(std::memory_order_relaxed);
+                return stats;
+            }
+
+        private:
+            struct WriterCounters
+            {
+                std::atomic<std::uint64_t> pushes;
+                std::atomic<std::uint64_t> slotsProbed;
+                std::atomic<std::uint64_t> conflatedPushes;
+            };
+
+            struct ReaderCounters
+            {
+                std::atomic<std::uint64_t> pulls;
+                std::atomic<std::uint64_t> emptyPulls;
+                std::atomic<std::uint64_t> latestRetries;
+                std::atomic<std::uint64_t> latestOverwrittenRetries;
+                std::atomic<std::uint64_t> answeredPulls;
+            };
+
+            struct RareCounters
+            {
+                std::atomic<std::uint64_t> failedWriterCheckouts;
+                std::atomic<std::uint64_t> failedReaderCheckouts;
+                std::atomic<std::uint64_t> failedLockouts;
+            };
+
+            static void increment(std::atomic<std::uint64_t>& counter, int amount)
+            {
+                counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+            }
+
+            ReaderCounters& stripeFor(const void* reader)
+            {
+                // Fibonacci hash of the address, so that nearby readers are spread out
+                std::uint32_t bits = static_cast<std::uint32_t>(reinterpret_cast<std::uintptr_t>(reader) >> 3);
+                return readers[(bits * 2654435769u >> 16) % RWSYNC_STATS_STRIPES];
+            }
+
+            Padded<WriterCounters> writer;
+            Padded<ReaderCounters> readers[RWSYNC_STATS_STRIPES];
+            Padded<RareCounters> rare;
+        };
+
+#else // RWSYNC_STATS
+
+        class StatsCounters
+        {
+        public:
+            static const bool enabled = false;
+
+            void countPush(int) {}
+            void countConflatedPush() {}
+            void countPull(const void*, bool) {}
+            void countLatestRetry(const void*, bool) {}
+            void countAnsweredPull(const void*) {}
+            void countFailedWriterCheckout() {}
+            void countFailedReaderCheckout() {}
+            void countFailedLockout() {}
+
+            Stats snapshot() const
+            {
+                return Stats();
+            }
+        };
+
+#endif // RWSYNC_STATS
+
+#ifdef RWSYNC_TIMESTAMPS
+
+        // Latency histogram of one reader. Only the reader records, so increments don't need to be
+        // RMWs, but the counts are atomic so that a snapshot can be taken from another thread.
+        class LatencyCounters
+        {
+        public:
+            LatencyCounters() : counts() {}
+
+            // for moving a reader; only the reader itself may be recording
+            LatencyCounters(const LatencyCounters& other)
+            {
+                for (int b = 0; b < LatencyHistogram::numBuckets; ++b)
+                {
+                    counts[b].store(other.counts[b].load(std::memory_order_relaxed), std::memory_order_relaxed);
+                }
+            }
+
+            // after pulling an update that was pushed at the given time
+            void record(PushClock::time_point pushed)
+            {
+                if (pushed == PushClock::time_point())
+                {
+                    return;
+                }
+
+                std::atomic<std::uint64_t>& count = counts[bucketFor(PushClock::now() - pushed)];
+                count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            }
+
+            LatencyHistogram snapshot() const
+            {
+                LatencyHistogram histogram;
+                for (int b = 0; b < LatencyHistogram::numBuckets; ++b)
+                {
+                    histogram.counts[b] = counts[b].load(std::memory_order_relaxed);
+                }
+                return histogram;
+            }
+
+        private:
+            static int bucketFor(PushClock::duration latency)
+            {
+                std::int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count();
+                const int lastBucket = LatencyHistogram::numBuckets - 1;
+                if (ns < 2)
+                {
+                    return 0;
+                }
+                if (ns >= std::int64_t(1) << lastBucket)
+                {
+                    return lastBucket;
+                }
+                return floorLog2(static_cast<unsigned int>(ns));
+            }
+
+            std::atomic<std::uint64_t> counts[LatencyHistogram::numBuckets];
+        };
+
+#else // RWSYNC_TIMESTAMPS
+
+        class LatencyCounters
+        {
+        public:
+            void record(PushClock::time_point) {}
+
+            LatencyHistogram snapshot() const
+            {
+                return LatencyHistogram();
+            }
+        };
+
+#endif // RWSYNC_TIMESTAMPS
+    }
+}
+
+#endif // RW_SYNC_STATS_H_INCLUDED
@@ -0,0 +1,504 @@
+/*
+ *  Copyright (C) 2019 Ethan Blackwood
+ *  This is free software released under the MIT license.
+ *  See attached LICENSE file for more details, or https://opensource.org/licenses/MIT.
+ */
+
+// In header-only mode, this is included at the end of RWSyncTripleBufferManager.h.
+#ifndef RW_SYNC_TRIPLE_BUFFER_MANAGER_CPP_INCLUDED
+#define RW_SYNC_TRIPLE_BUFFER_MANAGER_CPP_INCLUDED
+
+#include "RWSyncTripleBufferManager.h"
+
+#include <cassert>
+
+namespace RWSync
+{
+    ////// TripleBufferManager ///////
+
+    RWSYNC_INLINE TripleBufferManager::TripleBufferManager()
+        : nWriters(0)
+        , nReaders(0)
+    {
+        reset();
+    }
+
+
+    RWSYNC_INLINE bool TripleBufferManager::reset()
+    {
+        Lockout lock(*this);
+        return reset(lock);
+    }
+
+
+    RWSYNC_INLINE bool TripleBufferManager::reset(const Lockout& existingLock)
+    {
+        if (!existingLock.isValidForManager(this))
+        {
+            return false;
+        }
+
+        writer.index = 0;
+        writer.hasPushed = false;
+        writer.nPushes = 0;
+        reader.index = 2;
+        reader.hasData = false;
+        reader.version = 0;
+        reader.missed = 0;
+        back.store(1, std::memory_order_relaxed);
+
+        return true;
+    }
+
+
+    RWSYNC_INLINE int TripleBufferManager::getMaxReaders() const
+    {
+        return 1;
+    }
+
+
+    RWSYNC_INLINE Stats TripleBufferManager::getStats() const
+    {
+        return stats.snapshot();
+    }
+
+
+    RWSYNC_INLINE bool TripleBufferManager::checkoutWriter()
+    {
+        if (drainGate.mightBeClosed() || !claimWriter())
+        {
+            return false;
+        }
+
+        // see Manager::checkoutWriter
+        if (drainGate.isClosed())
+        {
+            returnWriter();
+            return false;
+        }
+
+        return true;
+    }
+
+
+    RWSYNC_INLINE bool TripleBufferManager::claimWriter()
+    {
+        int currWriters = 0;
+        return nWriters.compare_exchange_strong(currWriters, 1, std::memory_order_seq_cst);
+    }
+
+
+    RWSYNC_INLINE void TripleBufferManager::returnWriter()
+    {
+        int oldNWriters = nWriters.exchange(0, std::memory_order_seq_cst);
+        assert(oldNWriters == 1);
+        (void)oldNWriters;
+        drainGate.notifyReturned();
+    }
+
+
+    RWSYNC_INLINE bool TripleBufferManager::checkoutReader()
+    {
+        if (drainGate.mightBeClosed() || !claimReader())
+        {
+            return false;
+        }
+
+        if (drainGate.isClosed())
+        {
+            returnReader();
+            return false;
+        }
+
+        return true;
+    }
+
+
+    RWSYNC_INLINE bool TripleBufferManager::claimReader()
+    {
+        int currReaders = 0;
+        return nReaders.compare_exchange_strong(currReaders, 1, std::memory_order_seq_cst);
+    }
+
+
+    RWSYNC_INLINE void TripleBufferManager::returnReader()
+    {
+        int oldNReaders = nReaders.exchange(0, std::memory_order_seq_cst);
+        assert(oldNReaders == 1);
+        (void)oldNReaders;
+        drainGate.notifyReturned();
+    }
+
+
+    RWSYNC_INLINE void TripleBufferManager::pushWrite()
+    {
+        // release: make the write visible to the reader once it exchanges for this instance.
+        // acquire: if the reader just gave up the instance we receive, it must be done reading it.
+        // seq_cst (rather than just acq_rel) is required by ParkedReaders; on common platforms,
+        // an exchange compiles to the same instructions either way.
+        versions.of[writer.index] = ++writer.nPushes;
+        versions.pushTimes[writer.index].stamp();
+        int oldBack = back.exchange(writer.index | freshBit, std::memory_order_seq_cst);
+        writer.index = oldBack & indexMask;
+        writer.hasPushed = true;
+        stats.countPush(1);
+        if ((oldBack & freshBit) != 0)
+        {
+            // replaced a push that the reader never took
+            stats.countConflatedPush();
+        }
+
+        parked.notifyIfParked();
+    }
+
+
+    RWSYNC_INLINE bool TripleBufferManager::pullRead()
+    {
+        // only the reader ever clears the fresh bit, so if it's set now, it stays set until the exchange.
+        if ((back.load(std::memory_order_relaxed) & freshBit) == 0)
+        {
+            reader.missed = 0;
+            return false;
+        }
+
+        // acquire: see everything written to the instance we receive.
+        // release: we're done reading the instance we give up, before the writer can take it.
+        int oldBack = back.exchange(reader.index, std::memory_order_acq_rel);
+        assert((oldBack & freshBit) != 0);
+
+        reader.index = oldBack & indexMask;
+        reader.hasData = true;
+
+        std::uint64_t oldVersion = reader.version;
+        reader.version = versions.of[reader.index];
+        reader.missed = reader.version - oldVersion - 1;
+        return true;
+    }
+
+    /***** WriteIndex *****/
+
+    RWSYNC_INLINE TripleBufferManager::WriteIndex::WriteIndex(TripleBufferManager& o)
+        : owner(o)
+        , valid(false)
+    {
+        tryToMakeValid();
+    }
+
+
+    RWSYNC_INLINE TripleBufferManager::WriteIndex::WriteIndex(WriteIndex&& other)
+        : owner(other.owner)
+        , valid(other.valid)
+    {
+        other.valid = false;
+    }
+
+
+    RWSYNC_INLINE TripleBufferManager::WriteIndex::~WriteIndex()
+    {
+        if (valid)
+        {
+            owner.returnWriter();
+        }
+    }
+
+
+    RWSYNC_INLINE bool TripleBufferManager::WriteIndex::tryToMakeValid()
+    {
+        if (!valid)
+        {
+            valid = owner.checkoutWriter();
+            if (!valid)
+            {
+                owner.stats.countFailedWriterCheckout();
+            }
+        }
+
+        return valid;
+    }
+
+
+    RWSYNC_INLINE bool TripleBufferManager::WriteIndex::isValid() const
+    {
+        return valid;
+    }
+
+
+    RWSYNC_INLINE TripleBufferManager::WriteIndex::operator int() const
+    {
+        if (valid)
+        {
+            return owner.writer.index;
+        }
+        return -1;
+    }
+
+
+    RWSYNC_INLINE void TripleBufferManager::WriteIndex::pushUpdate()
+    {
+        if (valid)
+        {
+            owner.pushWrite();
+        }
+    }
+
+
+    RWSYNC_INLINE void TripleBufferManager::WriteIndex::pushUpdate(int)
+    {
+        pushUpdate();
+    }
+
+
+    RWSYNC_INLINE bool TripleBufferManager::WriteIndex::latestWasPulled() const
+    {
+        // only the reader clears the fresh bit, by taking our last push
+        return valid && owner.writer.hasPushed
+            && (owner.back.load(std::memory_order_relaxed) & freshBit) == 0;
+    }
+
+    /***** ReadIndex *****/
+
+    RWSYNC_INLINE TripleBufferManager::ReadIndex::ReadIndex(TripleBufferManager& o)
+        : owner(o)
+        , valid(false)
+    {
+        tryToMakeValid();
+    }
+
+
+    RWSYNC_INLINE TripleBufferManager::ReadIndex::ReadIndex(ReadIndex&& other)
+        : owner(other.owner)
+        , valid(other.valid)
+        , latency(other.latency)
+    {
+        // the reader's state is in the manager
+        other.valid = false;
+    }
+
+
+    RWSYNC_INLINE TripleBufferManager::ReadIndex::~ReadIndex()
+    {
+        // the reader's instance stays reserved, so the next reader starts out with it
+        if (valid)
+        {
+            owner.returnReader();
+        }
+    }
+
+
+    RWSYNC_INLINE bool TripleBufferManager::ReadIndex::tryToMakeValid()
+    {
+        if (!valid)
+        {
+            valid = owner.checkoutReader();
+            if (valid)
+            {
+                owner.pullRead();
+            }
+            else
+            {
+                owner.stats.countFailedReaderCheckout();
+            }
+        }
+
+        return valid;
+    }
+
+
+    RWSYNC_INLINE bool TripleBufferManager::ReadIndex::isValid() const
+    {
+        return valid;
+    }
+
+
+    RWSYNC_INLINE bool TripleBufferManager::ReadIndex::canRead() const
+    {
+        return valid && owner.reader.hasData;
+    }
+
+
+    RWSYNC_INLINE bool TripleBufferManager::ReadIndex::hasUpdate() const
+    {
+        return valid && (owner.back.load(std::memory_order_relaxed) & freshBit) != 0;
+    }
+
+
+    RWSYNC_INLINE void TripleBufferManager::ReadIndex::pullUpdate()
+    {
+        if (valid)
+        {
+            bool gotUpdate = owner.pullRead();
+            owner.stats.countPull(this, gotUpdate);
+            if (gotUpdate)
+            {
+                latency.record(owner.versions.pushTimes[owner.reader.index].get());
+            }
+        }
+    }
+
+
+    RWSYNC_INLINE bool TripleBufferManager::ReadIndex::waitForUpdate()
+    {
+        if (!valid)
+        {
+            return false;
+        }
+
+        return owner.parked.wait([this]() { return hasUpdate(); }, nullptr);
+    }
+
+
+    RWSYNC_INLINE bool TripleBufferManager::ReadIndex::waitForUpdateFor(std::chrono::nanoseconds timeout)
+    {
+        if (!valid)
+        {
+            return false;
+        }
+
+        detail::ParkedReaders::Clock::time_point deadline = detail::ParkedReaders::deadlineAfter(timeout);
+        return owner.parked.wait([this]() { return hasUpdate(); }, &deadline);
+    }
+
+
+    RWSYNC_INLINE bool TripleBufferManager::ReadIndex::parkUntilUpdate(detail::AsyncWaiter& w)
+    {
+        if (!valid)
+        {
+            return false;
+        }
+
+        return owner.parked.park(w, [this]() { return hasUpdate(); });
+    }
+
+
+    RWSYNC_INLINE void TripleBufferManager::ReadIndex::unpark(detail::AsyncWaiter& w)
+    {
+        owner.parked.unpark(w);
+    }
+
+
+    RWSYNC_INLINE TripleBufferManager::ReadIndex::operator int() const
+    {
+        if (valid && owner.reader.hasData)
+        {
+            return owner.reader.index;
+        }
+        return -1;
+    }
+
+
+    RWSYNC_INLINE std::uint64_t TripleBufferManager::ReadIndex::version() const
+    {
+        return canRead() ? owner.reader.version : 0;
+    }
+
+
+    RWSYNC_INLINE std::uint64_t TripleBufferManager::ReadIndex::missedSinceLastPull() const
+    {
+        return valid ? owner.reader.missed : 0;
+    }
+
+
+    RWSYNC_INLINE detail::PushClock::time_point TripleBufferManager::ReadIndex::pushTime() const
+    {
+        return canRead() ? owner.versions.pushTimes[owner.reader.index].get() : detail::PushClock::time_point();
+    }
+
+
+    RWSYNC_INLINE std::chrono::nanoseconds TripleBufferManager::ReadIndex::age() const
+    {
+        return detail::ageOf(pushTime());
+    }
+
+
+    RWSYNC_INLINE LatencyHistogram TripleBufferManager::ReadIndex::getLatencyHistogram() const
+    {
+        return latency.snapshot();
+    }
+
+    /***** TripleBufferManager::Lockout *****/
+
+    RWSYNC_INLINE TripleBufferManager::Lockout::Lockout(TripleBufferManager& o)
+        : owner         (o)
+        , hasReadLock   (o.checkoutReader())
+        , hasWriteLock  (o.checkoutWriter())
+        , valid         (hasReadLock && hasWriteLock)
+        , draining      (false)
+    {
+        if (!valid)
+        {
+            owner.stats.countFailedLockout();
+        }
+    }
+
+
+    RWSYNC_INLINE TripleBufferManager::Lockout::Lockout(TripleBufferManager& o, std::chrono::nanoseconds timeout)
+        : owner         (o)
+        , hasReadLock   (false)
+        , hasWriteLock  (false)
+        , valid         (false)
+        , draining      (true)
+    {
+        owner.drainGate.close();
+
+        detail::ParkedReaders::Clock::time_point deadline = detail::ParkedReaders::deadlineAfter(timeout);
+        TripleBufferManager* m = &owner;
+        auto isDrained = [m]()
+        {
+            return m->nReaders.load(std::memory_order_relaxed) == 0
+                && m->nWriters.load(std::memory_order_relaxed) == 0;
+        };
+
+        // see Manager::Lockout
+        while (owner.drainGate.wait(isDrained, &deadline))
+        {
+            hasReadLock = owner.claimReader();
+            hasWriteLock = hasReadLock && owner.claimWriter();
+            if (hasWriteLock)
+            {
+                valid = true;
+                return;
+            }
+
+            if (hasReadLock)
+            {
+                owner.returnReader();
+                hasReadLock = false;
+            }
+        }
+
+        owner.stats.countFailedLockout();
+    }
+
+
+    RWSYNC_INLINE TripleBufferManager::Lockout::~Lockout()
+    {
+        if (hasReadLock)
+        {
+            owner.returnReader();
+        }
+
+        if (hasWriteLock)
+        {
+            owner.returnWriter();
+        }
+
+        if (draining)
+        {
+            owner.drainGate.open();
+        }
+    }
+
+
+    RWSYNC_INLINE bool TripleBufferManager::Lockout::isValid() const
+    {
+        return valid;
+    }
+
+
+    RWSYNC_INLINE bool TripleBufferManager::Lockout::isValidForManager(const TripleBufferManager* expected) const
+    {
+        return valid && expected == &owner;
+    }
+}
+
+#endif // RW_SYNC_TRIPLE_BUFFER_MANAGER_CPP_INCLUDED
@@ -0,0 +1,249 @@
+#ifndef RW_SYNC_TRIPLE_BUFFER_MANAGER_H_INCLUDED
+#define RW_SYNC_TRIPLE_BUFFER_MANAGER_H_INCLUDED
+
+/*
+ *  Copyright (C) 2019 Ethan Blackwood
+ *  This is free software released under the MIT license.
+ *  See attached LICENSE file for more details, or https://opensource.org/licenses/MIT.
+ */
+
+#include "RWSyncManager.h"
+
+/*
+ * Replacement for RWSync::Manager when there is only ever one reader (used by StaticContainer<T, 1>).
+ * Has the same interface, but is implemented as a classic triple buffer: there are always
+ * exactly 3 instances, one owned by the writer, one owned by the reader, and one "back" instance
+ * in between. Pushing and pulling each just swap one's own instance with the back instance using
+ * a single atomic exchange; a "fresh" bit stored alongside the back index says whether it holds
+ * a push that the reader hasn't pulled yet.
+ */
+
+namespace RWSync
+{
+    class RWSYNC_API TripleBufferManager
+    {
+    public:
+        class Lockout;
+
+        TripleBufferManager();
+
+        // Reset to state with no valid object
+        // No readers or writers should be active when this is called!
+        // If it does fail due to existing readers or writers, returns false
+        bool reset();
+
+        // Use this call if you already have a valid Lockout for doing other operations
+        bool reset(const Lockout& existingLock);
+
+        // always 1
+        int getMaxReaders() const;
+
+        // Snapshot of the hot-path counters (all zero unless RWSYNC_STATS is defined; see RWSyncStats.h).
+        // Since pushing and pulling are a single exchange, slotsProbed is always equal to pushes,
+        // and the retry counts are always 0. Can be called at any time from any thread.
+        Stats getStats() const;
+
+        class RWSYNC_API WriteIndex
+        {
+        public:
+            explicit WriteIndex(TripleBufferManager& o);
+
+            // Takes over other's checkout (if it has one), leaving other invalid.
+            WriteIndex(WriteIndex&& other);
+
+            ~WriteIndex();
+
+            // tries to claim writer status if we don't have it
+            // already - returns true if the write index is now valid.
+            bool tryToMakeValid();
+
+            // is there actually a place to write?
+            bool isValid() const;
+
+            // index to access the correct data instance
+            operator int() const;
+
+            // push a finished write to the reader
+            void pushUpdate();
+
+            // For compatibility with Manager::WriteIndex::pushUpdate(int). There's no choice of
+            // instance here; the writer always takes the back one.
+            void pushUpdate(int preferredNext);
+
+            // see Manager::WriteIndex::latestWasPulled
+            bool latestWasPulled() const;
+
+        private:
+            TripleBufferManager& owner;
+            bool valid;
+
+            WriteIndex(const WriteIndex&);
+            WriteIndex& operator=(const WriteIndex&);
+        };
+
+
+        class RWSYNC_API ReadIndex
+        {
+        public:
+            explicit ReadIndex(TripleBufferManager& o);
+
+            // see WriteIndex
+            ReadIndex(ReadIndex&& other);
+
+            ~ReadIndex();
+
+            // tries to claim reader status if we don't have it
+            // already - returns true if the read index is now valid.
+            bool tryToMakeValid();
+
+            // check whether the reader has been checked out successfully
+            bool isValid() const;
+
+            // check whether the reader has been checked out and there
+            // has been at least one write.
+            bool canRead() const;
+
+            // check whether a new write has been pushed
+            bool hasUpdate() const;
+
+            // update the index, if a new version is available
+            void pullUpdate();
+
+            // Block until hasUpdate() is true (spinning briefly, then sleeping until the writer pushes),
+            // so that the next pullUpdate() gets a new version. Returns false immediately if invalid.
+            bool waitForUpdate();
+
+            // Same as waitForUpdate, but gives up after the timeout. Returns hasUpdate().
+            bool waitForUpdateFor(std::chrono::nanoseconds timeout);
+
+            // see Manager::ReadIndex::parkUntilUpdate and unpark
+            bool parkUntilUpdate(detail::AsyncWaiter& w);
+            void unpark(detail::AsyncWaiter& w);
+
+            // index to access the correct data instance
+            operator int() const;
+
+            // see Manager::ReadIndex::version and missedSinceLastPull
+            std::uint64_t version() const;
+            std::uint64_t missedSinceLastPull() const;
+
+            // see Manager::ReadIndex::pushTime, age and getLatencyHistogram
+            std::chrono::steady_clock::time_point pushTime() const;
+            std::chrono::nanoseconds age() const;
+            LatencyHistogram getLatencyHistogram() const;
+
+        private:
+            TripleBufferManager& owner;
+            bool valid;
+            detail::LatencyCounters latency;
+
+            ReadIndex(const ReadIndex&);
+            ReadIndex& operator=(const ReadIndex&);
+        };
+
+
+        // Registers as the writer and the reader, so no other reader or writer
+        // can exist while it's held. Use to access all the underlying data without
+        // concern for who has access to what, e.g. for updating settings, resizing, etc.
+        class RWSYNC_API Lockout
+        {
+        public:
+            explicit Lockout(TripleBufferManager& o);
+
+            // Draining version; see Manager::Lockout.
+            Lockout(TripleBufferManager& o, std::chrono::nanoseconds timeout);
+
+            ~Lockout();
+
+            bool isValid() const;
+
+            bool isValidForManager(const TripleBufferManager* expected) const;
+
+        private:
+            TripleBufferManager& owner;
+            bool hasReadLock;
+            bool hasWriteLock;
+            bool valid;
+            const bool draining;
+        };
+
+    private:
+        // Registers the writer/reader. If one already exists, returns false, else
+        // returns true. returnWriter/returnReader should be called to release.
+        // Also fail while a draining Lockout is waiting or held.
+        bool checkoutWriter();
+        void returnWriter();
+
+        bool checkoutReader();
+        void returnReader();
+
+        // the same, ignoring draining Lockouts (for use by one)
+        bool claimWriter();
+        bool claimReader();
+
+        // Makes newly written data available and takes the back instance to write to next.
+        // Should only ever be called by the writer.
+        void pushWrite();
+
+        // Takes the back instance if it holds a new push and returns true, else returns false.
+        // Should only ever be called by the reader.
+        bool pullRead();
+
+        // in "back", set if the back instance has been pushed and not yet pulled
+        static const int freshBit = 4;
+        static const int indexMask = freshBit - 1;
+
+        struct WriterState
+        {
+            int index;
+            bool hasPushed; // false until the first push after a reset
+            std::uint64_t nPushes;
+        };
+
+        struct ReaderState
+        {
+            int index;
+            bool hasData; // false until the first pull after a reset
+            std::uint64_t version;
+            std::uint64_t missed;
+        };
+
+        // Version and time of the push in each instance. Each entry is only accessed by whoever
+        // owns that instance (and passed along with it by the exchanges on back).
+        struct Versions
+        {
+            std::uint64_t of[3];
+            detail::PushTime pushTimes[3];
+        };
+
+        // as in Manager, everything that is modified by different threads is on its own cache line
+        detail::Padded<std::atomic<int>> nWriters;
+        detail::Padded<std::atomic<int>> nReaders;
+
+        detail::DrainGate drainGate;
+
+        // index of the instance owned by neither the writer nor the reader, plus freshBit if applicable
+        detail::Padded<std::atomic<int>> back;
+
+        // These persist when the write or read index is returned, so the next one
+        // continues where it left off. Synchronized by checking out the writer or reader.
+        detail::Padded<WriterState> writer;
+        detail::Padded<ReaderState> reader;
+        detail::Padded<Versions> versions;
+
+        detail::StatsCounters stats;
+
+        // readers sleeping in waitForUpdate; the writer wakes them after each push
+        detail::ParkedReaders parked;
+
+#ifdef OPEN_EPHYS
+        JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(TripleBufferManager);
+#endif
+    };
+}
+
+#ifdef RWSYNC_HEADER_ONLY
+#include "RWSyncTripleBufferManager.cpp"
+#endif
+
+#endif // RW_SYNC_TRIPLE_BUFFER_MANAGER_H_INCLUDED
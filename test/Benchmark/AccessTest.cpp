@@ -0,0 +1,217 @@
+/*
+*  Copyright (C) 2019 Ethan Blackwood
+*  This is free software released under the MIT license.
+*  See attached LICENSE file for more details, or https://opensource.org/licenses/MIT.
+*/
+
+// Test of the checks made on access through read and write pointers (RWSYNC_ACCESS_CHECKS).
+//
+// Usage: RWSyncAccessTest
+//
+// Each access that can't be made must trip the check: dereferencing an invalid write pointer, an
+// invalid read pointer or one that has nothing to read yet, or an empty ReaderPool handle, and
+// indexing a ChannelBank channel out of range (from either side). Accesses that can be made must
+// not. The CMake build makes this once with RWSYNC_ACCESS_CHECKS=2, where tripping means throwing a
+// std::out_of_range*, and (on POSIX) once with RWSYNC_ACCESS_CHECKS=1, where it means failing an
+// assert, so each access is made in a forked child, which must be killed by SIGABRT.
+
+#if defined(RWSYNC_ACCESS_CHECKS) && RWSYNC_ACCESS_CHECKS == 1
+#undef NDEBUG // the checks are asserts, which must be on even in a release build
+#endif
+
+#include <cstdio>
+#include <stdexcept>
+
+#include "../../RWSync/Source/RWSyncChannelBank.h"
+#include "../../RWSync/Source/RWSyncContainer.h"
+#include "../../RWSync/Source/RWSyncReaderPool.h"
+#include "../../RWSync/Source/RWSyncSeqlockContainer.h"
+
+#if RWSYNC_ACCESS_CHECKS == 1
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#if RWSYNC_ACCESS_CHECKS < 1
+#error "RWSyncAccessTest needs RWSYNC_ACCESS_CHECKS to be 1 or 2"
+#endif
+
+namespace
+{
+    struct Sample
+    {
+        int value;
+    };
+
+    int nFailures = 0;
+
+    void fail(const char* what, const char* why)
+    {
+        ++nFailures;
+        std::fprintf(stderr, "FAILED: %s %s\n", what, why);
+    }
+
+#if RWSYNC_ACCESS_CHECKS >= 2
+
+    template<typename Access>
+    void expectTrip(const char* what, Access access)
+    {
+        try
+        {
+            access();
+            fail(what, "didn't throw");
+        }
+        catch (std::out_of_range* e)
+        {
+            delete e;
+        }
+    }
+
+    template<typename Access>
+    void expectOk(const char* what, Access access)
+    {
+        try
+        {
+            access();
+        }
+        catch (std::out_of_range* e)
+        {
+            delete e;
+            fail(what, "threw");
+        }
+    }
+
+#else
+
+    // in a child, so that the failed assert only ends that
+    template<typename Access>
+    void expectTrip(const char* what, Access access)
+    {
+        std::fflush(stderr);
+        pid_t child = fork();
+        if (child < 0)
+        {
+            std::perror("fork");
+            fail(what, "couldn't be tried");
+            return;
+        }
+        if (child == 0)
+        {
+            std::freopen("/dev/null", "w", stderr); // the assert's message isn't news
+            access();
+            _exit(0);
+        }
+
+        int status = 0;
+        waitpid(child, &status, 0);
+        if (!WIFSIGNALED(status) || WTERMSIG(status) != SIGABRT)
+        {
+            fail(what, "didn't fail an assert");
+        }
+    }
+
+    // (if this asserts, the whole test fails)
+    template<typename Access>
+    void expectOk(const char*, Access access)
+    {
+        access();
+    }
+
+#endif
+
+    void runContainer()
+    {
+        typedef RWSync::FixedContainer<Sample, 1> ContainerType;
+        ContainerType container;
+
+        ContainerType::WritePtr writePtr(container);
+        ContainerType::WritePtr secondWritePtr(container);
+        ContainerType::CarryForwardWritePtr carryForwardPtr(container);
+        ContainerType::ReadPtr readPtr(container);
+        ContainerType::ReadPtr secondReadPtr(container);
+
+        expectTrip("write through an invalid write pointer", [&]() { secondWritePtr->value = 1; });
+        expectTrip("write through an invalid carry-forward pointer", [&]() { carryForwardPtr->value = 1; });
+        expectTrip("read before anything was pushed", [&]() { (void)readPtr->value; });
+        expectOk("write through the valid write pointer", [&]() { writePtr->value = 1; });
+
+        writePtr.pushUpdate();
+        readPtr.pullUpdate();
+        secondReadPtr.pullUpdate();
+        expectOk("read after pulling", [&]() { (void)readPtr->value; });
+        expectTrip("read through an invalid read pointer", [&]() { (void)*secondReadPtr; });
+    }
+
+    void runChannelBank()
+    {
+        typedef RWSync::ChannelBank<int, 4, 1> BankType;
+        BankType bank;
+
+        BankType::WritePtr writePtr(bank);
+        BankType::WritePtr secondWritePtr(bank);
+        BankType::ReadPtr readPtr(bank);
+
+        expectTrip("write to a channel past the end", [&]() { writePtr[4] = 1; });
+        expectTrip("write to a negative channel", [&]() { writePtr[-1] = 1; });
+        expectTrip("write to a channel through an invalid write pointer", [&]() { secondWritePtr[0] = 1; });
+        expectTrip("read a channel before anything was pushed", [&]() { (void)readPtr[0]; });
+        expectOk("write to the last channel", [&]() { writePtr[3] = 1; });
+
+        writePtr.pushUpdate();
+        readPtr.pullUpdate();
+        expectTrip("read a channel past the end", [&]() { (void)readPtr[4]; });
+        expectTrip("read a negative channel", [&]() { (void)readPtr[-1]; });
+        expectTrip("version of a channel past the end", [&]() { (void)readPtr.channelVersion(4); });
+        expectOk("read the last channel", [&]() { (void)readPtr[3]; });
+    }
+
+    void runSeqlock()
+    {
+        typedef RWSync::SeqlockContainer<Sample> ContainerType;
+        ContainerType container;
+
+        ContainerType::WritePtr writePtr(container);
+        ContainerType::WritePtr secondWritePtr(container);
+        ContainerType::ReadPtr readPtr(container);
+
+        expectTrip("write through an invalid seqlock write pointer", [&]() { secondWritePtr->value = 1; });
+        expectTrip("read from a seqlock before anything was pushed", [&]() { (void)readPtr->value; });
+
+        writePtr->value = 1;
+        writePtr.pushUpdate();
+        readPtr.pullUpdate();
+        expectOk("read from a seqlock after pulling", [&]() { (void)readPtr->value; });
+    }
+
+    void runReaderPool()
+    {
+        typedef RWSync::ExpandableContainer<Sample> ContainerType;
+        ContainerType container;
+        RWSync::ReaderPool<ContainerType> pool(container, 1);
+
+        RWSync::ReaderPool<ContainerType>::Handle handle = pool.acquire();
+        RWSync::ReaderPool<ContainerType>::Handle emptyHandle = pool.acquire();
+        expectTrip("use an empty reader pool handle", [&]() { (void)*emptyHandle; });
+        expectOk("use a reader pool handle", [&]() { (void)*handle; });
+    }
+}
+
+int main()
+{
+    std::fprintf(stderr, "RWSYNC_ACCESS_CHECKS=%d\n", RWSYNC_ACCESS_CHECKS);
+
+    runContainer();
+    runChannelBank();
+    runSeqlock();
+    runReaderPool();
+
+    if (nFailures > 0)
+    {
+        std::fprintf(stderr, "%d failures\n", nFailures);
+        return 1;
+    }
+
+    std::fprintf(stderr, "All passed\n");
+    return 0;
+}
@@ -0,0 +1,409 @@
+/*
+*  Copyright (C) 2019 Ethan Blackwood
+*  This is free software released under the MIT license.
+*  See attached LICENSE file for more details, or https://opensource.org/licenses/MIT.
+*/
+
+// Stress test of waiting for updates from coroutines (RWSyncAwait.h); needs C++20.
+//
+// Usage: RWSyncAwaitTest [--rounds N] [--seed S]
+//
+//  - resume: consumer coroutines wait with `co_await rp.nextUpdate(schedule)` while the writer
+//    pushes with random pauses. Each one checks that every update it's resumed with is whole and
+//    newer than the last, and quits after a random number of them (so its frame, awaiter and read
+//    pointer are destroyed), and new ones are started in its place. Once the writer is done, every
+//    consumer still waiting must get the last push. This runs with schedule resuming the coroutine
+//    right away, on the writer's thread inside pushUpdate(), and with it posting the coroutine to a
+//    pool thread, so the coroutine (and the awaiter the writer is waking) can be gone before the
+//    writer's call to schedule returns; each schedule uses its own state after that. (Best run
+//    with AddressSanitizer, which reports any access to the gone awaiter.)
+//  - destroy: a coroutine destroyed while it's suspended waiting is taken off the waiters, so the
+//    next push doesn't schedule it, and its read pointer is released.
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "../../RWSync/Source/RWSyncAwait.h"
+#include "../../RWSync/Source/RWSyncContainer.h"
+
+#if RWSYNC_COROUTINES
+
+namespace
+{
+    struct Sample
+    {
+        static const int nWords = 24; // a few cache lines
+
+        std::uint64_t words[nWords];
+
+        void fill(std::uint64_t v)
+        {
+            for (int i = 0; i < nWords; ++i)
+            {
+                words[i] = v;
+            }
+        }
+
+        bool isAll(std::uint64_t v) const
+        {
+            for (int i = 0; i < nWords; ++i)
+            {
+                if (words[i] != v)
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+    };
+
+    static const int maxConsumers = 4;
+    typedef RWSync::FixedContainer<Sample, maxConsumers> ContainerType;
+
+    std::atomic<int> nFailures(0);
+
+    void fail(const char* test, const char* what, long long a, long long b)
+    {
+        ++nFailures;
+        std::fprintf(stderr, "FAILED [%s]: %s (%lld, %lld)\n", test, what, a, b);
+    }
+
+    // xorshift, for random pauses and quitting points
+    class Random
+    {
+    public:
+        explicit Random(std::uint64_t seed) : state(seed * 2654435761u + 1) {}
+
+        std::uint64_t next()
+        {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            return state;
+        }
+
+        void pause()
+        {
+            std::uint64_t r = next() % 16;
+            if (r < 8)
+            {
+                return;
+            }
+            if (r < 15)
+            {
+                for (std::uint64_t i = 0; i < r * 8; ++i)
+                {
+                    RWSync::detail::cpuRelax();
+                }
+                return;
+            }
+            std::this_thread::yield();
+        }
+
+    private:
+        std::uint64_t state;
+    };
+
+    // A few threads that resume the coroutines posted to them.
+    class Pool
+    {
+    public:
+        explicit Pool(int nThreads)
+            : stopping(false)
+        {
+            for (int t = 0; t < nThreads; ++t)
+            {
+                threads.emplace_back([this]() { run(); });
+            }
+        }
+
+        ~Pool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            cv.notify_all();
+            for (std::thread& thread : threads)
+            {
+                thread.join();
+            }
+        }
+
+        void post(std::coroutine_handle<> h)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                queue.push_back(h);
+            }
+            cv.notify_one();
+        }
+
+    private:
+        void run()
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            for (;;)
+            {
+                cv.wait(lock, [this]() { return stopping || !queue.empty(); });
+                if (queue.empty())
+                {
+                    return;
+                }
+                std::coroutine_handle<> h = queue.front();
+                queue.pop_front();
+
+                lock.unlock();
+                h.resume();
+                lock.lock();
+            }
+        }
+
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::deque<std::coroutine_handle<>> queue;
+        bool stopping;
+        std::vector<std::thread> threads;
+    };
+
+    // Runs as soon as it's called, and destroys its own frame when it returns.
+    struct Detached
+    {
+        struct promise_type
+        {
+            Detached get_return_object() { return Detached(); }
+            std::suspend_never initial_suspend() noexcept { return {}; }
+            std::suspend_never final_suspend() noexcept { return {}; }
+            void return_void() {}
+            void unhandled_exception() { std::terminate(); }
+        };
+    };
+
+    // Runs as soon as it's called, and is destroyed with the Owned (or once it has returned).
+    struct Owned
+    {
+        struct promise_type
+        {
+            Owned get_return_object()
+            {
+                return Owned(std::coroutine_handle<promise_type>::from_promise(*this));
+            }
+            std::suspend_never initial_suspend() noexcept { return {}; }
+            std::suspend_always final_suspend() noexcept { return {}; }
+            void return_void() {}
+            void unhandled_exception() { std::terminate(); }
+        };
+
+        explicit Owned(std::coroutine_handle<promise_type> h) : handle(h) {}
+
+        Owned(Owned&& other) : handle(other.handle)
+        {
+            other.handle = nullptr;
+        }
+
+        ~Owned()
+        {
+            if (handle)
+            {
+                handle.destroy();
+            }
+        }
+
+        std::coroutine_handle<promise_type> handle;
+    };
+
+    // Waits for updates until it gets lastVersion, or until it has had quitAfter of them. Counts
+    // itself out of nActive once its read pointer is released.
+    template<typename Schedule>
+    Detached consume(ContainerType& container, const char* test, Schedule schedule, int quitAfter,
+        std::uint64_t lastVersion, std::atomic<int>& nActive)
+    {
+        {
+            ContainerType::ReadPtr readPtr(container);
+            if (!readPtr.isValid())
+            {
+                fail(test, "consumer couldn't check out a reader", 0, 0);
+            }
+
+            std::uint64_t seen = 0;
+            int nUpdates = 0;
+            while (co_await readPtr.nextUpdate(schedule))
+            {
+                std::uint64_t version = readPtr.version();
+                if (version <= seen)
+                {
+                    fail(test, "resumed without a newer update", version, seen);
+                }
+                else if (!readPtr->isAll(version))
+                {
+                    fail(test, "torn update", readPtr->words[0], version);
+                }
+                seen = version;
+
+                if (version == lastVersion || ++nUpdates == quitAfter)
+                {
+                    break;
+                }
+            }
+        }
+        nActive.fetch_sub(1, std::memory_order_release);
+    }
+
+    template<typename Schedule>
+    void runResume(const char* test, Schedule schedule, std::uint64_t nPushes, std::uint64_t seed)
+    {
+        std::unique_ptr<ContainerType> container(new ContainerType());
+        ContainerType::WritePtr writePtr(*container);
+        Random random(seed);
+        std::atomic<int> nActive(0);
+
+        for (std::uint64_t v = 1; v <= nPushes; ++v)
+        {
+            while (nActive.load(std::memory_order_acquire) < maxConsumers)
+            {
+                nActive.fetch_add(1, std::memory_order_relaxed);
+                int quitAfter = random.next() % 4 == 0 ? 0 : int(1 + random.next() % 50);
+                consume(*container, test, schedule, quitAfter, nPushes, nActive);
+            }
+
+            random.pause();
+            writePtr->fill(v);
+            writePtr.pushUpdate();
+        }
+
+        std::chrono::steady_clock::time_point deadline =
+            std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while (nActive.load(std::memory_order_acquire) > 0)
+        {
+            if (std::chrono::steady_clock::now() > deadline)
+            {
+                fail(test, "consumers still waiting after the last push (lost wake-up)",
+                    nActive.load(), 0);
+                std::abort(); // can't safely destroy the container with coroutines parked on it
+            }
+            std::this_thread::yield();
+        }
+        std::fprintf(stderr, "  %s: done\n", test);
+    }
+
+    template<typename Schedule>
+    Owned waitForUpdates(ContainerType& container, Schedule schedule, int& nResumed)
+    {
+        ContainerType::ReadPtr readPtr(container);
+        while (co_await readPtr.nextUpdate(schedule))
+        {
+            ++nResumed;
+        }
+    }
+
+    void runDestroy(int nRounds)
+    {
+        const char* test = "destroy while waiting";
+        std::unique_ptr<ContainerType> container(new ContainerType());
+        ContainerType::WritePtr writePtr(*container);
+        int nScheduled = 0;
+        auto schedule = [&nScheduled](std::coroutine_handle<>) { ++nScheduled; };
+
+        for (int round = 1; round <= nRounds; ++round)
+        {
+            int nResumed = 0;
+            {
+                Owned waiting = waitForUpdates(*container, schedule, nResumed);
+                if (nResumed != 0 || waiting.handle.done())
+                {
+                    fail(test, "coroutine didn't wait", nResumed, 0);
+                }
+            }
+
+            writePtr->fill(round);
+            writePtr.pushUpdate();
+            if (nScheduled != 0)
+            {
+                fail(test, "destroyed coroutine was scheduled", nScheduled, 0);
+                return;
+            }
+
+            // every reader was released
+            std::vector<std::unique_ptr<ContainerType::ReadPtr>> readers;
+            for (int r = 0; r < maxConsumers; ++r)
+            {
+                readers.emplace_back(new ContainerType::ReadPtr(*container));
+                if (!readers.back()->isValid())
+                {
+                    fail(test, "destroyed coroutine's reader wasn't released", r, maxConsumers);
+                    return;
+                }
+            }
+        }
+        std::fprintf(stderr, "  %s: done\n", test);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::uint64_t nPushes = 20000;
+    std::uint64_t seed = 1;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (std::strcmp(argv[i], "--rounds") == 0)
+        {
+            nPushes = std::strtoull(argv[i + 1], nullptr, 10);
+        }
+        else if (std::strcmp(argv[i], "--seed") == 0)
+        {
+            seed = std::strtoull(argv[i + 1], nullptr, 10);
+        }
+    }
+
+    // Each schedule uses its own state after handing off the coroutine, as a schedule may (which
+    // would be a use after free if that were the awaiter's copy).
+    std::atomic<std::uint64_t> nScheduled(0);
+    runResume("resume on the writer's thread", [&nScheduled](std::coroutine_handle<> h)
+        {
+            h.resume();
+            nScheduled.fetch_add(1, std::memory_order_relaxed);
+        }, nPushes, seed);
+    {
+        Pool pool(2);
+        runResume("resume on a pool", [&pool, &nScheduled](std::coroutine_handle<> h)
+            {
+                pool.post(h);
+                nScheduled.fetch_add(1, std::memory_order_relaxed);
+            }, nPushes, seed + 1);
+    }
+    if (nScheduled.load() == 0)
+    {
+        fail("resume", "no coroutine was ever scheduled", 0, 1);
+    }
+    runDestroy(100);
+
+    if (nFailures.load() > 0)
+    {
+        std::fprintf(stderr, "%d failures\n", nFailures.load());
+        return 1;
+    }
+
+    std::fprintf(stderr, "All passed\n");
+    return 0;
+}
+
+#else
+
+int main()
+{
+    std::fprintf(stderr, "Coroutines aren't supported by this compiler; nothing to test\n");
+    return 0;
+}
+
+#endif // RWSYNC_COROUTINES
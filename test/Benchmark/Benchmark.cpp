@@ -0,0 +1,515 @@
+/*
+*  Copyright (C) 2019 Ethan Blackwood
+*  This is free software released under the MIT license.
+*  See attached LICENSE file for more details, or https://opensource.org/licenses/MIT.
+*/
+
+// Push/pull throughput and latency benchmarks for the RWSync containers.
+//
+// Usage: RWSyncBenchmark [--duration-ms N] [--output FILE] [--csv]
+//
+// Runs three sweeps, each for the expandable (Manager) and static (FixedManager/TripleBufferManager)
+// engines, and also the seqlock engine (SeqlockContainer) for payloads that it can hold:
+//  - reader count: 1, 2, 4, 8, 16 and 32 readers continuously pulling a 64-byte payload
+//  - reader activity: 4 readers that are idle, only polling hasUpdate(), pulling, pulling with every
+//    pull timed, or pulling after blocking in waitForUpdateFor()
+//  - payload size: 4 readers pulling 8 B to 64 KiB payloads
+//
+// Results are written as a JSON object (default) with the clock overhead and a "results" array of one
+// record per scenario, or as CSV with one row per scenario. Each record has pushes/pulls per
+// second and the p50/p99/p99.9/max latency of sampled push and pull calls in nanoseconds. Latencies
+// are measured around single calls, so they include the cost of reading the clock (also reported).
+// The max is over every timed call, so in the "pulling-timed" mode it is the worst-case pull latency.
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../../RWSync/Source/RWSyncContainer.h"
+#include "../../RWSync/Source/RWSyncSeqlockContainer.h"
+
+namespace
+{
+    typedef std::chrono::steady_clock Clock;
+
+    // record the latency of every sampleInterval-th operation
+    const int sampleInterval = 16;
+    const size_t maxSamples = size_t(1) << 18;
+
+    enum ReaderMode
+    {
+        idle,           // readers exist but never touch the container
+        polling,        // readers spin on hasUpdate() without pulling
+        pulling,        // readers spin on hasUpdate() and pullUpdate() whenever there is an update
+        timedPulling,   // same as pulling, but every pull is timed rather than a sample
+        waiting         // readers block in waitForUpdateFor() and then pullUpdate()
+    };
+
+    const char* readerModeName(ReaderMode mode)
+    {
+        switch (mode)
+        {
+        case idle:          return "idle";
+        case polling:       return "polling";
+        case timedPulling:  return "pulling-timed";
+        case waiting:       return "waiting";
+        default:            return "pulling";
+        }
+    }
+
+    struct LatencyStats
+    {
+        double p50 = 0, p99 = 0, p999 = 0, max = 0;
+        size_t nSamples = 0;
+    };
+
+    struct Result
+    {
+        std::string engine;
+        size_t payloadBytes;
+        int nReaders;
+        ReaderMode mode;
+        double seconds;
+        long long nPushes;
+        long long nPulls;
+        LatencyStats push;
+        LatencyStats pull;
+    };
+
+    // Latency samples for one thread, overwriting the oldest when full (but keeping the max of all).
+    class SampleBuffer
+    {
+    public:
+        explicit SampleBuffer(int everyN = sampleInterval)
+            : samples(maxSamples), next(0), full(false), counter(0), interval(everyN), worst(0) {}
+
+        // true if the current operation should be timed
+        bool shouldSample()
+        {
+            return ++counter % interval == 0;
+        }
+
+        void add(Clock::duration d)
+        {
+            double ns = std::chrono::duration<double, std::nano>(d).count();
+            worst = std::max(worst, ns);
+            samples[next] = ns;
+            if (++next == samples.size())
+            {
+                next = 0;
+                full = true;
+            }
+        }
+
+        void appendTo(std::vector<double>& all) const
+        {
+            all.insert(all.end(), samples.begin(), samples.begin() + (full ? samples.size() : next));
+        }
+
+        double max() const
+        {
+            return worst;
+        }
+
+    private:
+        std::vector<double> samples;
+        size_t next;
+        bool full;
+        unsigned int counter;
+        const unsigned int interval;
+        double worst;
+    };
+
+    // max is the largest of all timed calls, including any that were overwritten in samples
+    LatencyStats summarize(std::vector<double>& samples, double max)
+    {
+        LatencyStats stats;
+        stats.nSamples = samples.size();
+        if (samples.empty())
+        {
+            return stats;
+        }
+
+        std::sort(samples.begin(), samples.end());
+        size_t n = samples.size();
+        stats.p50 = samples[n / 2];
+        stats.p99 = samples[std::min(n - 1, n * 99 / 100)];
+        stats.p999 = samples[std::min(n - 1, n * 999 / 1000)];
+        stats.max = max;
+        return stats;
+    }
+
+    // Touches one byte per cache line of the payload, so that moving instances between cores costs
+    // something like it would if the data were actually used, without being dominated by a full copy.
+    template<size_t bytes>
+    struct Payload
+    {
+        std::array<unsigned char, bytes> data;
+
+        Payload() { data.fill(0); }
+
+        void write(unsigned char value)
+        {
+            for (size_t i = 0; i < bytes; i += 64)
+            {
+                data[i] = value;
+            }
+        }
+
+        unsigned int read() const
+        {
+            unsigned int sum = 0;
+            for (size_t i = 0; i < bytes; i += 64)
+            {
+                sum += data[i];
+            }
+            return sum;
+        }
+    };
+
+    // keeps the optimizer from dropping reads
+    std::atomic<unsigned int> sink(0);
+
+    template<typename ContainerType, typename T>
+    Result runScenario(ContainerType& container, const char* engine, int nReaders,
+        ReaderMode mode, std::chrono::milliseconds duration)
+    {
+        typedef typename ContainerType::WritePtr WritePtr;
+        typedef typename ContainerType::ReadPtr ReadPtr;
+
+        std::atomic<bool> started(false);
+        std::atomic<bool> done(false);
+        std::atomic<int> nReady(0);
+
+        long long nPushes = 0;
+        SampleBuffer pushSamples;
+        std::vector<long long> nPulls(nReaders, 0);
+        std::vector<std::unique_ptr<SampleBuffer>> pullSamples;
+        for (int i = 0; i < nReaders; ++i)
+        {
+            pullSamples.emplace_back(new SampleBuffer(mode == timedPulling ? 1 : sampleInterval));
+        }
+
+        std::vector<std::thread> readers;
+        for (int r = 0; r < nReaders; ++r)
+        {
+            readers.emplace_back([&, r]
+            {
+                ReadPtr readPtr(container);
+                if (!readPtr.isValid())
+                {
+                    std::fprintf(stderr, "Failed to check out reader %d\n", r);
+                    std::abort();
+                }
+
+                ++nReady;
+                while (!started.load(std::memory_order_acquire))
+                {
+                    std::this_thread::yield();
+                }
+
+                SampleBuffer& samples = *pullSamples[r];
+                unsigned int sum = 0;
+                long long pulls = 0;
+                while (!done.load(std::memory_order_relaxed))
+                {
+                    if (mode == idle)
+                    {
+                        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    }
+                    else if (mode == waiting ? readPtr.waitForUpdateFor(std::chrono::milliseconds(1))
+                        : (readPtr.hasUpdate() && (mode == pulling || mode == timedPulling)))
+                    {
+                        if (samples.shouldSample())
+                        {
+                            Clock::time_point start = Clock::now();
+                            readPtr.pullUpdate();
+                            samples.add(Clock::now() - start);
+                        }
+                        else
+                        {
+                            readPtr.pullUpdate();
+                        }
+                        sum += readPtr->read();
+                        ++pulls;
+                    }
+                }
+
+                nPulls[r] = pulls;
+                sink += sum;
+            });
+        }
+
+        while (nReady.load() < nReaders)
+        {
+            std::this_thread::yield();
+        }
+
+        Clock::time_point start;
+        Clock::time_point end;
+        std::thread writer([&]
+        {
+            WritePtr writePtr(container);
+            if (!writePtr.isValid())
+            {
+                std::fprintf(stderr, "Failed to check out writer\n");
+                std::abort();
+            }
+
+            start = Clock::now();
+            started.store(true, std::memory_order_release);
+            Clock::time_point stopTime = start + duration;
+
+            long long pushes = 0;
+            while (true)
+            {
+                writePtr->write(static_cast<unsigned char>(pushes));
+                if (pushSamples.shouldSample())
+                {
+                    Clock::time_point pushStart = Clock::now();
+                    writePtr.pushUpdate();
+                    Clock::time_point pushEnd = Clock::now();
+                    pushSamples.add(pushEnd - pushStart);
+
+                    if (pushEnd >= stopTime)
+                    {
+                        end = pushEnd;
+                        break;
+                    }
+                }
+                else
+                {
+                    writePtr.pushUpdate();
+                }
+                ++pushes;
+            }
+            nPushes = pushes + 1;
+            done = true;
+        });
+
+        writer.join();
+        for (std::thread& reader : readers)
+        {
+            reader.join();
+        }
+
+        Result result;
+        result.engine = engine;
+        result.payloadBytes = sizeof(T);
+        result.nReaders = nReaders;
+        result.mode = mode;
+        result.seconds = std::chrono::duration<double>(end - start).count();
+        result.nPushes = nPushes;
+        result.nPulls = 0;
+
+        std::vector<double> all;
+        pushSamples.appendTo(all);
+        result.push = summarize(all, pushSamples.max());
+
+        all.clear();
+        double pullMax = 0;
+        for (int r = 0; r < nReaders; ++r)
+        {
+            result.nPulls += nPulls[r];
+            pullSamples[r]->appendTo(all);
+            pullMax = std::max(pullMax, pullSamples[r]->max());
+        }
+        result.pull = summarize(all, pullMax);
+
+        return result;
+    }
+
+    template<typename T>
+    Result runExpandable(int nReaders, ReaderMode mode, std::chrono::milliseconds duration)
+    {
+        std::unique_ptr<RWSync::ExpandableContainer<T>> container(new RWSync::ExpandableContainer<T>());
+        container->increaseMaxReadersTo(nReaders);
+        return runScenario<RWSync::ExpandableContainer<T>, T>(*container, "expandable", nReaders, mode, duration);
+    }
+
+    template<typename T, int maxReaders>
+    Result runStaticWithMax(ReaderMode mode, std::chrono::milliseconds duration)
+    {
+        typedef RWSync::StaticContainer<T, maxReaders> ContainerType;
+        std::unique_ptr<ContainerType> container(new ContainerType());
+        return runScenario<ContainerType, T>(*container, "static", maxReaders, mode, duration);
+    }
+
+    template<typename T>
+    Result runStatic(int nReaders, ReaderMode mode, std::chrono::milliseconds duration)
+    {
+        switch (nReaders)
+        {
+        case 1:  return runStaticWithMax<T, 1>(mode, duration);
+        case 2:  return runStaticWithMax<T, 2>(mode, duration);
+        case 4:  return runStaticWithMax<T, 4>(mode, duration);
+        case 8:  return runStaticWithMax<T, 8>(mode, duration);
+        case 16: return runStaticWithMax<T, 16>(mode, duration);
+        case 32: return runStaticWithMax<T, 32>(mode, duration);
+        default:
+            std::fprintf(stderr, "Unsupported static reader count %d\n", nReaders);
+            std::abort();
+        }
+    }
+
+    // SeqlockContainer only accepts small types, so larger payloads are skipped.
+    template<typename T, bool fitsSeqlock = (sizeof(T) <= RWSYNC_SEQLOCK_MAX_SIZE)>
+    struct SeqlockRunner
+    {
+        static void run(std::vector<Result>& results, int nReaders, ReaderMode mode, std::chrono::milliseconds duration)
+        {
+            typedef RWSync::SeqlockContainer<T> ContainerType;
+            std::unique_ptr<ContainerType> container(new ContainerType());
+            results.push_back(runScenario<ContainerType, T>(*container, "seqlock", nReaders, mode, duration));
+        }
+    };
+
+    template<typename T>
+    struct SeqlockRunner<T, false>
+    {
+        static void run(std::vector<Result>&, int, ReaderMode, std::chrono::milliseconds) {}
+    };
+
+    template<typename T>
+    void runBoth(std::vector<Result>& results, int nReaders, ReaderMode mode, std::chrono::milliseconds duration)
+    {
+        results.push_back(runExpandable<T>(nReaders, mode, duration));
+        results.push_back(runStatic<T>(nReaders, mode, duration));
+        SeqlockRunner<T>::run(results, nReaders, mode, duration);
+        const Result& r = results.back();
+        std::fprintf(stderr, "  %zu B, %d readers, %s: done\n", r.payloadBytes, r.nReaders, readerModeName(r.mode));
+    }
+
+    double clockOverheadNs()
+    {
+        const int n = 1000000;
+        Clock::time_point start = Clock::now();
+        for (int i = 0; i < n - 1; ++i)
+        {
+            Clock::now();
+        }
+        return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / n;
+    }
+
+    void writeJson(FILE* out, const std::vector<Result>& results, double clockNs)
+    {
+        std::fprintf(out, "{\n  \"clock_overhead_ns\": %.2f,\n  \"results\": [\n", clockNs);
+        for (size_t i = 0; i < results.size(); ++i)
+        {
+            const Result& r = results[i];
+            std::fprintf(out,
+                "    {\"engine\": \"%s\", \"payload_bytes\": %zu, \"readers\": %d, \"reader_mode\": \"%s\", "
+                "\"seconds\": %.4f, \"pushes\": %lld, \"pulls\": %lld, "
+                "\"pushes_per_s\": %.1f, \"pulls_per_s\": %.1f, "
+                "\"push_ns\": {\"p50\": %.1f, \"p99\": %.1f, \"p999\": %.1f, \"max\": %.1f, \"samples\": %zu}, "
+                "\"pull_ns\": {\"p50\": %.1f, \"p99\": %.1f, \"p999\": %.1f, \"max\": %.1f, \"samples\": %zu}}%s\n",
+                r.engine.c_str(), r.payloadBytes, r.nReaders, readerModeName(r.mode),
+                r.seconds, r.nPushes, r.nPulls, r.nPushes / r.seconds, r.nPulls / r.seconds,
+                r.push.p50, r.push.p99, r.push.p999, r.push.max, r.push.nSamples,
+                r.pull.p50, r.pull.p99, r.pull.p999, r.pull.max, r.pull.nSamples,
+                i + 1 < results.size() ? "," : "");
+        }
+        std::fprintf(out, "  ]\n}\n");
+    }
+
+    void writeCsv(FILE* out, const std::vector<Result>& results, double clockNs)
+    {
+        std::fprintf(out, "engine,payload_bytes,readers,reader_mode,seconds,pushes,pulls,pushes_per_s,pulls_per_s,"
+            "push_p50_ns,push_p99_ns,push_p999_ns,push_max_ns,pull_p50_ns,pull_p99_ns,pull_p999_ns,pull_max_ns,"
+            "clock_overhead_ns\n");
+        for (const Result& r : results)
+        {
+            std::fprintf(out, "%s,%zu,%d,%s,%.4f,%lld,%lld,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f,%.2f\n",
+                r.engine.c_str(), r.payloadBytes, r.nReaders, readerModeName(r.mode),
+                r.seconds, r.nPushes, r.nPulls, r.nPushes / r.seconds, r.nPulls / r.seconds,
+                r.push.p50, r.push.p99, r.push.p999, r.push.max,
+                r.pull.p50, r.pull.p99, r.pull.p999, r.pull.max, clockNs);
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    std::chrono::milliseconds duration(200);
+    const char* outputPath = nullptr;
+    bool csv = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--duration-ms") == 0 && i + 1 < argc)
+        {
+            duration = std::chrono::milliseconds(std::atoi(argv[++i]));
+        }
+        else if (std::strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+        {
+            outputPath = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--csv") == 0)
+        {
+            csv = true;
+        }
+        else
+        {
+            std::fprintf(stderr, "Usage: %s [--duration-ms N] [--output FILE] [--csv]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    std::vector<Result> results;
+    typedef Payload<64> SmallPayload;
+
+    std::fprintf(stderr, "Reader count sweep\n");
+    const int readerCounts[] = { 1, 2, 4, 8, 16, 32 };
+    for (int nReaders : readerCounts)
+    {
+        runBoth<SmallPayload>(results, nReaders, pulling, duration);
+    }
+
+    std::fprintf(stderr, "Reader activity sweep\n");
+    runBoth<SmallPayload>(results, 4, idle, duration);
+    runBoth<SmallPayload>(results, 4, polling, duration);
+    runBoth<SmallPayload>(results, 4, timedPulling, duration);
+    runBoth<SmallPayload>(results, 4, waiting, duration);
+
+    std::fprintf(stderr, "Payload size sweep\n");
+    runBoth<Payload<8>>(results, 4, pulling, duration);
+    runBoth<Payload<1024>>(results, 4, pulling, duration);
+    runBoth<Payload<4096>>(results, 4, pulling, duration);
+    runBoth<Payload<65536>>(results, 4, pulling, duration);
+
+    FILE* out = stdout;
+    if (outputPath != nullptr)
+    {
+        out = std::fopen(outputPath, "w");
+        if (out == nullptr)
+        {
+            std::fprintf(stderr, "Could not open %s for writing\n", outputPath);
+            return 1;
+        }
+    }
+
+    double clockNs = clockOverheadNs();
+    if (csv)
+    {
+        writeCsv(out, results, clockNs);
+    }
+    else
+    {
+        writeJson(out, results, clockNs);
+    }
+
+    if (out != stdout)
+    {
+        std::fclose(out);
+    }
+
+    return 0;
+}
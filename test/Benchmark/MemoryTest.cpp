@@ -0,0 +1,275 @@
+/*
+*  Copyright (C) 2019 Ethan Blackwood
+*  This is free software released under the MIT license.
+*  See attached LICENSE file for more details, or https://opensource.org/licenses/MIT.
+*/
+
+// Test of where containers allocate (RWSyncMemoryResource.h and RWSyncPageArena.h).
+//
+// Usage: RWSyncMemoryTest
+//
+// Global operator new is replaced to count calls, and checks that:
+//  - expandable and fixed containers made in a BufferResource make no global allocations while they
+//    are made, expanded, written, read and destroyed (and a static container makes none at all);
+//  - a BufferResource that's used up throws std::bad_alloc, without handing out any more of it,
+//    and so does making a container in one that's too small;
+//  - a container with page alignment made in a PageArena has every instance on its own page.
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <set>
+
+#include "../../RWSync/Source/RWSyncContainer.h"
+#include "../../RWSync/Source/RWSyncPageArena.h"
+
+namespace
+{
+    // Global allocations made while counting (only ever set on the main thread).
+    bool counting = false;
+    long nAllocations = 0;
+
+    int nFailures = 0;
+
+    void fail(const char* test, const char* what, long long a, long long b)
+    {
+        ++nFailures;
+        std::fprintf(stderr, "FAILED [%s]: %s (%lld, %lld)\n", test, what, a, b);
+    }
+
+    struct Sample
+    {
+        std::uint64_t words[16];
+    };
+
+    static const std::size_t pageSize = 4096;
+
+    // room for the instances and reader counts of the containers below, many times over
+    alignas(64) unsigned char buffer[1 << 20];
+
+    // Writes and reads a few times with every reader.
+    template<typename ContainerType>
+    void exercise(ContainerType& container, int nReaders)
+    {
+        typename ContainerType::WritePtr writePtr(container);
+        for (int r = 0; r < nReaders; ++r)
+        {
+            typename ContainerType::ReadPtr readPtr(container);
+            for (int k = 0; k < 3; ++k)
+            {
+                writePtr->words[0] = std::uint64_t(r * 3 + k);
+                writePtr.pushUpdate();
+                readPtr.pullUpdate();
+            }
+        }
+    }
+
+    void runNoGlobalAllocations()
+    {
+        const char* test = "no global allocations";
+        RWSync::BufferResource resource(buffer, sizeof(buffer));
+
+        counting = true;
+        {
+            RWSync::ExpandableContainer<Sample> container{ RWSync::InMemory(resource) };
+            container.increaseMaxReadersTo(4);
+            exercise(container, 4);
+        }
+        long nExpandable = nAllocations;
+        {
+            RWSync::FixedContainer<Sample, 3> container{ RWSync::InMemory(resource) };
+            exercise(container, 3);
+        }
+        long nFixed = nAllocations - nExpandable;
+        {
+            RWSync::StaticContainer<Sample, 3> container;
+            exercise(container, 3);
+        }
+        long nStatic = nAllocations - nExpandable - nFixed;
+        counting = false;
+
+        if (nExpandable != 0)
+        {
+            fail(test, "expandable container allocated outside its resource", nExpandable, 0);
+        }
+        if (nFixed != 0)
+        {
+            fail(test, "fixed container allocated outside its resource", nFixed, 0);
+        }
+        if (nStatic != 0)
+        {
+            fail(test, "static container allocated", nStatic, 0);
+        }
+        if (resource.getUsed() == 0)
+        {
+            fail(test, "containers didn't allocate from their resource", 0, 1);
+        }
+        std::fprintf(stderr, "  %s: done (%zu bytes of the buffer used)\n", test, resource.getUsed());
+    }
+
+    void runExhaustion()
+    {
+        const char* test = "exhaustion";
+        {
+            RWSync::BufferResource resource(buffer, 256);
+            resource.allocate(200, 8);
+            std::size_t used = resource.getUsed();
+
+            bool threw = false;
+            try
+            {
+                resource.allocate(100, 8);
+            }
+            catch (const std::bad_alloc&)
+            {
+                threw = true;
+            }
+            if (!threw)
+            {
+                fail(test, "allocating more than is left didn't throw", 100, 256 - used);
+            }
+            if (resource.getUsed() != used)
+            {
+                fail(test, "failed allocation used some of the buffer", resource.getUsed(), used);
+            }
+
+            // what's left is still there (the buffer is 64-byte aligned, so no padding is needed)
+            void* rest = resource.allocate(56, 8);
+            if (rest != buffer + 200 || resource.getUsed() != resource.getSize())
+            {
+                fail(test, "the rest of the buffer wasn't handed out", resource.getUsed(), resource.getSize());
+            }
+        }
+
+        {
+            // too small for even a single-reader container's instances
+            RWSync::BufferResource resource(buffer, sizeof(Sample));
+            bool threw = false;
+            try
+            {
+                RWSync::ExpandableContainer<Sample> container{ RWSync::InMemory(resource) };
+            }
+            catch (const std::bad_alloc&)
+            {
+                threw = true;
+            }
+            if (!threw)
+            {
+                fail(test, "making a container in too small a buffer didn't throw", sizeof(Sample), 0);
+            }
+        }
+        std::fprintf(stderr, "  %s: done\n", test);
+    }
+
+    void checkPageAligned(const char* test, std::set<std::uintptr_t>& seen, const Sample& instance)
+    {
+        std::uintptr_t address = reinterpret_cast<std::uintptr_t>(&instance);
+        if (address % pageSize != 0)
+        {
+            fail(test, "instance isn't page-aligned", address % pageSize, 0);
+        }
+        seen.insert(address / pageSize);
+    }
+
+    void runPageArena(int options)
+    {
+        const char* test = options == 0 ? "page arena" : "page arena (huge pages)";
+        typedef RWSync::ExpandableContainer<Sample, pageSize> ContainerType;
+        static const int nReaders = 3;
+
+        RWSync::PageArena arena(1 << 20, options);
+        if (reinterpret_cast<std::uintptr_t>(arena.allocate(1, 1)) % pageSize != 0)
+        {
+            fail(test, "arena doesn't start on a page", 0, 0);
+        }
+        {
+            ContainerType container{ RWSync::InMemory(arena) };
+            container.increaseMaxReadersTo(nReaders);
+
+            // Hold a reader on each of several pushes, so that the writer takes a new instance for each.
+            std::set<std::uintptr_t> pages;
+            ContainerType::WritePtr writePtr(container);
+            ContainerType::ReadPtr readPtrs[nReaders] = {
+                ContainerType::ReadPtr(container),
+                ContainerType::ReadPtr(container),
+                ContainerType::ReadPtr(container) };
+            checkPageAligned(test, pages, *writePtr);
+            for (int r = 0; r < nReaders; ++r)
+            {
+                writePtr.pushUpdate();
+                checkPageAligned(test, pages, *writePtr);
+                readPtrs[r].pullUpdate();
+                checkPageAligned(test, pages, *readPtrs[r]);
+            }
+
+            if (int(pages.size()) != nReaders + 1)
+            {
+                fail(test, "instances seen didn't each have their own page", pages.size(), nReaders + 1);
+            }
+        }
+
+        std::size_t used = arena.getUsed();
+        void* block = arena.allocate(10, pageSize);
+        if (reinterpret_cast<std::uintptr_t>(block) % pageSize != 0 || arena.getUsed() <= used)
+        {
+            fail(test, "page-aligned allocation", reinterpret_cast<std::uintptr_t>(block) % pageSize, 0);
+        }
+
+        bool threw = false;
+        try
+        {
+            arena.allocate(arena.getSize(), 1);
+        }
+        catch (const std::bad_alloc&)
+        {
+            threw = true;
+        }
+        if (!threw)
+        {
+            fail(test, "allocating more than the arena has didn't throw", arena.getSize(), arena.getUsed());
+        }
+        std::fprintf(stderr, "  %s: done\n", test);
+    }
+}
+
+void* operator new(std::size_t size)
+{
+    if (counting)
+    {
+        ++nAllocations;
+    }
+    void* block = std::malloc(size == 0 ? 1 : size);
+    if (block == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return block;
+}
+
+void operator delete(void* block) noexcept
+{
+    std::free(block);
+}
+
+void operator delete(void* block, std::size_t) noexcept
+{
+    std::free(block);
+}
+
+int main()
+{
+    runNoGlobalAllocations();
+    runExhaustion();
+    runPageArena(0);
+    runPageArena(RWSync::PageArena::hugePages);
+
+    if (nFailures > 0)
+    {
+        std::fprintf(stderr, "%d failures\n", nFailures);
+        return 1;
+    }
+
+    std::fprintf(stderr, "All passed\n");
+    return 0;
+}
@@ -0,0 +1,311 @@
+/*
+*  Copyright (C) 2019 Ethan Blackwood
+*  This is free software released under the MIT license.
+*  See attached LICENSE file for more details, or https://opensource.org/licenses/MIT.
+*/
+
+// Multi-process test of SharedContainer (POSIX only, since it forks).
+//
+// Usage: RWSyncSharedTest
+//
+// The parent creates a container with room for one reader and pushes to it. A forked child opens
+// the container by name, checks that it reads the parent's push and then keeps holding its read
+// pointer, so that the single reader record stays taken. The parent then checks that:
+//  - another reader can't register while the child is alive;
+//  - once the child is killed (without returning its record), reclaimAbandoned() frees the record,
+//    and a new reader gets the latest push;
+//  - opening the container as a different type, or opening a name that doesn't exist, is rejected;
+//  - creating a container with the name of one that exists fails (leaving it intact), and so does
+//    creating one whose creator crashed, until removeStale() removes the name it left behind.
+
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../../RWSync/Source/RWSyncSharedContainer.h"
+
+namespace
+{
+    struct Sample
+    {
+        std::uint64_t version;
+        std::uint64_t words[7];
+
+        void fill(std::uint64_t v)
+        {
+            version = v;
+            for (int i = 0; i < 7; ++i)
+            {
+                words[i] = v;
+            }
+        }
+
+        bool isAll(std::uint64_t v) const
+        {
+            for (int i = 0; i < 7; ++i)
+            {
+                if (words[i] != v)
+                {
+                    return false;
+                }
+            }
+            return version == v;
+        }
+    };
+
+    // a different type, of a different size
+    struct Mismatched
+    {
+        std::uint64_t words[9];
+    };
+
+    int nFailures = 0;
+
+    void fail(const char* what, long long a, long long b)
+    {
+        ++nFailures;
+        std::fprintf(stderr, "FAILED: %s (%lld, %lld)\n", what, a, b);
+    }
+
+    // Whether opening the named region as a SharedContainer<U> throws.
+    template<typename U>
+    bool openingFails(const std::string& name)
+    {
+        try
+        {
+            RWSync::SharedContainer<U> opened(name);
+            return false;
+        }
+        catch (std::runtime_error* e)
+        {
+            delete e;
+            return true;
+        }
+    }
+
+    // Whether creating a container with the given name throws.
+    bool creatingFails(const std::string& name)
+    {
+        try
+        {
+            RWSync::SharedContainer<Sample> created(name, 1);
+            return false;
+        }
+        catch (std::runtime_error* e)
+        {
+            delete e;
+            return true;
+        }
+    }
+
+    // In a child: create a container and exit without destroying it, as if the creator crashed.
+    bool leaveStale(const std::string& name)
+    {
+        pid_t child = fork();
+        if (child < 0)
+        {
+            std::perror("fork");
+            return false;
+        }
+        if (child == 0)
+        {
+            new RWSync::SharedContainer<Sample>(name, 1);
+            _exit(0);
+        }
+
+        int status = 0;
+        waitpid(child, &status, 0);
+        return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+
+    // In the child: open the container, read the first push, report on the pipe, then wait to be killed.
+    void runChild(const std::string& name, int reportFd)
+    {
+        char result = 'f';
+        try
+        {
+            RWSync::SharedContainer<Sample> container(name);
+            RWSync::SharedContainer<Sample>::ReadPtr readPtr(container);
+            readPtr.pullUpdate();
+            if (readPtr.isValid() && readPtr.canRead() && readPtr->isAll(1))
+            {
+                result = 'r';
+            }
+
+            if (write(reportFd, &result, 1) != 1)
+            {
+                _exit(2);
+            }
+
+            // hold the record until killed
+            for (;;)
+            {
+                pause();
+            }
+        }
+        catch (std::runtime_error* e)
+        {
+            delete e;
+        }
+
+        if (write(reportFd, &result, 1) != 1)
+        {
+            _exit(2);
+        }
+        _exit(1);
+    }
+}
+
+int main()
+{
+    const std::string name = "/rwsync-shared-test-" + std::to_string(getpid());
+
+    RWSync::SharedContainer<Sample> container(name, 1);
+    RWSync::SharedContainer<Sample>::WritePtr writePtr(container);
+    if (!writePtr.isValid())
+    {
+        fail("writer checkout failed", 0, 0);
+        return 1;
+    }
+    writePtr->fill(1);
+    writePtr.pushUpdate();
+
+    int fds[2];
+    if (pipe(fds) != 0)
+    {
+        std::perror("pipe");
+        return 1;
+    }
+
+    pid_t child = fork();
+    if (child < 0)
+    {
+        std::perror("fork");
+        return 1;
+    }
+    if (child == 0)
+    {
+        close(fds[0]);
+        runChild(name, fds[1]);
+    }
+    close(fds[1]);
+
+    char result = 0;
+    if (read(fds[0], &result, 1) != 1 || result != 'r')
+    {
+        fail("child didn't open the container by name and read the first push", result, 'r');
+        kill(child, SIGKILL);
+        waitpid(child, nullptr, 0);
+        return 1;
+    }
+
+    // the child's record is the only one
+    writePtr->fill(2);
+    writePtr.pushUpdate();
+    {
+        RWSync::SharedContainer<Sample>::ReadPtr readPtr(container);
+        if (readPtr.isValid())
+        {
+            fail("a second reader registered while the child held the only record", 1, 0);
+        }
+    }
+    if (container.reclaimAbandoned() != 0)
+    {
+        fail("reclaimAbandoned freed a live reader's record", 1, 0);
+    }
+
+    // kill the child while it holds its read pointer
+    kill(child, SIGKILL);
+    int status = 0;
+    waitpid(child, &status, 0);
+    if (!WIFSIGNALED(status))
+    {
+        fail("child exited on its own", status, 0);
+    }
+
+    int nFreed = container.reclaimAbandoned();
+    if (nFreed != 1)
+    {
+        fail("reclaimAbandoned didn't free the killed child's record", nFreed, 1);
+    }
+
+    writePtr->fill(3);
+    writePtr.pushUpdate();
+    {
+        RWSync::SharedContainer<Sample>::ReadPtr readPtr(container);
+        readPtr.pullUpdate();
+        if (!readPtr.isValid() || !readPtr.canRead())
+        {
+            fail("reader couldn't register after reclaiming", 0, 0);
+        }
+        else if (!readPtr->isAll(3))
+        {
+            fail("reader after reclaiming didn't get the latest push", readPtr->version, 3);
+        }
+    }
+
+    if (!openingFails<Mismatched>(name))
+    {
+        fail("opening the container as a different type succeeded", sizeof(Mismatched), sizeof(Sample));
+    }
+    if (openingFails<Sample>(name))
+    {
+        fail("opening the container as the right type failed", 0, 0);
+    }
+    if (!openingFails<Sample>(name + "-missing"))
+    {
+        fail("opening a container that doesn't exist succeeded", 0, 0);
+    }
+
+    if (!creatingFails(name))
+    {
+        fail("creating a container with the name of a live one succeeded", 0, 0);
+    }
+    {
+        RWSync::SharedContainer<Sample>::ReadPtr readPtr(container);
+        readPtr.pullUpdate();
+        if (!readPtr.isValid() || !readPtr.canRead() || !readPtr->isAll(3))
+        {
+            fail("the live container was disturbed by a failed create", 0, 0);
+        }
+    }
+
+    const std::string staleName = name + "-stale";
+    if (!leaveStale(staleName))
+    {
+        fail("child couldn't create the stale container", 0, 0);
+    }
+    else
+    {
+        if (!creatingFails(staleName))
+        {
+            fail("creating over a crashed creator's container succeeded without removeStale", 0, 0);
+        }
+        if (!RWSync::SharedContainer<Sample>::removeStale(staleName))
+        {
+            fail("removeStale didn't find the crashed creator's container", 0, 1);
+        }
+        if (creatingFails(staleName))
+        {
+            fail("creating after removeStale failed", 0, 0);
+        }
+    }
+    if (RWSync::SharedContainer<Sample>::removeStale(staleName))
+    {
+        fail("removeStale removed a name that the destroyed creator should have removed", 1, 0);
+    }
+
+    if (nFailures > 0)
+    {
+        std::fprintf(stderr, "%d failures\n", nFailures);
+        return 1;
+    }
+
+    std::fprintf(stderr, "All passed\n");
+    return 0;
+}
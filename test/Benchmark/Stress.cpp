@@ -0,0 +1,2064 @@
+/*
+*  Copyright (C) 2019 Ethan Blackwood
+*  This is free software released under the MIT license.
+*  See attached LICENSE file for more details, or https://opensource.org/licenses/MIT.
+*/
+
+// Randomized-schedule stress and litmus tests of the push/pull protocol of each manager.
+//
+// Usage: RWSyncStress [--rounds N] [--seed S]
+//
+// Each test runs a writer and several readers on one container for a number of rounds of pushes.
+// Every thread pauses for a random while (nothing, a few spins or a yield, from its own generator
+// seeded from --seed) between and around its operations, so that over a run the threads interleave
+// in many different ways, including the narrow windows in which a reader moves from one instance to
+// the next while the writer looks for one to claim. The CMake build makes one executable with the
+// default (seq_cst) protocol, one with RWSYNC_ACQUIRE_RELEASE and one with RWSYNC_PULL_ATTEMPTS=1 (so
+// that any reader the writer gets in the way of asks it for an instance), and ctest runs all three,
+// along with one with RWSYNC_STATS (and RWSYNC_PULL_ATTEMPTS=2), in which the counters must add up.
+//
+//  - message passing: the writer fills the whole payload (several cache lines) with the push's
+//    version. A reader must always see a whole payload, matching the version its ReadPtr reports
+//    (and so for each pinned push of the history), never going backwards, with missedSinceLastPull()
+//    accounting for any gap. A torn payload means the writer took an instance that was being read.
+//  - wake-up (store buffering): the writer waits for every reader to pull each push, while the
+//    readers block in waitForUpdateFor() with a long timeout, so a lost wake-up shows as a timeout.
+//  - convergence: once the writer is done, each reader's next pull gets the last push.
+//  - ring delivery: a RingContainer delivers every push in order under Backpressure::block and
+//    reportOverrun, and reports each push lost under dropOldest; readers can be checked out and
+//    returned while the writer is blocked waiting for a slow one.
+//  - group epochs: a ReadGroup always sees every container as of the same group push.
+//  - carry-forward: with a CarryForwardWritePtr, each instance read holds the sum of the ranges
+//    written by every push up to its version, however many of them its last writer missed.
+//  - reconfigure: a change made with reconfigure() is in every push that starts after it, and in
+//    every instance once isReconfigured() says so.
+//  - trim: phases in which readers come and go while the writer pushes alternate with trim()s of
+//    a container with lazy instances. trim() never frees an instance that's held, the latest push
+//    or one in the history, and trimmed instances are constructed again with every reconfigure().
+//  - drain: resetFor() and mapFor() against readers and a writer that keep coming and going. One
+//    that times out returns false and changes nothing; one that drains calls f on every instance
+//    exactly once.
+//  - channel bank: each pull gets every channel of a ChannelBank as of the same push, with the
+//    right per-channel versions, however few channels each push changed.
+//  - seqlock: each pull from a SeqlockContainer gets a whole payload (across several cache lines,
+//    checked with a checksum), matching its version, with one reader and with several.
+//  - reader pool: with more threads than a ReaderPool has pointers, no pointer is handed to two
+//    threads at once, and each one's pulls get whole pushes that never go backwards.
+// The writer not finding an instance to claim would hang (or assert, with the default protocol).
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "../../RWSync/Source/RWSyncChannelBank.h"
+#include "../../RWSync/Source/RWSyncContainer.h"
+#include "../../RWSync/Source/RWSyncGroup.h"
+#include "../../RWSync/Source/RWSyncReaderPool.h"
+#include "../../RWSync/Source/RWSyncRingContainer.h"
+#include "../../RWSync/Source/RWSyncSeqlockContainer.h"
+
+namespace
+{
+    struct Payload
+    {
+        static const int nWords = 48; // several cache lines
+
+        std::uint64_t words[nWords];
+
+        Payload() { fill(0); }
+
+        void fill(std::uint64_t value)
+        {
+            for (int i = 0; i < nWords; ++i)
+            {
+                words[i] = value;
+            }
+        }
+
+        bool isAll(std::uint64_t value) const
+        {
+            for (int i = 0; i < nWords; ++i)
+            {
+                if (words[i] != value)
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+    };
+
+    std::atomic<int> nFailures(0);
+
+    void fail(const char* test, const char* engine, const char* what, std::uint64_t a, std::uint64_t b)
+    {
+        if (nFailures++ < 20)
+        {
+            std::fprintf(stderr, "FAILED %s (%s): %s (%llu, %llu)\n", test, engine, what,
+                (unsigned long long)a, (unsigned long long)b);
+        }
+    }
+
+    // Random pauses for one thread (xorshift, so each thread's schedule depends only on the seed).
+    class Scheduler
+    {
+    public:
+        explicit Scheduler(std::uint64_t seed) : state(seed * 0x9E3779B97F4A7C15ull + 1) {}
+
+        void pause()
+        {
+            std::uint64_t r = next() % 64;
+            if (r < 40)
+            {
+                return;
+            }
+            if (r < 62)
+            {
+                for (std::uint64_t i = 0; i < (r - 39) * 8; ++i)
+                {
+                    RWSync::detail::cpuRelax();
+                }
+                return;
+            }
+            std::this_thread::yield();
+        }
+
+        // also for random choices that must depend only on the seed
+        std::uint64_t next()
+        {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            return state;
+        }
+
+    private:
+        std::uint64_t state;
+    };
+
+    // whether the ReadPtr has history() (only expandable containers do)
+    template<typename ReadPtr, bool withHistory>
+    struct HistoryCheck
+    {
+        static void run(ReadPtr&, const char*) {}
+    };
+
+    template<typename ReadPtr>
+    struct HistoryCheck<ReadPtr, true>
+    {
+        static void run(ReadPtr& readPtr, const char* engine)
+        {
+            for (int i = 1; i <= readPtr.historySize(); ++i)
+            {
+                const Payload* p = readPtr.history(i);
+                if (p == nullptr)
+                {
+                    break;
+                }
+
+                std::uint64_t v = readPtr.historyVersion(i);
+                if (v != readPtr.version() - i)
+                {
+                    fail("message passing", engine, "wrong history version", v, readPtr.version() - i);
+                }
+                if (!p->isAll(v))
+                {
+                    fail("message passing", engine, "torn history payload", p->words[0], v);
+                }
+            }
+        }
+    };
+
+#ifdef RWSYNC_STATS
+    // With RWSYNC_STATS, what the counters added up to over a run of message passing (before and after):
+    // one push for each of the writer's, one pull (with or without an update) for each of the readers'
+    // pullUpdate() calls, at most one pull with an update of each push by each reader, and
+    // RWSYNC_PULL_ATTEMPTS failed registrations before each pull the writer answered.
+    void checkStats(const char* engine, const RWSync::Stats& before, const RWSync::Stats& after,
+        std::uint64_t nPushes, std::uint64_t nPullCalls, int nReaders)
+    {
+        std::uint64_t pushes = after.pushes - before.pushes;
+        std::uint64_t conflated = after.conflatedPushes - before.conflatedPushes;
+        std::uint64_t pulls = after.pulls - before.pulls;
+        std::uint64_t emptyPulls = after.emptyPulls - before.emptyPulls;
+        std::uint64_t retries = after.latestRetries - before.latestRetries;
+        std::uint64_t overwrittenRetries = after.latestOverwrittenRetries - before.latestOverwrittenRetries;
+        std::uint64_t answered = after.answeredPulls - before.answeredPulls;
+
+        if (pushes != nPushes)
+        {
+            fail("stats", engine, "pushes counted aren't the writer's", pushes, nPushes);
+        }
+        if (conflated > pushes)
+        {
+            fail("stats", engine, "more conflated pushes than pushes", conflated, pushes);
+        }
+        if (pulls + emptyPulls != nPullCalls)
+        {
+            fail("stats", engine, "pulls counted aren't the readers'", pulls + emptyPulls, nPullCalls);
+        }
+        if (pulls > nPushes * nReaders)
+        {
+            fail("stats", engine, "more pulls with an update than pushes to pull", pulls, nPushes * nReaders);
+        }
+        if (overwrittenRetries > retries)
+        {
+            fail("stats", engine, "more overwritten retries than retries", overwrittenRetries, retries);
+        }
+        if (answered * RWSYNC_PULL_ATTEMPTS > retries)
+        {
+            fail("stats", engine, "answered pulls without as many failed registrations", answered, retries);
+        }
+    }
+#else
+    void checkStats(const char*, const RWSync::Stats&, const RWSync::Stats&, std::uint64_t, std::uint64_t, int) {}
+#endif
+
+    // Message passing and convergence: readers pull whenever they like, the writer never waits.
+    // By default, through the container's own pointer types.
+    template<typename ContainerType, bool withHistory, typename WritePtr = typename ContainerType::WritePtr,
+        typename ReadPtr = typename ContainerType::ReadPtr>
+    void runMessagePassing(ContainerType& container, const char* engine, int nReaders,
+        std::uint64_t nPushes, std::uint64_t seed)
+    {
+
+        std::atomic<bool> done(false);
+        std::atomic<int> nReady(0);
+        std::atomic<std::uint64_t> nPullCalls(0);
+        RWSync::Stats statsBefore = container.getStats();
+
+        std::vector<std::thread> readers;
+        for (int r = 0; r < nReaders; ++r)
+        {
+            readers.emplace_back([&, r]
+            {
+                Scheduler schedule(seed + 1 + r);
+                ReadPtr readPtr(container);
+                if (!readPtr.isValid())
+                {
+                    fail("message passing", engine, "reader checkout failed", r, 0);
+                    ++nReady;
+                    return;
+                }
+                ++nReady;
+
+                std::uint64_t last = 0;
+                bool writerDone = false;
+                while (!writerDone)
+                {
+                    // the writer's last push has to be visible to the first pull after this
+                    writerDone = done.load(std::memory_order_acquire);
+
+                    schedule.pause();
+                    if (!readPtr.hasUpdate() && !writerDone)
+                    {
+                        continue;
+                    }
+
+                    readPtr.pullUpdate();
+                    nPullCalls.fetch_add(1, std::memory_order_relaxed);
+                    schedule.pause();
+                    if (!readPtr.canRead())
+                    {
+                        continue;
+                    }
+
+                    std::uint64_t v = readPtr.version();
+                    if (v < last)
+                    {
+                        fail("message passing", engine, "version went backwards", v, last);
+                    }
+                    if (v > last && last != 0 && readPtr.missedSinceLastPull() != v - last - 1)
+                    {
+                        fail("message passing", engine, "wrong missedSinceLastPull", readPtr.missedSinceLastPull(), v - last - 1);
+                    }
+                    if (!readPtr->isAll(v))
+                    {
+                        fail("message passing", engine, "torn payload", readPtr->words[0], v);
+                    }
+                    HistoryCheck<ReadPtr, withHistory>::run(readPtr, engine);
+                    last = v;
+                }
+
+                if (last != nPushes)
+                {
+                    fail("convergence", engine, "last pull didn't get the last push", last, nPushes);
+                }
+            });
+        }
+
+        while (nReady.load() < nReaders)
+        {
+            std::this_thread::yield();
+        }
+
+        {
+            Scheduler schedule(seed);
+            WritePtr writePtr(container);
+            for (std::uint64_t v = 1; v <= nPushes; ++v)
+            {
+                writePtr->fill(v);
+                schedule.pause();
+                writePtr.pushUpdate();
+                schedule.pause();
+            }
+        }
+        done.store(true, std::memory_order_release);
+
+        for (std::thread& reader : readers)
+        {
+            reader.join();
+        }
+        checkStats(engine, statsBefore, container.getStats(), nPushes, nPullCalls.load(), nReaders);
+    }
+
+    // Wake-up: each push must wake the readers blocked in waitForUpdateFor().
+    template<typename ContainerType>
+    void runWakeUp(ContainerType& container, const char* engine, int nReaders,
+        std::uint64_t nPushes, std::uint64_t seed)
+    {
+        typedef typename ContainerType::WritePtr WritePtr;
+        typedef typename ContainerType::ReadPtr ReadPtr;
+
+        const std::chrono::seconds timeout(5);
+
+        std::unique_ptr<std::atomic<std::uint64_t>[]> pulled(new std::atomic<std::uint64_t>[nReaders]);
+        for (int r = 0; r < nReaders; ++r)
+        {
+            pulled[r].store(0);
+        }
+
+        std::vector<std::thread> readers;
+        std::atomic<int> nReady(0);
+        for (int r = 0; r < nReaders; ++r)
+        {
+            readers.emplace_back([&, r]
+            {
+                Scheduler schedule(seed + 101 + r);
+                ReadPtr readPtr(container);
+                ++nReady;
+                if (!readPtr.isValid())
+                {
+                    fail("wake-up", engine, "reader checkout failed", r, 0);
+                    pulled[r].store(nPushes);
+                    return;
+                }
+
+                std::uint64_t last = 0;
+                while (last < nPushes)
+                {
+                    schedule.pause();
+                    if (!readPtr.waitForUpdateFor(timeout))
+                    {
+                        fail("wake-up", engine, "lost wake-up", last, nPushes);
+                        pulled[r].store(nPushes);
+                        return;
+                    }
+
+                    readPtr.pullUpdate();
+                    last = readPtr.version();
+                    pulled[r].store(last, std::memory_order_release);
+                }
+            });
+        }
+
+        while (nReady.load() < nReaders)
+        {
+            std::this_thread::yield();
+        }
+
+        {
+            Scheduler schedule(seed + 100);
+            WritePtr writePtr(container);
+            for (std::uint64_t v = 1; v <= nPushes; ++v)
+            {
+                writePtr->fill(v);
+                schedule.pause();
+                writePtr.pushUpdate();
+
+                for (int r = 0; r < nReaders; ++r)
+                {
+                    while (pulled[r].load(std::memory_order_acquire) < v)
+                    {
+                        std::this_thread::yield();
+                    }
+                }
+            }
+        }
+
+        for (std::thread& reader : readers)
+        {
+            reader.join();
+        }
+    }
+
+    template<int maxReaders>
+    void runStatic(std::uint64_t nPushes, std::uint64_t seed)
+    {
+        typedef RWSync::StaticContainer<Payload, maxReaders> ContainerType;
+        const char* engine = maxReaders == 1 ? "static, 1 reader (triple buffer)" : "static";
+
+        std::unique_ptr<ContainerType> container(new ContainerType());
+        runMessagePassing<ContainerType, false>(*container, engine, maxReaders, nPushes, seed);
+        container->reset();
+        runWakeUp(*container, engine, maxReaders, nPushes / 20, seed);
+        std::fprintf(stderr, "  %s, %d readers: done\n", engine, maxReaders);
+    }
+
+    // More instances than the claim loop is unrolled for (see detail::ClaimFreeSlotOf), with a few
+    // readers, so most instances are free.
+    void runLargeStatic(int nReaders, std::uint64_t nPushes, std::uint64_t seed)
+    {
+        typedef RWSync::StaticContainer<Payload, 1000> ContainerType;
+        const char* engine = "static, 1000 max readers";
+
+        std::unique_ptr<ContainerType> container(new ContainerType());
+        runMessagePassing<ContainerType, false>(*container, engine, nReaders, nPushes, seed);
+        std::fprintf(stderr, "  %s, %d readers: done\n", engine, nReaders);
+    }
+
+    // A FixedContainer, with its instances inline, used as the Container<T> it is.
+    template<int maxReaders>
+    void runFixed(std::uint64_t nPushes, std::uint64_t seed)
+    {
+        const char* engine = "fixed";
+
+        std::unique_ptr<RWSync::FixedContainer<Payload, maxReaders>> fixed(
+            new RWSync::FixedContainer<Payload, maxReaders>());
+        RWSync::Container<Payload>& container = *fixed;
+        runMessagePassing<RWSync::Container<Payload>, false>(container, engine, maxReaders, nPushes, seed);
+        container.reset();
+        runWakeUp(container, engine, maxReaders, nPushes / 20, seed);
+        std::fprintf(stderr, "  %s, %d readers: done\n", engine, maxReaders);
+    }
+
+    // Ring delivery: with Backpressure::block or reportOverrun, every reader checked out before the
+    // first push gets every push, in order, whole and with nothing reported missed. With dropOldest,
+    // the versions it gets only increase, missedSinceLastPull() accounting for each gap, and its
+    // last pull gets the last push.
+    void runRingDelivery(RWSync::Backpressure policy, const char* engine, int nReaders,
+        std::uint64_t nPushes, std::uint64_t seed)
+    {
+        typedef RWSync::RingContainer<Payload> ContainerType;
+        const bool lossless = policy != RWSync::Backpressure::dropOldest;
+
+        std::unique_ptr<ContainerType> container(new ContainerType(8, nReaders, policy));
+        std::atomic<bool> done(false);
+        std::atomic<int> nReady(0);
+
+        std::vector<std::thread> readers;
+        for (int r = 0; r < nReaders; ++r)
+        {
+            readers.emplace_back([&, r]
+            {
+                Scheduler schedule(seed + 201 + r);
+                ContainerType::ReadPtr readPtr(*container);
+                ++nReady;
+                if (!readPtr.isValid())
+                {
+                    fail("ring delivery", engine, "reader checkout failed", r, 0);
+                    return;
+                }
+
+                std::uint64_t last = 0;
+                while (last < nPushes)
+                {
+                    bool writerDone = done.load(std::memory_order_acquire);
+
+                    schedule.pause();
+                    if (!readPtr.hasUpdate())
+                    {
+                        if (writerDone)
+                        {
+                            break;
+                        }
+                        continue;
+                    }
+
+                    readPtr.pullUpdate();
+                    std::uint64_t v = readPtr.version();
+                    std::uint64_t missed = readPtr.missedSinceLastPull();
+                    if (lossless && (v != last + 1 || missed != 0))
+                    {
+                        fail("ring delivery", engine, "push lost or out of order", v, last);
+                    }
+                    if (v <= last)
+                    {
+                        fail("ring delivery", engine, "version didn't increase", v, last);
+                    }
+                    else if (missed != v - last - 1)
+                    {
+                        fail("ring delivery", engine, "wrong missedSinceLastPull", missed, v - last - 1);
+                    }
+                    schedule.pause();
+                    if (!readPtr->isAll(v))
+                    {
+                        fail("ring delivery", engine, "torn payload", readPtr->words[0], v);
+                    }
+                    last = v;
+                }
+
+                if (last != nPushes)
+                {
+                    fail("ring delivery", engine, "last pull didn't get the last push", last, nPushes);
+                }
+            });
+        }
+
+        while (nReady.load() < nReaders)
+        {
+            std::this_thread::yield();
+        }
+
+        {
+            Scheduler schedule(seed + 200);
+            ContainerType::WritePtr writePtr(*container);
+            for (std::uint64_t v = 1; v <= nPushes; ++v)
+            {
+                writePtr->fill(v);
+                schedule.pause();
+                writePtr.pushUpdate();
+
+                // a refused push keeps the instance, so pushing again retries it
+                while (writePtr.lastPushOverran())
+                {
+                    std::this_thread::yield();
+                    writePtr.pushUpdate();
+                }
+                schedule.pause();
+            }
+
+            if (policy == RWSync::Backpressure::reportOverrun && nPushes > 1000 && writePtr.numOverruns() == 0)
+            {
+                fail("ring delivery", engine, "writer never overran", 0, nPushes);
+            }
+        }
+        done.store(true, std::memory_order_release);
+
+        for (std::thread& reader : readers)
+        {
+            reader.join();
+        }
+        std::fprintf(stderr, "  %s, %d readers: done\n", engine, nReaders);
+    }
+
+    // Readers checked out and returned while the writer is blocked on a slow reader (with
+    // Backpressure::block): the writer must neither hang nor overwrite a push a reader still has
+    // to pull, and each short-lived reader gets consecutive whole pushes from where it started.
+    void runRingChurn(std::uint64_t nPushes, std::uint64_t seed)
+    {
+        typedef RWSync::RingContainer<Payload> ContainerType;
+        const char* engine = "ring, block, readers coming and going";
+        const int nChurners = 2;
+
+        std::unique_ptr<ContainerType> container(new ContainerType(4, nChurners + 2, RWSync::Backpressure::block));
+        std::atomic<bool> done(false);
+        std::atomic<bool> slowReady(false);
+
+        // pulls every push, slowly, so the writer is often blocked
+        std::thread slow([&]
+        {
+            Scheduler schedule(seed + 301);
+            ContainerType::ReadPtr readPtr(*container);
+            slowReady = true;
+
+            std::uint64_t last = 0;
+            while (last < nPushes)
+            {
+                if (!readPtr.waitForUpdateFor(std::chrono::seconds(5)))
+                {
+                    fail("ring churn", engine, "slow reader timed out", last, nPushes);
+                    return;
+                }
+                schedule.pause();
+                schedule.pause();
+                readPtr.pullUpdate();
+                if (readPtr.version() != last + 1 || !readPtr->isAll(last + 1))
+                {
+                    fail("ring churn", engine, "slow reader lost a push", readPtr.version(), last + 1);
+                }
+                last = readPtr.version();
+                std::this_thread::yield();
+            }
+        });
+
+        std::vector<std::thread> churners;
+        for (int c = 0; c < nChurners; ++c)
+        {
+            churners.emplace_back([&, c]
+            {
+                Scheduler schedule(seed + 311 + c);
+                std::uint64_t round = 0;
+                while (!done.load())
+                {
+                    ContainerType::ReadPtr readPtr(*container);
+                    if (!readPtr.isValid())
+                    {
+                        fail("ring churn", engine, "reader checkout failed", c, round);
+                        return;
+                    }
+
+                    // pull a few pushes (or none, holding the writer up until we're returned)
+                    std::uint64_t last = 0;
+                    for (std::uint64_t n = round++ % 4; n > 0 && !done.load(); )
+                    {
+                        schedule.pause();
+                        if (!readPtr.hasUpdate())
+                        {
+                            std::this_thread::yield();
+                            continue;
+                        }
+
+                        readPtr.pullUpdate();
+                        std::uint64_t v = readPtr.version();
+                        if ((last != 0 && v != last + 1) || readPtr.missedSinceLastPull() != 0)
+                        {
+                            fail("ring churn", engine, "push lost or out of order", v, last);
+                        }
+                        if (!readPtr->isAll(v))
+                        {
+                            fail("ring churn", engine, "torn payload", readPtr->words[0], v);
+                        }
+                        last = v;
+                        --n;
+                    }
+                    schedule.pause();
+                }
+            });
+        }
+
+        while (!slowReady.load())
+        {
+            std::this_thread::yield();
+        }
+
+        {
+            Scheduler schedule(seed + 300);
+            ContainerType::WritePtr writePtr(*container);
+            for (std::uint64_t v = 1; v <= nPushes; ++v)
+            {
+                writePtr->fill(v);
+                schedule.pause();
+                writePtr.pushUpdate();
+            }
+        }
+        done.store(true);
+
+        slow.join();
+        for (std::thread& churner : churners)
+        {
+            churner.join();
+        }
+        std::fprintf(stderr, "  %s: done\n", engine);
+    }
+
+    // Group epochs: the writer changes a random subset of two containers in each group push,
+    // filling what it changes with the push's number. After each ReadGroup::pullUpdate(), both
+    // instances must be from the version() the group reports, i.e. each container must hold the
+    // last push up to that one that changed it.
+    void runGroup(int nReaders, std::uint64_t nPushes, std::uint64_t seed)
+    {
+        typedef RWSync::ExpandableContainer<Payload> ContainerType;
+        typedef RWSync::ReadGroup<ContainerType, ContainerType> ReadGroupType;
+        const char* engine = "group of 2 expandable";
+
+        // for each group push v, the last one up to v that changed each container (the first changes both)
+        std::vector<std::uint64_t> lastChange[2];
+        {
+            Scheduler choice(seed + 400);
+            for (int c = 0; c < 2; ++c)
+            {
+                lastChange[c].assign(nPushes + 1, 0);
+            }
+            for (std::uint64_t v = 1; v <= nPushes; ++v)
+            {
+                int which = v == 1 ? 3 : 1 + int(choice.next() % 3); // bit c: container c changes
+                for (int c = 0; c < 2; ++c)
+                {
+                    lastChange[c][v] = (which & (1 << c)) ? v : lastChange[c][v - 1];
+                }
+            }
+        }
+
+        RWSync::Group group;
+        std::unique_ptr<ContainerType> a(new ContainerType());
+        std::unique_ptr<ContainerType> b(new ContainerType());
+        a->increaseMaxReadersTo(nReaders);
+        b->increaseMaxReadersTo(nReaders);
+
+        std::atomic<bool> done(false);
+        std::atomic<int> nReady(0);
+
+        std::vector<std::thread> readers;
+        for (int r = 0; r < nReaders; ++r)
+        {
+            readers.emplace_back([&, r]
+            {
+                Scheduler schedule(seed + 401 + r);
+                ReadGroupType readGroup(group, *a, *b);
+                ++nReady;
+                if (!readGroup.isValid())
+                {
+                    fail("group epochs", engine, "reader checkout failed", r, 0);
+                    return;
+                }
+
+                std::uint64_t last = 0;
+                bool writerDone = false;
+                while (!writerDone)
+                {
+                    writerDone = done.load(std::memory_order_acquire);
+
+                    schedule.pause();
+                    if (!readGroup.hasUpdate() && !writerDone)
+                    {
+                        continue;
+                    }
+
+                    readGroup.pullUpdate();
+                    if (!readGroup.canRead())
+                    {
+                        continue;
+                    }
+
+                    std::uint64_t v = readGroup.version();
+                    if (v < last || v > nPushes)
+                    {
+                        fail("group epochs", engine, "version went backwards", v, last);
+                        continue;
+                    }
+                    schedule.pause();
+                    if (!readGroup.read<0>()->isAll(lastChange[0][v]))
+                    {
+                        fail("group epochs", engine, "first container not from the group's push",
+                            readGroup.read<0>()->words[0], lastChange[0][v]);
+                    }
+                    if (!readGroup.read<1>()->isAll(lastChange[1][v]))
+                    {
+                        fail("group epochs", engine, "second container not from the group's push",
+                            readGroup.read<1>()->words[0], lastChange[1][v]);
+                    }
+                    last = v;
+                }
+
+                if (last != nPushes)
+                {
+                    fail("group epochs", engine, "last pull didn't get the last push", last, nPushes);
+                }
+            });
+        }
+
+        while (nReady.load() < nReaders)
+        {
+            std::this_thread::yield();
+        }
+
+        {
+            Scheduler schedule(seed + 402);
+            RWSync::WriteGroup<ContainerType, ContainerType> writeGroup(group, *a, *b);
+            for (std::uint64_t v = 1; v <= nPushes; ++v)
+            {
+                if (lastChange[0][v] == v)
+                {
+                    writeGroup.write<0>()->fill(v);
+                }
+                schedule.pause();
+                if (lastChange[1][v] == v)
+                {
+                    writeGroup.write<1>()->fill(v);
+                }
+                writeGroup.pushUpdate();
+                schedule.pause();
+            }
+        }
+        done.store(true, std::memory_order_release);
+
+        for (std::thread& reader : readers)
+        {
+            reader.join();
+        }
+        std::fprintf(stderr, "  %s, %d readers: done\n", engine, nReaders);
+    }
+
+    // Carry-forward writing: each push changes a random range of words (or now and then the whole
+    // payload) to the push's number, and marks only that range dirty. Every instance a reader pulls
+    // must hold exactly what the writer's pushes up to its version() add up to, so a range that the
+    // new write instance missed while it was being read would show as a stale word.
+    void runCarryForward(int nReaders, std::uint64_t nPushes, std::uint64_t seed)
+    {
+        typedef RWSync::ExpandableContainer<Payload> ContainerType;
+        const char* engine = "expandable, carry-forward";
+
+        // what instance v should hold
+        std::vector<Payload> expected(nPushes + 1);
+        std::vector<int> rangeBegin(nPushes + 1, 0);
+        std::vector<int> rangeEnd(nPushes + 1, int(Payload::nWords)); // int(): nWords has no definition to bind to
+        {
+            Scheduler choice(seed + 500);
+            for (std::uint64_t v = 1; v <= nPushes; ++v)
+            {
+                if (v > 1 && choice.next() % 16 != 0)
+                {
+                    rangeBegin[v] = int(choice.next() % Payload::nWords);
+                    rangeEnd[v] = rangeBegin[v] + 1 + int(choice.next() % (Payload::nWords - rangeBegin[v]));
+                }
+
+                expected[v] = expected[v - 1];
+                for (int i = rangeBegin[v]; i < rangeEnd[v]; ++i)
+                {
+                    expected[v].words[i] = v;
+                }
+            }
+        }
+
+        std::unique_ptr<ContainerType> container(new ContainerType());
+        container->increaseMaxReadersTo(nReaders);
+
+        std::atomic<bool> done(false);
+        std::atomic<int> nReady(0);
+
+        std::vector<std::thread> readers;
+        for (int r = 0; r < nReaders; ++r)
+        {
+            readers.emplace_back([&, r]
+            {
+                Scheduler schedule(seed + 501 + r);
+                ContainerType::ReadPtr readPtr(*container);
+                ++nReady;
+                if (!readPtr.isValid())
+                {
+                    fail("carry-forward", engine, "reader checkout failed", r, 0);
+                    return;
+                }
+
+                std::uint64_t last = 0;
+                bool writerDone = false;
+                while (!writerDone)
+                {
+                    writerDone = done.load(std::memory_order_acquire);
+
+                    schedule.pause();
+                    if (!readPtr.hasUpdate() && !writerDone)
+                    {
+                        continue;
+                    }
+
+                    readPtr.pullUpdate();
+                    if (!readPtr.canRead())
+                    {
+                        continue;
+                    }
+
+                    std::uint64_t v = readPtr.version();
+                    if (v < last || v > nPushes)
+                    {
+                        fail("carry-forward", engine, "version went backwards", v, last);
+                        continue;
+                    }
+                    for (int i = 0; i < Payload::nWords; ++i)
+                    {
+                        if (readPtr->words[i] != expected[v].words[i])
+                        {
+                            fail("carry-forward", engine, "word not carried forward", readPtr->words[i], expected[v].words[i]);
+                            break;
+                        }
+                    }
+
+                    // hold the instance a while, so the writer's next instances miss several pushes
+                    schedule.pause();
+                    schedule.pause();
+                    last = v;
+                }
+
+                if (last != nPushes)
+                {
+                    fail("carry-forward", engine, "last pull didn't get the last push", last, nPushes);
+                }
+            });
+        }
+
+        while (nReady.load() < nReaders)
+        {
+            std::this_thread::yield();
+        }
+
+        {
+            Scheduler schedule(seed + 502);
+            ContainerType::CarryForwardWritePtr writePtr(*container);
+            for (std::uint64_t v = 1; v <= nPushes; ++v)
+            {
+                for (int i = rangeBegin[v]; i < rangeEnd[v]; ++i)
+                {
+                    writePtr->words[i] = v;
+                }
+
+                if (rangeEnd[v] - rangeBegin[v] == Payload::nWords)
+                {
+                    writePtr.markAllDirty();
+                }
+                else
+                {
+                    writePtr.markBytesDirty(&writePtr->words[rangeBegin[v]],
+                        (rangeEnd[v] - rangeBegin[v]) * sizeof(std::uint64_t));
+                }
+                schedule.pause();
+                writePtr.pushUpdate();
+                schedule.pause();
+            }
+        }
+        done.store(true, std::memory_order_release);
+
+        for (std::thread& reader : readers)
+        {
+            reader.join();
+        }
+        std::fprintf(stderr, "  %s, %d readers: done\n", engine, nReaders);
+    }
+
+    // Reconfiguration: while the writer fills all but the last word of each push with its version,
+    // another thread reconfigures the container, each change k setting the last word to k. Change k
+    // must be in every push that starts after reconfigure() returns (so every version from two past
+    // the last push started by then), and once isReconfigured(k), in whatever a reader holds.
+    template<typename ContainerType>
+    void runReconfigure(ContainerType& container, const char* engine, int nReaders,
+        std::uint64_t nPushes, std::uint64_t seed)
+    {
+        typedef typename ContainerType::WritePtr WritePtr;
+        typedef typename ContainerType::ReadPtr ReadPtr;
+
+        const int configWord = Payload::nWords - 1;
+        const std::uint64_t nChanges = 200;
+        const std::uint64_t never = ~std::uint64_t(0);
+
+        // for each change, the first version that must have it (never, until it's known)
+        std::unique_ptr<std::atomic<std::uint64_t>[]> firstVersionWith(new std::atomic<std::uint64_t>[nChanges + 2]);
+        for (std::uint64_t k = 0; k < nChanges + 2; ++k)
+        {
+            firstVersionWith[k].store(never);
+        }
+        firstVersionWith[0].store(0);
+
+        std::atomic<std::uint64_t> started(0);    // version of the push the writer is on
+        std::atomic<std::uint64_t> everywhere(0); // last change isReconfigured() reported
+        std::atomic<bool> reconfiguring(true);
+        std::atomic<bool> done(false);
+        std::atomic<int> nReady(0);
+
+        std::vector<std::thread> readers;
+        for (int r = 0; r < nReaders; ++r)
+        {
+            readers.emplace_back([&, r]
+            {
+                Scheduler schedule(seed + 601 + r);
+                ReadPtr readPtr(container);
+                ++nReady;
+                if (!readPtr.isValid())
+                {
+                    fail("reconfigure", engine, "reader checkout failed", r, 0);
+                    return;
+                }
+
+                while (!done.load())
+                {
+                    schedule.pause();
+                    readPtr.pullUpdate();
+                    if (!readPtr.canRead())
+                    {
+                        continue;
+                    }
+
+                    std::uint64_t applied = everywhere.load(std::memory_order_acquire);
+                    std::uint64_t v = readPtr.version();
+                    for (int i = 0; i < configWord; ++i)
+                    {
+                        if (readPtr->words[i] != v)
+                        {
+                            fail("reconfigure", engine, "torn payload", readPtr->words[i], v);
+                            break;
+                        }
+                    }
+
+                    std::uint64_t config = readPtr->words[configWord];
+                    if (config > nChanges)
+                    {
+                        fail("reconfigure", engine, "bad configuration", config, nChanges);
+                    }
+                    else if (firstVersionWith[config + 1].load() <= v)
+                    {
+                        fail("reconfigure", engine, "push missed a change made before it", v, config + 1);
+                    }
+                    if (config < applied)
+                    {
+                        fail("reconfigure", engine, "isReconfigured() before a held instance had the change", config, applied);
+                    }
+                    schedule.pause();
+                }
+            });
+        }
+
+        std::thread reconfigurer([&]
+        {
+            Scheduler schedule(seed + 602);
+            for (std::uint64_t k = 1; k <= nChanges; ++k)
+            {
+                for (std::uint64_t n = schedule.next() % 64; n > 0; --n)
+                {
+                    schedule.pause();
+                }
+
+                std::uint64_t version = container.reconfigure([k](Payload& p) { p.words[configWord] = k; });
+                if (version != k)
+                {
+                    fail("reconfigure", engine, "wrong change version", version, k);
+                }
+                firstVersionWith[k].store(started.load() + 2);
+
+                if (k % 4 == 0)
+                {
+                    if (!container.waitForReconfigurationFor(k, std::chrono::seconds(5)))
+                    {
+                        fail("reconfigure", engine, "change was never applied everywhere", k, 0);
+                    }
+                    else if (!container.isReconfigured(k - 1))
+                    {
+                        fail("reconfigure", engine, "earlier change not applied", k - 1, k);
+                    }
+                    everywhere.store(k, std::memory_order_release);
+                }
+            }
+            reconfiguring.store(false);
+        });
+
+        while (nReady.load() < nReaders)
+        {
+            std::this_thread::yield();
+        }
+
+        {
+            // keep pushing until every change is done, so the last ones can be applied everywhere
+            Scheduler schedule(seed + 600);
+            WritePtr writePtr(container);
+            for (std::uint64_t v = 1; v <= nPushes || reconfiguring.load(); ++v)
+            {
+                started.store(v);
+                for (int i = 0; i < configWord; ++i)
+                {
+                    writePtr->words[i] = v;
+                }
+                schedule.pause();
+                writePtr.pushUpdate();
+                schedule.pause();
+            }
+        }
+        done.store(true);
+
+        reconfigurer.join();
+        for (std::thread& reader : readers)
+        {
+            reader.join();
+        }
+        std::fprintf(stderr, "  %s, %d readers, reconfiguring: done\n", engine, nReaders);
+    }
+
+    // For the trim test: the addresses of the TrimPayloads that exist, so that reading an instance
+    // that trim() destroyed shows (a Payload's memory would still look fine).
+    class LiveInstances
+    {
+    public:
+        LiveInstances() : nMade(0) {}
+
+        void add(const void* instance)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            live.insert(instance);
+            ++nMade;
+        }
+
+        void remove(const void* instance)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            live.erase(instance);
+        }
+
+        bool contains(const void* instance) const
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            return live.count(instance) > 0;
+        }
+
+        std::size_t count() const
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            return live.size();
+        }
+
+        // how many have ever been constructed
+        std::uint64_t made() const
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            return nMade;
+        }
+
+    private:
+        mutable std::mutex mutex;
+        std::set<const void*> live;
+        std::uint64_t nMade;
+    };
+
+    LiveInstances liveInstances;
+
+    struct TrimPayload : Payload
+    {
+        TrimPayload()
+        {
+            liveInstances.add(this);
+        }
+
+        TrimPayload(const TrimPayload& other)
+            : Payload(other)
+        {
+            liveInstances.add(this);
+        }
+
+        ~TrimPayload()
+        {
+            liveInstances.remove(this);
+        }
+    };
+
+    // Lazy instances and trim(): phases in which readers come and go (each checking out, pulling a
+    // random number of times and returning its pointer) while the writer pushes alternate with trims,
+    // which need everyone to be gone. Before each phase, a reconfigure() sets the last word to the
+    // phase's number, so every push of phase p has p there, including pushes to instances that
+    // trim() destroyed and the writer constructed again (from the original copy). Every instance a
+    // reader or the writer holds, in the history too, must exist, and reads must be whole and not go
+    // backwards. After each trim, the latest push and the history are read right away: trim() must
+    // never free them. trim() with a reader checked out must fail and free nothing.
+    void runLazyTrim(int nReaders, std::uint64_t nPushes, std::uint64_t seed)
+    {
+        typedef RWSync::ExpandableContainer<TrimPayload> ContainerType;
+        const char* engine = "lazy instances";
+        const int historyDepth = 2;
+        const int configWord = Payload::nWords - 1;
+        const int nPhases = 20;
+        const std::uint64_t pushesPerPhase = std::max<std::uint64_t>(nPushes / nPhases, historyDepth + 1);
+
+        // phaseStart[p] is the first version pushed in phase p
+        std::vector<std::uint64_t> phaseStart(nPhases + 1, ~std::uint64_t(0));
+        auto phaseOf = [&phaseStart](std::uint64_t v)
+        {
+            std::uint64_t p = 0;
+            while (p + 1 < phaseStart.size() && phaseStart[p + 1] <= v)
+            {
+                ++p;
+            }
+            return p;
+        };
+
+        // whether the instance exists and is whole with the given version and the phase's configuration
+        auto check = [&](const char* where, const TrimPayload* p, std::uint64_t v)
+        {
+            if (!liveInstances.contains(p))
+            {
+                fail("trim", engine, where, v, 0);
+                return;
+            }
+            for (int i = 0; i < configWord; ++i)
+            {
+                if (p->words[i] != v)
+                {
+                    fail("trim", engine, "torn payload", p->words[i], v);
+                    return;
+                }
+            }
+            if (p->words[configWord] != phaseOf(v))
+            {
+                fail("trim", engine, "push didn't have its phase's configuration", p->words[configWord], phaseOf(v));
+            }
+        };
+
+        auto checkReader = [&](const char* where, ContainerType::ReadPtr& readPtr)
+        {
+            std::uint64_t v = readPtr.version();
+            check(where, &*readPtr, v);
+            for (int i = 1; i <= readPtr.historySize(); ++i)
+            {
+                const TrimPayload* p = readPtr.history(i);
+                if (p == nullptr)
+                {
+                    break;
+                }
+                if (readPtr.historyVersion(i) != v - i)
+                {
+                    fail("trim", engine, "wrong history version", readPtr.historyVersion(i), v - i);
+                }
+                check(where, p, v - i);
+            }
+        };
+
+        std::unique_ptr<ContainerType> container(
+            new ContainerType(RWSync::LazyInstances(), RWSync::HistoryDepth(historyDepth)));
+        container->increaseMaxReadersTo(nReaders);
+
+        Scheduler schedule(seed + 700);
+        std::uint64_t v = 0;
+        std::uint64_t nTrimmed = 0;
+        std::uint64_t nRebuilt = 0; // instances constructed in phases after one that trimmed some
+
+        for (int phase = 1; phase <= nPhases; ++phase)
+        {
+            container->reconfigure([phase](TrimPayload& p) { p.words[configWord] = phase; });
+            phaseStart[phase] = v + 1;
+            std::uint64_t nMadeBefore = liveInstances.made();
+
+            std::atomic<bool> done(false);
+            std::vector<std::thread> readers;
+            for (int r = 0; r < nReaders; ++r)
+            {
+                readers.emplace_back([&, r]
+                {
+                    Scheduler readerSchedule(seed + 701 + nReaders * phase + r);
+                    std::uint64_t last = 0;
+                    while (!done.load())
+                    {
+                        ContainerType::ReadPtr readPtr(*container);
+                        if (!readPtr.isValid())
+                        {
+                            fail("trim", engine, "reader checkout failed", r, phase);
+                            return;
+                        }
+                        for (std::uint64_t n = 1 + readerSchedule.next() % 32; n > 0 && !done.load(); --n)
+                        {
+                            readerSchedule.pause();
+                            readPtr.pullUpdate();
+                            if (!readPtr.canRead())
+                            {
+                                continue;
+                            }
+                            if (readPtr.version() < last)
+                            {
+                                fail("trim", engine, "went backwards", readPtr.version(), last);
+                            }
+                            last = readPtr.version();
+                            checkReader("read an instance that was trimmed", readPtr);
+                        }
+                    }
+                });
+            }
+
+            {
+                ContainerType::WritePtr writePtr(*container);
+                for (std::uint64_t k = 0; k < pushesPerPhase; ++k)
+                {
+                    ++v;
+                    for (int i = 0; i < configWord; ++i)
+                    {
+                        writePtr->words[i] = v;
+                    }
+                    schedule.pause();
+                    writePtr.pushUpdate();
+
+                    // the next instance to write: either copied from the original or an older push
+                    const TrimPayload* next = &*writePtr;
+                    if (!liveInstances.contains(next))
+                    {
+                        fail("trim", engine, "writer got an instance that was trimmed", v, 0);
+                    }
+                    else if (next->words[configWord] != std::uint64_t(phase))
+                    {
+                        fail("trim", engine, "rebuilt instance missed the configuration", next->words[configWord], phase);
+                    }
+                    else if (next->words[0] >= v)
+                    {
+                        fail("trim", engine, "writer's next instance is the latest", next->words[0], v);
+                    }
+                    schedule.pause();
+                }
+            }
+            done.store(true);
+            for (std::thread& reader : readers)
+            {
+                reader.join();
+            }
+            if (nTrimmed > 0)
+            {
+                nRebuilt += liveInstances.made() - nMadeBefore;
+            }
+
+            std::size_t nLive = liveInstances.count();
+            {
+                ContainerType::ReadPtr holder(*container);
+                if (container->trim(0))
+                {
+                    fail("trim", engine, "trim() succeeded with a reader checked out", phase, 0);
+                }
+                if (liveInstances.count() != nLive)
+                {
+                    fail("trim", engine, "failed trim() destroyed instances", liveInstances.count(), nLive);
+                }
+            }
+
+            std::uint64_t maxIdleTakes = schedule.next() % 4 == 0 ? 0 : schedule.next() % 8;
+            if (!container->trim(maxIdleTakes))
+            {
+                fail("trim", engine, "trim() failed with no readers or writer", phase, 0);
+                break;
+            }
+            std::size_t nLeft = liveInstances.count();
+            if (nLeft > nLive)
+            {
+                fail("trim", engine, "trim() made instances", nLeft, nLive);
+            }
+            nTrimmed += nLive - std::min(nLive, nLeft);
+
+            // the latest, its history, the writer's next instance and the original copy
+            if (maxIdleTakes == 0 && nLeft > std::size_t(historyDepth + 3))
+            {
+                fail("trim", engine, "trim(0) kept idle instances", nLeft, historyDepth + 3);
+            }
+
+            ContainerType::ReadPtr readPtr(*container);
+            readPtr.pullUpdate();
+            if (!readPtr.canRead() || readPtr.version() != v)
+            {
+                fail("trim", engine, "latest push not readable after trim()", readPtr.version(), v);
+            }
+            else
+            {
+                checkReader("latest push or its history was trimmed", readPtr);
+            }
+        }
+
+        if (nTrimmed == 0)
+        {
+            fail("trim", engine, "trim() never destroyed anything", 0, 1);
+        }
+        if (nRebuilt == 0)
+        {
+            fail("trim", engine, "trimmed instances were never constructed again", 0, 1);
+        }
+        std::fprintf(stderr, "  %s, %d readers, trimming: done (%llu destroyed, %llu rebuilt)\n", engine,
+            nReaders, (unsigned long long)nTrimmed, (unsigned long long)nRebuilt);
+    }
+
+    // Draining resetFor() and mapFor() against live readers and a live writer, which keep checking out,
+    // using and returning their pointers (retrying when a drain turns them away). A reset only happens
+    // while no pointer exists, so within each checkout, pushes must be whole and never go backwards.
+    // Rounds alternate between:
+    //  - a timeout: this thread holds a reader, so resetFor() and mapFor() must give up and return
+    //    false without calling f, and leave the data as it was: the held instance is unchanged,
+    //    and the next pull gets a push at least as new (a reset would have left nothing to read);
+    //  - a drain that succeeds: resetFor() and mapFor() must return true, and mapFor() must call f
+    //    exactly once on each of the container's nMapped instances (the ones every pointer used).
+    template<typename ContainerType>
+    void runDrain(ContainerType& container, const char* engine, int nReaders, int nMapped,
+        std::uint64_t nRounds, std::uint64_t seed)
+    {
+        typedef typename ContainerType::WritePtr WritePtr;
+        typedef typename ContainerType::ReadPtr ReadPtr;
+        typedef std::set<const Payload*> InstanceSet;
+
+        std::atomic<bool> done(false);
+        std::atomic<std::uint64_t> nWriterCheckouts(0);
+
+        // instances each thread has used (the writer's last, after the readers')
+        std::vector<InstanceSet> used(nReaders + 1);
+
+        std::vector<std::thread> threads;
+        for (int r = 0; r < nReaders; ++r)
+        {
+            threads.emplace_back([&, r]
+            {
+                Scheduler schedule(seed + 801 + r);
+                while (!done.load())
+                {
+                    ReadPtr readPtr(container);
+                    if (!readPtr.isValid())
+                    {
+                        schedule.pause();
+                        std::this_thread::yield();
+                        continue;
+                    }
+
+                    std::uint64_t last = 0;
+                    for (std::uint64_t n = 1 + schedule.next() % 16; n > 0; --n)
+                    {
+                        schedule.pause();
+                        readPtr.pullUpdate();
+                        if (!readPtr.canRead())
+                        {
+                            continue;
+                        }
+                        used[r].insert(&*readPtr);
+                        std::uint64_t value = readPtr->words[0];
+                        if (!readPtr->isAll(value))
+                        {
+                            fail("drain", engine, "torn payload", readPtr->words[Payload::nWords - 1], value);
+                        }
+                        if (value < last)
+                        {
+                            fail("drain", engine, "went backwards within a checkout", value, last);
+                        }
+                        last = value;
+                    }
+                }
+            });
+        }
+
+        threads.emplace_back([&]
+        {
+            Scheduler schedule(seed + 800);
+            std::uint64_t value = 0;
+            while (!done.load())
+            {
+                WritePtr writePtr(container);
+                if (!writePtr.isValid())
+                {
+                    schedule.pause();
+                    std::this_thread::yield();
+                    continue;
+                }
+
+                ++nWriterCheckouts;
+                for (std::uint64_t n = 1 + schedule.next() % 16; n > 0; --n)
+                {
+                    used[nReaders].insert(&*writePtr);
+                    writePtr->fill(++value);
+                    schedule.pause();
+                    writePtr.pushUpdate();
+                }
+            }
+        });
+
+        Scheduler schedule(seed + 810);
+        std::vector<const Payload*> mapped;
+        InstanceSet everMapped;
+        std::uint64_t nDrains = 0;
+        for (std::uint64_t round = 0; round < nRounds; ++round)
+        {
+            for (std::uint64_t n = schedule.next() % 64; n > 0; --n)
+            {
+                schedule.pause();
+            }
+
+            mapped.clear();
+            auto record = [&mapped](Payload& p) { mapped.push_back(&p); };
+
+            if (round % 2 == 0)
+            {
+                ReadPtr held(container);
+                while (!held.isValid())
+                {
+                    std::this_thread::yield();
+                    held.tryToMakeValid();
+                }
+                while (!held.canRead())
+                {
+                    std::this_thread::yield();
+                    held.pullUpdate();
+                }
+
+                const Payload* instance = &*held;
+                std::uint64_t value = held->words[0];
+                std::chrono::microseconds timeout(50 + schedule.next() % 1000);
+                if (container.resetFor(timeout))
+                {
+                    fail("drain", engine, "resetFor() succeeded while a reader was held", round, 0);
+                }
+                if (container.mapFor(record, timeout))
+                {
+                    fail("drain", engine, "mapFor() succeeded while a reader was held", round, 0);
+                }
+                if (!mapped.empty())
+                {
+                    fail("drain", engine, "mapFor() that timed out called f", mapped.size(), 0);
+                }
+                if (&*held != instance || !held->isAll(value))
+                {
+                    fail("drain", engine, "held instance changed by a drain that timed out", held->words[0], value);
+                }
+
+                held.pullUpdate();
+                if (!held.canRead())
+                {
+                    fail("drain", engine, "drain that timed out reset the container", round, 0);
+                }
+                else if (held->words[0] < value)
+                {
+                    fail("drain", engine, "went backwards after a drain that timed out", held->words[0], value);
+                }
+            }
+            else
+            {
+                std::chrono::seconds timeout(10);
+                if (!container.resetFor(timeout))
+                {
+                    fail("drain", engine, "resetFor() didn't drain", round, 0);
+                }
+                if (!container.mapFor(record, timeout))
+                {
+                    fail("drain", engine, "mapFor() didn't drain", round, 0);
+                    continue;
+                }
+                ++nDrains;
+
+                InstanceSet distinct(mapped.begin(), mapped.end());
+                if (distinct.size() != mapped.size())
+                {
+                    fail("drain", engine, "mapFor() called f on an instance twice", mapped.size(), distinct.size());
+                }
+                if (int(mapped.size()) != nMapped)
+                {
+                    fail("drain", engine, "mapFor() didn't call f on every instance", mapped.size(), nMapped);
+                }
+                everMapped.insert(distinct.begin(), distinct.end());
+            }
+        }
+
+        done.store(true);
+        for (std::thread& thread : threads)
+        {
+            thread.join();
+        }
+
+        for (const InstanceSet& instances : used)
+        {
+            for (const Payload* instance : instances)
+            {
+                if (everMapped.count(instance) == 0)
+                {
+                    fail("drain", engine, "mapFor() never called f on an instance that was used", nDrains, 0);
+                    break;
+                }
+            }
+        }
+        if (nWriterCheckouts.load() < 2)
+        {
+            fail("drain", engine, "the writer never came back after a drain", nWriterCheckouts.load(), 2);
+        }
+        std::fprintf(stderr, "  %s, %d readers, draining: done\n", engine, nReaders);
+    }
+
+    // For the ChannelBank test: a channel holds the version of the push that last changed it, twice
+    struct ChannelSample
+    {
+        std::uint64_t first;
+        std::uint64_t second;
+    };
+
+    // Channel bank carry-forward: each push changes a random few channels (sometimes none, sometimes
+    // all through allChannels()) to the push's number. After each pull, every channel must be as of
+    // the push the reader is on, i.e. hold (and have as its channelVersion()) the last push up to
+    // version() that changed it, and changedSinceLastPull() must say whether that's after the
+    // version the reader was on before (none, before its first pull).
+    void runChannelBank(std::uint64_t nPushes, std::uint64_t seed)
+    {
+        const int nChannels = 32;
+        const int nReaders = 3;
+        typedef RWSync::ChannelBank<ChannelSample, nChannels, nReaders> BankType;
+        const char* engine = "channel bank, 32 channels";
+
+        // for each push v, the last one up to v that changed each channel, and whether v changed all of them
+        std::vector<std::uint64_t> lastChange((nPushes + 1) * nChannels, 0);
+        std::vector<bool> changesAll(nPushes + 1, false);
+        {
+            Scheduler choice(seed + 700);
+            for (std::uint64_t v = 1; v <= nPushes; ++v)
+            {
+                std::copy(lastChange.begin() + (v - 1) * nChannels, lastChange.begin() + v * nChannels,
+                    lastChange.begin() + v * nChannels);
+
+                changesAll[v] = choice.next() % 16 == 0;
+                for (int n = changesAll[v] ? nChannels : int(choice.next() % 4); n > 0; --n)
+                {
+                    int c = changesAll[v] ? n - 1 : int(choice.next() % nChannels);
+                    lastChange[v * nChannels + c] = v;
+                }
+            }
+        }
+
+        std::unique_ptr<BankType> bank(new BankType());
+        std::atomic<bool> done(false);
+        std::atomic<int> nReady(0);
+
+        std::vector<std::thread> readers;
+        for (int r = 0; r < nReaders; ++r)
+        {
+            readers.emplace_back([&, r]
+            {
+                Scheduler schedule(seed + 701 + r);
+                BankType::ReadPtr readPtr(*bank);
+                ++nReady;
+                if (!readPtr.isValid())
+                {
+                    fail("channel bank", engine, "reader checkout failed", r, 0);
+                    return;
+                }
+
+                std::uint64_t last = 0;
+                bool writerDone = false;
+                while (!writerDone)
+                {
+                    writerDone = done.load(std::memory_order_acquire);
+
+                    schedule.pause();
+                    if (!readPtr.hasUpdate() && !writerDone)
+                    {
+                        continue;
+                    }
+
+                    readPtr.pullUpdate();
+                    if (!readPtr.canRead())
+                    {
+                        continue;
+                    }
+
+                    std::uint64_t v = readPtr.version();
+                    if (v < last || v > nPushes)
+                    {
+                        fail("channel bank", engine, "version went backwards", v, last);
+                        continue;
+                    }
+                    for (int c = 0; c < nChannels; ++c)
+                    {
+                        std::uint64_t expected = lastChange[v * nChannels + c];
+                        const ChannelSample& sample = readPtr[c];
+                        if (sample.first != expected || sample.second != expected)
+                        {
+                            fail("channel bank", engine, "channel not as of the push", sample.first, expected);
+                            break;
+                        }
+                        if (readPtr.channelVersion(c) != expected)
+                        {
+                            fail("channel bank", engine, "wrong channelVersion", readPtr.channelVersion(c), expected);
+                            break;
+                        }
+                        if (readPtr.changedSinceLastPull(c) != (expected > last))
+                        {
+                            fail("channel bank", engine, "wrong changedSinceLastPull", expected, last);
+                            break;
+                        }
+                    }
+                    schedule.pause();
+                    last = v;
+                }
+
+                if (last != nPushes)
+                {
+                    fail("channel bank", engine, "last pull didn't get the last push", last, nPushes);
+                }
+            });
+        }
+
+        while (nReady.load() < nReaders)
+        {
+            std::this_thread::yield();
+        }
+
+        {
+            Scheduler schedule(seed + 702);
+            BankType::WritePtr writePtr(*bank);
+            for (std::uint64_t v = 1; v <= nPushes; ++v)
+            {
+                if (changesAll[v])
+                {
+                    ChannelSample* all = writePtr.allChannels();
+                    for (int c = 0; c < nChannels; ++c)
+                    {
+                        all[c].first = all[c].second = v;
+                    }
+                }
+                else
+                {
+                    for (int c = 0; c < nChannels; ++c)
+                    {
+                        if (lastChange[v * nChannels + c] == v)
+                        {
+                            writePtr[c].first = v;
+                            schedule.pause();
+                            writePtr[c].second = v;
+                        }
+                    }
+                }
+                schedule.pause();
+                writePtr.pushUpdate();
+                schedule.pause();
+            }
+        }
+        done.store(true, std::memory_order_release);
+
+        for (std::thread& reader : readers)
+        {
+            reader.join();
+        }
+        std::fprintf(stderr, "  %s, %d readers: done\n", engine, nReaders);
+    }
+
+    // Message passing through AnyWritePtr<T> and AnyReadPtr<T>, which wrap each container's own pointers.
+    void runAnyPointers(std::uint64_t nPushes, std::uint64_t seed)
+    {
+        typedef RWSync::AnyWritePtr<Payload> WritePtr;
+        typedef RWSync::AnyReadPtr<Payload> ReadPtr;
+        const char* engine = "AnyWritePtr/AnyReadPtr";
+
+        std::unique_ptr<RWSync::StaticContainer<Payload>> static1(new RWSync::StaticContainer<Payload>());
+        runMessagePassing<RWSync::StaticContainer<Payload>, false, WritePtr, ReadPtr>(*static1, engine, 1, nPushes, seed);
+
+        std::unique_ptr<RWSync::StaticContainer<Payload, 3>> static3(new RWSync::StaticContainer<Payload, 3>());
+        runMessagePassing<RWSync::StaticContainer<Payload, 3>, false, WritePtr, ReadPtr>(*static3, engine, 3, nPushes, seed);
+
+        std::unique_ptr<RWSync::FixedContainer<Payload, 3>> fixed3(new RWSync::FixedContainer<Payload, 3>());
+        runMessagePassing<RWSync::FixedContainer<Payload, 3>, false, WritePtr, ReadPtr>(*fixed3, engine, 3, nPushes, seed);
+
+        typedef RWSync::ExpandableContainer<Payload> ExpandableType;
+        std::unique_ptr<ExpandableType> expandable(new ExpandableType(RWSync::HistoryDepth(2)));
+        expandable->increaseMaxReadersTo(3);
+        runMessagePassing<ExpandableType, true, WritePtr, ReadPtr>(*expandable, engine, 3, nPushes, seed);
+        std::fprintf(stderr, "  %s with static, fixed and expandable containers: done\n", engine);
+    }
+
+    // Fills most of RWSYNC_SEQLOCK_MAX_SIZE (several cache lines) with a push's version, and ends with
+    // a checksum of the rest, so a copy that mixes two pushes shows up however it's torn.
+    struct SeqlockPayload
+    {
+        static const int nWords = (RWSYNC_SEQLOCK_MAX_SIZE / 8) - 2;
+
+        std::uint64_t version;
+        std::uint64_t words[nWords];
+        std::uint64_t checksum;
+
+        static std::uint64_t checksumOf(std::uint64_t v)
+        {
+            return (v * 0x9E3779B97F4A7C15ull) ^ (v >> 7);
+        }
+
+        void fill(std::uint64_t v)
+        {
+            version = v;
+            for (int i = 0; i < nWords; ++i)
+            {
+                words[i] = v;
+            }
+            checksum = checksumOf(v);
+        }
+
+        bool isWhole() const
+        {
+            for (int i = 0; i < nWords; ++i)
+            {
+                if (words[i] != version)
+                {
+                    return false;
+                }
+            }
+            return checksum == checksumOf(version);
+        }
+    };
+
+    // Each successful pull from a SeqlockContainer must get a whole payload (nothing from another
+    // push, which would mean the retry missed the writer), whose version matches the ReadPtr's,
+    // never going backwards and with missedSinceLastPull() accounting for any gap.
+    void runSeqlock(int nReaders, std::uint64_t nPushes, std::uint64_t seed)
+    {
+        typedef RWSync::SeqlockContainer<SeqlockPayload> ContainerType;
+        const char* engine = "seqlock";
+
+        std::unique_ptr<ContainerType> container(new ContainerType());
+        std::atomic<int> nReady(0);
+
+        std::vector<std::thread> readers;
+        for (int r = 0; r < nReaders; ++r)
+        {
+            readers.emplace_back([&, r]
+            {
+                Scheduler schedule(seed + 501 + r);
+                ContainerType::ReadPtr readPtr(*container);
+                ++nReady;
+
+                std::uint64_t last = 0;
+                while (last < nPushes)
+                {
+                    schedule.pause();
+                    readPtr.pullUpdate();
+                    if (!readPtr.canRead())
+                    {
+                        continue;
+                    }
+
+                    std::uint64_t v = readPtr.version();
+                    if (!readPtr->isWhole())
+                    {
+                        fail("seqlock", engine, "torn payload", readPtr->version, readPtr->checksum);
+                    }
+                    if (readPtr->version != v)
+                    {
+                        fail("seqlock", engine, "payload doesn't match version", readPtr->version, v);
+                    }
+                    if (v < last)
+                    {
+                        fail("seqlock", engine, "went backwards", v, last);
+                    }
+                    if (v > last && readPtr.missedSinceLastPull() != v - last - 1)
+                    {
+                        fail("seqlock", engine, "wrong missed count", readPtr.missedSinceLastPull(), v - last - 1);
+                    }
+                    last = v;
+                }
+            });
+        }
+
+        while (nReady.load() < nReaders)
+        {
+            std::this_thread::yield();
+        }
+
+        {
+            Scheduler schedule(seed + 500);
+            ContainerType::WritePtr writePtr(*container);
+            for (std::uint64_t v = 1; v <= nPushes; ++v)
+            {
+                writePtr->fill(v);
+                schedule.pause();
+                writePtr.pushUpdate();
+            }
+        }
+
+        for (std::thread& reader : readers)
+        {
+            reader.join();
+        }
+        std::fprintf(stderr, "  %s, %d readers: done\n", engine, nReaders);
+    }
+
+    // More threads than a ReaderPool has pointers acquiring and releasing them while the writer
+    // pushes: no pointer may be handed to two threads at once, and each pointer's pulls (by whichever
+    // thread has it) must get whole pushes that never go backwards.
+    void runReaderPool(std::uint64_t nPushes, std::uint64_t seed)
+    {
+        typedef RWSync::ExpandableContainer<Payload> ContainerType;
+        typedef RWSync::ReaderPool<ContainerType> PoolType;
+        const char* engine = "reader pool";
+        const int poolSize = 3;
+        const int nThreads = 8;
+
+        std::unique_ptr<ContainerType> container(new ContainerType());
+        container->increaseMaxReadersTo(poolSize);
+        std::unique_ptr<PoolType> pool(new PoolType(*container, poolSize));
+        std::atomic<bool> done(false);
+
+        // by pointer (each stays the same until releaseIdle()): who holds it, and its last version
+        struct Holding
+        {
+            std::atomic<const void*> ptr;
+            std::atomic<int> nHolders;
+            std::atomic<std::uint64_t> lastVersion;
+        };
+        std::unique_ptr<Holding[]> holdings(new Holding[poolSize]);
+        for (int h = 0; h < poolSize; ++h)
+        {
+            holdings[h].ptr = nullptr;
+            holdings[h].nHolders = 0;
+            holdings[h].lastVersion = 0;
+        }
+
+        auto holdingFor = [&](const void* ptr) -> Holding*
+        {
+            for (int h = 0; h < poolSize; ++h)
+            {
+                const void* expected = nullptr;
+                if (holdings[h].ptr.compare_exchange_strong(expected, ptr) || expected == ptr)
+                {
+                    return &holdings[h];
+                }
+            }
+            return nullptr;
+        };
+
+        std::atomic<std::uint64_t> nEmpty(0);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < nThreads; ++t)
+        {
+            threads.emplace_back([&, t]
+            {
+                Scheduler schedule(seed + 401 + t);
+                while (!done.load())
+                {
+                    PoolType::Handle handle = pool->acquire();
+                    if (!handle.isValid())
+                    {
+                        ++nEmpty;
+                        schedule.pause();
+                        continue;
+                    }
+
+                    Holding* holding = holdingFor(&*handle);
+                    if (holding == nullptr)
+                    {
+                        fail("reader pool", engine, "more distinct pointers than the pool's size", t, poolSize);
+                        return;
+                    }
+                    int nOthers = holding->nHolders.fetch_add(1);
+                    if (nOthers != 0)
+                    {
+                        fail("reader pool", engine, "pointer handed out twice", t, nOthers);
+                    }
+
+                    schedule.pause();
+                    if (handle->canRead())
+                    {
+                        std::uint64_t v = handle->version();
+                        if (!(*handle)->isAll(v))
+                        {
+                            fail("reader pool", engine, "torn payload", (*handle)->words[0], v);
+                        }
+                        std::uint64_t last = holding->lastVersion.exchange(v);
+                        if (v < last)
+                        {
+                            fail("reader pool", engine, "pointer went backwards", v, last);
+                        }
+                    }
+                    schedule.pause();
+
+                    holding->nHolders.fetch_sub(1);
+                }
+            });
+        }
+
+        {
+            Scheduler schedule(seed + 400);
+            ContainerType::WritePtr writePtr(*container);
+            for (std::uint64_t v = 1; v <= nPushes; ++v)
+            {
+                writePtr->fill(v);
+                writePtr.pushUpdate();
+                schedule.pause();
+            }
+        }
+        done = true;
+        for (std::thread& thread : threads)
+        {
+            thread.join();
+        }
+
+        if (nEmpty.load() == 0)
+        {
+            fail("reader pool", engine, "no thread found the pool empty", nThreads, poolSize);
+        }
+        pool->releaseIdle();
+        if (!container->reset())
+        {
+            fail("reader pool", engine, "releaseIdle() didn't return every reader", 0, 0);
+        }
+        std::fprintf(stderr, "  %s, %d threads, %d pointers: done\n", engine, nThreads, poolSize);
+    }
+
+    void runExpandable(int nReaders, int historyDepth, std::uint64_t nPushes, std::uint64_t seed)
+    {
+        typedef RWSync::ExpandableContainer<Payload> ContainerType;
+        const char* engine = historyDepth > 0 ? "expandable with history" : "expandable";
+
+        std::unique_ptr<ContainerType> container(historyDepth > 0
+            ? new ContainerType(RWSync::HistoryDepth(historyDepth))
+            : new ContainerType());
+        container->increaseMaxReadersTo(nReaders);
+
+        if (historyDepth > 0)
+        {
+            runMessagePassing<ContainerType, true>(*container, engine, nReaders, nPushes, seed);
+        }
+        else
+        {
+            runMessagePassing<ContainerType, false>(*container, engine, nReaders, nPushes, seed);
+        }
+        container->reset();
+        runWakeUp(*container, engine, nReaders, nPushes / 20, seed);
+        std::fprintf(stderr, "  %s, %d readers: done\n", engine, nReaders);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    std::uint64_t nPushes = 20000;
+    std::uint64_t seed = 1;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--rounds") == 0 && i + 1 < argc)
+        {
+            nPushes = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else if (std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+        {
+            seed = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else
+        {
+            std::fprintf(stderr, "Usage: %s [--rounds N] [--seed S]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    std::fprintf(stderr, "Protocol: %s, %d pull attempts, %llu pushes per test, seed %llu\n",
+        RWSYNC_ACQUIRE_RELEASE ? "acquire/release" : "seq_cst", RWSYNC_PULL_ATTEMPTS,
+        (unsigned long long)nPushes, (unsigned long long)seed);
+
+    runStatic<1>(nPushes, seed);
+    runStatic<2>(nPushes, seed);
+    runStatic<4>(nPushes, seed);
+    runLargeStatic(3, nPushes / 10, seed);
+    runFixed<1>(nPushes, seed);
+    runFixed<3>(nPushes, seed);
+    runExpandable(1, 0, nPushes, seed);
+    runExpandable(3, 0, nPushes, seed);
+    runExpandable(3, 2, nPushes, seed);
+    runAnyPointers(nPushes / 4, seed);
+    runRingDelivery(RWSync::Backpressure::block, "ring, block", 3, nPushes, seed);
+    runRingDelivery(RWSync::Backpressure::reportOverrun, "ring, reportOverrun", 3, nPushes, seed);
+    runRingDelivery(RWSync::Backpressure::dropOldest, "ring, dropOldest", 3, nPushes, seed);
+    runRingChurn(nPushes / 4, seed);
+    runGroup(3, nPushes, seed);
+    runCarryForward(3, nPushes, seed);
+    {
+        std::unique_ptr<RWSync::ExpandableContainer<Payload>> expandable(new RWSync::ExpandableContainer<Payload>());
+        expandable->increaseMaxReadersTo(3);
+        runReconfigure(*expandable, "expandable", 3, nPushes, seed);
+
+        std::unique_ptr<RWSync::FixedContainer<Payload, 3>> fixed(new RWSync::FixedContainer<Payload, 3>());
+        runReconfigure(*fixed, "fixed", 3, nPushes, seed);
+
+        std::unique_ptr<RWSync::StaticContainer<Payload, 3>> inlineContainer(new RWSync::StaticContainer<Payload, 3>());
+        runReconfigure(*inlineContainer, "static", 3, nPushes, seed);
+    }
+    runLazyTrim(3, nPushes, seed);
+    {
+        // each with room for this thread's reader too
+        std::unique_ptr<RWSync::ExpandableContainer<Payload>> expandable(new RWSync::ExpandableContainer<Payload>());
+        expandable->increaseMaxReadersTo(4);
+        runDrain(*expandable, "expandable", 3, 4 + 2 + 1, nPushes / 200, seed); // and the original copy
+
+        std::unique_ptr<RWSync::StaticContainer<Payload, 4>> inlineContainer(new RWSync::StaticContainer<Payload, 4>());
+        runDrain(*inlineContainer, "static", 3, 4 + 2, nPushes / 200, seed);
+    }
+    runChannelBank(nPushes, seed);
+    runSeqlock(1, nPushes, seed);
+    runSeqlock(4, nPushes, seed);
+    runReaderPool(nPushes, seed);
+
+    if (nFailures.load() > 0)
+    {
+        std::fprintf(stderr, "%d failures\n", nFailures.load());
+        return 1;
+    }
+
+    std::fprintf(stderr, "All passed\n");
+    return 0;
+}
@@ -0,0 +1,137 @@
+/*
+*  Copyright (C) 2019 Ethan Blackwood
+*  This is free software released under the MIT license.
+*  See attached LICENSE file for more details, or https://opensource.org/licenses/MIT.
+*/
+
+// Compares the one-reader cost of the general Manager protocol against the
+// TripleBufferManager used by StaticContainer<T, 1>.
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+#include "../../RWSync/Source/RWSyncManager.h"
+#include "../../RWSync/Source/RWSyncTripleBufferManager.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static const int nIterations = 10000000;
+static const std::chrono::milliseconds threadedDuration(1000);
+
+static double nsPerIteration(Clock::duration d, long long n)
+{
+    return std::chrono::duration<double, std::nano>(d).count() / n;
+}
+
+// keeps the optimizer from dropping index reads
+static std::atomic<int> sink(0);
+
+template<typename ManagerType>
+static void runBenchmarks(ManagerType& manager, const char* name)
+{
+    std::printf("%s\n", name);
+
+    // pushes with no reader
+    {
+        typename ManagerType::WriteIndex writeIndex(manager);
+        Clock::time_point start = Clock::now();
+        for (int i = 0; i < nIterations; ++i)
+        {
+            writeIndex.pushUpdate();
+        }
+        std::printf("  push (no reader):                  %7.2f ns\n",
+            nsPerIteration(Clock::now() - start, nIterations));
+    }
+    manager.reset();
+
+    // push then pull, same thread (no contention, every pull gets an update)
+    {
+        typename ManagerType::WriteIndex writeIndex(manager);
+        typename ManagerType::ReadIndex readIndex(manager);
+        int indexSum = 0;
+        Clock::time_point start = Clock::now();
+        for (int i = 0; i < nIterations; ++i)
+        {
+            writeIndex.pushUpdate();
+            readIndex.pullUpdate();
+            indexSum += readIndex;
+        }
+        std::printf("  push + pull (same thread):         %7.2f ns\n",
+            nsPerIteration(Clock::now() - start, nIterations));
+        sink += indexSum;
+    }
+    manager.reset();
+
+    // polling with no update available
+    {
+        typename ManagerType::WriteIndex writeIndex(manager);
+        typename ManagerType::ReadIndex readIndex(manager);
+        writeIndex.pushUpdate();
+        readIndex.pullUpdate();
+        int nUpdates = 0;
+        Clock::time_point start = Clock::now();
+        for (int i = 0; i < nIterations; ++i)
+        {
+            nUpdates += readIndex.hasUpdate();
+        }
+        std::printf("  hasUpdate (none available):        %7.2f ns\n",
+            nsPerIteration(Clock::now() - start, nIterations));
+        sink += nUpdates;
+    }
+    manager.reset();
+
+    // writer and reader on separate threads, both as fast as possible
+    {
+        std::atomic<bool> done(false);
+        long long nPushes = 0;
+        long long nPulls = 0;
+
+        std::thread writer([&]
+        {
+            typename ManagerType::WriteIndex writeIndex(manager);
+            while (!done.load(std::memory_order_relaxed))
+            {
+                writeIndex.pushUpdate();
+                ++nPushes;
+            }
+        });
+
+        std::thread reader([&]
+        {
+            typename ManagerType::ReadIndex readIndex(manager);
+            while (!done.load(std::memory_order_relaxed))
+            {
+                if (readIndex.hasUpdate())
+                {
+                    readIndex.pullUpdate();
+                    ++nPulls;
+                }
+            }
+        });
+
+        std::this_thread::sleep_for(threadedDuration);
+        done = true;
+        writer.join();
+        reader.join();
+
+        double seconds = std::chrono::duration<double>(threadedDuration).count();
+        std::printf("  threaded: %.3g pushes/s, %.3g pulls/s (%.2f ns/push, %.2f ns/pull)\n",
+            nPushes / seconds, nPulls / seconds,
+            nPushes > 0 ? 1e9 * seconds / nPushes : 0.0,
+            nPulls > 0 ? 1e9 * seconds / nPulls : 0.0);
+    }
+    manager.reset();
+}
+
+int main()
+{
+    RWSync::Manager generalManager(1);
+    runBenchmarks(generalManager, "Manager(1)");
+
+    RWSync::TripleBufferManager tripleBufferManager;
+    runBenchmarks(tripleBufferManager, "TripleBufferManager");
+
+    return 0;
+}
@@ -49,7 +49,7 @@ int _tmain(int argc, _TCHAR* argv[])
     });
 
     // Test dynamically expanding # of readers
-    std::cout << "Checking out 4 readers, which should increase the size by 1" << std::endl;
+    std::cout << "Checking out 4 readers, which should double the allocated readers to 6" << std::endl;
     std::deque<RWSync::GuaranteedReadPtr<int>> readers;
     for (int i = 0; i < 4; ++i)
     {